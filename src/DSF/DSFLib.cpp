@@ -130,6 +130,19 @@ int		DSFReadFile(
 			DSFCallbacks_t *	inCallbacks, 
 			const int *			inPasses, 
 			void *				inRef)
+{
+	return DSFReadFilePartial(inPath, malloc_func, free_func, inCallbacks, inPasses, NULL, 0, inRef);
+}
+
+int		DSFReadFilePartial(
+			const char *		inPath,  
+			void * (*			malloc_func)(size_t s), 
+			void (*				free_func)(void * ptr), 
+			DSFCallbacks_t *	inCallbacks, 
+			const int *			inPasses, 
+			const double *		inBounds,
+			int					inBoundsCount,
+			void *				inRef)
 {
 	char *		mem = nullptr;
 	size_t		uncomp_size = 0;
@@ -171,7 +184,7 @@ int		DSFReadFile(
 			// no need to skip over directory-only entries. New api keeps directories vs files separate. So fileIndex = 0 is always the first real file
 			if (SzArEx_Extract(&db, &lookStream.vt, 0 , &blockIndex, (Byte **) &mem, &mem_size, &mem_offset, &uncomp_size, &allocImp, &allocTempImp) == 0)
 			{
-				result = DSFReadMem(mem + mem_offset, mem + mem_offset + uncomp_size, inCallbacks, inPasses, inRef);
+				result = DSFReadMemPartial(mem + mem_offset, mem + mem_offset + uncomp_size, inCallbacks, inPasses, inBounds, inBoundsCount, inRef);
 			}
 			SzArEx_Free(&db, &allocImp);
 		}
@@ -193,7 +206,7 @@ int		DSFReadFile(
 	if (fread(mem, 1, uncomp_size, fi) != uncomp_size)
 		{ result = dsf_ErrCouldNotReadFile; goto bail; }
 
-	result = DSFReadMem(mem + mem_offset, mem + uncomp_size, inCallbacks, inPasses, inRef);
+	result = DSFReadMemPartial(mem + mem_offset, mem + uncomp_size, inCallbacks, inPasses, inBounds, inBoundsCount, inRef);
 
 bail:
 	if (fi) fclose(fi);
@@ -245,8 +258,65 @@ bail:
 	return result;
 }
 
+// A pool covers offset .. offset + scale in each plane - planes 0 and 1 are lon and lat.  Unscaled pools store raw
+// values, so we can't tell where they are.
+static bool	DSFPoolInBounds(const vector<double>& scales, const vector<double>& offsets, const double * inBounds, int inBoundsCount)
+{
+	if (scales.size() < 2 || scales[0] == 0.0 || scales[1] == 0.0)
+		return true;
+	double west  = min(offsets[0], offsets[0] + scales[0]);
+	double east  = max(offsets[0], offsets[0] + scales[0]);
+	double south = min(offsets[1], offsets[1] + scales[1]);
+	double north = max(offsets[1], offsets[1] + scales[1]);
+	for (int n = 0; n < inBoundsCount; ++n, inBounds += 4)
+		if (west <= inBounds[2] && east >= inBounds[0] && south <= inBounds[3] && north >= inBounds[1])
+			return true;
+	return false;
+}
+
+static bool	DSFPointInBounds(const double * inCoords, const double * inBounds, int inBoundsCount)
+{
+	for (int n = 0; n < inBoundsCount; ++n, inBounds += 4)
+		if (inCoords[0] >= inBounds[0] && inCoords[0] <= inBounds[2] && inCoords[1] >= inBounds[1] && inCoords[1] <= inBounds[3])
+			return true;
+	return false;
+}
+
+// Peeks at the next inCount point indices of a command.  If none of their points are in bounds the indices stay consumed
+// and the caller skips the whole command, otherwise the atom is rewound so the command is read normally.
+static bool	DSFIndicesInBounds(XAtomPackedData& ioCmds, int inCount, bool inIndex32, unsigned int inOffset,
+						const double * inPool, int inDepth, const double * inBounds, int inBoundsCount)
+{
+	char *	start = ioCmds.position;
+	bool	hit = false;
+	while (inCount--)
+	{
+		unsigned int index = inOffset + (inIndex32 ? ioCmds.ReadUInt32() : ioCmds.ReadUInt16());
+		if (!hit && !ioCmds.Overrun())
+			hit = DSFPointInBounds(inPool + index * inDepth, inBounds, inBoundsCount);
+	}
+	if (hit)
+		ioCmds.position = start;
+	return hit;
+}
+
+static bool	DSFRangeInBounds(unsigned int inFirst, unsigned int inLast, const double * inPool, int inDepth, const double * inBounds, int inBoundsCount)
+{
+	for (unsigned int index = inFirst; index < inLast; ++index)
+		if (DSFPointInBounds(inPool + index * inDepth, inBounds, inBoundsCount))
+			return true;
+	return false;
+}
+
 int		DSFReadMem(const char * inStart, const char * inStop, DSFCallbacks_t * inCallbacks, const int * inPasses, void * ref)
 {
+	return DSFReadMemPartial(inStart, inStop, inCallbacks, inPasses, NULL, 0, ref);
+}
+
+int		DSFReadMemPartial(const char * inStart, const char * inStop, DSFCallbacks_t * inCallbacks, const int * inPasses, const double * inBounds, int inBoundsCount, void * ref)
+{
+	bool	partial = inBounds != NULL && inBoundsCount > 0;
+
 	/* MD5 checksum...*/
 	if(inPasses && (inPasses[0] & dsf_CmdSign))
 	{
@@ -412,6 +482,8 @@ someday check footer when in sloooow mode
 	vector<int>						planeSizes32;	// Per plane length of plane
 	vector<vector<double> >			planeScales32;	// Per plane scaling factor
 	vector<vector<double> >			planeOffsets32;	// Per plane offset
+	vector<bool>					poolSkipped;	// Per pool - outside the bounds of a partial read, never decompressed
+	vector<bool>					poolSkipped32;
 
 
 	n = 0;
@@ -468,6 +540,12 @@ someday check footer when in sloooow mode
 //		planarDataRaw.push_back(vector<unsigned short>());
 //		planarDataRaw.back().resize(aSize * pCount);
 		planarData.push_back(vector<double>());
+		poolSkipped.push_back(partial && !DSFPoolInBounds(planeScales[n], planeOffsets[n], inBounds, inBoundsCount));
+		if (poolSkipped.back())
+		{
+			++n;
+			continue;
+		}
 		planarData.back().resize(aSize * pCount);
 //		poolAtom.DecompressShort(pCount, aSize, 1, (short *) &*planarDataRaw.back().begin());
 		poolAtom.DecompressShortToDoubleInterleaved(pCount, aSize, &*planarData.back().begin(),
@@ -487,6 +565,12 @@ someday check footer when in sloooow mode
 //		planarData32Raw.push_back(vector<unsigned int>());
 //		planarData32Raw.back().resize(aSize * pCount);
 		planarData32.push_back(vector<double>());
+		poolSkipped32.push_back(partial && !DSFPoolInBounds(planeScales32[n], planeOffsets32[n], inBounds, inBoundsCount));
+		if (poolSkipped32.back())
+		{
+			++n;
+			continue;
+		}
 		planarData32.back().resize(aSize * pCount);
 //		poolAtom.DecompressInt(pCount, aSize, 1, (int *) &*planarData32Raw.back().begin());
 
@@ -576,6 +660,8 @@ someday check footer when in sloooow mode
 	{
 		int flags = inPasses[pass_number];
 		obj_elev_mode curObjMode = obj_ModeMSL;
+		if (partial)
+			flags &= ~(dsf_CmdPatches | dsf_CmdRaster);
 
 		if (flags & dsf_CmdProps)
 		{
@@ -673,6 +759,7 @@ someday check footer when in sloooow mode
 		double *			currentPoolPtr32 = NULL;
 		int					currentDepth = -1;
 		int					currentDepth32 = -1;
+		int					poolFlags = flags;		// flags minus the primitives whose pool was skipped
 
 
 	cmdsAtom.Reset();
@@ -716,8 +803,11 @@ someday check footer when in sloooow mode
 				return dsf_ErrPoolOutOfRange;
 			}
 			
-			if (currentPool < planarData.size())	{ currentPoolPtr   = &*planarData  [currentPool].begin(); currentDepth   = planeDepths  [currentPool]; } else currentPoolPtr = NULL;
-			if (currentPool < planarData32.size())	{ currentPoolPtr32 = &*planarData32[currentPool].begin(); currentDepth32 = planeDepths32[currentPool]; } else currentPoolPtr32 = NULL;
+			if (currentPool < planarData.size())	{ currentPoolPtr   = planarData  [currentPool].data(); currentDepth   = planeDepths  [currentPool]; } else currentPoolPtr = NULL;
+			if (currentPool < planarData32.size())	{ currentPoolPtr32 = planarData32[currentPool].data(); currentDepth32 = planeDepths32[currentPool]; } else currentPoolPtr32 = NULL;
+			poolFlags = flags;
+			if (currentPool < poolSkipped.size()   && poolSkipped  [currentPool])	poolFlags &= ~(dsf_CmdObjects | dsf_CmdPolys);
+			if (currentPool < poolSkipped32.size() && poolSkipped32[currentPool])	poolFlags &= ~dsf_CmdVectors;
 			break;
 		case dsf_Cmd_JunctionOffsetSelect		:
 			junctionOffset = cmdsAtom.ReadUInt32();
@@ -743,7 +833,8 @@ someday check footer when in sloooow mode
 		 **************************************************************************************************************/
 		case dsf_Cmd_Object						:
 			index = cmdsAtom.ReadUInt16();
-			if (flags & dsf_CmdObjects)
+			if (poolFlags & dsf_CmdObjects)
+			if (!partial || DSFPointInBounds(DECODE_SCALED_CURRENT(index), inBounds, inBoundsCount))
 			{
 //				objCoord3[0] = DECODE_SCALED_CURRENT(index)[0];
 //				objCoord3[1] = DECODE_SCALED_CURRENT(index)[1];
@@ -754,8 +845,9 @@ someday check footer when in sloooow mode
 		case dsf_Cmd_ObjectRange				:
 			index1 = cmdsAtom.ReadUInt16();
 			index2 = cmdsAtom.ReadUInt16();
-				if (flags & dsf_CmdObjects)
+				if (poolFlags & dsf_CmdObjects)
 			for (index = index1; index < index2; ++index)
+			if (!partial || DSFPointInBounds(DECODE_SCALED_CURRENT(index), inBounds, inBoundsCount))
 			{
 //				objCoord3[0] = DECODE_SCALED_CURRENT(index)[0];
 //				objCoord3[1] = DECODE_SCALED_CURRENT(index)[1];
@@ -772,10 +864,13 @@ someday check footer when in sloooow mode
 		case dsf_Cmd_NetworkChain				:
 			count = cmdsAtom.ReadUInt8();
 			hasCurve = planeDepths32[currentPool] >= 7;
+			if (partial && (poolFlags & dsf_CmdVectors) &&
+				!DSFIndicesInBounds(cmdsAtom, count, false, junctionOffset, currentPoolPtr32, currentDepth32, inBounds, inBoundsCount))
+				break;
 			for (counter = 0; counter < count; ++counter)
 			{
 				index = junctionOffset + cmdsAtom.ReadUInt16();
-					if (flags & dsf_CmdVectors)
+					if (poolFlags & dsf_CmdVectors)
 					{
 					segCoord = DECODE_SCALED32_CURRENT(index);
 					if (segCoord[3]) {
@@ -798,7 +893,8 @@ someday check footer when in sloooow mode
 			index1 = junctionOffset + cmdsAtom.ReadUInt16();
 			index2 = junctionOffset + cmdsAtom.ReadUInt16();
 			hasCurve = planeDepths32[currentPool] >= 7;
-				if (flags & dsf_CmdVectors)
+				if (poolFlags & dsf_CmdVectors)
+				if (!partial || DSFRangeInBounds(index1, index2, currentPoolPtr32, currentDepth32, inBounds, inBoundsCount))
 			for (index = index1; index < index2; ++index)
 			{
 				segCoord = DECODE_SCALED32_CURRENT(index);
@@ -815,10 +911,13 @@ someday check footer when in sloooow mode
 		case dsf_Cmd_NetworkChain32		:
 			count = cmdsAtom.ReadUInt8();
 			hasCurve = planeDepths32[currentPool] >= 7;
+			if (partial && (poolFlags & dsf_CmdVectors) &&
+				!DSFIndicesInBounds(cmdsAtom, count, true, 0, currentPoolPtr32, currentDepth32, inBounds, inBoundsCount))
+				break;
 			for (counter = 0; counter < count; ++counter)
 			{
 				index = cmdsAtom.ReadUInt32();
-					if (flags & dsf_CmdVectors)
+					if (poolFlags & dsf_CmdVectors)
 					{
 					segCoord = DECODE_SCALED32_CURRENT(index);
 					if (segCoord[3]) {
@@ -841,7 +940,10 @@ someday check footer when in sloooow mode
 		case dsf_Cmd_Polygon:
 			polyParam = cmdsAtom.ReadUInt16();
 			count = cmdsAtom.ReadUInt8();
-			if (flags & dsf_CmdPolys)
+			if (partial && (poolFlags & dsf_CmdPolys) &&
+				!DSFIndicesInBounds(cmdsAtom, count, false, 0, currentPoolPtr, currentDepth, inBounds, inBoundsCount))
+				break;
+			if (poolFlags & dsf_CmdPolys)
 			{
 				inCallbacks->BeginPolygon_f(currentDefinition, polyParam, planeDepths[currentPool], ref);
 				inCallbacks->BeginPolygonWinding_f(ref);
@@ -850,12 +952,12 @@ someday check footer when in sloooow mode
 			while(count--)
 			{
 				index = cmdsAtom.ReadUInt16();
-				if (dsf_CmdPolys)
+				if (poolFlags & dsf_CmdPolys)
 				{
 					inCallbacks->AddPolygonPoint_f(DECODE_SCALED_CURRENT(index), ref);
 				}
 			}
-			if (flags & dsf_CmdPolys)
+			if (poolFlags & dsf_CmdPolys)
 			{
 				inCallbacks->EndPolygonWinding_f(ref);
 				inCallbacks->EndPolygon_f(ref);
@@ -866,7 +968,8 @@ someday check footer when in sloooow mode
 			polyParam = cmdsAtom.ReadUInt16();
 			index1 = cmdsAtom.ReadUInt16();
 			index2 = cmdsAtom.ReadUInt16();
-			if (flags & dsf_CmdPolys)
+			if (poolFlags & dsf_CmdPolys)
+			if (!partial || DSFRangeInBounds(index1, index2, currentPoolPtr, currentDepth, inBounds, inBoundsCount))
 			{
 				inCallbacks->BeginPolygon_f(currentDefinition, polyParam, planeDepths[currentPool], ref);
 				inCallbacks->BeginPolygonWinding_f(ref);
@@ -883,26 +986,40 @@ someday check footer when in sloooow mode
 		case dsf_Cmd_NestedPolygon:
 			polyParam = cmdsAtom.ReadUInt16();
 			count = cmdsAtom.ReadUInt8();
-			if (flags & dsf_CmdPolys)
+			if (partial && (poolFlags & dsf_CmdPolys))
+			{
+				char *	start = cmdsAtom.position;
+				bool	hit = false;
+				for (counter = 0; counter < count; ++counter)
+					if (DSFIndicesInBounds(cmdsAtom, cmdsAtom.ReadUInt8(), false, 0, currentPoolPtr, currentDepth, inBounds, inBoundsCount))
+					{
+						hit = true;
+						break;
+					}
+				if (!hit)
+					break;					// all windings consumed
+				cmdsAtom.position = start;
+			}
+			if (poolFlags & dsf_CmdPolys)
 				inCallbacks->BeginPolygon_f(currentDefinition, polyParam, planeDepths[currentPool], ref);
 			triCoordDim = planeDepths[currentPool];
 			while(count--)
 			{
-				if (flags & dsf_CmdPolys)
+				if (poolFlags & dsf_CmdPolys)
 					inCallbacks->BeginPolygonWinding_f(ref);
 				counter = cmdsAtom.ReadUInt8();
 				while (counter--)
 				{
 					index = cmdsAtom.ReadUInt16();
-					if (flags & dsf_CmdPolys)
+					if (poolFlags & dsf_CmdPolys)
 					{
 						inCallbacks->AddPolygonPoint_f(DECODE_SCALED_CURRENT(index), ref);
 					}
 				}
-				if (flags & dsf_CmdPolys)
+				if (poolFlags & dsf_CmdPolys)
 					inCallbacks->EndPolygonWinding_f(ref);
 			}
-			if (flags & dsf_CmdPolys)
+			if (poolFlags & dsf_CmdPolys)
 				inCallbacks->EndPolygon_f(ref);
 			break;
 
@@ -910,15 +1027,27 @@ someday check footer when in sloooow mode
 			polyParam = cmdsAtom.ReadUInt16();
 			count = cmdsAtom.ReadUInt8();
 			index1 = cmdsAtom.ReadUInt16();
-			if (flags & dsf_CmdPolys)
+			if (partial && (poolFlags & dsf_CmdPolys) && count > 0)
+			{
+				// the windings are one contiguous run of points, ending at the last winding's end index
+				cmdsAtom.Advance((count - 1) * sizeof(uint16_t));
+				index2 = cmdsAtom.ReadUInt16();
+				cmdsAtom.Advance(-(int) (count * sizeof(uint16_t)));
+				if (!DSFRangeInBounds(index1, index2, currentPoolPtr, currentDepth, inBounds, inBoundsCount))
+				{
+					cmdsAtom.Advance(count * sizeof(uint16_t));
+					break;
+				}
+			}
+			if (poolFlags & dsf_CmdPolys)
 				inCallbacks->BeginPolygon_f(currentDefinition, polyParam, planeDepths[currentPool], ref);
 			triCoordDim = planeDepths[currentPool];
 			while(count--)
 			{
-				if (flags & dsf_CmdPolys)
+				if (poolFlags & dsf_CmdPolys)
 					inCallbacks->BeginPolygonWinding_f(ref);
 				index2 = cmdsAtom.ReadUInt16();
-				if (flags & dsf_CmdPolys)
+				if (poolFlags & dsf_CmdPolys)
 				{
 					for (index = index1; index < index2; ++index)
 					{
@@ -928,7 +1057,7 @@ someday check footer when in sloooow mode
 				}
 				index1 = index2;
 			}
-			if (flags & dsf_CmdPolys)
+			if (poolFlags & dsf_CmdPolys)
 				inCallbacks->EndPolygon_f(ref);
 			break;
 
@@ -1232,3 +1361,62 @@ someday check footer when in sloooow mode
 }
 
 #pragma mark -
+
+#if UNIT_TEST
+#include <chrono>
+#include <math.h>
+
+// Benchmark of a partial read: all of a DSF vs. a 2x2 km window around a point, counting what gets delivered.
+
+struct bench_counts { int objs, segs, polys; };
+
+static bool	bench_next(int, void *) { return true; }
+static int	bench_def(const char *, void *) { return 1; }
+static void	bench_prop(const char *, const char *, void *) { }
+static void	bench_patch(unsigned int, double, double, unsigned char, int, void *) { }
+static void	bench_prim(int, void *) { }
+static void	bench_coords(double *, void *) { }
+static void	bench_ref(void *) { }
+static void	bench_obj(unsigned int, double *, obj_elev_mode, void * r) { ((bench_counts *) r)->objs++; }
+static void	bench_seg_begin(unsigned int, unsigned int, double *, bool, void *) { }
+static void	bench_seg_shape(double *, bool, void *) { }
+static void	bench_seg_end(double *, bool, void * r) { ((bench_counts *) r)->segs++; }
+static void	bench_poly(unsigned int, unsigned short, int, void * r) { ((bench_counts *) r)->polys++; }
+static void	bench_raster(DSFRasterHeader_t *, void *, void *) { }
+static void	bench_filter(int, void *) { }
+
+int main(int argc, const char * argv[])
+{
+	if (argc < 4)
+	{
+		printf("usage: %s <dsf file> <lon> <lat>\n", argv[0]);
+		return 1;
+	}
+	double lon = atof(argv[2]), lat = atof(argv[3]);
+	double dlat = 1000.0 / 111320.0;
+	double dlon = dlat / cos(lat * M_PI / 180.0);
+	double bounds[4] = { lon - dlon, lat - dlat, lon + dlon, lat + dlat };
+
+	DSFCallbacks_t cb = {	bench_next, bench_def, bench_def, bench_def, bench_def, bench_def, bench_prop,
+							bench_patch, bench_prim, bench_coords, bench_ref, bench_ref,
+							bench_obj,
+							bench_seg_begin, bench_seg_shape, bench_seg_end,
+							bench_poly, bench_ref, bench_coords, bench_ref, bench_ref, bench_raster, bench_filter };
+
+	for (int partial = 0; partial < 2; ++partial)
+	{
+		bench_counts c = { 0 };
+		auto t0 = chrono::steady_clock::now();
+		int err = DSFReadFilePartial(argv[1], malloc, free, &cb, NULL, partial ? bounds : NULL, partial ? 1 : 0, &c);
+		auto t1 = chrono::steady_clock::now();
+		if (err != dsf_ErrOK)
+		{
+			printf("read failed: %s\n", dsfErrorMessages[err]);
+			return 1;
+		}
+		printf("%-8s %8.1f ms  %7d objects %7d segments %7d polygons\n", partial ? "window" : "full",
+			chrono::duration<double, milli>(t1 - t0).count(), c.objs, c.segs, c.polys);
+	}
+	return 0;
+}
+#endif
@@ -222,6 +222,20 @@ struct	DSFCallbacks_t {
 /* Returns true if successful, false if not. */
 int		DSFReadFile(const char * inPath, void * (* malloc_func)(size_t s), void (* free_func)(void * ptr), DSFCallbacks_t * inCallbacks, const int * inPasses, void * inRef);
 int		DSFReadMem(const char * inStart, const char * inStop, DSFCallbacks_t * inCallbacks, const int * inPasses, void * inRef);
+
+/*
+ * Partial reads only deliver what can touch one of inBoundsCount lon/lat boxes, passed in
+ * inBounds as west, south, east, north quadruples.  Point pools that lie entirely outside
+ * all boxes are never decompressed and the objects, network chains and polygons using them
+ * are skipped without any callbacks.  Otherwise objects, polygons and network chain commands
+ * are skipped unless one of their points is inside a box.  A chain command that is delivered
+ * is delivered whole, so its segments may still lie outside - clients cull those themselves.
+ *
+ * Terrain patches and raster data are not read in a partial read.  With no bounds these
+ * are the same as DSFReadFile and DSFReadMem.
+ */
+int		DSFReadFilePartial(const char * inPath, void * (* malloc_func)(size_t s), void (* free_func)(void * ptr), DSFCallbacks_t * inCallbacks, const int * inPasses, const double * inBounds, int inBoundsCount, void * inRef);
+int		DSFReadMemPartial(const char * inStart, const char * inStop, DSFCallbacks_t * inCallbacks, const int * inPasses, const double * inBounds, int inBoundsCount, void * inRef);
 int		DSFCheckSignature(const char * inPath);
 /************************************************************
  * DFS WRITING UTILS
@@ -255,6 +255,38 @@ void	GUI_PlotIcon(
 		glPopMatrix();
 }
 
+int		GUI_PlotIconQuad(
+				const char *				in_resource,
+				int							x,
+				int							y,
+				float						angle,
+				float						scale,
+				float						st_xy[16])
+{
+	GUI_TexPosition_t metrics;
+	int tex_id = GUI_GetTextureResource(in_resource, UI_TEX_FLAGS, &metrics);
+
+	// Same rounding as GUI_DrawCentered, then the rotate and scale around x, y that GUI_PlotIcon sets up.
+	int l = (2 * x - metrics.real_width) / 2,  r = l + metrics.real_width;
+	int b = (2 * y - metrics.real_height) / 2, t = b + metrics.real_height;
+	if (metrics.real_width % 2)		l++, r++;
+	if (metrics.real_height % 2)	b++, t++;
+
+	float c = cos(angle * M_PI / 180.0) * scale;
+	float s = sin(angle * M_PI / 180.0) * scale;
+	int corners[8] = { l, b, l, t, r, t, r, b };
+	float sts[8] = { 0.0f, 0.0f, 0.0f, metrics.t_rescale, metrics.s_rescale, metrics.t_rescale, metrics.s_rescale, 0.0f };
+	for (int n = 0; n < 4; ++n)
+	{
+		float dx = corners[2*n] - x, dy = corners[2*n+1] - y;
+		st_xy[4*n  ] = sts[2*n];
+		st_xy[4*n+1] = sts[2*n+1];
+		st_xy[4*n+2] = x + dx * c + dy * s;		// cw rotate
+		st_xy[4*n+3] = y - dx * s + dy * c;
+	}
+	return tex_id;
+}
+
 void	GUI_PlotIconBulk(
 				GUI_GraphState *			state,
 				const char *				in_resource,
@@ -74,6 +74,16 @@ void	GUI_PlotIcon(
 				float						angle,
 				float						scale);
 
+// The quad GUI_PlotIcon would draw, for callers that collect icons into their own vertex arrays.  Fills 4 vertices of
+// s, t, x, y in glBegin(GL_QUADS) order and returns the texture to bind.
+int		GUI_PlotIconQuad(
+				const char *				in_resource,
+				int							x,
+				int							y,
+				float						angle,
+				float						scale,
+				float						st_xy[16]);
+
 void	GUI_PlotIconBulk(
 				GUI_GraphState *			state,
 				const char *				in_resource,
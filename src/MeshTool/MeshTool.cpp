@@ -23,6 +23,7 @@
 
 #include "../XPTools/version.h"
 #include "MeshTool_Create.h"
+#include "BitmapUtils.h"
 
 #include "DEMTables.h"
 #include "XESInit.h"
@@ -200,6 +201,21 @@ int	main(int argc, char * argv[])
 				printf("%s DDS generation.\n", param1 ? "Enabling" : "Disabling");
 				MT_EnableDDSGeneration(param1);
 			}
+
+			if(sscanf(buf,"DDS_ENCODER %s", typ)==1)
+			{
+				if(strcmp(typ, "fast") == 0)		MT_SetDDSEncoder(dds_encode_fast);
+				else if(strcmp(typ, "best") == 0)	MT_SetDDSEncoder(dds_encode_best);
+				else die_parse("ERROR: DDS_ENCODER must be fast or best.\n");
+				printf("Using the %s DDS encoder.\n", typ);
+			}
+
+			int dds_mb = MT_DDS_DEFAULT_MB;
+			if(sscanf(buf,"DDS_THREADS %d %d", &param1, &dds_mb) >= 1)
+			{
+				printf("Making DDS files with %d worker threads, up to %d MB of images in flight.\n", param1, dds_mb);
+				MT_SetDDSWorkers(param1, dds_mb);
+			}
 			
 			if(sscanf(buf,"MESH_SPECS %d %f", &param1, &param2) == 2)
 			{
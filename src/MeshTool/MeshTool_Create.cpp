@@ -51,6 +51,12 @@
 #include "ShapeIO.h"
 #include "FileUtils.h"
 #include "NetAlgs.h"
+#include "MathUtils.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
 
 #define MT_GAMMA 2.2f
 #define MT_USE_WIN_GAMMA (1)
@@ -63,6 +69,7 @@ static double				sBounds[4];
 static string				g_qmid_prefix;
 
 static int					sMakeDDS = 0;
+static int					sDDSEncoder = dds_encode_best;
 
 static Pmwx *							the_map = NULL;
 static int								layer_type = NO_VALUE;
@@ -87,6 +94,114 @@ static void die_err(const char * msg, ...)
 		vfprintf(stderr,msg,l);
 }
 
+/************************************************************************************************************************
+ * DDS WORKERS
+ ************************************************************************************************************************
+ * The script thread loads each orthophoto (it needs the size for the .ter file anyway) and then hands the scaling,
+ * mipmapping and DXT compression - the slow part - to a few worker threads, so they run while the rest of the script
+ * is parsed and the mesh is built.  Loaded images count against a memory cap: when it's used up the script thread
+ * waits for a worker to finish an image before loading the next.  With 0 threads every image is done on the spot.
+ */
+
+class mt_dds_queue {
+public:
+
+	~mt_dds_queue() { finish(); }		// if the script dies half way through, still write what's been queued
+
+	void	configure(int threads, int mem_mb)
+	{
+		finish();
+		mThreads = threads;
+		mCap = (size_t) max(1, mem_mb) * 1024 * 1024;
+	}
+
+	// Run job, which owns (and frees) about bytes of image memory.
+	void	add(size_t bytes, function<bool ()> job, const string& what)
+	{
+		if (mThreads == 0)
+		{
+			if (!job())
+				mFailed.push_back(what);
+			return;
+		}
+
+		unique_lock<mutex> lock(mLock);
+		if (mWorkers.empty())
+			for (int n = 0; n < mThreads; ++n)
+				mWorkers.push_back(thread(&mt_dds_queue::worker, this));
+		mRoom.wait(lock, [&]{ return mBytes == 0 || mBytes + bytes <= mCap; });
+		mBytes += bytes;
+		mJobs.push_back(job_t{ job, what, bytes });
+		mWork.notify_one();
+	}
+
+	// Wait for every queued image, then stop the workers and report anything that couldn't be written.
+	void	finish()
+	{
+		{
+			lock_guard<mutex> lock(mLock);
+			mQuit = true;
+		}
+		mWork.notify_all();
+		for (auto& t : mWorkers)
+			t.join();
+		mWorkers.clear();
+		mQuit = false;
+
+		for (auto& f : mFailed)
+			fprintf(stderr, "Unable to write DDS file %s\n", f.c_str());
+		mFailed.clear();
+	}
+
+	int		thread_count() const { return mThreads; }
+
+private:
+
+	struct job_t {
+		function<bool ()>	job;
+		string				what;
+		size_t				bytes;
+	};
+
+	void	worker()
+	{
+		unique_lock<mutex> lock(mLock);
+		while (1)
+		{
+			mWork.wait(lock, [&]{ return mQuit || !mJobs.empty(); });
+			if (mJobs.empty())
+				break;
+			job_t j = mJobs.front();
+			mJobs.pop_front();
+			lock.unlock();
+			bool ok = j.job();
+			lock.lock();
+			if (!ok)
+				mFailed.push_back(j.what);
+			mBytes -= j.bytes;
+			mRoom.notify_all();
+		}
+	}
+
+	int					mThreads = intlim(thread::hardware_concurrency(), 1, 16);
+	size_t				mCap = (size_t) MT_DDS_DEFAULT_MB * 1024 * 1024;
+	size_t				mBytes = 0;
+	bool				mQuit = false;
+	deque<job_t>		mJobs;
+	vector<thread>		mWorkers;
+	vector<string>		mFailed;
+	mutex				mLock;
+	condition_variable	mWork;			// workers wait here for jobs
+	condition_variable	mRoom;			// the script thread waits here for memory
+};
+
+static mt_dds_queue						sDDSQueue;
+
+static size_t image_bytes(const ImageInfo& i)
+{
+	return (size_t) (i.width * i.channels + i.pad) * i.height;
+}
+
 void MT_StartCreate(const char * xes_path, const DEMGeo& in_dem, MT_Error_f err_handler)
 {
 	DebugAssert(err_handler != NULL);
@@ -215,10 +330,13 @@ void MT_MakeDSF(rf_region region, const char * dump, const char * out_dsf)
 
 	// -exportDSF
 	BuildDSF(out_dsf, NULL, sDem[dem_Elevation], sDem[dem_Bathymetry], {}, sMesh, /*sTriangulationLo,*/ *the_map, region, ConsoleProgressFunc);
+
+	MT_FinishDDS();
 }
 
 void MT_Cleanup(void)
 {
+	MT_FinishDDS();
 	err_f = NULL;
 	delete the_map;
 	the_map = NULL;
@@ -285,6 +403,7 @@ int MT_CreateCustomTerrain(
 	ni.custom_ter = (back_with_water == 2) ? tex_custom_soft_water : ((back_with_water == 1) ? tex_custom_hard_water : tex_custom_no_water);
 
 	gNaturalTerrainRules.insert(gNaturalTerrainRules.begin(), nr);
+	NaturalTerrainRulesChanged();
 	gNaturalTerrainInfo[tt] = ni;
 
 	tex_proj_info	pinfo;
@@ -494,6 +613,23 @@ void MT_EnableDDSGeneration(int create)
 	sMakeDDS = create;
 }
 
+void MT_SetDDSEncoder(int encoder)
+{
+	sDDSEncoder = encoder;
+}
+
+void MT_SetDDSWorkers(int threads, int mem_mb)
+{
+	sDDSQueue.configure(max(0, threads), mem_mb);
+}
+
+void MT_FinishDDS(void)
+{
+	if (sDDSQueue.thread_count() > 0)
+		printf("Waiting for DDS generation to finish.\n");
+	sDDSQueue.finish();
+}
+
 void MT_SetMeshSpecs(int max_pts, float max_err)
 {
 	gMeshPrefs.max_points = max_pts;
@@ -642,18 +778,24 @@ void MT_GeoTiff(const char * fname, int back_with_water)
 			ImageInfo rgba;
 			if(!CreateBitmapFromTIF(fname,&rgba))
 			{
-				ImageInfo smaller;
-				if (!CreateNewBitmap(near2(rgba.width),near2(rgba.height), 4, &smaller))
-				{
-					isize = max(smaller.width,smaller.height);
+				int sx = near2(rgba.width), sy = near2(rgba.height);
+				isize = max(sx, sy);
+				string dds_path(dname);
+				int encoder = sDDSEncoder;
+				sDDSQueue.add(image_bytes(rgba) + (size_t) sx * sy * 4 * 2, [rgba, sx, sy, dds_path, encoder]() mutable {
+					ImageInfo smaller;
+					int err = CreateNewBitmap(sx, sy, 4, &smaller);
+					if (!err)
+					{
+						CopyBitmapSection(&rgba,&smaller, 0,0,rgba.width,rgba.height, 0, 0, smaller.width,smaller.height);
 
-					CopyBitmapSection(&rgba,&smaller, 0,0,rgba.width,rgba.height, 0, 0, smaller.width,smaller.height);				
-					
-					MakeMipmapStack(&smaller);
-					WriteBitmapToDDS(smaller, 5, dname, MT_USE_WIN_GAMMA);
-					DestroyBitmap(&smaller);
-				}
-				DestroyBitmap(&rgba);
+						MakeMipmapStack(&smaller);
+						err = WriteBitmapToDDS(smaller, 5, dds_path.c_str(), MT_USE_WIN_GAMMA, encoder);
+						DestroyBitmap(&smaller);
+					}
+					DestroyBitmap(&rgba);
+					return err == 0;
+				}, dds_path);
 			}
 		}
 	} else {
@@ -736,12 +878,18 @@ void MT_QMID(const char * id, int back_with_water)
 						DestroyBitmap(&alpha);
 					}
 
-					MakeMipmapStack(&rgb);
 					sprintf(fname,"%s%s.dds",g_qmid_prefix.c_str(),id);
-					WriteBitmapToDDS(rgb, 5, fname, MT_USE_WIN_GAMMA);
+					string dds_path(fname);
+					int encoder = sDDSEncoder;
+					sDDSQueue.add(image_bytes(rgb) * 2, [rgb, dds_path, encoder]() mutable {
+						MakeMipmapStack(&rgb);
+						int err = WriteBitmapToDDS(rgb, 5, dds_path.c_str(), MT_USE_WIN_GAMMA, encoder);
+						DestroyBitmap(&rgb);
+						return err == 0;
+					}, dds_path);
 				}
-
-				DestroyBitmap(&rgb);
+				else
+					DestroyBitmap(&rgb);
 			}
 		}
 	} else {
@@ -762,9 +910,14 @@ void MT_QMID(const char * id, int back_with_water)
 		{
 			sprintf(fname,"%s%s_LIT.dds",g_qmid_prefix.c_str(),id);
 			ConvertBitmapToAlpha(&lit,false);
-			MakeMipmapStack(&lit);
-			WriteBitmapToDDS(lit,1,fname, MT_USE_WIN_GAMMA);
-			DestroyBitmap(&lit);
+			string dds_path(fname);
+			int encoder = sDDSEncoder;
+			sDDSQueue.add(image_bytes(lit) * 2, [lit, dds_path, encoder]() mutable {
+				MakeMipmapStack(&lit);
+				int err = WriteBitmapToDDS(lit,1,dds_path.c_str(), MT_USE_WIN_GAMMA, encoder);
+				DestroyBitmap(&lit);
+				return err == 0;
+			}, dds_path);
 			want_lite=true;
 		}
 	}
@@ -63,6 +63,10 @@ void MT_NetSegment(double lon1, double lat1, double lon2, double lat2);
 void MT_NetEnd(void);
 
 void MT_EnableDDSGeneration(int create);
+void MT_SetDDSEncoder(int encoder);				// dds_encode_best or dds_encode_fast, see BitmapUtils.h
+#define MT_DDS_DEFAULT_MB	2048
+void MT_SetDDSWorkers(int threads, int mem_mb);	// 0 threads = make each DDS right away
+void MT_FinishDDS(void);						// Waits for all queued DDS files to be written.
 void MT_SetMeshSpecs(int max_pts, float max_err);
 
 void MT_Mask(const char * shapefile);	// or NULL
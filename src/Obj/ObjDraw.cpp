@@ -213,13 +213,13 @@ void	ObjDraw8(const XObj8& obj, float dist, ObjDrawFuncs10_t * funcs, void * ref
 					{
 						GLuint x[2];
 						glGenBuffers(2, x);                                  CHECK_GL_ERR
-						const_cast<unsigned int&>(obj.geo_VBO) = x[0];
-						const_cast<unsigned int&>(obj.idx_VBO) = x[1];
+						obj.geo_VBO = x[0];
+						obj.idx_VBO = x[1];
 
 						glBindBuffer(GL_ARRAY_BUFFER, obj.geo_VBO);          CHECK_GL_ERR
 						glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, obj.idx_VBO);  CHECK_GL_ERR
 			#if SHORT_IDX
-						*(const_cast<bool*>(&obj.short_idx)) = obj.geo_tri.count() < 65536;
+						obj.short_idx = obj.geo_tri.count() < 65536;
 			#endif
 
 			#if HALF_SIZE_VBO
@@ -469,3 +469,16 @@ void	ObjDraw8(const XObj8& obj, float dist, ObjDrawFuncs10_t * funcs, void * ref
 	#endif
 #endif
 }
+
+void	ObjDraw8_ReleaseVBO(const XObj8& obj)
+{
+#if XOBJ8_USE_VBO
+	if(obj.geo_VBO)
+	{
+		GLuint x[2] = { obj.geo_VBO, obj.idx_VBO };
+		glDeleteBuffers(2, x);						CHECK_GL_ERR
+		obj.geo_VBO = 0;
+		obj.idx_VBO = 0;
+	}
+#endif
+}
@@ -47,4 +47,8 @@ struct	ObjDrawFuncs10_t {
 
 void	ObjDraw8(const XObj8& obj, float dist, ObjDrawFuncs10_t * funcs, void * ref);
 
+// Releases the vertex buffers ObjDraw8 created for this OBJ - call this before deleting an OBJ that was drawn.
+// Needs the GL context current, just like ObjDraw8 itself.
+void	ObjDraw8_ReleaseVBO(const XObj8& obj);
+
 #endif
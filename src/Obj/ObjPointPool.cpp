@@ -23,13 +23,15 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <algorithm>
 
 #include "ObjPointPool.h"
 
 using std::min;
 using std::max;
 
-ObjPointPool::ObjPointPool() : mDepth(8)
+ObjPointPool::ObjPointPool() : mIndexed(0), mUsed(0), mDepth(8), mSnap(0.0f)
 {
 }
 
@@ -40,36 +42,183 @@ ObjPointPool::~ObjPointPool()
 void	ObjPointPool::clear(int depth)
 {
 	mData.clear();
-	mIndex.clear();
+	mOrder.clear();
+	reset_index();
 	mDepth = depth;
 }
 
 void	ObjPointPool::resize(int pts)
 {
 	mData.resize(pts * mDepth);
-	mIndex.clear();
+	mOrder.clear();
+	reset_index();
+}
+
+void	ObjPointPool::set_snap(float eps)
+{
+	if (eps != mSnap)
+	{
+		mSnap = eps;
+		reset_index();
+	}
 }
 
 int		ObjPointPool::accumulate(const float pt[])
 {
-	index_type::iterator iter = mIndex.find(key_type(pt, pt + mDepth));
-	if (iter != mIndex.end())
-		return iter->second;
-	return append(pt);
+	update_index();
+	unsigned int h = hash_pt(pt);
+	int n = find_pt(pt, h);
+	if (n >= 0)
+		return n;
+
+	n = mData.size() / mDepth;
+	mData.insert(mData.end(), pt, pt + mDepth);
+	mOrder.push_back(n);
+	insert_slot(n, h);
+	mIndexed = mOrder.size();
+	return n;
 }
 
 int		ObjPointPool::append(const float pt[])
 {
 	int ret = mData.size() / mDepth;
 	mData.insert(mData.end(), pt, pt + mDepth);
-	mIndex.insert(index_type::value_type(key_type(pt,pt+mDepth), ret));
+	mOrder.push_back(ret);
 	return ret;
 }
 
 void	ObjPointPool::set(int n, float pt[])
 {
+	if (find_slot(n, hash_pt(&mData[n*mDepth])) >= 0)
+	{
+		// Its old value is in the index - start over, with the pt taking its place in line as of now.
+		mOrder.erase(std::remove(mOrder.begin(), mOrder.end(), n), mOrder.end());
+		reset_index();
+	}
 	memcpy(&mData[n*mDepth], pt, mDepth * sizeof(float));
-	mIndex.insert(index_type::value_type(key_type(pt,pt+mDepth), n));
+	mOrder.push_back(n);
+}
+
+/************************************************************************
+ * INDEX
+ ************************************************************************/
+
+// Snapped coordinates are compared as doubles so that large values on a fine grid don't overflow an int.
+static inline double	snap_coord(float v, float eps)
+{
+	return floor((double) v / eps + 0.5) + 0.0;		// + 0.0 turns -0 into 0
+}
+
+unsigned int	ObjPointPool::hash_pt(const float pt[]) const
+{
+	unsigned int h = 2166136261u;
+	for (int i = 0; i < mDepth; ++i)
+	{
+		if (mSnap > 0.0f)
+		{
+			double q = snap_coord(pt[i], mSnap);
+			unsigned int w[2];
+			memcpy(w, &q, sizeof(q));
+			h = (h ^ w[0]) * 16777619u;
+			h = (h ^ w[1]) * 16777619u;
+		}
+		else
+		{
+			float v = pt[i] + 0.0f;		// + 0.0 turns -0 into 0, they compare equal
+			unsigned int w;
+			memcpy(&w, &v, sizeof(v));
+			h = (h ^ w) * 16777619u;
+		}
+	}
+	return h ^ (h >> 15);
+}
+
+bool	ObjPointPool::match_pt(const float a[], const float b[]) const
+{
+	if (mSnap > 0.0f)
+	{
+		for (int i = 0; i < mDepth; ++i)
+		if (snap_coord(a[i], mSnap) != snap_coord(b[i], mSnap))
+			return false;
+	}
+	else
+	{
+		for (int i = 0; i < mDepth; ++i)
+		if (a[i] != b[i])
+			return false;
+	}
+	return true;
+}
+
+int		ObjPointPool::find_pt(const float pt[], unsigned int h) const
+{
+	if (mSlots.empty())
+		return -1;
+	size_t mask = mSlots.size() - 1;
+	for (size_t s = h & mask; mSlots[s] >= 0; s = (s + 1) & mask)
+	if (match_pt(&mData[mSlots[s] * mDepth], pt))
+		return mSlots[s];
+	return -1;
+}
+
+// The slot holding pt n, whose value hashes to h - or -1 if n is not in the index.
+int		ObjPointPool::find_slot(int n, unsigned int h) const
+{
+	if (mSlots.empty())
+		return -1;
+	size_t mask = mSlots.size() - 1;
+	for (size_t s = h & mask; mSlots[s] >= 0; s = (s + 1) & mask)
+	if (mSlots[s] == n)
+		return s;
+	return -1;
+}
+
+void	ObjPointPool::insert_slot(int n, unsigned int h)
+{
+	// Keep the table at most half full so probe chains stay short.
+	if ((mUsed + 1) * 2 > mSlots.size())
+	{
+		vector<int> old;
+		old.swap(mSlots);
+		mSlots.resize(max<size_t>(old.size() * 2, 64), -1);
+		size_t mask = mSlots.size() - 1;
+		for (vector<int>::iterator i = old.begin(); i != old.end(); ++i)
+		if (*i >= 0)
+		{
+			size_t s = hash_pt(&mData[*i * mDepth]) & mask;
+			while (mSlots[s] >= 0)
+				s = (s + 1) & mask;
+			mSlots[s] = *i;
+		}
+	}
+
+	size_t mask = mSlots.size() - 1;
+	size_t s = h & mask;
+	while (mSlots[s] >= 0)
+		s = (s + 1) & mask;
+	mSlots[s] = n;
+	++mUsed;
+}
+
+// Index the pts appended or set since the last accumulate, in that order.  A pt equal to one already in the index is
+// left out, so the first copy of each pt is the one accumulate returns.
+void	ObjPointPool::update_index(void)
+{
+	for (; mIndexed < mOrder.size(); ++mIndexed)
+	{
+		int n = mOrder[mIndexed];
+		const float * pt = &mData[n * mDepth];
+		unsigned int h = hash_pt(pt);
+		if (find_pt(pt, h) < 0)
+			insert_slot(n, h);
+	}
+}
+
+void	ObjPointPool::reset_index(void)
+{
+	mSlots.clear();
+	mIndexed = 0;
+	mUsed = 0;
 }
 
 int		ObjPointPool::count(void) const
@@ -103,3 +252,200 @@ void ObjPointPool::get_minmax(float minCoords[3], float maxCoords[3]) const
 		maxCoords[2] = max(maxCoords[2], mData[n+2]);	minCoords[2] = min(minCoords[2], mData[n+2]);
 	}
 }
+
+#if UNIT_TEST
+// Checks that accumulate merges the same pts the map-based index it replaced did - exact and snapped, after append,
+// resize and set - and times building a large made-up OBJ through XObjBuilder, the way ObjConverter builds its output,
+// against the map.
+//	usage: <grid size>
+
+#include <stdio.h>
+#include "XObjDefs.h"
+#include "XObjBuilder.h"
+#include "PerfUtils.h"
+
+// The map-based index ObjPointPool used to have, with the snap rule for set_snap.
+class	test_map_pool {
+public:
+	test_map_pool(int depth, float snap) : mDepth(depth), mSnap(snap) { }
+
+	int		accumulate(const float pt[])
+	{
+		index_type::iterator iter = mIndex.find(key(pt));
+		if (iter != mIndex.end())
+			return iter->second;
+		return append(pt);
+	}
+	int		append(const float pt[])
+	{
+		int ret = mCount++;
+		mIndex.insert(index_type::value_type(key(pt), ret));
+		return ret;
+	}
+	void	set(int n, const float pt[])	{ mIndex.insert(index_type::value_type(key(pt), n)); }
+	void	resize(int pts)					{ mCount = pts; mIndex.clear(); }
+
+private:
+	typedef	vector<double>											key_type;
+	typedef map<key_type, int, lex_compare_vector<double> >		index_type;
+
+	key_type	key(const float pt[])
+	{
+		key_type k(pt, pt + mDepth);
+		if (mSnap > 0.0f)
+			for (int i = 0; i < mDepth; ++i)
+				k[i] = floor(k[i] / mSnap + 0.5);
+		return k;
+	}
+
+	index_type	mIndex;
+	int			mCount = 0;
+	int			mDepth;
+	float		mSnap;
+};
+
+#define TEST_EXPECT(x)	if (!(x)) { printf("%s:%d: %s failed.\n", __FILE__, __LINE__, #x); return false; }
+
+static bool	test_rules(void)
+{
+	ObjPointPool p;
+	p.clear(3);
+	float a[3] = { 1, 2, 3 }, mz[3] = { -0.0f, 0, 0 }, z[3] = { 0, 0, 0 }, near_a[3] = { 1, 2, 3.0001f };
+	TEST_EXPECT(p.accumulate(a) == 0);
+	TEST_EXPECT(p.accumulate(mz) == 1);
+	TEST_EXPECT(p.accumulate(z) == 1);			// -0 == 0
+	TEST_EXPECT(p.accumulate(near_a) == 2);		// exact mode: close is not equal
+	TEST_EXPECT(p.accumulate(a) == 0);
+
+	// Blank pts from resize are not in the index, and the pt set first wins over the lower index.
+	p.resize(4);
+	float b[3] = { 5, 6, 7 }, c[3] = { 8, 9, 10 };
+	p.set(2, b);
+	p.set(1, b);
+	TEST_EXPECT(p.accumulate(b) == 2);
+	TEST_EXPECT(p.accumulate(z) == 4);
+	p.set(2, c);								// 2 leaves b behind - the next one in line takes over
+	TEST_EXPECT(p.accumulate(b) == 1);
+	TEST_EXPECT(p.accumulate(c) == 2);
+	TEST_EXPECT(p.append(b) == 5);
+	TEST_EXPECT(p.accumulate(b) == 1);
+	TEST_EXPECT(p.count() == 6);
+
+	// Snapped: pts on the same grid cell merge and the first keeps its exact values.
+	p.clear(3);
+	p.set_snap(0.01f);
+	float s1[3] = { 1.001f, -0.002f, 100.0f }, s2[3] = { 0.999f, 0.004f, 100.003f }, s3[3] = { 1.02f, 0.0f, 100.0f };
+	TEST_EXPECT(p.accumulate(s1) == 0);
+	TEST_EXPECT(p.accumulate(s2) == 0);
+	TEST_EXPECT(p.get(0)[0] == s1[0] && p.get(0)[1] == s1[1]);
+	TEST_EXPECT(p.accumulate(s3) == 1);
+	p.set_snap(0.0f);							// back to exact: s2 is a pt of its own
+	TEST_EXPECT(p.accumulate(s2) == 2);
+	TEST_EXPECT(p.accumulate(s1) == 0);
+	return true;
+}
+
+// Random appends, resizes, sets of blank pts and accumulates from a small set of values, checked against the map.
+static bool	test_against_map(float snap)
+{
+	srand(1);
+	const int depth = 4;
+	ObjPointPool p;
+	p.clear(depth);
+	p.set_snap(snap);
+	test_map_pool m(depth, snap);
+	vector<int> blank;
+	for (int op = 0; op < 200000; ++op)
+	{
+		float pt[depth];
+		for (int i = 0; i < depth; ++i)
+			pt[i] = (rand() % 7) * 0.5f + (snap > 0.0f ? (rand() % 100) * snap * 0.004f : 0.0f) - (i == 0 ? 1.5f : 0.0f);
+		int r = rand() % 100;
+		if (r == 0)
+		{
+			int n = rand() % 500;
+			p.resize(n);
+			m.resize(n);
+			blank.clear();
+			for (int i = 0; i < n; ++i)
+				blank.push_back(i);
+			for (int i = n - 1; i > 0; --i)
+				std::swap(blank[i], blank[rand() % (i + 1)]);
+		}
+		else if (r < 40 && !blank.empty())
+		{
+			p.set(blank.back(), pt);
+			m.set(blank.back(), pt);
+			blank.pop_back();
+		}
+		else if (r < 50)
+		{
+			TEST_EXPECT(p.append(pt) == m.append(pt));
+		}
+		else
+		{
+			int got = p.accumulate(pt), want = m.accumulate(pt);
+			if (got != want)
+			{
+				printf("Op %d, snap %f: accumulate returned %d, the map %d.\n", op, snap, got, want);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+int main(int argc, const char * argv[])
+{
+	int grid = argc > 1 ? atoi(argv[1]) : 400;
+
+	if (!test_rules() || !test_against_map(0.0f) || !test_against_map(0.01f))
+		return 1;
+
+	// A terrain-like mesh: every inner vertex is shared by six triangles.
+	XObj8 obj;
+	unsigned long long t0 = query_hpc();
+	{
+		XObjBuilder builder(&obj);
+		for (int y = 0; y < grid; ++y)
+		for (int x = 0; x < grid; ++x)
+		{
+			float v[4][8];
+			for (int k = 0; k < 4; ++k)
+			{
+				float vx = x + (k & 1), vy = y + (k >> 1);
+				float h = sinf(vx * 0.1f) * cosf(vy * 0.1f) * 20.0f;
+				float pt[8] = { vx, h, -vy, 0.0f, 1.0f, 0.0f, vx / grid, vy / grid };
+				memcpy(v[k], pt, sizeof(pt));
+			}
+			float t1[24], t2[24];
+			memcpy(t1, v[0], 32); memcpy(t1 + 8, v[1], 32); memcpy(t1 + 16, v[2], 32);
+			memcpy(t2, v[2], 32); memcpy(t2 + 8, v[1], 32); memcpy(t2 + 16, v[3], 32);
+			builder.AccumTri(t1);
+			builder.AccumTri(t2);
+		}
+		builder.Finish();
+	}
+	double t_pool = hpc_to_microseconds(query_hpc() - t0) / 1000.0;
+
+	// The same vertex stream through the map
+	vector<float> stream;
+	for (int i : obj.indices)
+		stream.insert(stream.end(), obj.geo_tri.get(i), obj.geo_tri.get(i) + 8);
+	test_map_pool m(8, 0.0f);
+	vector<int> idx;
+	t0 = query_hpc();
+	for (size_t i = 0; i < stream.size(); i += 8)
+		idx.push_back(m.accumulate(&stream[i]));
+	double t_map = hpc_to_microseconds(query_hpc() - t0) / 1000.0;
+
+	if (idx != obj.indices || obj.geo_tri.count() != (grid + 1) * (grid + 1))
+	{
+		printf("The OBJ built with the pool has %d vertices, the map merges them differently.\n", obj.geo_tri.count());
+		return 1;
+	}
+	printf("OK, %d triangles, %d vertices: built with the pool in %.0lf ms, the map alone takes %.0lf ms.\n",
+		(int) obj.indices.size() / 3, obj.geo_tri.count(), t_pool, t_map);
+	return 0;
+}
+#endif
@@ -39,6 +39,18 @@ struct lex_compare_vector : public binary_function<vector<T>, vector<T>, bool> {
 	}
 };
 
+// ObjPointPool keeps a flat array of fixed-size points (mDepth floats each) and can merge duplicates on accumulate.
+// Duplicates are found through an open-addressed hash table of point indices that is built lazily: append, set and
+// resize only touch the array and note the pt, and the index catches up the next time accumulate is called.  This keeps
+// OBJ reading (which never merges) as cheap as a plain vector.
+//
+// Only pts that were appended, set or accumulated are in the index - the blank pts resize makes are not.  If several pts
+// are equal, accumulate returns the one that was appended or set first.  Setting a pt that is already in the index drops
+// its old value.
+//
+// By default points merge only if every float is equal.  With set_snap(eps) they merge if every float rounds to the
+// same multiple of eps; the first point added wins and keeps its exact values.
+
 class ObjPointPool {
 public:
 	ObjPointPool();
@@ -46,6 +58,7 @@ public:
 
 	void	clear(int depth);	// Set zero points and number of floats per pt
 	void	resize(int pts);	// Set a lot of pts
+	void	set_snap(float eps);// Merge pts on the same eps grid, 0 = exact match (default)
 
 	int		accumulate(const float pt[]);	// Add a pt, extend if needed
 	int		append(const float pt[]);		// Add a pt to the end
@@ -59,12 +72,21 @@ public:
 
 private:
 
-	typedef	vector<float>									key_type;
-	typedef map<key_type, int, lex_compare_vector<float> >	index_type;
+	unsigned int	hash_pt(const float pt[]) const;
+	bool			match_pt(const float a[], const float b[]) const;
+	int				find_pt(const float pt[], unsigned int h) const;
+	int				find_slot(int n, unsigned int h) const;
+	void			insert_slot(int n, unsigned int h);
+	void			update_index(void);
+	void			reset_index(void);
 
 	vector<float>	mData;
-	index_type		mIndex;
+	vector<int>		mOrder;		// pts in the order they were appended or set - the order the index takes them in
+	vector<int>		mSlots;		// pt index or -1, size is a power of 2
+	int				mIndexed;	// mOrder[0,mIndexed) have been through the index
+	int				mUsed;		// occupied slots
 	int				mDepth;
+	float			mSnap;
 
 };
 
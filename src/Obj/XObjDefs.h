@@ -342,9 +342,9 @@ struct	XObj8 {
 	ObjPointPool			geo_lights;
 #endif
 #if XOBJ8_USE_VBO
-	unsigned int			geo_VBO;
-	unsigned int			idx_VBO;
-	bool					short_idx;
+	mutable unsigned int	geo_VBO;		// created on first draw, so these change on a const XObj8
+	mutable unsigned int	idx_VBO;
+	mutable bool			short_idx;
 	XObj8(void) : geo_VBO(0), idx_VBO(0), short_idx(false) {};
 #endif
 	vector<XObjAnim8>		animation;
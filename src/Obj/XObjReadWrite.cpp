@@ -28,7 +28,10 @@
 #include "XObjDefs.h"
 #include "AssertUtils.h"
 #include "MemFileUtils.h"
+#include "FileUtils.h"
 #include <math.h>
+#include <atomic>
+#include <algorithm>
 
 #ifndef CRLF
 	#if APL
@@ -52,7 +55,7 @@ static const char * dataref_or_none(const char * d)
 /****************************************************************************************
  * OBJ 8 READ
  ****************************************************************************************/
-bool	XObj8Read(const char * inFile, XObj8& outObj)
+static bool	XObj8ReadText(const char * inFile, XObj8& outObj)
 {
 	outObj.texture.clear();
 	outObj.texture_lit.clear();
@@ -1007,6 +1010,419 @@ bool	XObj8Read(const char * inFile, XObj8& outObj)
 }
 
 
+/****************************************************************************************
+ * OBJ 8 BINARY CACHE
+ ****************************************************************************************
+
+	The cache holds one file per OBJ, named after a hash of the OBJ's path.  Each starts with the OBJ's full path, size
+	and modification time in nanoseconds, where the file system has them; if any of them doesn't match the OBJ on disk
+	the cache file is ignored and overwritten.  The rest is the XObj8 dumped field by field in native byte order - this
+	is a local cache, not an interchange format.
+
+	Cache files are written to a temp name and renamed into place, so a reader on another thread never sees a partial
+	file.  The folder has a size budget: setting the folder deletes the oldest cache files until it is down to 3/4 of
+	the budget, and once a session has filled it up no more OBJs are cached until the next start.  The UNIT_TEST below
+	checks that loading a cache gives back exactly what the text parser made.
+*/
+
+#define OBJ_CACHE_MAGIC		"XOC8"
+#define OBJ_CACHE_VERSION	2
+
+static string				sObjCacheFolder;
+static long long			sObjCacheMaxBytes = 0;		// 0 = no limit
+static atomic<long long>	sObjCacheBytes(0);			// all cache files, including the ones written since
+
+static long long	obj_mtime_ns(const struct stat& ss)
+{
+#if LIN
+	return ss.st_mtim.tv_sec * 1000000000LL + ss.st_mtim.tv_nsec;
+#elif APL
+	return ss.st_mtimespec.tv_sec * 1000000000LL + ss.st_mtimespec.tv_nsec;
+#else
+	return ss.st_mtime * 1000000000LL;
+#endif
+}
+
+void	XObj8SetCacheFolder(const char * inFolder, long long inMaxBytes)
+{
+	sObjCacheFolder = inFolder ? inFolder : "";
+	sObjCacheMaxBytes = inMaxBytes;
+	sObjCacheBytes = 0;
+	if (sObjCacheFolder.empty())
+		return;
+	if (FILE_make_dir_exist(sObjCacheFolder.c_str()) != 0)
+	{
+		LOG_MSG("W/OBJ cannot create OBJ cache folder %s, cache is off\n", sObjCacheFolder.c_str());
+		sObjCacheFolder.clear();
+		return;
+	}
+
+	// Nobody reads OBJs yet - clean up after crashed writers and trim the oldest files to make room for this session.
+	vector<string> names;
+	vector<pair<long long, pair<long long, string> > > files;	// mtime, size, path
+	long long total = 0;
+	FILE_get_directory(sObjCacheFolder, &names, NULL);
+	for (vector<string>::iterator n = names.begin(); n != names.end(); ++n)
+	{
+		string path = sObjCacheFolder + "/" + *n;
+		struct stat ss;
+		if (n->size() > 4 && n->compare(n->size() - 4, 4, ".tmp") == 0)
+			FILE_delete_file(path.c_str(), false);
+		else if (n->size() > 5 && n->compare(n->size() - 5, 5, ".objc") == 0 && FILE_get_file_meta_data(path, ss) == 0)
+		{
+			files.push_back(make_pair(obj_mtime_ns(ss), make_pair((long long) ss.st_size, path)));
+			total += ss.st_size;
+		}
+	}
+	if (sObjCacheMaxBytes > 0 && total > sObjCacheMaxBytes)
+	{
+		sort(files.begin(), files.end());
+		int deleted = 0;
+		for (vector<pair<long long, pair<long long, string> > >::iterator f = files.begin(); f != files.end() && total > sObjCacheMaxBytes / 4 * 3; ++f)
+			if (FILE_delete_file(f->second.second.c_str(), false) == 0)
+			{
+				total -= f->second.first;
+				++deleted;
+			}
+		LOG_MSG("I/OBJ deleted %d old OBJ cache files, %.1lf MB left\n", deleted, total / (1024.0 * 1024.0));
+	}
+	sObjCacheBytes = total;
+}
+
+static string	obj_cache_path(const char * inFile)
+{
+	unsigned long long h = 14695981039346656037ULL;
+	for (const char * c = inFile; *c; ++c)
+		h = (h ^ (unsigned char) *c) * 1099511628211ULL;
+	char buf[24];
+	snprintf(buf, sizeof(buf), "%016llx", h);
+	return sObjCacheFolder + "/" + buf + ".objc";
+}
+
+class	obj_cache_writer {
+public:
+	string	buf;
+
+	void	raw(const void * p, size_t n)	{ buf.append((const char *) p, n); }
+	void	i32(int v)						{ raw(&v, sizeof(v)); }
+	void	f32(float v)					{ raw(&v, sizeof(v)); }
+	void	f32(const float * v, int n)		{ raw(v, n * sizeof(float)); }
+	void	str(const string& s)			{ i32(s.size()); raw(s.data(), s.size()); }
+	void	key(const XObjKey& k)			{ f32(k.key); f32(k.v, 3); }
+
+	template <class Pool>
+	void	pool(const Pool& p, int depth)
+	{
+		i32(p.count());
+		if (p.count())
+			f32(p.get(0), p.count() * depth);
+	}
+};
+
+class	obj_cache_reader {
+public:
+	const char *	p;
+	const char *	e;
+	bool			ok;
+
+	obj_cache_reader(const char * b, const char * end) : p(b), e(end), ok(true) { }
+
+	void	raw(void * d, size_t n)			{ if (ok && n <= e - p) { memcpy(d, p, n); p += n; } else { ok = false; memset(d, 0, n); } }
+	int		i32(void)						{ int v; raw(&v, sizeof(v)); return v; }
+	float	f32(void)						{ float v; raw(&v, sizeof(v)); return v; }
+	void	f32(float * v, int n)			{ raw(v, n * sizeof(float)); }
+	void	str(string& s)					{ int n = count(1); s.assign(ok ? p : "", n); p += n; }
+	void	key(XObjKey& k)					{ k.key = f32(); f32(k.v, 3); }
+
+	// An element count, checked against what's left of the file so a damaged cache can't make us allocate the moon.
+	int		count(int min_elem_size)
+	{
+		int n = i32();
+		if (n < 0 || (size_t) n * min_elem_size > e - p) ok = false;
+		return ok ? n : 0;
+	}
+
+	template <class Pool>
+	void	pool(Pool& p, int depth)
+	{
+		int n = count(depth * sizeof(float));
+		p.clear(depth);
+		p.resize(n);
+		float pt[8];
+		for (int i = 0; i < n && ok; ++i)
+		{
+			f32(pt, depth);
+			p.set(i, pt);
+		}
+	}
+};
+
+static void	obj_cache_write_obj(obj_cache_writer& w, const XObj8& obj)
+{
+	w.str(obj.texture);
+	w.str(obj.texture_normal_map);
+	w.str(obj.texture_lit);
+	w.str(obj.texture_draped);
+	w.i32(obj.use_metalness);
+	w.i32(obj.glass_blending);
+	w.str(obj.particle_system);
+
+	w.i32(obj.regions.size());
+	for (vector<XObjPanelRegion8>::const_iterator r = obj.regions.begin(); r != obj.regions.end(); ++r)
+	{
+		w.i32(r->left);	w.i32(r->bottom); w.i32(r->right); w.i32(r->top);
+	}
+	w.i32(obj.indices.size());
+	if (!obj.indices.empty())
+		w.raw(&obj.indices[0], obj.indices.size() * sizeof(int));
+
+	w.pool(obj.geo_tri, 8);
+	w.pool(obj.geo_lines, 6);
+	w.pool(obj.geo_lights, 6);
+
+	w.i32(obj.animation.size());
+	for (vector<XObjAnim8>::const_iterator a = obj.animation.begin(); a != obj.animation.end(); ++a)
+	{
+		w.i32(a->cmd);
+		w.str(a->dataref);
+		w.f32(a->axis, 3);
+		w.f32(a->loop);
+		w.i32(a->keyframes.size());
+		for (vector<XObjKey>::const_iterator k = a->keyframes.begin(); k != a->keyframes.end(); ++k)
+			w.key(*k);
+	}
+
+	w.i32(obj.manips.size());
+	for (vector<XObjManip8>::const_iterator m = obj.manips.begin(); m != obj.manips.end(); ++m)
+	{
+		w.str(m->dataref1);
+		w.str(m->dataref2);
+		w.f32(m->centroid, 3);
+		w.f32(m->axis, 3);
+		w.f32(m->angle_min);	w.f32(m->angle_max);	w.f32(m->lift);
+		w.f32(m->v1_min);		w.f32(m->v1_max);
+		w.f32(m->v2_min);		w.f32(m->v2_max);
+		w.str(m->cursor);
+		w.str(m->tooltip);
+		w.f32(m->mouse_wheel_delta);
+		w.i32(m->rotation_key_frames.size());
+		for (vector<XObjKey>::const_iterator k = m->rotation_key_frames.begin(); k != m->rotation_key_frames.end(); ++k)
+			w.key(*k);
+		w.i32(m->detents.size());
+		for (vector<XObjDetentRange>::const_iterator d = m->detents.begin(); d != m->detents.end(); ++d)
+		{
+			w.f32(d->lo); w.f32(d->hi); w.f32(d->height);
+		}
+	}
+
+	w.i32(obj.emitters.size());
+	for (vector<XObjEmitter8>::const_iterator e = obj.emitters.begin(); e != obj.emitters.end(); ++e)
+	{
+		w.str(e->name);
+		w.str(e->dataref);
+		w.f32(e->x);	w.f32(e->y);	w.f32(e->z);
+		w.f32(e->psi);	w.f32(e->the);	w.f32(e->phi);
+		w.f32(e->v_min);w.f32(e->v_max);
+	}
+
+	w.i32(obj.lods.size());
+	for (vector<XObjLOD8>::const_iterator l = obj.lods.begin(); l != obj.lods.end(); ++l)
+	{
+		w.f32(l->lod_near);
+		w.f32(l->lod_far);
+		w.i32(l->cmds.size());
+		for (vector<XObjCmd8>::const_iterator c = l->cmds.begin(); c != l->cmds.end(); ++c)
+		{
+			w.i32(c->cmd);
+			w.f32(c->params, 12);
+			w.str(c->name);
+			w.i32(c->idx_offset);
+			w.i32(c->idx_count);
+		}
+	}
+
+	w.f32(obj.xyz_min, 3);
+	w.f32(obj.xyz_max, 3);
+	w.f32(obj.fixed_heading);
+	w.f32(obj.viewpoint_height);
+	w.str(obj.description);
+}
+
+static bool	obj_cache_read_obj(obj_cache_reader& r, XObj8& obj)
+{
+	r.str(obj.texture);
+	r.str(obj.texture_normal_map);
+	r.str(obj.texture_lit);
+	r.str(obj.texture_draped);
+	obj.use_metalness = r.i32();
+	obj.glass_blending = r.i32();
+	r.str(obj.particle_system);
+
+	obj.regions.resize(r.count(4 * sizeof(int)));
+	for (vector<XObjPanelRegion8>::iterator g = obj.regions.begin(); g != obj.regions.end(); ++g)
+	{
+		g->left = r.i32(); g->bottom = r.i32(); g->right = r.i32(); g->top = r.i32();
+	}
+	obj.indices.resize(r.count(sizeof(int)));
+	if (!obj.indices.empty())
+		r.raw(&obj.indices[0], obj.indices.size() * sizeof(int));
+
+	r.pool(obj.geo_tri, 8);
+	r.pool(obj.geo_lines, 6);
+	r.pool(obj.geo_lights, 6);
+
+	obj.animation.resize(r.count(4 * sizeof(int)));
+	for (vector<XObjAnim8>::iterator a = obj.animation.begin(); a != obj.animation.end(); ++a)
+	{
+		a->cmd = r.i32();
+		r.str(a->dataref);
+		r.f32(a->axis, 3);
+		a->loop = r.f32();
+		a->keyframes.resize(r.count(sizeof(XObjKey)));
+		for (vector<XObjKey>::iterator k = a->keyframes.begin(); k != a->keyframes.end(); ++k)
+			r.key(*k);
+	}
+
+	obj.manips.resize(r.count(16 * sizeof(float)));
+	for (vector<XObjManip8>::iterator m = obj.manips.begin(); m != obj.manips.end(); ++m)
+	{
+		r.str(m->dataref1);
+		r.str(m->dataref2);
+		r.f32(m->centroid, 3);
+		r.f32(m->axis, 3);
+		m->angle_min = r.f32();	m->angle_max = r.f32();	m->lift = r.f32();
+		m->v1_min = r.f32();	m->v1_max = r.f32();
+		m->v2_min = r.f32();	m->v2_max = r.f32();
+		r.str(m->cursor);
+		r.str(m->tooltip);
+		m->mouse_wheel_delta = r.f32();
+		m->rotation_key_frames.resize(r.count(sizeof(XObjKey)));
+		for (vector<XObjKey>::iterator k = m->rotation_key_frames.begin(); k != m->rotation_key_frames.end(); ++k)
+			r.key(*k);
+		m->detents.resize(r.count(3 * sizeof(float)));
+		for (vector<XObjDetentRange>::iterator d = m->detents.begin(); d != m->detents.end(); ++d)
+		{
+			d->lo = r.f32(); d->hi = r.f32(); d->height = r.f32();
+		}
+	}
+
+	obj.emitters.resize(r.count(10 * sizeof(float)));
+	for (vector<XObjEmitter8>::iterator e = obj.emitters.begin(); e != obj.emitters.end(); ++e)
+	{
+		r.str(e->name);
+		r.str(e->dataref);
+		e->x = r.f32();		e->y = r.f32();		e->z = r.f32();
+		e->psi = r.f32();	e->the = r.f32();	e->phi = r.f32();
+		e->v_min = r.f32();	e->v_max = r.f32();
+	}
+
+	obj.lods.resize(r.count(3 * sizeof(float)));
+	for (vector<XObjLOD8>::iterator l = obj.lods.begin(); l != obj.lods.end(); ++l)
+	{
+		l->lod_near = r.f32();
+		l->lod_far = r.f32();
+		l->cmds.resize(r.count(16 * sizeof(int)));
+		for (vector<XObjCmd8>::iterator c = l->cmds.begin(); c != l->cmds.end(); ++c)
+		{
+			c->cmd = r.i32();
+			r.f32(c->params, 12);
+			r.str(c->name);
+			c->idx_offset = r.i32();
+			c->idx_count = r.i32();
+		}
+	}
+
+	r.f32(obj.xyz_min, 3);
+	r.f32(obj.xyz_max, 3);
+	obj.fixed_heading = r.f32();
+	obj.viewpoint_height = r.f32();
+	r.str(obj.description);
+
+	return r.ok && r.p == r.e;
+}
+
+static void	obj_cache_write_header(obj_cache_writer& w, const char * inFile, const struct stat& ss)
+{
+	long long size = ss.st_size, mtime = obj_mtime_ns(ss);
+	w.raw(OBJ_CACHE_MAGIC, 4);
+	w.i32(OBJ_CACHE_VERSION);
+	w.str(inFile);
+	w.raw(&size, sizeof(size));
+	w.raw(&mtime, sizeof(mtime));
+}
+
+static bool	obj_cache_load(const string& cache_path, const char * inFile, const struct stat& ss, XObj8& outObj)
+{
+	MFMemFile * f = MemFile_Open(cache_path.c_str());
+	if (!f) return false;
+
+	// The header must match byte for byte what we'd write for the OBJ as it is on disk now.
+	obj_cache_writer hdr;
+	obj_cache_write_header(hdr, inFile, ss);
+	obj_cache_reader r(MemFile_GetBegin(f), MemFile_GetEnd(f));
+	bool ok = (r.e - r.p) >= hdr.buf.size() && memcmp(r.p, hdr.buf.data(), hdr.buf.size()) == 0;
+	if (ok)
+	{
+		r.p += hdr.buf.size();
+		if (!obj_cache_read_obj(r, outObj))
+		{
+			// Damaged - the caller will parse the text instead, which doesn't reset these.
+			LOG_MSG("W/OBJ ignoring damaged OBJ cache %s\n", cache_path.c_str());
+			outObj.texture_draped.clear();
+			outObj.particle_system.clear();
+			outObj.description.clear();
+			outObj.regions.clear();
+			outObj.manips.clear();
+			outObj.emitters.clear();
+			ok = false;
+		}
+	}
+	MemFile_Close(f);
+	return ok;
+}
+
+static void	obj_cache_save(const string& cache_path, const char * inFile, const struct stat& ss, const XObj8& inObj)
+{
+	obj_cache_writer w;
+	obj_cache_write_header(w, inFile, ss);
+	obj_cache_write_obj(w, inObj);
+
+	// A stale cache of the same OBJ gets replaced, its size no longer counts.
+	struct stat old;
+	long long replaced = FILE_get_file_meta_data(cache_path, old) == 0 ? old.st_size : 0;
+	if (sObjCacheMaxBytes > 0 && sObjCacheBytes + (long long) w.buf.size() - replaced > sObjCacheMaxBytes)
+		return;
+
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%p.tmp", (void *) &w);		// unique per writer, in case two threads load the same OBJ
+	string tmp_path = cache_path + suffix;
+	FILE * fo = fopen(tmp_path.c_str(), "wb");
+	if (!fo) return;
+	fwrite(w.buf.data(), 1, w.buf.size(), fo);
+	if ((ferror(fo) | fclose(fo)) || FILE_rename_file(tmp_path.c_str(), cache_path.c_str()) != 0)
+	{
+		FILE_delete_file(tmp_path.c_str(), false);
+		return;
+	}
+	sObjCacheBytes += (long long) w.buf.size() - replaced;
+}
+
+bool	XObj8Read(const char * inFile, XObj8& outObj)
+{
+	struct stat ss;
+	if (sObjCacheFolder.empty() || FILE_get_file_meta_data(inFile, ss) != 0)
+		return XObj8ReadText(inFile, outObj);
+
+	string cache_path = obj_cache_path(inFile);
+	if (obj_cache_load(cache_path, inFile, ss, outObj))
+		return true;
+
+	if (!XObj8ReadText(inFile, outObj))
+		return false;
+	obj_cache_save(cache_path, inFile, ss, outObj);
+	return true;
+}
+
 /****************************************************************************************
  * OBJ 8 WRITE
  ****************************************************************************************/
@@ -1507,3 +1923,235 @@ bool	XObj8Write(const char * inFile, const XObj8& outObj)
 	return true;
 }
 
+#if UNIT_TEST
+#include "PerfUtils.h"
+
+#if WED
+FILE * gLogFile = stderr;
+#endif
+
+// Field by field comparison, written separately from the cache reader and writer so that a field both of them forget
+// still shows up as a difference.
+template <class Pool>
+static bool	obj_same_pool(const Pool& a, const Pool& b, int depth)
+{
+	if (a.count() != b.count()) return false;
+	for (int n = 0; n < a.count(); ++n)
+	if (memcmp(a.get(n), b.get(n), depth * sizeof(float)))
+		return false;
+	return true;
+}
+
+static bool	obj_same_keys(const vector<XObjKey>& a, const vector<XObjKey>& b)
+{
+	if (a.size() != b.size()) return false;
+	for (int n = 0; n < a.size(); ++n)
+	if (!a[n].eq(b[n]))
+		return false;
+	return true;
+}
+
+#define	OBJ_SAME_F(a, b, n)	(memcmp((a), (b), (n) * sizeof(float)) == 0)
+
+static bool	obj_same(const XObj8& a, const XObj8& b)
+{
+	if (a.texture != b.texture || a.texture_normal_map != b.texture_normal_map || a.texture_lit != b.texture_lit ||
+		a.texture_draped != b.texture_draped || a.use_metalness != b.use_metalness || a.glass_blending != b.glass_blending ||
+		a.particle_system != b.particle_system || a.indices != b.indices || a.description != b.description ||
+		!OBJ_SAME_F(a.xyz_min, b.xyz_min, 3) || !OBJ_SAME_F(a.xyz_max, b.xyz_max, 3) ||
+		!OBJ_SAME_F(&a.fixed_heading, &b.fixed_heading, 1) || !OBJ_SAME_F(&a.viewpoint_height, &b.viewpoint_height, 1))
+		return false;
+
+	if (!obj_same_pool(a.geo_tri, b.geo_tri, 8) || !obj_same_pool(a.geo_lines, b.geo_lines, 6) || !obj_same_pool(a.geo_lights, b.geo_lights, 6))
+		return false;
+
+	if (a.regions.size() != b.regions.size()) return false;
+	for (int n = 0; n < a.regions.size(); ++n)
+	if (a.regions[n].left != b.regions[n].left || a.regions[n].bottom != b.regions[n].bottom ||
+		a.regions[n].right != b.regions[n].right || a.regions[n].top != b.regions[n].top)
+		return false;
+
+	if (a.animation.size() != b.animation.size()) return false;
+	for (int n = 0; n < a.animation.size(); ++n)
+	{
+		const XObjAnim8& x(a.animation[n]), & y(b.animation[n]);
+		if (x.cmd != y.cmd || x.dataref != y.dataref || !OBJ_SAME_F(x.axis, y.axis, 3) || !OBJ_SAME_F(&x.loop, &y.loop, 1) ||
+			!obj_same_keys(x.keyframes, y.keyframes))
+			return false;
+	}
+
+	if (a.manips.size() != b.manips.size()) return false;
+	for (int n = 0; n < a.manips.size(); ++n)
+	{
+		const XObjManip8& x(a.manips[n]), & y(b.manips[n]);
+		if (x.dataref1 != y.dataref1 || x.dataref2 != y.dataref2 || x.cursor != y.cursor || x.tooltip != y.tooltip ||
+			!OBJ_SAME_F(x.centroid, y.centroid, 3) || !OBJ_SAME_F(x.axis, y.axis, 3) ||
+			!OBJ_SAME_F(&x.angle_min, &y.angle_min, 1) || !OBJ_SAME_F(&x.angle_max, &y.angle_max, 1) || !OBJ_SAME_F(&x.lift, &y.lift, 1) ||
+			!OBJ_SAME_F(&x.v1_min, &y.v1_min, 1) || !OBJ_SAME_F(&x.v1_max, &y.v1_max, 1) ||
+			!OBJ_SAME_F(&x.v2_min, &y.v2_min, 1) || !OBJ_SAME_F(&x.v2_max, &y.v2_max, 1) ||
+			!OBJ_SAME_F(&x.mouse_wheel_delta, &y.mouse_wheel_delta, 1) ||
+			!obj_same_keys(x.rotation_key_frames, y.rotation_key_frames) || x.detents.size() != y.detents.size())
+			return false;
+		for (int d = 0; d < x.detents.size(); ++d)
+		if (!OBJ_SAME_F(&x.detents[d].lo, &y.detents[d].lo, 1) || !OBJ_SAME_F(&x.detents[d].hi, &y.detents[d].hi, 1) ||
+			!OBJ_SAME_F(&x.detents[d].height, &y.detents[d].height, 1))
+			return false;
+	}
+
+	if (a.emitters.size() != b.emitters.size()) return false;
+	for (int n = 0; n < a.emitters.size(); ++n)
+	{
+		const XObjEmitter8& x(a.emitters[n]), & y(b.emitters[n]);
+		if (x.name != y.name || x.dataref != y.dataref ||
+			!OBJ_SAME_F(&x.x, &y.x, 1) || !OBJ_SAME_F(&x.y, &y.y, 1) || !OBJ_SAME_F(&x.z, &y.z, 1) ||
+			!OBJ_SAME_F(&x.psi, &y.psi, 1) || !OBJ_SAME_F(&x.the, &y.the, 1) || !OBJ_SAME_F(&x.phi, &y.phi, 1) ||
+			!OBJ_SAME_F(&x.v_min, &y.v_min, 1) || !OBJ_SAME_F(&x.v_max, &y.v_max, 1))
+			return false;
+	}
+
+	if (a.lods.size() != b.lods.size()) return false;
+	for (int n = 0; n < a.lods.size(); ++n)
+	{
+		const XObjLOD8& x(a.lods[n]), & y(b.lods[n]);
+		if (!OBJ_SAME_F(&x.lod_near, &y.lod_near, 1) || !OBJ_SAME_F(&x.lod_far, &y.lod_far, 1) || x.cmds.size() != y.cmds.size())
+			return false;
+		for (int c = 0; c < x.cmds.size(); ++c)
+		if (x.cmds[c].cmd != y.cmds[c].cmd || !OBJ_SAME_F(x.cmds[c].params, y.cmds[c].params, 12) || x.cmds[c].name != y.cmds[c].name ||
+			x.cmds[c].idx_offset != y.cmds[c].idx_offset || x.cmds[c].idx_count != y.cmds[c].idx_count)
+			return false;
+	}
+	return true;
+}
+
+static bool	obj_test_write(const string& path, const char * text)
+{
+	FILE * fi = fopen(path.c_str(), "wb");
+	if (!fi) return false;
+	fputs(text, fi);
+	return fclose(fi) == 0;
+}
+
+// Checks the OBJ cache in <folder>: loading a cache file gives back exactly what the text parser made, a cache goes stale
+// when its OBJ is rewritten with the same size, and the folder is trimmed to its budget.  Any OBJs given are run through
+// the first check too, with the time to parse them against the time to load their cache.
+//	usage: <folder> [obj files...]
+int main(int argc, const char * argv[])
+{
+	if (argc < 2)
+	{
+		printf("usage: %s <folder> [obj files...]\n", argv[0]);
+		return 1;
+	}
+	string folder(argv[1]);
+	string cache = folder + "/cache";
+	FILE_make_dir_exist(folder.c_str());
+	FILE_delete_dir_recursive(cache);
+	XObj8SetCacheFolder(cache.c_str(), 0);
+	int errs = 0;
+
+	const char * text_a =
+		"I\n800\nOBJ\n\nTEXTURE tex.png\nPOINT_COUNTS 4 0 0 10\n"
+		"VT 0 0 0 0 1 0 0 0\nVT 1 0 0 0 1 0 1 0\nVT 1 0 1 0 1 0 1 1\nVT 0 0 1 0 1 0 0 1\n"
+		"IDX10 0 1 2 0 2 3 0 0 0 0\n"
+		"ATTR_LOD 0 1000\nANIM_begin\nANIM_rotate 0 1 0 0 90 0 1 sim/foo\nTRIS 0 6\nANIM_end\n";
+	// Same size as text_a, only the texture name differs.
+	const char * text_b =
+		"I\n800\nOBJ\n\nTEXTURE tey.png\nPOINT_COUNTS 4 0 0 10\n"
+		"VT 0 0 0 0 1 0 0 0\nVT 1 0 0 0 1 0 1 0\nVT 1 0 1 0 1 0 1 1\nVT 0 0 1 0 1 0 0 1\n"
+		"IDX10 0 1 2 0 2 3 0 0 0 0\n"
+		"ATTR_LOD 0 1000\nANIM_begin\nANIM_rotate 0 1 0 0 90 0 1 sim/foo\nTRIS 0 6\nANIM_end\n";
+
+	vector<string> objs;
+	objs.push_back(folder + "/test.obj");
+	obj_test_write(objs.back(), text_a);
+	for (int n = 2; n < argc; ++n)
+		objs.push_back(argv[n]);
+
+	for (vector<string>::iterator o = objs.begin(); o != objs.end(); ++o)
+	{
+		// Compare with the very parse that was cached - the parser leaves unused command params uninitialized.
+		XObj8 parsed, cached;
+		StElapsedTime * t = new StElapsedTime("text parse and cache write");
+		bool ok = XObj8Read(o->c_str(), parsed);
+		delete t;
+		if (!ok)
+		{
+			printf("%s: does not parse\n", o->c_str());
+			++errs;
+			continue;
+		}
+		{
+			StElapsedTime t("cache load");
+			struct stat ss;
+			ok = FILE_get_file_meta_data(*o, ss) == 0 && obj_cache_load(obj_cache_path(o->c_str()), o->c_str(), ss, cached);
+		}
+		if (!ok || !obj_same(parsed, cached))
+		{
+			printf("%s: cache does not match the text parse\n", o->c_str());
+			++errs;
+		}
+	}
+
+	// Rewrite the OBJ with the same size - only the ns mtime tells the cache is stale.  Wait out coarse file system clocks.
+	struct stat before, after;
+	FILE_get_file_meta_data(objs[0], before);
+	do {
+		obj_test_write(objs[0], text_b);
+		FILE_get_file_meta_data(objs[0], after);
+	} while (obj_mtime_ns(after) == obj_mtime_ns(before));
+	XObj8 changed;
+	if (!XObj8Read(objs[0].c_str(), changed) || changed.texture != "tey.png" || after.st_size != before.st_size)
+	{
+		printf("cache of a rewritten OBJ is used, texture %s\n", changed.texture.c_str());
+		++errs;
+	}
+
+	// Budget: fill the folder with 20 files of 1 KB, setting a 10 KB budget leaves the newest 7.
+	FILE_delete_dir_recursive(cache);
+	XObj8SetCacheFolder(cache.c_str(), 0);
+	vector<string> fills;
+	for (int n = 0; n < 20; ++n)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "/fill%02d.objc", n);
+		fills.push_back(cache + name);
+		obj_test_write(fills.back(), string(1024, 'x').c_str());
+		struct stat ss;											// distinct mtimes, so oldest first is well defined
+		FILE_get_file_meta_data(fills.back(), ss);
+		do {
+			obj_test_write(cache + "/clock.tmp", "");
+			FILE_get_file_meta_data(cache + "/clock.tmp", after);
+		} while (obj_mtime_ns(after) == obj_mtime_ns(ss));
+	}
+	XObj8SetCacheFolder(cache.c_str(), 10 * 1024);
+	int left = 0;
+	for (int n = 0; n < 20; ++n)
+	{
+		bool exists = FILE_exists(fills[n].c_str());
+		left += exists;
+		if (exists != (n >= 13))
+		{
+			printf("fill%02d.objc %s\n", n, exists ? "was kept" : "was deleted");
+			++errs;
+		}
+	}
+	if (FILE_exists((cache + "/clock.tmp").c_str()))
+	{
+		printf("temp file was not cleaned up\n");
+		++errs;
+	}
+
+	// A full cache folder stops caching, it doesn't grow past the budget.
+	XObj8SetCacheFolder(cache.c_str(), left * 1024 + 100);
+	XObj8 full;
+	XObj8Read(objs[0].c_str(), full);
+	if (FILE_exists(obj_cache_path(objs[0].c_str()).c_str()))
+	{
+		printf("OBJ was cached past the budget\n");
+		++errs;
+	}
+
+	printf("%s, %d OBJs, %d of 20 files left after trimming\n", errs ? "FAILED" : "OK", (int) objs.size(), left);
+	return errs ? 1 : 0;
+}
+#endif
@@ -27,6 +27,12 @@ struct	XObj8;
 
 bool	XObj8Read(const char * inFile, XObj8& outObj);
 
+// Optional cache of pre-parsed OBJs.  Once a folder is set, XObj8Read saves a binary copy of each OBJ it parses there,
+// keyed by the OBJ's path, size and modification time, and loads that copy instead of the text next time.  Set this
+// once at startup, before any threads read OBJs - it also trims the folder to inMaxBytes, oldest files first, and
+// nothing more is cached once it's full.  NULL or "" turns the cache off, which is the default; inMaxBytes 0 is no limit.
+void	XObj8SetCacheFolder(const char * inFolder, long long inMaxBytes = 0);
+
 // hasnt been updated since XP 10.00 - missing all newer OBJ commands !!!!
 bool	XObj8Write(const char * inFile, const XObj8& outObj);
 
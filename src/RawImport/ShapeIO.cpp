@@ -32,6 +32,9 @@
 #include "MapTopology.h"
 #include "MapHelpers.h"
 #include "PolyRasterUtils.h"
+#include "FileUtils.h"
+#include "MemFileUtils.h"
+#include <sys/stat.h>
 
 // This will cause us to debug-show red/green outlines of the .shp data to see what we imported and what we had to drop.
 #define SHOW_FEATURE_IMPORT		0
@@ -166,6 +169,343 @@ bool shape_in_bounds(SHPObject * obj)
 						   return true;
 }
 
+/************************************************************************************************************************************
+ * RECORD BOX INDEX
+ ************************************************************************************************************************************
+ * To crop we only need each record's bounding box, and every non-null record starts with one - so instead of decoding every
+ * shape we seek to each record via the .shx offsets (that shapelib has already loaded) and read 36 bytes.  Only records whose
+ * box passes the same test as shape_in_bounds() get decoded.
+ *
+ * With shp_Index the boxes also go into a sidecar file next to the shapefile (<name>.xgrid), along with a grid of which records
+ * touch which cell.  It is memory mapped, so cutting one tile out of a huge shapefile touches only the grid cells and boxes
+ * under the crop box.  The sidecar is rebuilt whenever the .shp's size or date (in ns where the OS has it) changes, or the
+ * hash of the .shx record table - every record's offset and length - no longer matches.  The grid is sanity checked before
+ * use, so a damaged sidecar is rebuilt rather than read out of bounds.
+ *
+ * Sidecar layout, all native endian:
+ *   char[4] "XSGI", int version, int64 shp size, int64 shp mtime, uint64 shx hash, int record count, int grid size G,
+ *   double lo[2], hi[2]
+ *   double box[count][4]			xmin, ymin, xmax, ymax - a null record is +inf,+inf,-inf,-inf so it never overlaps
+ *   int cell_start[G*G+1]			records of cell c are cell_ids[cell_start[c]..cell_start[c+1])
+ *   int cell_ids[]					followed by the "big" records that would cover too many cells and are always tested
+ *   int big_count, big_ids[]
+ */
+
+#define SHP_INDEX_VERSION	2
+#define SHP_INDEX_MAX_GRID	512
+
+struct shp_index_header {
+	char		magic[4];
+	int			version;
+	int64_t		shp_size;
+	int64_t		shp_mtime;
+	uint64_t	shx_hash;
+	int			count;
+	int			grid;
+	double		lo[2];
+	double		hi[2];
+};
+
+static double shp_le_double(const unsigned char * p)
+{
+	uint64_t	bits = 0;
+	for(int i = 7; i >= 0; --i)
+		bits = (bits << 8) | p[i];
+	double d;
+	memcpy(&d, &bits, sizeof(d));
+	return d;
+}
+
+static string shp_base_path(const char * in_file)
+{
+	string base(in_file);
+	if(base.size() > 4 && base[base.size()-4] == '.')
+	{
+		string ext = base.substr(base.size() - 3);
+		for(auto& c : ext) c = tolower(c);
+		if(ext == "shp" || ext == "shx" || ext == "dbf")
+			base.erase(base.size() - 4);
+	}
+	return base;
+}
+
+// What the sidecar was built from: the .shp's size and date, and a hash of the record table from the .shx.
+static void shp_index_key(SHPHandle file, const struct stat& shp_info, shp_index_header& h)
+{
+	h.shp_size = shp_info.st_size;
+#if LIN
+	h.shp_mtime = shp_info.st_mtim.tv_sec * 1000000000LL + shp_info.st_mtim.tv_nsec;
+#elif APL
+	h.shp_mtime = shp_info.st_mtimespec.tv_sec * 1000000000LL + shp_info.st_mtimespec.tv_nsec;
+#else
+	h.shp_mtime = shp_info.st_mtime * 1000000000LL;
+#endif
+	uint64_t hash = 14695981039346656037ULL;		// FNV-1a
+	for(int n = 0; n < file->nRecords; ++n)
+	{
+		uint64_t rec[2] = { (uint64_t) file->panRecOffset[n], (uint64_t) file->panRecSize[n] };
+		const unsigned char * b = (const unsigned char *) rec;
+		for(int k = 0; k < sizeof(rec); ++k)
+			hash = (hash ^ b[k]) * 1099511628211ULL;
+	}
+	h.shx_hash = hash;
+}
+
+static bool shp_box_in_crop(const double box[4])
+{
+	Point2	lo(box[0],box[1]);
+	Point2	hi(box[2],box[3]);
+	if(lo.x() > hi.x())
+		return false;			// null record
+	if(sProj)
+	{
+		reproj(lo);
+		reproj(hi);
+	}
+	if(hi.x() < s_crop[0]) return false;
+	if(lo.x() > s_crop[2]) return false;
+	if(hi.y() < s_crop[1]) return false;
+	if(lo.y() > s_crop[3]) return false;
+						   return true;
+}
+
+// Read every record's box straight from the .shp, using the record offsets from the .shx.
+static bool shp_read_boxes(SHPHandle file, const string& base, int count, vector<double>& boxes)
+{
+	FILE * fi = fopen((base + ".shp").c_str(), "rb");
+	if(!fi) fi = fopen((base + ".SHP").c_str(), "rb");
+	if(!fi) return false;
+
+	boxes.resize(4 * count);
+	for(int n = 0; n < count; ++n)
+	{
+		unsigned char rec[8 + 4 + 32];
+		double * b = &boxes[4 * n];
+		size_t got = 0;
+		if(fseek(fi, file->panRecOffset[n], SEEK_SET) == 0)
+			got = fread(rec, 1, sizeof(rec), fi);
+		int type = got >= 12 ? rec[8] | (rec[9] << 8) | (rec[10] << 16) | (rec[11] << 24) : SHPT_NULL;
+		if(type == SHPT_POINT || type == SHPT_POINTZ || type == SHPT_POINTM)
+		{
+			if(got < 12 + 16) { fclose(fi); return false; }
+			b[0] = b[2] = shp_le_double(rec + 12);
+			b[1] = b[3] = shp_le_double(rec + 20);
+		}
+		else if(type != SHPT_NULL)
+		{
+			if(got < sizeof(rec)) { fclose(fi); return false; }
+			for(int k = 0; k < 4; ++k)
+				b[k] = shp_le_double(rec + 12 + 8 * k);
+		}
+		else
+		{
+			b[0] = b[1] =  numeric_limits<double>::infinity();
+			b[2] = b[3] = -numeric_limits<double>::infinity();
+		}
+	}
+	fclose(fi);
+	return true;
+}
+
+static void shp_cell_range(const shp_index_header& h, const double box[4], int r[4])
+{
+	for(int k = 0; k < 2; ++k)
+	{
+		double span = h.hi[k] - h.lo[k];
+		double lo = span > 0.0 ? (box[k]     - h.lo[k]) / span * h.grid : 0.0;
+		double hi = span > 0.0 ? (box[k + 2] - h.lo[k]) / span * h.grid : 0.0;
+		r[k]     = intlim((int) floor(max(-1.0, min(lo, (double) h.grid))), 0, h.grid - 1);
+		r[k + 2] = intlim((int) floor(max(-1.0, min(hi, (double) h.grid))), 0, h.grid - 1);
+	}
+}
+
+static bool shp_write_index(const string& path, const shp_index_header& key, const vector<double>& boxes)
+{
+	shp_index_header h(key);
+	memcpy(h.magic, "XSGI", 4);
+	h.version = SHP_INDEX_VERSION;
+	h.count = boxes.size() / 4;
+	h.grid = intlim((int) sqrt(h.count / 8.0), 1, SHP_INDEX_MAX_GRID);
+	h.lo[0] = h.lo[1] =  numeric_limits<double>::infinity();
+	h.hi[0] = h.hi[1] = -numeric_limits<double>::infinity();
+	for(int n = 0; n < h.count; ++n)
+	if(boxes[4*n] <= boxes[4*n+2])
+	{
+		h.lo[0] = min(h.lo[0], boxes[4*n]);		h.hi[0] = max(h.hi[0], boxes[4*n+2]);
+		h.lo[1] = min(h.lo[1], boxes[4*n+1]);	h.hi[1] = max(h.hi[1], boxes[4*n+3]);
+	}
+	if(h.lo[0] > h.hi[0])
+		h.lo[0] = h.lo[1] = h.hi[0] = h.hi[1] = 0.0;
+
+	// Two passes over the records - count per cell, then fill - so the cell lists come out in record order.
+	int cells = h.grid * h.grid;
+	int big_limit = max(4, cells / 4);
+	vector<int>	cell_start(cells + 1, 0), cell_ids, big_ids;
+	for(int pass = 0; pass < 2; ++pass)
+	{
+		vector<int> fill(cell_start.begin(), cell_start.end() - 1);
+		for(int n = 0; n < h.count; ++n)
+		{
+			const double * b = &boxes[4*n];
+			if(b[0] > b[2]) continue;
+			int r[4];
+			shp_cell_range(h, b, r);
+			if((r[2] - r[0] + 1) * (r[3] - r[1] + 1) > big_limit)
+			{
+				if(pass == 0) big_ids.push_back(n);
+				continue;
+			}
+			for(int y = r[1]; y <= r[3]; ++y)
+			for(int x = r[0]; x <= r[2]; ++x)
+				if(pass == 0)	++cell_start[y * h.grid + x + 1];
+				else			cell_ids[fill[y * h.grid + x]++] = n;
+		}
+		if(pass == 0)
+		{
+			for(int c = 0; c < cells; ++c)
+				cell_start[c + 1] += cell_start[c];
+			cell_ids.resize(cell_start[cells]);
+		}
+	}
+
+	string temp = path + ".tmp";
+	FILE * fi = fopen(temp.c_str(), "wb");
+	if(!fi) return false;
+	int big_count = big_ids.size();
+	bool ok = fwrite(&h, sizeof(h), 1, fi) == 1 &&
+		fwrite(boxes.data(), sizeof(double), boxes.size(), fi) == boxes.size() &&
+		fwrite(cell_start.data(), sizeof(int), cell_start.size(), fi) == cell_start.size() &&
+		fwrite(cell_ids.data(), sizeof(int), cell_ids.size(), fi) == cell_ids.size() &&
+		fwrite(&big_count, sizeof(int), 1, fi) == 1 &&
+		fwrite(big_ids.data(), sizeof(int), big_ids.size(), fi) == big_ids.size();
+	ok = (fclose(fi) == 0) && ok;
+	if(ok)
+		ok = FILE_rename_file(temp.c_str(), path.c_str()) == 0;
+	if(!ok)
+		FILE_delete_file(temp.c_str(), false);
+	return ok;
+}
+
+// Look up the records of the crop box in a sidecar.  Returns false if it is missing, stale or damaged.
+static bool shp_query_index(const string& path, const shp_index_header& key, int count, vector<int>& out_records)
+{
+	MFMemFile * mf = MemFile_Open(path.c_str());
+	if(!mf) return false;
+
+	const char * p   = MemFile_GetBegin(mf);
+	const char * end = MemFile_GetEnd(mf);
+	shp_index_header h;
+	bool ok = end - p >= (ptrdiff_t) sizeof(h);
+	if(ok)
+	{
+		memcpy(&h, p, sizeof(h));
+		ok = memcmp(h.magic, "XSGI", 4) == 0 && h.version == SHP_INDEX_VERSION && h.count == count &&
+			 h.shp_size == key.shp_size && h.shp_mtime == key.shp_mtime && h.shx_hash == key.shx_hash &&
+			 h.grid >= 1 && h.grid <= SHP_INDEX_MAX_GRID;
+	}
+	int cells = ok ? h.grid * h.grid : 0;
+	const double * boxes = (const double *) (p + sizeof(h));
+	const int * cell_start = (const int *) (boxes + 4 * (size_t) count);
+	const int * cell_ids = cell_start + cells + 1;
+	ok = ok && (const char *) cell_ids <= end;
+
+	// The cell lists must be in order and inside the file, the big list must end exactly where the file does.
+	ptrdiff_t ids_avail = ok ? (end - (const char *) cell_ids) / (ptrdiff_t) sizeof(int) - 1 : 0;
+	ok = ok && cell_start[0] == 0;
+	for(int c = 0; ok && c < cells; ++c)
+		ok = cell_start[c] <= cell_start[c + 1];
+	ok = ok && cell_start[cells] <= ids_avail;
+	const int * big = ok ? cell_ids + cell_start[cells] : nullptr;
+	ok = ok && big[0] >= 0 && big[0] <= count && (const char *) (big + 1 + big[0]) == end;
+	if(!ok)
+	{
+		MemFile_Close(mf);
+		return false;
+	}
+
+	// A crop box in the file's own units lets us use the grid; with a projection we test every box.
+	vector<char> hit(count, 0);
+	if(sProj)
+		fill(hit.begin(), hit.end(), 1);
+	else
+	{
+		int r[4];
+		shp_cell_range(h, s_crop, r);
+		for(int y = r[1]; y <= r[3]; ++y)
+		for(int x = r[0]; x <= r[2]; ++x)
+		{
+			int c = y * h.grid + x;
+			for(int i = cell_start[c]; ok && i < cell_start[c + 1]; ++i)
+				if((ok = (unsigned) cell_ids[i] < (unsigned) count))
+					hit[cell_ids[i]] = 1;
+		}
+		for(int i = 0; ok && i < big[0]; ++i)
+			if((ok = (unsigned) big[1 + i] < (unsigned) count))
+				hit[big[1 + i]] = 1;
+	}
+	if(!ok)
+	{
+		MemFile_Close(mf);
+		return false;
+	}
+
+	out_records.clear();
+	for(int n = 0; n < count; ++n)
+	if(hit[n] && shp_box_in_crop(boxes + 4 * n))
+		out_records.push_back(n);
+
+	MemFile_Close(mf);
+	return true;
+}
+
+// The records (in file order) whose boxes overlap the crop box.  Returns false if we can't tell - then read them all.
+static bool shp_records_in_crop(SHPHandle file, const char * in_file, int count, bool use_index, vector<int>& out_records)
+{
+	string base = shp_base_path(in_file);
+	struct stat shp_info;
+	if(use_index)
+	{
+		if(FILE_get_file_meta_data(base + ".shp", shp_info) != 0 &&
+		   FILE_get_file_meta_data(base + ".SHP", shp_info) != 0)
+			use_index = false;
+	}
+	string index_path = base + ".xgrid";
+	shp_index_header key;
+	if(use_index)
+		shp_index_key(file, shp_info, key);
+	if(use_index && shp_query_index(index_path, key, count, out_records))
+		return true;
+
+	vector<double> boxes;
+	if(!shp_read_boxes(file, base, count, boxes))
+		return false;
+	if(use_index && !shp_write_index(index_path, key, boxes))
+		printf("Could not write shape index %s\n", index_path.c_str());
+
+	out_records.clear();
+	for(int n = 0; n < count; ++n)
+	if(shp_box_in_crop(&boxes[4 * n]))
+		out_records.push_back(n);
+	return true;
+}
+
+bool	ShapeFileRecordsInBounds(const char * in_file, const double bounds[4], bool use_index, vector<int>& out_records)
+{
+	SHPHandle file = SHPOpen(in_file, "rb");
+	if(!file)
+		return false;
+	int		entity_count, shape_type;
+	double	bounds_lo[4], bounds_hi[4];
+	SHPGetInfo(file, &entity_count, &shape_type, bounds_lo, bounds_hi);
+
+	if(sProj) pj_free(sProj);sProj=nullptr;
+	for(int n = 0; n < 4; ++n)
+		s_crop[n] = bounds[n];
+	bool ok = shp_records_in_crop(file, in_file, entity_count, use_index, out_records);
+	SHPClose(file);
+	return ok;
+}
+
 /*
 inline void DEBUG_POLYGON(const Polygon_2& p, const Point3& c1, const Point3& c2)
 {
@@ -602,10 +942,19 @@ bool	ReadShapeFile(const char * in_file, Pmwx& io_map, shp_Flags flags, const ch
 	 * MAIN SHAPE READING LOOP
 	 ************************************************************************************************************************************/
 
-	int step = entity_count ? (entity_count / 150) : 2;
-	for(int n = 0; n < entity_count; ++n)
+	vector<int>	records;
+	if((flags & shp_Use_Crop) == 0 || !shp_records_in_crop(file, in_file, entity_count, (flags & shp_Index) != 0, records))
 	{
-		PROGRESS_CHECK(inFunc, 0, 1, "Reading shape file...", n, entity_count, step)
+		records.resize(entity_count);
+		for(int n = 0; n < entity_count; ++n)
+			records[n] = n;
+	}
+
+	int step = records.size() ? (records.size() / 150) : 2;
+	for(int r = 0; r < records.size(); ++r)
+	{
+		PROGRESS_CHECK(inFunc, 0, 1, "Reading shape file...", r, records.size(), step)
+		int n = records[r];
 		SHPObject * obj = SHPReadObject(file, n);
 		if((flags & shp_Use_Crop) == 0 || shape_in_bounds(obj))
 		if(!db || want_this_thing(db, obj->nShapeId, sShapeRules, &feat))
@@ -1160,11 +1509,19 @@ bool	RasterShapeFile(
 	 * MAIN SHAPE READING LOOP
 	 ************************************************************************************************************************************/
 
-	int step = entity_count ? (entity_count / 150) : 2;
-	for(int n = 0; n < entity_count; ++n)
+	vector<int>	records;
+	if((flags & shp_Use_Crop) == 0 || !shp_records_in_crop(file, inFile, entity_count, (flags & shp_Index) != 0, records))
 	{
-		PROGRESS_CHECK(inFunc, 0, 1, "Reading shape file...", n, entity_count, step)
-		SHPObject * obj = SHPReadObject(file, n);
+		records.resize(entity_count);
+		for(int n = 0; n < entity_count; ++n)
+			records[n] = n;
+	}
+
+	int step = records.size() ? (records.size() / 150) : 2;
+	for(int r = 0; r < records.size(); ++r)
+	{
+		PROGRESS_CHECK(inFunc, 0, 1, "Reading shape file...", r, records.size(), step)
+		SHPObject * obj = SHPReadObject(file, records[r]);
 		if((flags & shp_Use_Crop) == 0 || shape_in_bounds(obj))
 		if(!db || want_this_thing(db, obj->nShapeId, sShapeRules, &feat))
 		switch(obj->nSHPType) {
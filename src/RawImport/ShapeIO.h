@@ -42,6 +42,7 @@ enum {
 		shp_ErrCheck		= 128,			// Check for overlapping line segments, and fail if we find any.
 		shp_Altitude		= 256,			// Import elevation from polygon vertex Z values.
 		shp_Outline			= 512,			// Rasterizing: ink in outline to guarantee coverage
+		shp_Index			= 1024,			// With crop: keep a grid index of record boxes in <name>.xgrid next to the shape file.
 };
 typedef unsigned int shp_Flags;
 
@@ -73,6 +74,14 @@ bool	ReadShapeFile(
 			Pmwx&					io_map,
 			ProgressFunc			inFunc);
 
+// The records (in file order) whose bounding boxes overlap bounds, without decoding any shapes.  Uses and (re)builds
+// the .xgrid sidecar if use_index is set.  Any PROJ setting of the last import is dropped.
+bool	ShapeFileRecordsInBounds(
+			const char *			in_file,
+			const double			bounds[4],
+			bool					use_index,
+			vector<int>&			out_records);
+
 bool	WriteShapefile(
 			const char *			in_file,
 			Pmwx&					in_map,
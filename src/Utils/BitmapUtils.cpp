@@ -31,6 +31,10 @@
 
 #include <errno.h>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
 #include <png.h>
 #include <zlib.h>
 
@@ -1303,7 +1307,8 @@ int		WriteBitmapToPNG(const struct ImageInfo * inImage, const char * inFilePath,
 
 	png_set_bgr(png_ptr);
 
-	png_set_PLTE(png_ptr, info_ptr, (png_colorp) inPalette, inPaletteLen);
+	if(inPalette)
+		png_set_PLTE(png_ptr, info_ptr, (png_colorp) inPalette, inPaletteLen);	// newer libpng rejects an empty palette
 
     png_set_IHDR(png_ptr, info_ptr, inImage->width, inImage->height, 8,
     	(inImage->channels == 1) ? (inPalette ? PNG_COLOR_TYPE_PALETTE : PNG_COLOR_TYPE_GRAY) :
@@ -1602,8 +1607,82 @@ static void	in_place_scaleY(int x, int y, unsigned char * src, unsigned char * d
 		}
 	}
 
+// Whole-row versions of the two box filters for the common 2x2 case. They give exactly the same bytes as calling
+// the filter per sample (same float math, same order of additions) but without the call, the switch on the sample
+// count or the pow-ish math - from_srgb() of a byte comes from a table. Templated on the channel count so the inner
+// loops are fixed-size and the compiler can vectorize them.
+
+template <int CH>
+static void mip_row_box(const unsigned char * s1, const unsigned char * s2, unsigned char * d, int dst_width)
+{
+	for(int x = 0; x < dst_width; ++x)
+	for(int c = 0; c < CH; ++c)
+	{
+		int i = 2 * x * CH + c;
+		d[x * CH + c] = ((int) s1[i] + (int) s1[i + CH] + (int) s2[i] + (int) s2[i + CH]) >> 2;
+	}
+}
+
+template <int CH>
+static void mip_row_box_with_gamma(const unsigned char * s1, const unsigned char * s2, unsigned char * d, int dst_width, const float * lin)
+{
+	for(int x = 0; x < dst_width; ++x)
+	for(int c = 0; c < CH; ++c)
+	{
+		int i = 2 * x * CH + c;
+		if(c < 3)
+			d[x * CH + c] = intlim(to_srgb((lin[s1[i]] + lin[s1[i + CH]] + lin[s2[i]] + lin[s2[i + CH]]) * 0.25f), 0, 255);
+		else
+			d[x * CH + c] = ((int) s1[i] + (int) s1[i + CH] + (int) s2[i] + (int) s2[i + CH]) >> 2;
+	}
+}
+
+struct srgb_to_linear_table {
+	float lin[256];
+	srgb_to_linear_table() { for(int i = 0; i < 256; ++i) lin[i] = from_srgb(i); }
+};
+
+static bool copy_mip_2x2_fast(const ImageInfo& src, ImageInfo& dst, mip_func_t filter)
+{
+	static const srgb_to_linear_table table;		// function static - safe to build from several threads at once
+	const float * lin = table.lin;
+
+	bool gamma = filter == mip_filter_box_with_gamma;
+	if(!gamma && filter != mip_filter_box) return false;
+	if(src.width != 2 * dst.width || src.height != 2 * dst.height) return false;
+	if(src.channels != dst.channels || src.channels < 1 || src.channels > 4) return false;
+
+	int srb = src.width * src.channels + src.pad;
+	int drb = dst.width * dst.channels + dst.pad;
+
+	for(int y = 0; y < dst.height; ++y)
+	{
+		const unsigned char * s1 = src.data + 2 * y * srb;
+		const unsigned char * s2 = s1 + srb;
+		unsigned char * d = dst.data + y * drb;
+		if(gamma)
+		switch(src.channels) {
+		case 1: mip_row_box_with_gamma<1>(s1, s2, d, dst.width, lin);	break;
+		case 2: mip_row_box_with_gamma<2>(s1, s2, d, dst.width, lin);	break;
+		case 3: mip_row_box_with_gamma<3>(s1, s2, d, dst.width, lin);	break;
+		case 4: mip_row_box_with_gamma<4>(s1, s2, d, dst.width, lin);	break;
+		}
+		else
+		switch(src.channels) {
+		case 1: mip_row_box<1>(s1, s2, d, dst.width);	break;
+		case 2: mip_row_box<2>(s1, s2, d, dst.width);	break;
+		case 3: mip_row_box<3>(s1, s2, d, dst.width);	break;
+		case 4: mip_row_box<4>(s1, s2, d, dst.width);	break;
+		}
+	}
+	return true;
+}
+
 static void copy_mip_with_filter(const ImageInfo& src, ImageInfo& dst,int level, mip_func_t filter)
 {
+	if(copy_mip_2x2_fast(src, dst, filter))
+		return;
+
 	unsigned char temp_buf[4];	        // Enough storage for RGBA 2x2
 	int xr = src.width == dst.width ? 1 : 2;
 	int yr = src.height == dst.height ? 1 : 2;
@@ -1655,7 +1734,188 @@ static void swap_bgra_y(struct ImageInfo& i)
 }
 
 // Compressed DDS.
-int	WriteBitmapToDDS(struct ImageInfo& ioImage, int dxt, const char * file_name, int use_win_gamma)
+/* Fast DXT1/DXT5 encoder - a simple range fit, for preview and test builds where libsquish's cluster fit is too slow.
+   Endpoints are the two pixels furthest apart along the block's principal color axis, and every pixel just takes
+   the nearest of the 4 palette colors.  Alpha (DXT5) uses the block's min and max alpha with 8 interpolated steps.
+   DDSTool --bench_dxt reports speed and PSNR of both encoders for a given image.
+   The 16-pixel loops are kept branch-free so the compiler can vectorize them. */
+
+static inline int expand565(int c, int shift, int bits)
+{
+	int v = (c >> shift) & ((1 << bits) - 1);
+	return bits == 5 ? (v << 3) | (v >> 2) : (v << 2) | (v >> 4);
+}
+
+static inline int pack565(float r, float g, float b)
+{
+	int r5 = intlim((int) (r * 31.0f / 255.0f + 0.5f), 0, 31);
+	int g6 = intlim((int) (g * 63.0f / 255.0f + 0.5f), 0, 63);
+	int b5 = intlim((int) (b * 31.0f / 255.0f + 0.5f), 0, 31);
+	return (r5 << 11) | (g6 << 5) | b5;
+}
+
+static void fast_color_block(const unsigned char px[64], bool dxt1_alpha, unsigned char * out)
+{
+	float r[16], g[16], b[16];
+	int   use[16];
+	int   transparent = 0, used = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		r[i] = px[4*i]; g[i] = px[4*i+1]; b[i] = px[4*i+2];
+		use[i] = !dxt1_alpha || px[4*i+3] >= 128;
+		transparent |= !use[i];
+		used += use[i];
+	}
+
+	int c0 = 0, c1 = 0;
+	if (used)
+	{
+		// Mean, covariance and bounding box of the pixels we have to match
+		float mr = 0, mg = 0, mb = 0;
+		float lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+		for (int i = 0; i < 16; ++i)
+		if (use[i])
+		{
+			mr += r[i]; mg += g[i]; mb += b[i];
+			lo[0] = min(lo[0], r[i]); hi[0] = max(hi[0], r[i]);
+			lo[1] = min(lo[1], g[i]); hi[1] = max(hi[1], g[i]);
+			lo[2] = min(lo[2], b[i]); hi[2] = max(hi[2], b[i]);
+		}
+		mr /= used; mg /= used; mb /= used;
+		float crr = 0, crg = 0, crb = 0, cgg = 0, cgb = 0, cbb = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			float dr = (r[i] - mr) * use[i], dg = (g[i] - mg) * use[i], db = (b[i] - mb) * use[i];
+			crr += dr * dr; crg += dr * dg; crb += dr * db;
+			cgg += dg * dg; cgb += dg * db; cbb += db * db;
+		}
+
+		// Principal axis by power iteration, starting from the bounding box diagonal
+		float ax = hi[0] - lo[0], ay = hi[1] - lo[1], az = hi[2] - lo[2];
+		for (int it = 0; it < 4; ++it)
+		{
+			float nx = crr * ax + crg * ay + crb * az;
+			float ny = crg * ax + cgg * ay + cgb * az;
+			float nz = crb * ax + cgb * ay + cbb * az;
+			float len = max(fabsf(nx), max(fabsf(ny), fabsf(nz)));
+			if (len == 0.0f) break;
+			ax = nx / len; ay = ny / len; az = nz / len;
+		}
+
+		int imin = -1, imax = -1;
+		float dmin = 0, dmax = 0;
+		for (int i = 0; i < 16; ++i)
+		if (use[i])
+		{
+			float d = r[i] * ax + g[i] * ay + b[i] * az;
+			if (imin < 0 || d < dmin) { dmin = d; imin = i; }
+			if (imax < 0 || d > dmax) { dmax = d; imax = i; }
+		}
+		c0 = pack565(r[imax], g[imax], b[imax]);
+		c1 = pack565(r[imin], g[imin], b[imin]);
+	}
+
+	// 4 color mode needs c0 > c1, 3 color + transparent mode needs c0 <= c1.
+	bool three = transparent != 0;
+	if (three ? c0 > c1 : c0 < c1)
+		swap(c0, c1);
+
+	float pr[4], pg[4], pb[4];
+	pr[0] = expand565(c0, 11, 5); pg[0] = expand565(c0, 5, 6); pb[0] = expand565(c0, 0, 5);
+	pr[1] = expand565(c1, 11, 5); pg[1] = expand565(c1, 5, 6); pb[1] = expand565(c1, 0, 5);
+	if (three)
+	{
+		pr[2] = (pr[0] + pr[1]) / 2; pg[2] = (pg[0] + pg[1]) / 2; pb[2] = (pb[0] + pb[1]) / 2;
+		pr[3] = pg[3] = pb[3] = 1e9f;		// never the nearest - transparent pixels are set below
+	}
+	else
+	{
+		pr[2] = (2 * pr[0] + pr[1]) / 3; pg[2] = (2 * pg[0] + pg[1]) / 3; pb[2] = (2 * pb[0] + pb[1]) / 3;
+		pr[3] = (pr[0] + 2 * pr[1]) / 3; pg[3] = (pg[0] + 2 * pg[1]) / 3; pb[3] = (pb[0] + 2 * pb[1]) / 3;
+	}
+
+	unsigned int idx = 0;
+	if (c0 != c1 || three)
+	for (int i = 0; i < 16; ++i)
+	{
+		int best = 0;
+		float best_d = 1e30f;
+		for (int k = 0; k < 4; ++k)
+		{
+			float d = (r[i] - pr[k]) * (r[i] - pr[k]) + (g[i] - pg[k]) * (g[i] - pg[k]) + (b[i] - pb[k]) * (b[i] - pb[k]);
+			if (d < best_d) { best_d = d; best = k; }
+		}
+		if (!use[i]) best = 3;
+		idx |= best << (2 * i);
+	}
+
+	out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+	out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+	out[4] = idx & 0xFF; out[5] = (idx >> 8) & 0xFF; out[6] = (idx >> 16) & 0xFF; out[7] = idx >> 24;
+}
+
+static void fast_alpha_block(const unsigned char px[64], unsigned char * out)
+{
+	int a0 = 0, a1 = 255;
+	for (int i = 0; i < 16; ++i)
+	{
+		a0 = max(a0, (int) px[4*i+3]);
+		a1 = min(a1, (int) px[4*i+3]);
+	}
+
+	// 8 alpha mode: 0 = a0, 1 = a1, 2..7 = 6/7 a0 + 1/7 a1 ... 1/7 a0 + 6/7 a1.
+	int pal[8] = { a0, a1 };
+	for (int k = 2; k < 8; ++k)
+		pal[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+
+	unsigned long long idx = 0;
+	if (a0 != a1)
+	for (int i = 0; i < 16; ++i)
+	{
+		int a = px[4*i+3], best = 0, best_d = 256;
+		for (int k = 0; k < 8; ++k)
+		{
+			int d = abs(a - pal[k]);
+			if (d < best_d) { best_d = d; best = k; }
+		}
+		idx |= (unsigned long long) best << (3 * i);
+	}
+	out[0] = a0;
+	out[1] = a1;
+	for (int i = 0; i < 6; ++i)
+		out[2 + i] = (idx >> (8 * i)) & 0xFF;
+}
+
+// Same contract as squish::CompressImage for kDxt1 and kDxt5: RGBA in, blocks out, partial edge blocks allowed.
+static void fast_compress_image(const unsigned char * rgba, int width, int height, void * blocks, bool dxt5)
+{
+	unsigned char * dst = (unsigned char *) blocks;
+	unsigned char px[64];
+	for (int y = 0; y < height; y += 4)
+	for (int x = 0; x < width; x += 4)
+	{
+		// Clamp at the edges - repeating real pixels doesn't change the fit.
+		for (int py = 0; py < 4; ++py)
+		for (int px_ = 0; px_ < 4; ++px_)
+		{
+			int sx = min(x + px_, width - 1), sy = min(y + py, height - 1);
+			memcpy(px + 4 * (4 * py + px_), rgba + 4 * (width * sy + sx), 4);
+		}
+		if (dxt5)
+		{
+			fast_alpha_block(px, dst);
+			fast_color_block(px, false, dst + 8);
+			dst += 16;
+		}
+		else
+		{
+			fast_color_block(px, true, dst);
+			dst += 8;
+		}
+	}
+}
+
+int	WriteBitmapToDDS(struct ImageInfo& ioImage, int dxt, const char * file_name, int use_win_gamma, int encoder)
 {
 	Assert(ioImage.channels == 4);//Your number of channels better equal 4 or else
 	FILE * fi = fopen(file_name,"wb");
@@ -1686,7 +1946,10 @@ int	WriteBitmapToDDS(struct ImageInfo& ioImage, int dxt, const char * file_name,
 		// Get the image into RGBA upper left origin, that's what Squish/DXT/DDS wants.
 		swap_bgra_y(img);
 
-		squish::CompressImage(img.data, img.width, img.height, dst_mem, flags|squish::kColourIterativeClusterFit);
+		if (encoder == dds_encode_fast && dxt != 3)
+			fast_compress_image(img.data, img.width, img.height, dst_mem, dxt == 5);
+		else
+			squish::CompressImage(img.data, img.width, img.height, dst_mem, flags|squish::kColourIterativeClusterFit);
 		int len = squish::GetStorageRequirements(img.width,img.height,flags);
 		fwrite(dst_mem,len,1,fi);
 #if !WED
@@ -1818,7 +2081,112 @@ namespace squish {
 }
 
 
-int	WriteBitmapToDDS_MT(struct ImageInfo& ioImage, int BCtype, const char * file_name, mip_func_t mip_filter)
+/* DXT compression worker pool. The threads are created on first use and then live for the rest of the process, so
+   converting a folder of textures doesn't pay thread startup per file. Callers queue a batch of jobs and then help
+   run queued jobs until their own batch is done - so several threads can compress different files at once. */
+
+class dds_worker_pool {
+public:
+	struct batch {
+		batch() : pending(0) { }
+		int		pending;
+	};
+
+	static dds_worker_pool& get(void)
+	{
+		static dds_worker_pool * pool = new dds_worker_pool;	// never deleted - the threads just idle until exit
+		return *pool;
+	}
+
+	void	add(batch& b, function<void()> job)
+	{
+		{
+			lock_guard<mutex> lock(mLock);
+			++b.pending;
+			mJobs.push_back(make_pair(&b, job));
+		}
+		mJobCond.notify_one();
+	}
+
+	void	wait(batch& b)
+	{
+		unique_lock<mutex> lock(mLock);
+		while (b.pending > 0)
+		{
+			if (mJobs.empty())
+				mDoneCond.wait(lock);
+			else
+				run_one(lock);
+		}
+	}
+
+private:
+
+	dds_worker_pool()
+	{
+		int n = intlim(thread::hardware_concurrency(), 1, 32) - 1;	// the waiting caller is the last worker
+		for (int i = 0; i < n; ++i)
+			thread(&dds_worker_pool::worker, this).detach();
+	}
+
+	void	worker(void)
+	{
+		unique_lock<mutex> lock(mLock);
+		while (1)
+		{
+			while (mJobs.empty())
+				mJobCond.wait(lock);
+			run_one(lock);
+		}
+	}
+
+	void	run_one(unique_lock<mutex>& lock)
+	{
+		pair<batch *, function<void()> > job = mJobs.front();
+		mJobs.pop_front();
+		lock.unlock();
+		job.second();
+		lock.lock();
+		if (--job.first->pending == 0)
+			mDoneCond.notify_all();
+	}
+
+	mutex										mLock;
+	condition_variable							mJobCond;
+	condition_variable							mDoneCond;
+	deque<pair<batch *, function<void()> > >	mJobs;
+};
+
+/* Every 4x4 block compresses independently, so each mip level is cut into bands of whole block rows that go to the
+   pool as separate jobs. Each band writes only its own slice of the output, so the file is byte-identical no matter
+   how the bands get scheduled. The full-size level is queued first and compresses while we build the mipmaps. */
+
+#define DDS_BAND_PIXELS (256 * 256)
+
+static void queue_dds_level(dds_worker_pool::batch& b, const ImageInfo& level, unsigned char * dst, int BCtype, int flags, int encoder)
+{
+	int block_rows = (level.height + 3) / 4;
+	int rows_per_band = max(1, min(block_rows, DDS_BAND_PIXELS / (int) (4 * level.width)));
+	for (int by = 0; by < block_rows; by += rows_per_band)
+	{
+		int y = by * 4;
+		int h = min(rows_per_band * 4, (int) level.height - y);
+		const unsigned char * src = level.data + y * level.width * 4;
+		unsigned char * out = dst + squish::GetStorageRequirements(level.width, y, flags);
+		int w = level.width;
+		bool fast = encoder == dds_encode_fast && (BCtype == 1 || BCtype == 3);
+		dds_worker_pool::get().add(b, [=]() {
+			if (fast)
+				fast_compress_image(src, w, h, out, BCtype == 3);
+			else if (BCtype < 4)
+				squish::CompressImage(src, w, h, out, flags);
+			else
+				squish::CompressImageBC45(src, w, h, out, BCtype == 5);
+		});
+	}
+}
+
+int	WriteBitmapToDDS_MT(struct ImageInfo& ioImage, int BCtype, const char * file_name, mip_func_t mip_filter, int encoder)
 {
 	Assert(ioImage.channels == 4);    // this only accepts BGRA bitmaps
 	swap_bgra_y(ioImage);             // do this early - so we won't have to do it for all the mipmaps again
@@ -1826,35 +2194,14 @@ int	WriteBitmapToDDS_MT(struct ImageInfo& ioImage, int BCtype, const char * file
 	FILE * fi = fopen(file_name,"wb");
 	if (fi == NULL) return -1;
 
-/* The very simply parallel processing of the full resolution texture scales to ~(3+1) threads, only. As the
-   remaining mipmap levels all together use ~1/3 as many pixels as the full resolution texture. Otherwise the
-   full texture gets done haead of the mipmaps == no faster overall. */
-
-	#define MAX_WORKER_THREADS 3
-	thread threads[MAX_WORKER_THREADS];
-
-	/* don't waste thread startup time parallelizing so much for small textures, libsquish runs at 1+ Mpixels/sec */
-	int num_threads = (ioImage.height * ioImage.width >= 256 * 256) ? MAX_WORKER_THREADS : 1;
-
 	int flags = ((BCtype == 1 || BCtype == 4) ? squish::kDxt1 : (BCtype == 2 ? squish::kDxt3 : squish::kDxt5)) | squish::kColourIterativeClusterFit;
 	void* dst_mem = malloc(squish::GetStorageRequirements(ioImage.width, ioImage.height, flags) * 3 / 2);
 	auto dst_ptr = (unsigned char*) dst_mem;
 
-	int start_line = 0;
-	for (int i = 0; i < num_threads; i++)
-	{
-		int height =  i < num_threads -1 ? ((ioImage.height / num_threads) >> 2) << 2 : ioImage.height - start_line;
-		auto data = ioImage.data + start_line * ioImage.width * 4;
-
-		if(BCtype < 4)
-			threads[i] = thread(squish::CompressImage, data, ioImage.width, height, dst_ptr, flags);
-		else
-			threads[i] = thread(squish::CompressImageBC45, data, ioImage.width, height, dst_ptr, BCtype == 5);
+	dds_worker_pool::batch	batch;
+	queue_dds_level(batch, ioImage, dst_ptr, BCtype, flags, encoder);
+	dst_ptr += squish::GetStorageRequirements(ioImage.width, ioImage.height, flags);
 
-		start_line += height;
-		dst_ptr += squish::GetStorageRequirements(ioImage.width, height, flags);
-	}
-	
 	// scale down the mipmaps using sRGB gamma 
 	
 	ImageInfo ioMips(ioImage);
@@ -1868,10 +2215,7 @@ int	WriteBitmapToDDS_MT(struct ImageInfo& ioImage, int BCtype, const char * file
 	{
 		if (mip_filter)
 			copy_mip_with_filter(src, ioMips, mips, mip_filter);
-		if (BCtype < 4)
-			squish::CompressImage(ioMips.data, ioMips.width, ioMips.height, dst_ptr, flags);
-		else
-			squish::CompressImageBC45(ioMips.data, ioMips.width, ioMips.height, dst_ptr, BCtype == 5);
+		queue_dds_level(batch, ioMips, dst_ptr, BCtype, flags, encoder);
 		src = ioMips;
 		dst_ptr += squish::GetStorageRequirements(ioMips.width, ioMips.height, flags);
 		++mips;
@@ -1881,8 +2225,7 @@ int	WriteBitmapToDDS_MT(struct ImageInfo& ioImage, int BCtype, const char * file
 	TEX_dds_desc header(ioImage.width, ioImage.height, mips, BCtype);
 	fwrite(&header,sizeof(header), 1, fi);
 	
-	for (int i = 0; i < num_threads; i++)
-		threads[i].join();
+	dds_worker_pool::get().wait(batch);
 
 	fwrite(dst_mem, dst_ptr - (unsigned char *) dst_mem, 1, fi);
 	free(dst_mem);
@@ -2207,3 +2550,255 @@ int AdvanceMipmapStack(struct ImageInfo * ioImage)
 	return 1;
 }
 
+
+#if UNIT_TEST
+// Mipmap and DDS writer test.  The two box filters build 2x2 mip levels with row kernels - checks they give the same
+// bytes as calling the filter per sample, for 1 to 4 channels and padded rows.  WriteBitmapToDDS_MT cuts every mip
+// level into bands and compresses them on the shared worker pool - checks the files it writes are byte-identical to
+// compressing each level in one piece on the calling thread, also when several files are written at once.  Times both.
+
+#include <chrono>
+
+static void test_image(ImageInfo& img, int w, int h, int seed)
+{
+	CreateNewBitmap(w, h, 4, &img);
+	unsigned r = seed;
+	for (int y = 0; y < h; ++y)
+	for (int x = 0; x < w; ++x)
+	{
+		unsigned char * p = img.data + 4 * (y * w + x);
+		r = r * 1103515245u + 12345u;
+		p[0] = x * 255 / w;
+		p[1] = y * 255 / h;
+		p[2] = (x + y) * 4 + (r >> 28);
+		p[3] = (r >> 16) & 0xFF;
+	}
+}
+
+static void copy_image(const ImageInfo& src, ImageInfo& dst)
+{
+	CreateNewBitmap(src.width, src.height, src.channels, &dst);
+	memcpy(dst.data, src.data, src.width * src.height * src.channels);
+}
+
+// The reference: all of each level in one compressor call, in order, no pool.
+static vector<unsigned char> dds_one_piece(const ImageInfo& in, int BCtype, mip_func_t mip_filter, int encoder)
+{
+	ImageInfo img;
+	copy_image(in, img);
+	swap_bgra_y(img);
+	int flags = ((BCtype == 1 || BCtype == 4) ? squish::kDxt1 : (BCtype == 2 ? squish::kDxt3 : squish::kDxt5)) | squish::kColourIterativeClusterFit;
+	bool fast = encoder == dds_encode_fast && (BCtype == 1 || BCtype == 3);
+
+	vector<unsigned char> blocks;
+	vector<unsigned char> mip_mem(img.width * img.height * 2);
+	ImageInfo level(img), src(img);
+	int mips = 0;
+	do
+	{
+		if (mips)
+			copy_mip_with_filter(src, level, mips, mip_filter);
+		size_t at = blocks.size();
+		blocks.resize(at + squish::GetStorageRequirements(level.width, level.height, flags));
+		if (fast)
+			fast_compress_image(level.data, level.width, level.height, &blocks[at], BCtype == 3);
+		else if (BCtype < 4)
+			squish::CompressImage(level.data, level.width, level.height, &blocks[at], flags);
+		else
+			squish::CompressImageBC45(level.data, level.width, level.height, &blocks[at], BCtype == 5);
+		src = level;
+		if (!mips++)
+			level.data = &mip_mem[0];
+		else
+			level.data += level.width * level.height * 4;
+		if (level.width > 1) level.width >>= 1;
+		if (level.height > 1) level.height >>= 1;
+	}
+	while (src.width > 1 || src.height > 1);
+
+	TEX_dds_desc header(img.width, img.height, mips, BCtype);
+	vector<unsigned char> file((unsigned char *) &header, (unsigned char *) &header + sizeof(header));
+	file.insert(file.end(), blocks.begin(), blocks.end());
+	DestroyBitmap(&img);
+	return file;
+}
+
+static vector<unsigned char> dds_banded(const ImageInfo& in, int BCtype, mip_func_t mip_filter, int encoder, const string& path)
+{
+	ImageInfo img;
+	copy_image(in, img);
+	WriteBitmapToDDS_MT(img, BCtype, path.c_str(), mip_filter, encoder);
+	DestroyBitmap(&img);
+	string s;
+	FILE_read_file_to_string(path, s);
+	FILE_delete_file(path.c_str(), false);
+	return vector<unsigned char>(s.begin(), s.end());
+}
+
+static double seconds_since(chrono::high_resolution_clock::time_point t0)
+{
+	chrono::duration<double> elapsed = chrono::high_resolution_clock::now() - t0;
+	return elapsed.count();
+}
+
+// copy_mip_with_filter only knows the stock box filters by address - going through these gets the per-sample path.
+static unsigned char per_sample_box(unsigned char src[], int count, int chan, int level)            { return mip_filter_box(src, count, chan, level); }
+static unsigned char per_sample_box_with_gamma(unsigned char src[], int count, int chan, int level) { return mip_filter_box_with_gamma(src, count, chan, level); }
+
+static bool check_mip_kernels(void)
+{
+	for (int gamma = 0; gamma < 2; ++gamma)
+	for (int ch = 1; ch <= 4; ++ch)
+	for (int pad = 0; pad < 4; pad += 3)
+	{
+		mip_func_t fast = gamma ? mip_filter_box_with_gamma : mip_filter_box;
+		mip_func_t slow = gamma ? per_sample_box_with_gamma : per_sample_box;
+		int w = 2 * 67, h = 2 * 33;
+		vector<unsigned char> src_mem((w * ch + pad) * h);
+		unsigned r = 17 * ch + pad;
+		for (auto& b : src_mem)
+			b = (r = r * 1103515245u + 12345u) >> 24;
+
+		ImageInfo src = { &src_mem[0], w, h, pad, (short) ch };
+		ImageInfo dst[2];
+		vector<unsigned char> dst_mem[2];
+		for (int k = 0; k < 2; ++k)
+		{
+			dst_mem[k].assign((w / 2 * ch + pad) * h / 2, 0xAA);		// the pad bytes must stay untouched, too
+			dst[k] = src;
+			dst[k].data = &dst_mem[k][0];
+			dst[k].width /= 2;
+			dst[k].height /= 2;
+			copy_mip_with_filter(src, dst[k], 1, k ? fast : slow);
+		}
+		if (dst_mem[0] != dst_mem[1])
+		{
+			printf("FAIL: %s, %d channels, pad %d: row kernel differs from per sample filter\n", gamma ? "box with gamma" : "box", ch, pad);
+			return false;
+		}
+	}
+
+	// Whole stacks, including the 2x1 and 1x2 levels at the end of a non-square image.
+	for (int ch = 1; ch <= 4; ++ch)
+	for (int gamma = 0; gamma < 2; ++gamma)
+	{
+		ImageInfo img[2];
+		for (int k = 0; k < 2; ++k)
+		{
+			CreateNewBitmap(64, 512, ch, &img[k]);
+			unsigned r = ch;
+			for (int i = 0; i < 64 * 512 * ch; ++i)
+				img[k].data[i] = (r = r * 1103515245u + 12345u) >> 24;
+			MakeMipmapStackWithFilter(&img[k], k ? (gamma ? mip_filter_box_with_gamma : mip_filter_box) : (gamma ? per_sample_box_with_gamma : per_sample_box));
+		}
+		int bytes = 0;
+		for (int x = 64, y = 512; ; x = max(1, x / 2), y = max(1, y / 2))
+		{
+			bytes += x * y * ch;
+			if (x == 1 && y == 1) break;
+		}
+		bool same = memcmp(img[0].data, img[1].data, bytes) == 0;
+		DestroyBitmap(&img[0]);
+		DestroyBitmap(&img[1]);
+		if (!same)
+		{
+			printf("FAIL: %s, %d channels: mipmap stack differs from per sample filter\n", gamma ? "box with gamma" : "box", ch);
+			return false;
+		}
+	}
+	return true;
+}
+
+//	usage: [size of the image to time]
+int main(int argc, const char * argv[])
+{
+	int bench_size = argc > 1 ? atoi(argv[1]) : 2048;
+
+	if (!check_mip_kernels())
+		return 1;
+
+	char dir[] = "/tmp/bitmap_utils_XXXXXX";
+	if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+	string base = string(dir) + "/";
+
+	struct { int w, h, bc, enc; mip_func_t filter; } cases[] = {
+		{ 1024, 1024, 1, dds_encode_best, mip_filter_box_with_gamma },
+		{ 2048,  256, 3, dds_encode_best, mip_filter_box_with_gamma },
+		{  128, 4096, 5, dds_encode_best, mip_filter_box },
+		{  512,  512, 4, dds_encode_best, mip_filter_box },
+		{ 1024,  512, 1, dds_encode_fast, mip_filter_box_with_gamma },
+		{  512, 1024, 3, dds_encode_fast, mip_filter_box },
+		{   64,   16, 3, dds_encode_best, mip_filter_box_with_gamma } };
+
+	int n = 0;
+	for (auto& c : cases)
+	{
+		ImageInfo img;
+		test_image(img, c.w, c.h, ++n);
+		if (dds_banded(img, c.bc, c.filter, c.enc, base + "t.dds") != dds_one_piece(img, c.bc, c.filter, c.enc))
+		{
+			printf("FAIL: %dx%d BC%d encoder %d differs from compressing each level in one piece\n", c.w, c.h, c.bc, c.enc);
+			return 1;
+		}
+		DestroyBitmap(&img);
+	}
+
+	// Several files at once - each caller waits for its own batch while helping with everyone's.
+	const int num_files = 6;
+	ImageInfo imgs[num_files];
+	vector<unsigned char> want[num_files], got[num_files];
+	for (int i = 0; i < num_files; ++i)
+	{
+		test_image(imgs[i], 1024 >> (i % 3), 512, 100 + i);
+		want[i] = dds_one_piece(imgs[i], i % 2 ? 3 : 1, mip_filter_box_with_gamma, dds_encode_best);
+	}
+	vector<thread> writers;
+	for (int i = 0; i < num_files; ++i)
+		writers.push_back(thread([&, i]() {
+			got[i] = dds_banded(imgs[i], i % 2 ? 3 : 1, mip_filter_box_with_gamma, dds_encode_best, base + to_string(i) + ".dds"); }));
+	for (auto& w : writers)
+		w.join();
+	for (int i = 0; i < num_files; ++i)
+	{
+		if (got[i] != want[i])
+		{
+			printf("FAIL: file %d of %d written at the same time differs\n", i, num_files);
+			return 1;
+		}
+		DestroyBitmap(&imgs[i]);
+	}
+
+	for (int gamma = 0; gamma < 2; ++gamma)
+	{
+		double secs[2];
+		for (int k = 0; k < 2; ++k)
+		{
+			ImageInfo img;
+			test_image(img, bench_size, bench_size, 7);
+			auto t0 = chrono::high_resolution_clock::now();
+			MakeMipmapStackWithFilter(&img, k ? (gamma ? mip_filter_box_with_gamma : mip_filter_box) : (gamma ? per_sample_box_with_gamma : per_sample_box));
+			secs[k] = seconds_since(t0);
+			DestroyBitmap(&img);
+		}
+		printf("%dx%d mipmaps, %s: per sample %.3lf s, row kernel %.3lf s\n", bench_size, bench_size, gamma ? "box with gamma" : "box", secs[0], secs[1]);
+	}
+
+	ImageInfo img;
+	test_image(img, bench_size, bench_size, 42);
+	for (int bc = 1; bc <= 3; bc += 2)
+	{
+		auto t0 = chrono::high_resolution_clock::now();
+		dds_one_piece(img, bc, mip_filter_box_with_gamma, dds_encode_best);
+		double one_piece = seconds_since(t0);
+		t0 = chrono::high_resolution_clock::now();
+		dds_banded(img, bc, mip_filter_box_with_gamma, dds_encode_best, base + "t.dds");
+		double banded = seconds_since(t0);
+		printf("%dx%d DXT%d: one piece %.3lf s, worker pool %.3lf s\n", bench_size, bench_size, bc == 1 ? 1 : 5, one_piece, banded);
+	}
+	DestroyBitmap(&img);
+
+	FILE_delete_dir_recursive(base);
+	printf("PASS\n");
+	return 0;
+}
+#endif
@@ -213,17 +213,22 @@ int		WriteBitmapToFile(const struct ImageInfo * inImage, const char * inFilePath
 /* Given an imageInfo structure, this routine writes it to disk as a .png file.  Image is tagged with gamma, or 0.0f to leave untagged. */
 int		WriteBitmapToPNG(const struct ImageInfo * inImage, const char * inFilePath, char * inPalette, int inPaletteLen, float gamma);
 
+/* DXT1/DXT5 block encoders for the DDS writers below. dds_encode_best (the default) is libsquish's iterative
+ * cluster fit. dds_encode_fast is a simple range fit that is many times faster but a bit blurrier - for
+ * preview and test builds. DXT3, BC4 and BC5 always use the best encoder. */
+enum { dds_encode_best, dds_encode_fast };
+
 /* This routine writes a 4 channel bitmap as a mip-mapped DXT1, DXT3 or DXT5 image.
  * NOTE: if you compile with PHONE then DDS are written upside down (lower left origin
  * instead of upper-left).  This is an optimization for the iphone, which can then
  * pass the data DIRECTLY to OpenGL. */
-int	WriteBitmapToDDS(struct ImageInfo& ioImage, int dxt, const char * file_name, int use_win_gamma);
+int	WriteBitmapToDDS(struct ImageInfo& ioImage, int dxt, const char * file_name, int use_win_gamma, int encoder = dds_encode_best);
 
 /* similar, but capable of multi-threaded compression and BC1-BC5 formats. Gamma corrected mipmap generation done within, if filter given */
 typedef unsigned char (*mip_func_t) (unsigned char src[], int count, int channel, int level);
 		unsigned char mip_filter_box(unsigned char src[], int count, int chan, int level);
 		unsigned char mip_filter_box_with_gamma(unsigned char src[], int count, int chan, int level);
-		int	WriteBitmapToDDS_MT(struct ImageInfo& ioImage, int BC_type, const char* file_name, mip_func_t filter = nullptr);
+		int	WriteBitmapToDDS_MT(struct ImageInfo& ioImage, int BC_type, const char* file_name, mip_func_t filter = nullptr, int encoder = dds_encode_best);
 
 /* This routine writes a 1 to 4 channel bitmap as a mip-mapped, uncompressed L, LA, RGB or RGBA image. */
 int	WriteUncompressedToDDS(struct ImageInfo& ioImage, const char * file_name, int use_win_gamma);
@@ -584,6 +584,22 @@ int FILE_delete_dir_recursive(const string& path)
 }
 
 #if WED	
+static void zip_time_now(tm_zip& d)
+{
+	time_t		t;			
+	time(&t);
+	struct tm * our_time = localtime(&t);
+	if(our_time)
+	{
+		d.tm_sec  = our_time->tm_sec ;
+		d.tm_min  = our_time->tm_min ;
+		d.tm_hour = our_time->tm_hour;
+		d.tm_mday = our_time->tm_mday;
+		d.tm_mon  = our_time->tm_mon ;
+		d.tm_year = our_time->tm_year + 1900;
+	}
+}
+
 static int compress_one_file(zipFile archive, const string& src, const string& dst)
 {
 	FILE * srcf = fopen(src.c_str(),"rb");
@@ -593,19 +609,7 @@ static int compress_one_file(zipFile archive, const string& src, const string& d
 	zip_fileinfo	fi = { 0 };
 	//http://unix.stackexchange.com/questions/14705/the-zip-formats-external-file-attribute
 	fi.external_fa = 0100777 << 16;
-
-	time_t		t;			
-	time(&t);
-	struct tm * our_time = localtime(&t);
-	if(our_time)
-	{
-		fi.tmz_date.tm_sec  = our_time->tm_sec ;
-		fi.tmz_date.tm_min  = our_time->tm_min ;
-		fi.tmz_date.tm_hour = our_time->tm_hour;
-		fi.tmz_date.tm_mday = our_time->tm_mday;
-		fi.tmz_date.tm_mon  = our_time->tm_mon ;
-		fi.tmz_date.tm_year = our_time->tm_year + 1900;
-	}
+	zip_time_now(fi.tmz_date);
 
 	int r = zipOpenNewFileInZip (archive,dst.c_str(),
 		&fi,		// mod dates, etc??
@@ -645,8 +649,155 @@ static int compress_one_file(zipFile archive, const string& src, const string& d
 	r = zipCloseFileInZip(archive);
 	return r;
 }
+
+// In-memory zip archive.  This writes exactly the bytes minizip's zip.c would write for the same
+// files (same headers, same deflate settings, no data descriptors) so the two paths are interchangeable,
+// but never touches the disk and never re-reads the archive.
+
+struct zip_mem_archive {
+	vector<char>&	out;
+	vector<char>	central_dir;
+	int				count;
+	
+	zip_mem_archive(vector<char>& o) : out(o), count(0) { }
+};
+
+static void zip_put(vector<char>& v, unsigned long x, int bytes)
+{
+	for(int n = 0; n < bytes; ++n, x >>= 8)
+		v.push_back((char) (x & 0xFF));
+}
+
+static void zip_put_at(vector<char>& v, size_t pos, unsigned long x, int bytes)
+{
+	for(int n = 0; n < bytes; ++n, x >>= 8)
+		v[pos + n] = (char) (x & 0xFF);
+}
+
+// Same as zip.c's ziplocal_TmzDateToDosDate
+static unsigned long zip_dos_date(const tm_zip& d)
+{
+	unsigned long year = d.tm_year;
+	if (year > 1980)
+		year -= 1980;
+	else if (year > 80)
+		year -= 80;
+	return ((d.tm_mday + 32 * (d.tm_mon + 1) + 512 * year) << 16) |
+		(d.tm_sec / 2 + 32 * d.tm_min + 2048 * (unsigned long) d.tm_hour);
+}
+
+static int compress_one_file(zip_mem_archive& archive, const string& src, const string& dst)
+{
+	FILE * srcf = fopen(src.c_str(),"rb");
+	if(!srcf)
+		return errno;
+
+	tm_zip	tmz = { 0 };
+	zip_time_now(tmz);
+	unsigned long dos_date = zip_dos_date(tmz);
+	unsigned long flag = 0;			// what zip.c sets for Z_DEFAULT_COMPRESSION
+
+	vector<char>& out(archive.out);
+	size_t local_header = out.size();
+	
+	zip_put(out, 0x04034b50, 4);
+	zip_put(out, 20, 2);			// version needed to extract
+	zip_put(out, flag, 2);
+	zip_put(out, Z_DEFLATED, 2);
+	zip_put(out, dos_date, 4);
+	zip_put(out, 0, 4);				// crc, sizes - patched below
+	zip_put(out, 0, 4);
+	zip_put(out, 0, 4);
+	zip_put(out, dst.size(), 2);
+	zip_put(out, 0, 2);				// no extra field
+	out.insert(out.end(), dst.begin(), dst.end());
+
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	int r = deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, MAX_MEM_LEVEL, 0);
+	if(r != Z_OK)
+	{
+		fclose(srcf);
+		return r;
+	}
+	
+	fseek(srcf, 0, SEEK_END);
+	long src_len = ftell(srcf);
+	fseek(srcf, 0, SEEK_SET);
+	if(src_len > 0)
+		out.reserve(out.size() + deflateBound(&zs, src_len) + 46 + dst.size());
+
+	unsigned long crc = crc32(0L, Z_NULL, 0);
+	vector<char> buf(65536);
+	size_t used = out.size();
+	int flush = Z_NO_FLUSH;
+	
+	while(r == Z_OK)
+	{
+		if(flush == Z_NO_FLUSH && zs.avail_in == 0)
+		{
+			size_t rd = fread(buf.data(), 1, buf.size(), srcf);
+			crc = crc32(crc, (const Bytef *) buf.data(), rd);
+			zs.next_in = (Bytef *) buf.data();
+			zs.avail_in = rd;
+			if(rd == 0)
+			{
+				if(ferror(srcf))
+					r = errno;
+				flush = Z_FINISH;
+			}
+		}
+		if(r != Z_OK)
+			break;
+		
+		if(out.size() - used < 16384)
+			out.resize(max(out.capacity(), used + 16384));
+		zs.next_out = (Bytef *) out.data() + used;
+		zs.avail_out = out.size() - used;
+		r = deflate(&zs, flush);
+		used = (char *) zs.next_out - out.data();
+		if(r == Z_BUF_ERROR && flush == Z_NO_FLUSH)	// consumed everything we had, feed more
+			r = Z_OK;
+	}
+	out.resize(used);
+	fclose(srcf);
+	deflateEnd(&zs);
+
+	if(r != Z_STREAM_END)
+	{
+		out.resize(local_header);
+		return r;
+	}
+	
+	zip_put_at(out, local_header + 14, crc, 4);
+	zip_put_at(out, local_header + 18, zs.total_out, 4);
+	zip_put_at(out, local_header + 22, zs.total_in, 4);
+	
+	vector<char>& cd(archive.central_dir);
+	zip_put(cd, 0x02014b50, 4);
+	zip_put(cd, 0, 2);				// version made by, zip.c's VERSIONMADEBY
+	zip_put(cd, 20, 2);
+	zip_put(cd, flag, 2);
+	zip_put(cd, Z_DEFLATED, 2);
+	zip_put(cd, dos_date, 4);
+	zip_put(cd, crc, 4);
+	zip_put(cd, zs.total_out, 4);
+	zip_put(cd, zs.total_in, 4);
+	zip_put(cd, dst.size(), 2);
+	zip_put(cd, 0, 2);				// extra field
+	zip_put(cd, 0, 2);				// comment
+	zip_put(cd, 0, 2);				// disk number
+	zip_put(cd, 0, 2);				// internal attributes
+	zip_put(cd, 0100777 << 16, 4);	// external attributes, same as above
+	zip_put(cd, local_header, 4);
+	cd.insert(cd.end(), dst.begin(), dst.end());
+	++archive.count;
+
+	return 0;
+}
 				
-static int compress_recursive(zipFile archive, const string& dir, const string& prefix)
+template <class Archive>
+static int compress_recursive(Archive& archive, const string& dir, const string& prefix)
 {	
 	vector<string> files ,dirs;
 	int r = FILE_get_directory(dir, &files,&dirs);
@@ -685,4 +836,82 @@ int FILE_compress_dir(const string& src_path, const string& dst_path, const stri
 	return r;
 	
 }
+
+int FILE_compress_dir(const string& src_path, vector<char>& out_zip, const string& prefix)
+{
+	out_zip.clear();
+	zip_mem_archive archive(out_zip);
+	
+	int r = compress_recursive(archive, src_path, prefix);
+	
+	size_t cd_pos = out_zip.size();
+	out_zip.insert(out_zip.end(), archive.central_dir.begin(), archive.central_dir.end());
+	zip_put(out_zip, 0x06054b50, 4);
+	zip_put(out_zip, 0, 2);			// disk numbers
+	zip_put(out_zip, 0, 2);
+	zip_put(out_zip, archive.count, 2);
+	zip_put(out_zip, archive.count, 2);
+	zip_put(out_zip, archive.central_dir.size(), 4);
+	zip_put(out_zip, cd_pos, 4);
+	zip_put(out_zip, 0, 2);			// no global comment
+
+	return r;
+}
 #endif // WED
+
+#if WED && UNIT_TEST
+#include <chrono>
+
+// Zips a folder through minizip to disk and reads it back (what the gateway export used to do), then zips it into memory.
+// The two archives must be identical - they are stamped with the current time, so retry if the clock ticked in between.
+int main(int argc, const char * argv[])
+{
+	if(argc < 2)
+	{
+		printf("usage: %s <folder> [prefix]\n", argv[0]);
+		return 1;
+	}
+	string src(argv[1]);
+	if(src.back() != DIR_CHAR)
+		src += DIR_STR;
+	string prefix(argc > 2 ? argv[2] : "");
+	string tmp_zip = src.substr(0, src.size() - 1) + ".bench.zip";
+
+	for(int tries = 0; tries < 3; ++tries)
+	{
+		auto t0 = chrono::steady_clock::now();
+		if(FILE_compress_dir(src, tmp_zip, prefix) != 0)
+		{
+			printf("disk zip failed\n");
+			return 1;
+		}
+		vector<char> disk_zip;
+		FILE * fi = fopen(tmp_zip.c_str(), "rb");
+		char buf[3];
+		int rd;
+		while((rd = fread(buf, 1, 3, fi)) > 0)
+			disk_zip.insert(disk_zip.end(), buf, buf + rd);
+		fclose(fi);
+		FILE_delete_file(tmp_zip.c_str(), false);
+
+		auto t1 = chrono::steady_clock::now();
+		vector<char> mem_zip;
+		if(FILE_compress_dir(src, mem_zip, prefix) != 0)
+		{
+			printf("memory zip failed\n");
+			return 1;
+		}
+		auto t2 = chrono::steady_clock::now();
+
+		printf("disk zip + read back: %8.1f ms\n", chrono::duration<double, milli>(t1 - t0).count());
+		printf("memory zip:           %8.1f ms\n", chrono::duration<double, milli>(t2 - t1).count());
+		if(disk_zip == mem_zip)
+		{
+			printf("%zu bytes, identical\n", mem_zip.size());
+			return 0;
+		}
+		printf("zips differ (%zu vs %zu bytes), retrying\n", disk_zip.size(), mem_zip.size());
+	}
+	return 1;
+}
+#endif
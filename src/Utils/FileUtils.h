@@ -63,6 +63,7 @@ int FILE_case_correct(char * buf);
 	read_file_to_string         | read a (non-binary) file to a string          | N/A                 | 0, last_error
 	rename_file                 | rename 1 file                                 | N/A                 | 0, last_error
 	compress_dir                | zip compress folder, save zip to disk         | No                  | 0, not zero (see zlib)
+	                            | or to memory, byte for byte the same zip      |                     |
 	get_directory               | get dir's content's paths*                    | No                  | num files found?**, -1 or last_error
 	get_directory_recursive     | get dir and sub dir's files and folders       | No                  | num files found?**, -1 or last_error 
 	make_dir                    | make directory, assumes parent folders exist  | No                  | 0, last_error
@@ -121,6 +122,7 @@ int FILE_get_directory(const string& path, vector<string> * out_files, vector<st
 int FILE_get_directory_recursive(const string& path, vector<string>& out_files, vector<string>& out_dirs);
 
 int FILE_compress_dir(const string& src_path, const string& dst_path, const string& prefix);
+int FILE_compress_dir(const string& src_path, vector<char>& out_zip, const string& prefix);
 
 enum date_cmpr_result_t
 {
@@ -124,6 +124,74 @@ void UnpadImage(ImageInfo * im)
 	im->pad = 0;
 }
 
+/*****************************************************************************************
+ * Shared by LoadTextureFromImage and UploadDecodedTexture
+ *****************************************************************************************/
+static void choose_tex_format(unsigned char * data, long pixel_count, int channels, int flags, int& iformat, int& glformat)
+{
+	if (channels == 1)
+	{
+		iformat = glformat = GL_ALPHA;
+	}
+	else if(gl_info.has_bgra)
+	{
+		                            iformat = GL_RGB;  glformat = GL_BGR;
+		if (channels == 4)  { iformat = GL_RGBA; glformat = GL_BGRA; }
+	}
+	else
+	{
+		long cnt = pixel_count;
+		unsigned char * p = data;
+		while (cnt--)
+		{
+			swap(p[0], p[2]);						// Ben says: since we get BGR or BGRA, swap red and blue channesl to make RGB or RGBA.  Some day we could
+			p += channels;							// use our brains and use GL_BGR_EXT and GL_BGRA_EXT; literally all GL cards from Radeon/GeForce on support this.
+			}
+													// Michael says: that day was the last day of 2018. Eight years, 4 months and EXA bytes swapped by CPUs later.
+													// But, its just a drop into the ocean: ALL images except BMP are channel order swapped when loading in BitmapUtils,
+													// the real architectural misfortune was choosing the ImageInfo data format to be BGR rather than RGB.
+													
+						   iformat = glformat = GL_RGB;
+		if (channels == 4) iformat = glformat = GL_RGBA;
+	}
+
+	if(gl_info.has_tex_compression && (flags & tex_Compress_Ok))
+	{
+		switch (iformat) {
+		case GL_RGB:	iformat = GL_COMPRESSED_RGB;	break;
+		case GL_RGBA:	iformat = GL_COMPRESSED_RGBA;	break;
+		}
+	}
+}
+
+static void set_tex_params(int flags)
+{
+	// BAS note: for some reason on my WinXP system with GF-FX, if
+	// I do not set these explicitly to linear, I get no drawing at all.
+	// Who knows what default state the card is in. :-(
+//	if(flags & tex_Nearest)
+//	{
+//		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+//		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+//	} else 
+	if (flags & tex_Linear) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (flags & tex_Mipmap) ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR);
+	} else {
+		// If we have nearest-neighboring and we are down-sampling WITHOUT a mip-map we STILL use linear in an attempt to keep this thing from looking TOTALY blitzed, I guess?
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (flags & tex_Mipmap) ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR);
+	}
+	if(flags & tex_Wrap) {
+		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_REPEAT );
+	    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_REPEAT );
+	}
+	else {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+}
+
 /*****************************************************************************************
  * LoadTextureFromFile
  *****************************************************************************************/
@@ -210,72 +278,184 @@ bool LoadTextureFromImage(ImageInfo& im, int inTexNum, int inFlags, int * outWid
 	glBindTexture(GL_TEXTURE_2D, inTexNum);  CHECK_GL_ERR
 	
 	int	iformat, glformat;
-	if (useIt->channels == 1)
-	{
-		iformat = glformat = GL_ALPHA;
-	}
-	else if(gl_info.has_bgra)
-	{
-		                            iformat = GL_RGB;  glformat = GL_BGR;
-		if (useIt->channels == 4) { iformat = GL_RGBA; glformat = GL_BGRA; }
-	}
+	choose_tex_format(useIt->data, (long) useIt->width * useIt->height, useIt->channels, inFlags, iformat, glformat);
+
+	if (inFlags & tex_Mipmap)
+		gluBuild2DMipmaps(GL_TEXTURE_2D, iformat, useIt->width, useIt->height, glformat, GL_UNSIGNED_BYTE, useIt->data); CHECK_GL_ERR
 	else
+		glTexImage2D(GL_TEXTURE_2D, 0, iformat, useIt->width ,useIt->height, 0,	glformat, GL_UNSIGNED_BYTE, useIt->data); CHECK_GL_ERR
+
+	if (resize)
+		DestroyBitmap(&rescaleBits);
+
+	set_tex_params(inFlags);
+	return true;
+}
+
+/*****************************************************************************************
+ * DecodeTextureFromFile - no GL in here, this runs on worker threads
+ *****************************************************************************************/
+static int next_pow2(int a, int max_dim)
+{
+	int rval = 2;
+	while(rval < a && rval < max_dim)
+		rval <<= 1;
+	return rval;
+}
+
+bool DecodeTextureFromFile(const char * inFileName, int inFlags, int inMaxSize, bool inAllowRaw, TexDecoded& outTex)
+{
+	outTex = TexDecoded();
+	outTex.flags = inFlags;
+
+#if LOAD_DDS_DIRECT || LOAD_KTX2_DIRECT
+	if (inAllowRaw)
 	{
-		long cnt = useIt->width * useIt->height;
-		unsigned char * p = useIt->data;
-		while (cnt--)
+		FILE * fi = fopen(inFileName, "rb");
+		if (!fi) return false;
+		char c[8];
+		bool raw = fread(c, 1, 8, fi) == 8 && (strncmp(c, "DDS ", 4) == 0
+#if LOAD_KTX2_DIRECT
+											|| strncmp(c, "\253KTX 20\273", 8) == 0
+#endif
+											);
+		if (raw)
 		{
-			swap(p[0], p[2]);						// Ben says: since we get BGR or BGRA, swap red and blue channesl to make RGB or RGBA.  Some day we could
-			p += useIt->channels;					// use our brains and use GL_BGR_EXT and GL_BGRA_EXT; literally all GL cards from Radeon/GeForce on support this.
-			}
-													// Michael says: that day was the last day of 2018. Eight years, 4 months and EXA bytes swapped by CPUs later.
-													// But, its just a drop into the ocean: ALL images except BMP are channel order swapped when loading in BitmapUtils,
-													// the real architectural misfortune was choosing the ImageInfo data format to be BGR rather than RGB.
-													
-								  iformat = glformat = GL_RGB;
-		if (useIt->channels == 4) iformat = glformat = GL_RGBA;
+			fseek(fi, 0, SEEK_END);
+			long len = ftell(fi);
+			fseek(fi, 0, SEEK_SET);
+			outTex.raw.resize(len);
+			raw = len > 0 && fread(outTex.raw.data(), 1, len, fi) == len;
+		}
+		fclose(fi);
+		if (raw)
+		{
+			outTex.is_raw = true;
+			return true;
+		}
+		outTex.raw.clear();
 	}
+#endif
+
+	ImageInfo im = { 0 };
+	if (LoadBitmapFromAnyFile(inFileName, &im) != 0)
+		return false;
+
+	if (inFlags & tex_MagentaAlpha)	ConvertBitmapToAlpha(&im, true);
+	if (im.pad != 0)
+		UnpadImage(&im);
 
-	if(gl_info.has_tex_compression && (inFlags & tex_Compress_Ok))
+	// Same sizing rules as LoadTextureFromImage, except that all GL 3.0 cards do non-pots. Mipmapped textures are
+	// scaled up to a power of 2, just like gluBuild2DMipmaps did, since the box filter wants even sizes all the way down.
+	bool	non_pots = (inFlags & (tex_Always_Pad | tex_Mipmap)) == 0;
+	int		res_x = non_pots ? min((int) im.width, inMaxSize) : next_pow2(im.width, inMaxSize);
+	int		res_y = non_pots ? min((int) im.height,inMaxSize) : next_pow2(im.height, inMaxSize);
+	bool	resize = (res_x != im.width || res_y != im.height);
+	bool	rescale = resize && (inFlags & (tex_Rescale | tex_Mipmap));
+	if (im.width > res_x || im.height > res_y)
+		rescale = true;
+
+	ImageInfo * useIt = &im;
+	ImageInfo	rescaleBits;
+	if (resize)
 	{
-		switch (iformat) {
-		case GL_RGB:	iformat = GL_COMPRESSED_RGB;	break;
-		case GL_RGBA:	iformat = GL_COMPRESSED_RGBA;	break;
+		if (CreateNewBitmap(res_x, res_y, im.channels, &rescaleBits) != 0)
+		{
+			DestroyBitmap(&im);
+			return false;
 		}
-	}
+		useIt = &rescaleBits;
 
-	if (inFlags & tex_Mipmap)
-		gluBuild2DMipmaps(GL_TEXTURE_2D, iformat, useIt->width, useIt->height, glformat, GL_UNSIGNED_BYTE, useIt->data); CHECK_GL_ERR
-	else
-		glTexImage2D(GL_TEXTURE_2D, 0, iformat, useIt->width ,useIt->height, 0,	glformat, GL_UNSIGNED_BYTE, useIt->data); CHECK_GL_ERR
+		if (rescale)
+			CopyBitmapSection(&im, &rescaleBits, 0, 0, im.width, im.height, 0, 0, rescaleBits.width, rescaleBits.height);
+		else
+		{
+			CopyBitmapSectionDirect(im, rescaleBits, 0, 0, 0, 0, im.width, im.height);
+			if (im.width < rescaleBits.width)
+				CopyBitmapSectionDirect(im, rescaleBits, im.width-1, 0, im.width, 0, 1, im.height);
+			if (im.height < rescaleBits.height)
+				CopyBitmapSectionDirect(im, rescaleBits, 0, im.height-1, 0, im.height, im.width, 1);
+			if (im.height < rescaleBits.height && im.width < rescaleBits.width)
+				CopyBitmapSectionDirect(im, rescaleBits, im.width-1, im.height-1, im.width, im.height, 1, 1);
 
-	if (resize)
-		DestroyBitmap(&rescaleBits);
+			outTex.s = (float) im.width / (float) rescaleBits.width;
+			outTex.t = (float) im.height / (float) rescaleBits.height;
+		}
+		DestroyBitmap(&im);
+	}
 
-	// BAS note: for some reason on my WinXP system with GF-FX, if
-	// I do not set these explicitly to linear, I get no drawing at all.
-	// Who knows what default state the card is in. :-(
-//	if(inFlags & tex_Nearest)
-//	{
-//		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-//		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-//	} else 
-	if (inFlags & tex_Linear) {
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (inFlags & tex_Mipmap) ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR);
-	} else {
-		// If we have nearest-neighboring and we are down-sampling WITHOUT a mip-map we STILL use linear in an attempt to keep this thing from looking TOTALY blitzed, I guess?
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (inFlags & tex_Mipmap) ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR);
+	outTex.width = useIt->width;
+	outTex.height = useIt->height;
+	outTex.channels = useIt->channels;
+	outTex.mips = (inFlags & tex_Mipmap) ? MakeMipmapStack(useIt) : 1;
+
+	size_t bytes = 0;
+	for (int l = 0, x = outTex.width, y = outTex.height; l < outTex.mips; ++l)
+	{
+		bytes += (size_t) x * y * outTex.channels;
+		if (x > 1) x >>= 1;
+		if (y > 1) y >>= 1;
 	}
-	if(inFlags & tex_Wrap) {
-		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_REPEAT );
-	    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_REPEAT );
+	outTex.pixels.assign(useIt->data, useIt->data + bytes);
+	DestroyBitmap(useIt);
+	return true;
+}
+
+/*****************************************************************************************
+ * UploadDecodedTexture
+ *****************************************************************************************/
+bool UploadDecodedTexture(TexDecoded& ioTex, int inTexNum, int * outWidth, int * outHeight, float * outS, float * outT)
+{
+	INIT_GL_INFO
+
+	if (ioTex.is_raw)
+	{
+#if LOAD_DDS_DIRECT || LOAD_KTX2_DIRECT
+		char * mem_start = ioTex.raw.data();
+		char * mem_end = mem_start + ioTex.raw.size();
+		int siz_x, siz_y;
+		bool ok = false;
+		if (strncmp(mem_start, "DDS ", 4) == 0)
+			ok = LoadTextureFromDDS(mem_start, mem_end, inTexNum, ioTex.flags, &siz_x, &siz_y);
+#if LOAD_KTX2_DIRECT
+		else
+			ok = LoadTextureFromKTX2(mem_start, mem_end, inTexNum, ioTex.flags, &siz_x, &siz_y);
+#endif
+		if (!ok) return false;
+		if (outWidth) *outWidth = siz_x;
+		if (outHeight) *outHeight = siz_y;
+		if (outS) *outS = 1.0;
+		if (outT) *outT = 1.0;
+		return true;
+#else
+		return false;
+#endif
 	}
-	else {
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	if (ioTex.pixels.empty())
+		return false;
+
+	glBindTexture(GL_TEXTURE_2D, inTexNum);  CHECK_GL_ERR
+
+	int	iformat, glformat;
+	choose_tex_format(ioTex.pixels.data(), ioTex.pixels.size() / ioTex.channels, ioTex.channels, ioTex.flags, iformat, glformat);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);		// the small mips of RGB images are not 4-byte aligned
+	unsigned char * p = ioTex.pixels.data();
+	for (int l = 0, x = ioTex.width, y = ioTex.height; l < ioTex.mips; ++l)
+	{
+		glTexImage2D(GL_TEXTURE_2D, l, iformat, x, y, 0, glformat, GL_UNSIGNED_BYTE, p); CHECK_GL_ERR
+		p += x * y * ioTex.channels;
+		if (x > 1) x >>= 1;
+		if (y > 1) y >>= 1;
 	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	if (outWidth) *outWidth = ioTex.width;
+	if (outHeight) *outHeight = ioTex.height;
+	if (outS) *outS = ioTex.s;
+	if (outT) *outT = ioTex.t;
+
+	set_tex_params(ioTex.flags);
 	return true;
 }
 
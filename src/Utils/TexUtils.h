@@ -34,7 +34,8 @@ enum {
 	tex_Rescale			=	16,	// Rescale to use whole tex
 //	tex_Nearest			=	32,	// Use nearest-neighbor - appears to be legacy that this is explicit?
 	tex_Compress_Ok		=	64,	// Allow driver-driven texture compression
-	tex_Always_Pad		=	128	// Force pad up to pow2 even if we have non-pots card.  Needed for UI
+	tex_Always_Pad		=	128,// Force pad up to pow2 even if we have non-pots card.  Needed for UI
+	tex_Stream			=	256	// Texture manager may decode in the background, tex ID is 0 until the texture is uploaded
 
 };
 
@@ -56,6 +57,38 @@ bool LoadTextureFromImage(
 				float *			outS,
 				float *			outT);
 
+/* Texture loading split in two halves: DecodeTextureFromFile does the file IO, decoding, padding and mipmap
+ * generation into main memory. It does not touch GL, so it can run on any thread. UploadDecodedTexture then
+ * hands the result to GL and needs the GL context. inMaxSize is the GL_MAX_TEXTURE_SIZE of that context.
+ * DDS and KTX2 files are kept as-is and uploaded without decompression unless inAllowRaw is false. */
+struct	TexDecoded {
+	int						flags = 0;
+	bool					is_raw = false;		// raw is a DDS or KTX2 file image
+	vector<char>			raw;
+	int						width = 0;			// of the base level, after padding
+	int						height = 0;
+	int						channels = 0;
+	int						mips = 0;			// levels in pixels, base level first, tightly packed
+	float					s = 1.0f;
+	float					t = 1.0f;
+	vector<unsigned char>	pixels;
+};
+
+bool DecodeTextureFromFile(
+				const char * 	inFileName,
+				int				inFlags,
+				int				inMaxSize,
+				bool			inAllowRaw,
+				TexDecoded&		outTex);
+
+bool UploadDecodedTexture(
+				TexDecoded& 	ioTex,
+				int 			inTexNum,
+				int * 			outWidth,
+				int * 			outHeight,
+				float *			outS,
+				float *			outT);
+
 bool LoadTextureFromDDS(
 				char *			mem_start,
 				char *			mem_end,
@@ -32,7 +32,10 @@
 #include "WED_Application.h"
 #include "WED_Document.h"
 #include "FileUtils.h"
+#include "PlatformUtils.h"
+#include "XObjReadWrite.h"
 #include "WED_FileCache.h"
+#include "WED_Globals.h"
 #include "WED_Menus.h"
 #include "WED_PackageMgr.h"
 #include "WED_StartWindow.h"
@@ -234,7 +237,11 @@ int main(int argc, char * argv[])
 	pMgr.SetRecentName(GUI_GetPrefString("packages","Recent",""));
 
 	start->ShowMessage("Initializing WED File Cache");
-	gFileCache.init();
+	gFileCache.init((long long) gFileCacheMB * 1024 * 1024);
+
+	string obj_cache = GetCacheFolder();           // once, before any document's resource loader threads read OBJs
+	if(!obj_cache.empty())
+		XObj8SetCacheFolder((obj_cache + DIR_STR "wed_obj_cache").c_str(), (long long) gObjCacheMB * 1024 * 1024);
 
 	start->ShowMessage("Loading ENUM system...");
 	WED_AssertInit();
@@ -31,6 +31,7 @@
 #include "WED_Errors.h"
 #include "WED_XMLWriter.h"
 #include "WED_Messages.h"
+#include "IODefs.h"
 
 WED_Archive::WED_Archive(IResolver * r) : mResolver(r), mDying(false), mUndo(NULL), mUndoMgr(NULL),
  #if WITHNWLINK
@@ -134,6 +135,62 @@ void			WED_Archive::SaveToXML(WED_XMLElement * parent)
 
 	mOpCount = 0;
 }
+void			WED_Archive::SaveToBinary(IOWriter * writer)
+{
+	int ct = 0;
+	for (ObjectMap::iterator ob = mObjects.begin(); ob != mObjects.end(); ++ob)
+		if(ob->second != NULL)
+			++ct;
+
+	writer->WriteInt(ct);
+	for (ObjectMap::iterator ob = mObjects.begin(); ob != mObjects.end(); ++ob)
+	if(ob->second != NULL)
+	{
+		const char * cls = ob->second->GetClass();
+		int len = strlen(cls);
+		writer->WriteInt(len);
+		writer->WriteBulk(cls, len, false);
+		writer->WriteInt(ob->first);
+		ob->second->WriteTo(writer);
+	}
+
+	mOpCount = 0;
+}
+
+void			WED_Archive::LoadFromBinary(IOReader * reader)
+{
+	// Same sequence as the undo system re-creating destroyed objects: construct by class, stream in
+	// the state, then do the post-change notifications once all peers exist.
+	vector<WED_Persistent *>	needs_post_call;
+	int ct;
+	reader->ReadInt(ct);
+	needs_post_call.reserve(ct);
+
+	char cls[256];
+	while(ct-- > 0)
+	{
+		int len, id;
+		reader->ReadInt(len);
+		if(len <= 0 || len >= sizeof(cls))
+			WED_ThrowPrintf("Bad class name length %d in binary snapshot.", len);
+		reader->ReadBulk(cls, len, false);
+		cls[len] = 0;
+		reader->ReadInt(id);
+
+		WED_Persistent * new_obj = WED_Persistent::CreateByClass(cls, this, id);
+		if(new_obj == NULL)
+			WED_ThrowPrintf("Unknown class %s in binary snapshot.", cls);
+		if(new_obj->ReadFrom(reader))
+			needs_post_call.push_back(new_obj);
+	}
+
+	for(vector<WED_Persistent *>::iterator o = needs_post_call.begin(); o != needs_post_call.end(); ++o)
+		(*o)->PostChangeNotify();
+
+	mOpCount = 0;
+	++mCacheKey;
+}
+
 #if WITHNWLINK
 void			WED_Archive::SetNWLinkAdapter(WED_NWLinkAdapter * inAdapter)
 {
@@ -248,3 +305,337 @@ void		WED_Archive::PopHandler(void)
 	mOpCount = 0;
 	++mCacheKey;
 }
+
+#if UNIT_TEST
+// Round trip of a made-up airport and some scenery through the XML file and through the binary stream of the snapshot.
+// Every editable property of every object gets a random value.  The archive read back from the XML must write out the
+// very same XML as the original, the archive read from the binary stream the very same bytes - and the two must agree.
+//	usage: <scratch XML file>
+
+#include "WED_Thing.h"
+#include "WED_EnumSystem.h"
+#include "IGIS.h"
+#include "PerfUtils.h"
+
+#define TEST_CLASSES \
+	_R(WED_Group) _R(WED_Airport) _R(WED_Runway) _R(WED_RunwayNode) _R(WED_Taxiway) _R(WED_Ring) _R(WED_AirportNode) \
+	_R(WED_AirportChain) _R(WED_Helipad) _R(WED_Windsock) _R(WED_AirportBeacon) _R(WED_AirportSign) _R(WED_LightFixture) \
+	_R(WED_TowerViewpoint) _R(WED_RampPosition) _R(WED_ObjPlacement) _R(WED_ATCFrequency) _R(WED_ATCFlow) \
+	_R(WED_ATCRunwayUse) _R(WED_ATCWindRule) _R(WED_ATCTimeRule) _R(WED_TaxiRoute) _R(WED_TaxiRouteNode) \
+	_R(WED_TruckParkingLocation) _R(WED_TruckDestination) _R(WED_ForestPlacement) _R(WED_ForestRing) \
+	_R(WED_SimpleBoundaryNode) _R(WED_FacadePlacement) _R(WED_FacadeRing) _R(WED_FacadeNode) _R(WED_LinePlacement) \
+	_R(WED_SimpleBezierBoundaryNode) _R(WED_DrapedOrthophoto) _R(WED_TextureBezierNode) _R(WED_ExclusionZone)
+
+#define _R(x)	extern void x##_Register();
+TEST_CLASSES
+#undef _R
+
+class	WED_TestBufWriter : public IOWriter {
+public:
+	WED_TestBufWriter(vector<char>& buf) : mBuf(buf) { }
+
+	virtual	void	WriteShort(short v)		{ Write(&v, sizeof(v)); }
+	virtual	void	WriteInt(int v)			{ Write(&v, sizeof(v)); }
+	virtual	void	WriteFloat(float v)		{ Write(&v, sizeof(v)); }
+	virtual	void	WriteDouble(double v)	{ Write(&v, sizeof(v)); }
+	virtual	void	WriteBulk(const char * inBuf, int inLength, bool inZip) { Write(inBuf, inLength); }
+
+private:
+	void	Write(const void * p, int len) { mBuf.insert(mBuf.end(), (const char *) p, (const char *) p + len); }
+
+	vector<char>&	mBuf;
+};
+
+class	WED_TestBufReader : public IOReader {
+public:
+	WED_TestBufReader(const vector<char>& buf) : mPtr(buf.data()), mEnd(buf.data() + buf.size()) { }
+
+	virtual	void	ReadShort(short& v)		{ Read(&v, sizeof(v)); }
+	virtual	void	ReadInt(int& v)			{ Read(&v, sizeof(v)); }
+	virtual	void	ReadFloat(float& v)		{ Read(&v, sizeof(v)); }
+	virtual	void	ReadDouble(double& v)	{ Read(&v, sizeof(v)); }
+	virtual	void	ReadBulk(char * inBuf, int inLength, bool inZip) { Read(inBuf, inLength); }
+
+private:
+	void	Read(void * p, int len)
+	{
+		if(len < 0 || len > mEnd - mPtr)
+			WED_ThrowMessage("Binary stream is truncated.");
+		memcpy(p, mPtr, len);
+		mPtr += len;
+	}
+
+	const char *	mPtr;
+	const char *	mEnd;
+};
+
+// What WED_Document does for the <objects> element
+class	WED_TestDocHandler : public WED_XMLHandler {
+public:
+	WED_TestDocHandler(WED_Archive * a) : mArchive(a) { }
+	virtual void	StartElement(WED_XMLReader * reader, const XML_Char * name, const XML_Char ** atts)
+	{
+		if(strcmp(name,"objects")==0)
+			reader->PushHandler(mArchive);
+	}
+	virtual	void	EndElement(void) { }
+	virtual	void	PopHandler(void) { }
+private:
+	WED_Archive *	mArchive;
+};
+
+static double test_rand(double lo, double hi) { return lo + (hi - lo) * rand() / (double) RAND_MAX; }
+
+static void test_fill(WED_Thing * t, int n)
+{
+	t->SetName(string(t->GetClass()) + " " + to_string(n));
+
+	IGISPoint * pt = dynamic_cast<IGISPoint *>(t);
+	if(pt)
+	{
+		Point2 ll(test_rand(-71.1, -71.0), test_rand(42.3, 42.4));
+		pt->SetLocation(gis_Geo, ll);
+		if(pt->HasLayer(gis_UV))
+			pt->SetLocation(gis_UV, Point2(test_rand(0, 1), test_rand(0, 1)));
+		IGISPoint_Bezier * bez = dynamic_cast<IGISPoint_Bezier *>(t);
+		if(bez && rand() % 2)
+			bez->SetControlHandleHi(gis_Geo, ll + Vector2(test_rand(-1e-4, 1e-4), test_rand(-1e-4, 1e-4)));
+		IGISPoint_Heading * hdg = dynamic_cast<IGISPoint_Heading *>(t);
+		if(hdg)
+			hdg->SetHeading(test_rand(0, 360));
+		IGISPoint_WidthLength * wl = dynamic_cast<IGISPoint_WidthLength *>(t);
+		if(wl)
+		{
+			wl->SetWidth(test_rand(10, 50));
+			wl->SetLength(test_rand(10, 50));
+		}
+	}
+
+	for(int p = 0; p < t->CountProperties(); ++p)
+	{
+		PropertyInfo_t info;
+		PropertyVal_t val;
+		t->GetNthPropertyInfo(p, info);
+		if(!info.can_edit || info.synthetic || info.prop_name == ".")
+			continue;
+		t->GetNthProperty(p, val);
+		vector<int> members;
+		switch(info.prop_kind) {
+		case prop_Int:		val.int_val = rand() % 1000;										break;
+		case prop_Double:	val.double_val = test_rand(0, 100);									break;
+		case prop_String:	val.string_val = "text " + to_string(rand() % 1000);				break;
+		case prop_FilePath:	val.string_val = "lib/test_" + to_string(rand() % 10) + ".obj";	break;
+		case prop_Bool:		val.int_val = rand() % 2;											break;
+		case prop_Enum:
+		case prop_EnumSet:
+			DOMAIN_Members(info.domain, members);
+			if(members.empty())
+				continue;
+			val.int_val = members[rand() % members.size()];
+			val.set_val.clear();
+			val.set_val.insert(val.int_val);
+			if(info.prop_kind == prop_EnumSet && !info.exclusive)
+				val.set_val.insert(members[rand() % members.size()]);
+			break;
+		default:
+			continue;
+		}
+		t->SetNthProperty(p, val);
+	}
+}
+
+// The XML of every object, in ID order - the archive writes them in hash order.
+static vector<string> test_xml(WED_Archive& a, const char * path)
+{
+	vector<string> ret;
+	FILE * fi = fopen(path, "w");
+	if(!fi) return ret;
+	{
+		WED_XMLElement top("doc", 0, fi);
+		a.SaveToXML(&top);
+	}
+	fclose(fi);
+	string xml;
+	fi = fopen(path, "rb");
+	char buf[65536];
+	int len;
+	while((len = fread(buf, 1, sizeof(buf), fi)) > 0)
+		xml.append(buf, len);
+	fclose(fi);
+
+	map<int, string> objs;
+	string::size_type p = xml.find("<object ");
+	while(p != string::npos)
+	{
+		string::size_type e = xml.find("<object ", p + 1);
+		string obj(xml, p, e == string::npos ? string::npos : e - p);
+		obj.erase(obj.rfind("</object>") + 9);
+		objs[atoi(obj.c_str() + obj.find(" id=\"") + 5)] = obj;
+		p = e;
+	}
+	for(auto& o : objs)
+		ret.push_back(o.second);
+	return ret;
+}
+
+// The binary stream of every object, in ID order
+static vector<vector<char> > test_bin(WED_Archive& a, const vector<WED_Thing *>& ids)
+{
+	vector<vector<char> > ret;
+	for(auto t : ids)
+	{
+		WED_Persistent * p = a.Fetch(t->GetID());
+		ret.push_back(vector<char>());
+		if(p)
+		{
+			WED_TestBufWriter w(ret.back());
+			w.WriteBulk(p->GetClass(), strlen(p->GetClass()), false);
+			p->WriteTo(&w);
+		}
+	}
+	return ret;
+}
+
+int main(int argc, const char * argv[])
+{
+	const char * path = argc > 1 ? argv[1] : "wed_archive_test.xml";
+
+	ENUM_Init();
+	#define _R(x)	x##_Register();
+	TEST_CLASSES
+	#undef _R
+
+	// Class, parent (index into this table), copies
+	struct { const char * cls; int parent; int count; } layout[] = {
+		{ "WED_Group", -1, 1 },							// 0
+		{ "WED_Airport", 0, 1 },						// 1
+		{ "WED_Runway", 1, 1 },							// 2
+		{ "WED_Taxiway", 1, 1 },						// 3
+		{ "WED_Ring", 3, 1 },							// 4
+		{ "WED_AirportNode", 4, 8 },					// 5
+		{ "WED_AirportChain", 1, 1 },					// 6
+		{ "WED_AirportNode", 6, 5 },					// 7
+		{ "WED_ATCFlow", 1, 1 },						// 8
+		{ "WED_ATCRunwayUse", 8, 2 },					// 9
+		{ "WED_ATCWindRule", 8, 1 },					// 10
+		{ "WED_ATCTimeRule", 8, 1 },					// 11
+		{ "WED_TaxiRouteNode", 1, 2 },					// 12
+		{ "WED_TaxiRoute", 1, 1 },						// 13
+		{ "WED_ForestPlacement", 0, 1 },				// 14
+		{ "WED_ForestRing", 14, 1 },					// 15
+		{ "WED_SimpleBoundaryNode", 15, 4 },			// 16
+		{ "WED_FacadePlacement", 0, 1 },				// 17
+		{ "WED_FacadeRing", 17, 1 },					// 18
+		{ "WED_FacadeNode", 18, 4 },					// 19
+		{ "WED_LinePlacement", 0, 1 },					// 20
+		{ "WED_SimpleBezierBoundaryNode", 20, 3 },		// 21
+		{ "WED_DrapedOrthophoto", 0, 1 },				// 22
+		{ "WED_Ring", 22, 1 },							// 23
+		{ "WED_TextureBezierNode", 23, 4 },				// 24
+		{ "WED_RunwayNode", 2, 2 },						// 25
+		{ "WED_Helipad", 1, 2 },
+		{ "WED_Windsock", 1, 2 },
+		{ "WED_AirportBeacon", 1, 1 },
+		{ "WED_AirportSign", 1, 3 },
+		{ "WED_LightFixture", 1, 3 },
+		{ "WED_TowerViewpoint", 1, 1 },
+		{ "WED_RampPosition", 1, 4 },
+		{ "WED_ObjPlacement", 1, 4 },
+		{ "WED_ATCFrequency", 1, 3 },
+		{ "WED_TruckParkingLocation", 1, 2 },
+		{ "WED_TruckDestination", 1, 2 },
+		{ "WED_ExclusionZone", 0, 1 }
+	};
+
+	WED_Archive orig(NULL);
+	orig.SetUndo(UNDO_DISCARD);
+	srand(1);
+	vector<WED_Thing *> made;
+	vector<int> first;
+	for(auto& l : layout)
+	{
+		first.push_back(made.size());
+		for(int n = 0; n < l.count; ++n)
+		{
+			WED_Thing * t = dynamic_cast<WED_Thing *>(WED_Persistent::CreateByClass(l.cls, &orig, orig.NewID()));
+			if(t == NULL)
+			{
+				printf("Could not create a %s.\n", l.cls);
+				return 1;
+			}
+			if(l.parent >= 0)
+				t->SetParent(made[first[l.parent]], n);
+			test_fill(t, n);
+			made.push_back(t);
+		}
+	}
+	made[first[13]]->AddSource(made[first[12]], 0);
+	made[first[13]]->AddSource(made[first[12] + 1], 1);
+	orig.SetUndo(NULL);
+
+	vector<char> bin;
+	unsigned long long t0 = query_hpc();
+	{
+		WED_TestBufWriter w(bin);
+		orig.SaveToBinary(&w);
+	}
+	double t_bin_save = hpc_to_microseconds(query_hpc() - t0);
+	t0 = query_hpc();
+	vector<string> xml = test_xml(orig, path);
+	double t_xml_save = hpc_to_microseconds(query_hpc() - t0);
+	size_t xml_bytes = 0;
+	for(auto& x : xml)
+		xml_bytes += x.size();
+
+	WED_Archive from_xml(NULL);
+	from_xml.SetUndo(UNDO_DISCARD);
+	t0 = query_hpc();
+	{
+		WED_TestDocHandler doc(&from_xml);
+		WED_XMLReader reader;
+		reader.PushHandler(&doc);
+		bool exists;
+		string err = reader.ReadFile(path, &exists);
+		if(!exists || !err.empty())
+		{
+			printf("Could not read %s back: %s\n", path, err.c_str());
+			return 1;
+		}
+	}
+	double t_xml_load = hpc_to_microseconds(query_hpc() - t0);
+	from_xml.SetUndo(NULL);
+
+	WED_Archive from_bin(NULL);
+	from_bin.SetUndo(UNDO_DISCARD);
+	t0 = query_hpc();
+	{
+		WED_TestBufReader r(bin);
+		from_bin.LoadFromBinary(&r);
+	}
+	double t_bin_load = hpc_to_microseconds(query_hpc() - t0);
+	from_bin.SetUndo(NULL);
+
+	vector<string> xml_of_xml = test_xml(from_xml, path);
+	vector<string> xml_of_bin = test_xml(from_bin, path);
+	remove(path);
+
+	if(xml.size() != made.size() || xml_of_xml != xml)
+	{
+		printf("The archive read from XML does not write the same XML.\n");
+		return 1;
+	}
+	if(test_bin(from_bin, made) != test_bin(orig, made))
+	{
+		printf("The archive read from the binary stream does not write the same stream.\n");
+		return 1;
+	}
+	if(xml_of_bin != xml_of_xml)
+	{
+		printf("The archives read from XML and from the binary stream differ.\n");
+		return 1;
+	}
+	printf("OK, %d objects: XML %d bytes, saved in %.0lf us, read in %.0lf us - binary %d bytes, saved in %.0lf us, read in %.0lf us.\n",
+		(int) made.size(), (int) xml_bytes, t_xml_save, t_xml_load, (int) bin.size(), t_bin_save, t_bin_load);
+	return 0;
+}
+#endif
@@ -51,6 +51,8 @@ class	WED_UndoLayer;
 class	WED_UndoMgr;
 class	WED_XMLElement;
 class	IResolver;
+class	IOReader;
+class	IOWriter;
 #if WITHNWLINK
 class	WED_NWLinkAdapter;
 #endif
@@ -77,6 +79,12 @@ public:
 
 	void			ClearAll(void);
 	void			SaveToXML(WED_XMLElement * parent);
+
+	// Binary snapshot of every object, using the same WriteTo/ReadFrom stream the undo system uses.
+	// The stream is only valid for the WED build that wrote it - enum values and class layouts are not
+	// stable across versions - so the XML file remains the interchange format.
+	void			SaveToBinary(IOWriter * writer);
+	void			LoadFromBinary(IOReader * reader);
 #if WITHNWLINK
 	void			SetNWLinkAdapter(WED_NWLinkAdapter * inAdapter);
 #endif
@@ -47,6 +47,9 @@
 #include "WED_ResourceMgr.h"
 #include "WED_GroupCommands.h"
 #include "WED_Version.h"
+#include "MemFileUtils.h"
+#include "IODefs.h"
+#include <zlib.h>
 
 #include "GUI_Fonts.h"
 #include "GUI_Resources.h"
@@ -66,10 +69,129 @@ int gModeratorMode;
 int gFontSize;
 string gCustomSlippyMap;
 int gOrthoExport;
+int gOrthoFastDDS;
+int gResourceCacheMB;
+int gTextureCacheMB;
+int gUndoBudgetMB;
+int gFileCacheMB;
+int gObjCacheMB;
 
 static set<WED_Document *> sDocuments;
 static map<string,string>	sGlobalPrefs;
 
+/*
+	Binary snapshots
+
+	Next to earth.wed.xml we keep earth.wed.bin - the archive streamed through the objects' WriteTo methods, plus
+	the doc prefs.  Loading it is a straight memory-mapped walk with no XML parsing or attribute formatting, so big
+	projects open much faster.  The snapshot records the size and CRC of the XML it was saved with and the WED
+	version and enum table size it was written by; if any of these don't match we ignore it and go through the
+	XML, which stays the authoritative interchange format.  Mod dates are not good enough - a copy or a sync tool
+	can keep the date of a changed file, and many file systems only store whole seconds.
+*/
+
+#define SNAPSHOT_MAGIC		"WEDB"
+#define SNAPSHOT_VERSION	2
+#define SNAPSHOT_END		0x57454445		// 'WEDE'
+
+class	WED_SnapshotWriter : public IOWriter {
+public:
+	WED_SnapshotWriter(FILE * fi) : mFile(fi), mFill(0) { }
+	~WED_SnapshotWriter() { Flush(); }
+
+	virtual	void	WriteShort(short v)		{ Write(&v, sizeof(v)); }
+	virtual	void	WriteInt(int v)			{ Write(&v, sizeof(v)); }
+	virtual	void	WriteFloat(float v)		{ Write(&v, sizeof(v)); }
+	virtual	void	WriteDouble(double v)	{ Write(&v, sizeof(v)); }
+	virtual	void	WriteBulk(const char * inBuf, int inLength, bool inZip) { Write(inBuf, inLength); }
+
+	void	Flush(void)
+	{
+		if(mFill) fwrite(mBuf, 1, mFill, mFile);
+		mFill = 0;
+	}
+
+private:
+	void	Write(const void * p, int len)
+	{
+		if(mFill + len > sizeof(mBuf))
+		{
+			Flush();
+			if(len > sizeof(mBuf))
+			{
+				fwrite(p, 1, len, mFile);
+				return;
+			}
+		}
+		memcpy(mBuf + mFill, p, len);
+		mFill += len;
+	}
+
+	FILE *	mFile;
+	int		mFill;
+	char	mBuf[65536];
+};
+
+class	WED_SnapshotReader : public IOReader {
+public:
+	WED_SnapshotReader(const char * b, const char * e) : mPtr(b), mEnd(e) { }
+
+	virtual	void	ReadShort(short& v)		{ Read(&v, sizeof(v)); }
+	virtual	void	ReadInt(int& v)			{ Read(&v, sizeof(v)); }
+	virtual	void	ReadFloat(float& v)		{ Read(&v, sizeof(v)); }
+	virtual	void	ReadDouble(double& v)	{ Read(&v, sizeof(v)); }
+	virtual	void	ReadBulk(char * inBuf, int inLength, bool inZip) { Read(inBuf, inLength); }
+
+			void	ReadString(string& s)
+	{
+		int len;
+		ReadInt(len);
+		if(len < 0 || len > mEnd - mPtr)
+			WED_ThrowMessage("Binary snapshot is truncated.");
+		s.assign(mPtr, len);
+		mPtr += len;
+	}
+
+private:
+	void	Read(void * p, int len)
+	{
+		if(len < 0 || len > mEnd - mPtr)
+			WED_ThrowMessage("Binary snapshot is truncated.");
+		memcpy(p, mPtr, len);
+		mPtr += len;
+	}
+
+	const char *	mPtr;
+	const char *	mEnd;
+};
+
+static void	snapshot_write_string(IOWriter * w, const string& s)
+{
+	w->WriteInt(s.size());
+	w->WriteBulk(s.c_str(), s.size(), false);
+}
+
+// Size and CRC32 of the XML file - what a snapshot is keyed on.  Hashing is a small fraction of what parsing the file costs.
+static bool	snapshot_xml_key(const string& xml_path, double& out_size, int& out_crc)
+{
+	MFMemFile * mf = MemFile_Open(xml_path.c_str());
+	if(mf == NULL)
+		return false;
+	const char * p = MemFile_GetBegin(mf);
+	const char * e = MemFile_GetEnd(mf);
+	uLong crc = crc32(0L, Z_NULL, 0);
+	out_size = e - p;
+	while(p < e)
+	{
+		uInt len = min<ptrdiff_t>(e - p, 1 << 30);
+		crc = crc32(crc, (const Bytef *) p, len);
+		p += len;
+	}
+	out_crc = (int) crc;
+	MemFile_Close(mf);
+	return true;
+}
+
 WED_Document::WED_Document(
 	const string& 		package,
 	double				inBounds[4]) :
@@ -302,6 +424,14 @@ void	WED_Document::Save(void)
 		// This is the save-was-okay case.
 		mOnDisk=true;
 		mPrefsChanged=false;
+
+		if(!WriteSnapshot(xml))
+			LOG_MSG("W/Doc could not write binary snapshot, next open will read XML\n");
+
+		t1 = std::chrono::high_resolution_clock::now();
+		elapsed = t1 - t0;
+		LOG_MSG("snapshot write %.3lf s\n", elapsed.count());
+		t0 = t1;
 	}
 #if 0
 	//if the second backup still exists after the error handling
@@ -335,11 +465,25 @@ void	WED_Document::Revert(void)
 		fname+=".xml";
 		mArchive.ClearAll();
 
-		// First: try to IO the XML file.
 		bool xml_exists;
-		LOG_MSG("I/Doc reading XML from %s\n", fname.c_str());
+		string result;
 
-		string result = reader.ReadFile(fname.c_str(),&xml_exists);
+		// First: try the binary snapshot - it is only used if it was written along with the XML file we have now.
+		if(ReadSnapshot(fname))
+		{
+			LOG_MSG("I/Doc read binary snapshot for %s\n", fname.c_str());
+			xml_exists = true;
+		}
+		else
+		{
+			// Then: try to IO the XML file.
+			mArchive.ClearAll();
+			mDocPrefs.clear();
+			mDocPrefsItems.clear();
+			LOG_MSG("I/Doc reading XML from %s\n", fname.c_str());
+
+			result = reader.ReadFile(fname.c_str(),&xml_exists);
+		}
 
 		for (auto sp : mDocPrefs)
 			LOG_MSG("I/Doc prefs %s = %s\n", sp.first.c_str(), sp.second.c_str());
@@ -613,6 +757,12 @@ void	WED_Document::ReadGlobalPrefs(void)
 	gFontSize = intlim(FontSize, 10, 18);
 	GUI_SetFontSizes(gFontSize);
 	gOrthoExport = atoi(GUI_GetPrefString("preferences","OrthoExport","1"));
+	gOrthoFastDDS = atoi(GUI_GetPrefString("preferences","OrthoFastDDS","0"));
+	gResourceCacheMB = max(0, atoi(GUI_GetPrefString("preferences","ResourceCacheMB","1024")));
+	gTextureCacheMB = max(0, atoi(GUI_GetPrefString("preferences","TextureCacheMB","1024")));
+	gUndoBudgetMB = max(0, atoi(GUI_GetPrefString("preferences","UndoBudgetMB","512")));
+	gFileCacheMB = max(0, atoi(GUI_GetPrefString("preferences","FileCacheMB","4096")));
+	gObjCacheMB = max(0, atoi(GUI_GetPrefString("preferences","ObjCacheMB","512")));
 }
 
 void	WED_Document::WriteGlobalPrefs(void)
@@ -623,6 +773,12 @@ void	WED_Document::WriteGlobalPrefs(void)
 	string FontSize(to_string(gFontSize));
 	GUI_SetPrefString("preferences","FontSize",FontSize.c_str());
 	GUI_SetPrefString("preferences","OrthoExport",gOrthoExport ? "1" : "0");
+	GUI_SetPrefString("preferences","OrthoFastDDS",gOrthoFastDDS ? "1" : "0");
+	GUI_SetPrefString("preferences","ResourceCacheMB",to_string(gResourceCacheMB).c_str());
+	GUI_SetPrefString("preferences","TextureCacheMB",to_string(gTextureCacheMB).c_str());
+	GUI_SetPrefString("preferences","UndoBudgetMB",to_string(gUndoBudgetMB).c_str());
+	GUI_SetPrefString("preferences","FileCacheMB",to_string(gFileCacheMB).c_str());
+	GUI_SetPrefString("preferences","ObjCacheMB",to_string(gObjCacheMB).c_str());
 
 	for (map<string,string>::iterator i = sGlobalPrefs.begin(); i != sGlobalPrefs.end(); ++i)
 		if(i->first != "doc/xml_compatibility")          // why NOT write that ? Cuz WED 2.0 ... 2.2 read that and if an PRE wed-2.0 document
@@ -748,6 +904,137 @@ bool		WED_Document::ReadPrefInternal(const char * in_key, unsigned type, string
 	return found;
 }
 
+bool		WED_Document::WriteSnapshot(const string& xml_path)
+{
+	string bin_path = mFilePath + ".bin";
+
+	double xml_size;
+	int xml_crc;
+	if(!snapshot_xml_key(xml_path, xml_size, xml_crc))
+	{
+		FILE_delete_file(bin_path.c_str(), false);
+		return false;
+	}
+
+	FILE * fi = fopen(bin_path.c_str(), "wb");
+	if(fi == NULL)
+		return false;
+	{
+		WED_SnapshotWriter w(fi);
+		w.WriteBulk(SNAPSHOT_MAGIC, 4, false);
+		w.WriteInt(SNAPSHOT_VERSION);
+		w.WriteInt(WED_VERSION_NUMERIC);
+		w.WriteInt(last_enum);
+		w.WriteDouble(xml_size);
+		w.WriteInt(xml_crc);
+
+		w.WriteInt(mDocPrefs.size());
+		for(map<string,string>::iterator p = mDocPrefs.begin(); p != mDocPrefs.end(); ++p)
+		{
+			snapshot_write_string(&w, p->first);
+			snapshot_write_string(&w, p->second);
+		}
+		w.WriteInt(mDocPrefsItems.size());
+		for(map<string,set<int> >::iterator pi = mDocPrefsItems.begin(); pi != mDocPrefsItems.end(); ++pi)
+		{
+			snapshot_write_string(&w, pi->first);
+			w.WriteInt(pi->second.size());
+			for(set<int>::iterator i = pi->second.begin(); i != pi->second.end(); ++i)
+				w.WriteInt(*i);
+		}
+
+		mArchive.SaveToBinary(&w);
+		w.WriteInt(SNAPSHOT_END);
+	}
+	int err = ferror(fi);
+	err |= fclose(fi);
+	if(err)
+	{
+		FILE_delete_file(bin_path.c_str(), false);
+		return false;
+	}
+	return true;
+}
+
+bool		WED_Document::ReadSnapshot(const string& xml_path)
+{
+	string bin_path = mFilePath + ".bin";
+
+	MFMemFile * mf = MemFile_Open(bin_path.c_str());
+	if(mf == NULL)
+		return false;
+
+	double xml_size;
+	int xml_crc;
+	if(!snapshot_xml_key(xml_path, xml_size, xml_crc))
+	{
+		MemFile_Close(mf);
+		return false;
+	}
+
+	bool ok = false;
+	try {
+		WED_SnapshotReader r(MemFile_GetBegin(mf), MemFile_GetEnd(mf));
+		char magic[4];
+		int version, wed_version = 0, enum_count = 0, snap_crc = 0;
+		double snap_size = -1;
+		r.ReadBulk(magic, 4, false);
+		r.ReadInt(version);
+		if(strncmp(magic, SNAPSHOT_MAGIC, 4) == 0 && version == SNAPSHOT_VERSION)
+		{
+			r.ReadInt(wed_version);
+			r.ReadInt(enum_count);
+			r.ReadDouble(snap_size);
+			r.ReadInt(snap_crc);
+		}
+
+		if(strncmp(magic, SNAPSHOT_MAGIC, 4) == 0 &&
+			version == SNAPSHOT_VERSION &&
+			wed_version == WED_VERSION_NUMERIC &&
+			enum_count == last_enum &&
+			snap_size == xml_size &&
+			snap_crc == xml_crc)
+		{
+			int ct;
+			string n, v;
+			r.ReadInt(ct);
+			while(ct-- > 0)
+			{
+				r.ReadString(n);
+				r.ReadString(v);
+				mDocPrefs[n] = v;
+			}
+			r.ReadInt(ct);
+			while(ct-- > 0)
+			{
+				int items, item;
+				r.ReadString(n);
+				r.ReadInt(items);
+				set<int>& ip(mDocPrefsItems[n]);
+				while(items-- > 0)
+				{
+					r.ReadInt(item);
+					ip.insert(item);
+				}
+			}
+
+			mArchive.LoadFromBinary(&r);
+
+			int end_mark;
+			r.ReadInt(end_mark);
+			ok = (end_mark == SNAPSHOT_END);
+		}
+		else
+			LOG_MSG("I/Doc binary snapshot is stale or from another WED version, ignored\n");
+	}
+	catch(exception& e) {
+		LOG_MSG("E/Doc error reading binary snapshot: %s\n", e.what());
+		ok = false;
+	}
+	MemFile_Close(mf);
+	return ok;
+}
+
 void		WED_Document::WriteXML(FILE * xml_file)
 {
 	//print to file the xml file passed in with the following encoding
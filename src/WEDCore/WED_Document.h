@@ -136,6 +136,8 @@ private:
 	bool				ReadPrefInternal(const char * in_key, unsigned type, string &out_value) const;
 
 	void				WriteXML(FILE * fi);
+	bool				WriteSnapshot(const string& xml_path);
+	bool				ReadSnapshot(const string& xml_path);
 
 	//Member Variables
 
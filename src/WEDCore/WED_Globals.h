@@ -51,6 +51,18 @@ extern int gModeratorMode;
 extern int gFontSize;
 /* Switch format for orthophoto tiles export */
 extern int gOrthoExport;
+/* Orthophoto .dds tiles use the fast DXT encoder instead of the best one - for quick test exports */
+extern int gOrthoFastDDS;
+/* Memory budget in MB for parsed OBJs held by the resource manager, 0 = unlimited */
+extern int gResourceCacheMB;
+/* Memory budget in MB for textures held by the texture manager, 0 = unlimited */
+extern int gTextureCacheMB;
+/* Memory budget in MB for the undo history of each document, 0 = only the level limit applies */
+extern int gUndoBudgetMB;
+/* Disk budget in MB for the file cache (slippy map tiles, gateway downloads), 0 = unlimited */
+extern int gFileCacheMB;
+/* Disk budget in MB for the pre-parsed OBJ cache, 0 = unlimited */
+extern int gObjCacheMB;
 
 enum WED_Export_Target {
 		wet_xplane_900,		// X-Plane 9-compatible DSFs.
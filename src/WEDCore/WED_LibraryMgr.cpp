@@ -30,6 +30,10 @@
 #include "PlatformUtils.h"
 #include "MemFileUtils.h"
 #include <time.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 void WED_clean_vpath(string& s)
 {
@@ -310,143 +314,405 @@ struct local_scan_t {
 	WED_LibraryMgr * who;
 };
 
-void		WED_LibraryMgr::Rescan()
+/*
+	Library scan cache
+
+	Parsing every library.txt and case-correcting every path in it is slow with hundreds of custom scenery packs. So the
+	result of parsing one library.txt - the list of EXPORT lines with fully resolved real paths - is kept per library file,
+	keyed by its path, size and mod date, and persisted in the cache folder so the next WED session can reuse it.
+	The real paths are case-corrected against the pack's directory listings, so each entry also remembers the mod date of
+	every directory that case correction looked at - renaming or adding an asset file changes its directory's mod date
+	and forces a re-parse, just like an edit to the library.txt itself.
+	Only stale libraries are re-parsed, and those get parsed in parallel. Everything that depends on the package order or
+	on the current date (package numbers, default-ness, PUBLIC <date> newness) is applied afterwards, in package order,
+	exactly as if the file had just been read.
+*/
+
+#define LIB_CACHE_FILE		"wed_library_cache.bin"
+#define LIB_CACHE_MAGIC		"WLIB"
+#define LIB_CACHE_VERSION	2
+
+struct lib_export_t {
+	string			vpath;
+	string			rpath;
+	int				new_until;		// for status_Public items: show as status_New until this date
+	unsigned char	status;
+	unsigned char	is_backup, is_seasonal, is_regional;
+};
+
+struct lib_cache_entry_t {
+	long long						size;
+	long long						mtime;
+	vector<lib_export_t>			exports;
+	vector<pair<string, long long> >	dirs;		// directories the rpaths were case-corrected against, with their mtime
+};
+
+typedef map<string, lib_cache_entry_t>	lib_cache_t;
+
+static lib_cache_t	sLibCache;
+static bool			sLibCacheLoaded = false;
+
+static bool lib_cache_read(FILE * fi, void * p, size_t len)
 {
-	res_table.clear();
-	int np = gPackageMgr->CountPackages();
+	return fread(p, 1, len, fi) == len;
+}
 
-	for(int p = 0; p < np; ++p)
-	{
-		if(gPackageMgr->IsDisabled(p)) continue;
-		//the physical directory of the scenery pack
-		string pack_base;
-		//Get the pack's physical location
-		gPackageMgr->GetNthPackagePath(p,pack_base);
+// Mod date in ns where the platform has it, so a rename right after the last scan is still noticed. -1 if missing.
+static long long lib_cache_mtime(const string& path)
+{
+	struct stat meta;
+	if(FILE_get_file_meta_data(path, meta) != 0) return -1;
+#if LIN
+	return meta.st_mtim.tv_sec * 1000000000LL + meta.st_mtim.tv_nsec;
+#elif APL
+	return meta.st_mtimespec.tv_sec * 1000000000LL + meta.st_mtimespec.tv_nsec;
+#else
+	return meta.st_mtime * 1000000000LL;
+#endif
+}
 
-		pack_base += DIR_STR "library.txt";
+static bool lib_cache_read_str(FILE * fi, string& s)
+{
+	int len;
+	if(!lib_cache_read(fi, &len, sizeof(len)) || len < 0 || len > 4096) return false;
+	s.resize(len);
+	return len == 0 || lib_cache_read(fi, &s[0], len);
+}
 
-		bool is_default_pack = gPackageMgr->IsPackageDefault(p);
-		bool in_region = false;
-		string all_region, current_region;
+static void lib_cache_write_str(FILE * fo, const string& s)
+{
+	int len = s.size();
+	fwrite(&len, 1, sizeof(len), fo);
+	fwrite(s.c_str(), 1, len, fo);
+}
 
-		MFMemFile * lib = MemFile_Open(pack_base.c_str());
+static string lib_cache_path(void)
+{
+	string path = GetCacheFolder();
+	if(path.empty()) return path;
+	return path + DIR_STR LIB_CACHE_FILE;
+}
 
-		if(lib)
+static void lib_cache_load(void)
+{
+	sLibCacheLoaded = true;
+	string path = lib_cache_path();
+	if(path.empty()) return;
+	FILE * fi = fopen(path.c_str(), "rb");
+	if(!fi) return;
+
+	char magic[4];
+	int version, ct;
+	bool ok = lib_cache_read(fi, magic, 4) && strncmp(magic, LIB_CACHE_MAGIC, 4) == 0 &&
+			  lib_cache_read(fi, &version, sizeof(version)) && version == LIB_CACHE_VERSION &&
+			  lib_cache_read(fi, &ct, sizeof(ct));
+	while(ok && ct-- > 0)
+	{
+		string lib_path;
+		lib_cache_entry_t e;
+		int n;
+		ok = lib_cache_read_str(fi, lib_path) && lib_cache_read(fi, &e.size, sizeof(e.size)) &&
+			 lib_cache_read(fi, &e.mtime, sizeof(e.mtime)) && lib_cache_read(fi, &n, sizeof(n)) && n >= 0;
+		if(ok) e.exports.resize(n);
+		for(int i = 0; ok && i < n; ++i)
 		{
-			gPackageMgr->GetNthPackagePath(p,pack_base);
-			MFScanner	s;
-			MFS_init(&s, lib);
+			lib_export_t& x(e.exports[i]);
+			int32_t status, flags;
+			ok = lib_cache_read_str(fi, x.vpath) && lib_cache_read_str(fi, x.rpath) &&
+				 lib_cache_read(fi, &x.new_until, sizeof(x.new_until)) &&
+				 lib_cache_read(fi, &status, sizeof(status)) && lib_cache_read(fi, &flags, sizeof(flags));
+			x.status = status;
+			x.is_backup   = (flags & 1) != 0;
+			x.is_seasonal = (flags & 2) != 0;
+			x.is_regional = (flags & 4) != 0;
+		}
+		ok = ok && lib_cache_read(fi, &n, sizeof(n)) && n >= 0;
+		if(ok) e.dirs.resize(n);
+		for(int i = 0; ok && i < n; ++i)
+			ok = lib_cache_read_str(fi, e.dirs[i].first) && lib_cache_read(fi, &e.dirs[i].second, sizeof(e.dirs[i].second));
+		if(ok) sLibCache[lib_path] = std::move(e);
+	}
+	fclose(fi);
+	if(!ok)
+	{
+		LOG_MSG("W/Lib library cache %s is damaged, ignoring it\n", path.c_str());
+		sLibCache.clear();
+	}
+}
 
-			res_status cur_status = status_Public;
-			int lib_version[] = { 800, 1200, 0 };
+static void lib_cache_save(void)
+{
+	string path = lib_cache_path();
+	if(path.empty()) return;
+	FILE * fo = fopen(path.c_str(), "wb");
+	if(!fo) return;
+
+	int version = LIB_CACHE_VERSION, ct = sLibCache.size();
+	fwrite(LIB_CACHE_MAGIC, 1, 4, fo);
+	fwrite(&version, 1, sizeof(version), fo);
+	fwrite(&ct, 1, sizeof(ct), fo);
+	for(lib_cache_t::iterator l = sLibCache.begin(); l != sLibCache.end(); ++l)
+	{
+		lib_cache_write_str(fo, l->first);
+		fwrite(&l->second.size, 1, sizeof(l->second.size), fo);
+		fwrite(&l->second.mtime, 1, sizeof(l->second.mtime), fo);
+		int n = l->second.exports.size();
+		fwrite(&n, 1, sizeof(n), fo);
+		for(vector<lib_export_t>::iterator x = l->second.exports.begin(); x != l->second.exports.end(); ++x)
+		{
+			lib_cache_write_str(fo, x->vpath);
+			lib_cache_write_str(fo, x->rpath);
+			fwrite(&x->new_until, 1, sizeof(x->new_until), fo);
+			int32_t status = x->status;
+			int32_t flags = (x->is_backup ? 1 : 0) | (x->is_seasonal ? 2 : 0) | (x->is_regional ? 4 : 0);
+			fwrite(&status, 1, sizeof(status), fo);
+			fwrite(&flags, 1, sizeof(flags), fo);
+		}
+		n = l->second.dirs.size();
+		fwrite(&n, 1, sizeof(n), fo);
+		for(vector<pair<string, long long> >::iterator d = l->second.dirs.begin(); d != l->second.dirs.end(); ++d)
+		{
+			lib_cache_write_str(fo, d->first);
+			fwrite(&d->second, 1, sizeof(d->second), fo);
+		}
+	}
+	if(ferror(fo) | fclose(fo))
+		FILE_delete_file(path.c_str(), false);
+}
+
+// Parses one library.txt. This runs on worker threads - so it must not touch the package manager or the res_table.
+static void parse_library(const string& lib_path, const string& pack_base, lib_cache_entry_t& entry)
+{
+	vector<lib_export_t>& exports(entry.exports);
+	exports.clear();
+	entry.dirs.clear();
+	MFMemFile * lib = MemFile_Open(lib_path.c_str());
+	if(!lib) return;
+
+	bool in_region = false;
+	string all_region, current_region;
 
-			if (MFS_xplane_header(&s, lib_version, "LIBRARY", NULL) == 0)
+	MFScanner	s;
+	MFS_init(&s, lib);
+
+	res_status cur_status = status_Public;
+	int cur_new_until = 0;
+	int lib_version[] = { 800, 1200, 0 };
+
+	if (MFS_xplane_header(&s, lib_version, "LIBRARY", NULL) == 0)
+	{
+		LOG_MSG("E/LIB unsupported version or header data in %s\n", pack_base.c_str());
+	}
+	else
+		while (!MFS_done(&s))
+		{
+			lib_export_t x;
+			bool is_export_backup = false;
+			bool is_season = false;
+
+			if (MFS_string_match(&s, "EXPORT", false) || 	MFS_string_match(&s, "EXPORT_EXTEND", false) ||
+					MFS_string_match(&s, "EXPORT_EXCLUDE", false) ||
+				(is_season = (MFS_string_match(&s, "EXPORT_SEASON", false) || MFS_string_match(&s, "EXPORT_EXTEND_SEASON", false) ||
+					MFS_string_match(&s, "EXPORT_EXCLUDE_SEASON", false))) ||
+				(is_export_backup = MFS_string_match(&s, "EXPORT_BACKUP", false)))
 			{
-				LOG_MSG("E/LIB unsupported version or header data in %s\n", pack_base.c_str());
-			}
-			else
-				while (!MFS_done(&s))
+				if (is_season)
 				{
-					string vpath, rpath;
-					bool is_export_backup = false;
-					bool is_season = false;
-
-					if (MFS_string_match(&s, "EXPORT", false) || 	MFS_string_match(&s, "EXPORT_EXTEND", false) ||
-							MFS_string_match(&s, "EXPORT_EXCLUDE", false) ||
-						(is_season = (MFS_string_match(&s, "EXPORT_SEASON", false) || MFS_string_match(&s, "EXPORT_EXTEND_SEASON", false) ||
-							MFS_string_match(&s, "EXPORT_EXCLUDE_SEASON", false))) ||
-						(is_export_backup = MFS_string_match(&s, "EXPORT_BACKUP", false)))
+					string season;
+					MFS_string(&s, &season);
+					if (season.find("sum") == string::npos)
 					{
-						if (is_season)
-						{
-							string season;
-							MFS_string(&s, &season);
-							if (season.find("sum") == string::npos)
-							{
-								MFS_string_eol(&s, NULL);
-								continue;
-							}
-						}
-						MFS_string(&s, &vpath);
-						MFS_string_eol(&s, &rpath);
-						WED_clean_vpath(vpath);
-						WED_clean_rpath(rpath);
-
-						if (is_no_true_subdir_path(rpath)) break; // ignore paths that lead outside current scenery directory
-						rpath = pack_base + DIR_STR + rpath;
-						FILE_case_correct((char*)rpath.c_str());  /* yeah - I know I'm overriding the 'const' protection of the c_str() here.
-						   But I know this operation is never going to change the strings length, so thats OK to do.
-						   And I have to case-correct the path right here, as this path later is not only used by the case insensitive MF_open()
-						   but also to derive the paths to the textures referenced in those assets. And those textures are loaded with case-sensitive fopen.
-						   */
-						AccumResource(vpath, p, rpath, is_default_pack, cur_status, is_export_backup, is_season, in_region);
+						MFS_string_eol(&s, NULL);
+						continue;
 					}
-					else if (MFS_string_match(&s, "EXPORT_RATIO", false))
+				}
+				MFS_string(&s, &x.vpath);
+				MFS_string_eol(&s, &x.rpath);
+				WED_clean_vpath(x.vpath);
+				WED_clean_rpath(x.rpath);
+
+				if (is_no_true_subdir_path(x.rpath)) break; // ignore paths that lead outside current scenery directory
+				x.rpath = pack_base + DIR_STR + x.rpath;
+				FILE_case_correct((char*)x.rpath.c_str());  /* yeah - I know I'm overriding the 'const' protection of the c_str() here.
+				   But I know this operation is never going to change the strings length, so thats OK to do.
+				   And I have to case-correct the path right here, as this path later is not only used by the case insensitive MF_open()
+				   but also to derive the paths to the textures referenced in those assets. And those textures are loaded with case-sensitive fopen.
+				   */
+				x.status = cur_status;
+				x.new_until = cur_new_until;
+				x.is_backup = is_export_backup;
+				x.is_seasonal = is_season;
+				x.is_regional = in_region;
+				exports.push_back(x);
+			}
+			else if (MFS_string_match(&s, "EXPORT_RATIO", false))
+			{
+				double r = MFS_double(&s);
+				MFS_string(&s, &x.vpath);
+				MFS_string_eol(&s, &x.rpath);
+				WED_clean_vpath(x.vpath);
+				WED_clean_rpath(x.rpath);
+				if (is_no_true_subdir_path(x.rpath)) break; // ignore paths that lead outside current scenery directory
+				x.rpath = pack_base + DIR_STR + x.rpath;
+				FILE_case_correct((char*)x.rpath.c_str());  // yeah - I know I'm overriding the 'const' protection of the c_str() here.
+				x.status = cur_status;
+				x.new_until = cur_new_until;
+				x.is_backup = x.is_seasonal = x.is_regional = false;
+				exports.push_back(x);
+			}
+			else
+			{
+				if (MFS_string_match(&s, "PUBLIC", true))
+				{
+					cur_status = status_Public;
+					cur_new_until = MFS_int(&s);
+				}
+				else if (MFS_string_match(&s, "PRIVATE", true))
+					cur_status = status_Private;
+				else if (MFS_string_match(&s, "DEPRECATED", true))
+					cur_status = status_Deprecated;
+				else if (MFS_string_match(&s, "SEMI_DEPRECATED", true))
+					cur_status = status_SemiDeprecated;
+				else if (MFS_string_match(&s, "REGION_DEFINE", false))
+					MFS_string(&s, &current_region);
+				else if (MFS_string_match(&s, "REGION_RECT", false))
+				{
+					int west = MFS_int(&s);
+					int south = MFS_int(&s);
+					int east = MFS_int(&s);
+					int north = MFS_int(&s);
+					if (west == -180 && east == 179 && south == -90 && north == 89)
 					{
-						double x = MFS_double(&s);
-						MFS_string(&s, &vpath);
-						MFS_string_eol(&s, &rpath);
-						WED_clean_vpath(vpath);
-						WED_clean_rpath(rpath);
-						if (is_no_true_subdir_path(rpath)) break; // ignore paths that lead outside current scenery directory
-						rpath = pack_base + DIR_STR + rpath;
-						FILE_case_correct((char*)rpath.c_str());  // yeah - I know I'm overriding the 'const' protection of the c_str() here.
-						AccumResource(vpath, p, rpath, is_default_pack, cur_status);
+						all_region = current_region;
+						LOG_MSG("I/Lib %s has global region '%s'\n", pack_base.c_str(), all_region.c_str());
 					}
-					else
-					{
-						if (MFS_string_match(&s, "PUBLIC", true))
-						{
-							cur_status = status_Public;
-
-							int new_until = 0;
-							new_until = MFS_int(&s);
-							if (new_until > 20170101)
-							{
-								time_t rawtime;
-								struct tm* timeinfo;
-								time(&rawtime);
-								timeinfo = localtime(&rawtime);
-								int now = 10000 * (timeinfo->tm_year + 1900) + 100 * timeinfo->tm_mon + timeinfo->tm_mday;
-								if (new_until >= now)
-								{
-									cur_status = status_New;
-								}
-							}
-						}
-						else if (MFS_string_match(&s, "PRIVATE", true))
-							cur_status = status_Private;
-						else if (MFS_string_match(&s, "DEPRECATED", true))
-							cur_status = status_Deprecated;
-						else if (MFS_string_match(&s, "SEMI_DEPRECATED", true))
-							cur_status = status_SemiDeprecated;
-						else if (MFS_string_match(&s, "REGION_DEFINE", false))
-							MFS_string(&s, &current_region);
-						else if (MFS_string_match(&s, "REGION_RECT", false))
-						{
-							int west = MFS_int(&s);
-							int south = MFS_int(&s);
-							int east = MFS_int(&s);
-							int north = MFS_int(&s);
-							if (west == -180 && east == 179 && south == -90 && north == 89)
-							{
-								all_region = current_region;
-								LOG_MSG("I/Lib %s has global region '%s'\n", pack_base.c_str(), all_region.c_str());
-							}
-						}
-						else if (MFS_string_match(&s, "REGION", false))
-						{
-							string r;
-							MFS_string(&s, &r);
-							in_region = r != all_region;
-						}
+				}
+				else if (MFS_string_match(&s, "REGION", false))
+				{
+					string r;
+					MFS_string(&s, &r);
+					in_region = r != all_region;
+				}
 
-						MFS_string_eol(&s, NULL);
-					}
+				MFS_string_eol(&s, NULL);
+			}
+		}
+	MemFile_Close(lib);
+
+	// Remember every directory from the pack base down that case correction had to look at.
+	set<string> dirs;
+	for(auto& x : exports)
+	{
+		string d(x.rpath);
+		size_t p;
+		while((p = d.find_last_of(DIR_CHAR)) != d.npos && p >= pack_base.size())
+		{
+			d.erase(p);
+			if(!dirs.insert(d).second) break;
+		}
+	}
+	for(auto& d : dirs)
+		entry.dirs.push_back(make_pair(d, lib_cache_mtime(d)));
+}
+
+void		WED_LibraryMgr::Rescan()
+{
+	auto t0 = chrono::high_resolution_clock::now();
+	res_table.clear();
+	int np = gPackageMgr->CountPackages();
+
+	if(!sLibCacheLoaded)
+		lib_cache_load();
+
+	struct pack_scan_t {
+		int					pack;
+		string				pack_base;
+		string				lib_path;
+		lib_cache_entry_t *	entry;
+		bool				cached;
+	};
+	vector<pack_scan_t>		packs;
+	lib_cache_t				new_cache;
+
+	for(int p = 0; p < np; ++p)
+	{
+		if(gPackageMgr->IsDisabled(p)) continue;
+		pack_scan_t ps;
+		ps.pack = p;
+		//Get the pack's physical location
+		gPackageMgr->GetNthPackagePath(p,ps.pack_base);
+		ps.lib_path = ps.pack_base + DIR_STR "library.txt";
+
+		struct stat meta;
+		if(FILE_get_file_meta_data(ps.lib_path, meta) != 0) continue;
+
+		ps.entry = &new_cache[ps.lib_path];
+		ps.entry->size = meta.st_size;
+		ps.entry->mtime = lib_cache_mtime(ps.lib_path);
+
+		lib_cache_t::iterator c = sLibCache.find(ps.lib_path);
+		ps.cached = c != sLibCache.end() && c->second.size == ps.entry->size && c->second.mtime == ps.entry->mtime;
+		if(ps.cached)
+			for(auto& d : c->second.dirs)
+				if(lib_cache_mtime(d.first) != d.second)
+				{
+					ps.cached = false;
+					break;
 				}
-			MemFile_Close(lib);
+		if(ps.cached)
+		{
+			ps.entry->exports.swap(c->second.exports);
+			ps.entry->dirs.swap(c->second.dirs);
 		}
+		packs.push_back(ps);
+	}
+
+	vector<pack_scan_t *>	stale;
+	for(auto& ps : packs)
+		if(!ps.cached)
+			stale.push_back(&ps);
+
+	// Parse everything that changed since last time, spread across all cores.
+	if(!stale.empty())
+	{
+		atomic_int next(0);
+		auto worker = [&stale, &next]() {
+			int i;
+			while((i = next++) < stale.size())
+				parse_library(stale[i]->lib_path, stale[i]->pack_base, *stale[i]->entry);
+		};
+		int num_threads = min((int) stale.size(), max(1, (int) thread::hardware_concurrency()));
+		vector<thread> threads;
+		for(int t = 1; t < num_threads; ++t)
+			threads.push_back(thread(worker));
+		worker();
+		for(auto& t : threads)
+			t.join();
 	}
+
+	time_t rawtime;
+	struct tm* timeinfo;
+	time(&rawtime);
+	timeinfo = localtime(&rawtime);
+	int now = 10000 * (timeinfo->tm_year + 1900) + 100 * timeinfo->tm_mon + timeinfo->tm_mday;
+
+	for(auto& ps : packs)
+	{
+		bool is_default_pack = gPackageMgr->IsPackageDefault(ps.pack);
+		for(auto& x : ps.entry->exports)
+		{
+			res_status status = (res_status) x.status;
+			if(status == status_Public && x.new_until > 20170101 && x.new_until >= now)
+				status = status_New;
+			AccumResource(x.vpath, ps.pack, x.rpath, is_default_pack, status, x.is_backup, x.is_seasonal, x.is_regional);
+		}
+	}
+
+	bool cache_changed = !stale.empty() || new_cache.size() != sLibCache.size();
+	sLibCache.swap(new_cache);
+	if(cache_changed)
+		lib_cache_save();
+
 	RescanLines();
 	RescanSurfaces();
 
@@ -462,7 +728,8 @@ void		WED_LibraryMgr::Rescan()
 		MF_IterateDirectory(package_base.c_str(), AccumLocalFile, reinterpret_cast<void*>(&info));
 	}
 	BroadcastMessage(msg_LibraryChanged,0);
-	LOG_MSG("I/Lib scan finished, %d vpaths\n", (int) res_table.size());
+	chrono::duration<double> elapsed = chrono::high_resolution_clock::now() - t0;
+	LOG_MSG("I/Lib scan finished, %d vpaths, parsed %d of %d libraries in %.3lf s\n", (int) res_table.size(), (int) stale.size(), (int) packs.size(), elapsed.count());
 }
 
 
@@ -844,3 +1111,169 @@ bool WED_LibraryMgr::AccumLocalFile(const char * filename, bool is_dir, void * r
 	}
 	return false;
 }
+
+#if UNIT_TEST
+// Library scan benchmark.  Builds a fake X-System folder with lots of library packs whose EXPORT lines all need case
+// correction, then times a cold scan, a rescan within the session and a rescan from the cache file as at the next WED start.
+// Also checks that the cache notices an edited library.txt and an asset file whose name changed case, and that
+// PRIVATE, PUBLIC <date>, backups, variants and default pack overrides come out the same for every kind of scan.
+
+FILE * gLogFile = stdout;
+
+static void bench_write_file(const string& path, const string& txt)
+{
+	FILE * fo = fopen(path.c_str(), "w");
+	DebugAssert(fo);
+	fputs(txt.c_str(), fo);
+	fclose(fo);
+}
+
+static double bench_scan(WED_LibraryMgr& mgr)
+{
+	auto t0 = chrono::high_resolution_clock::now();
+	mgr.ReceiveMessage(NULL, msg_SystemFolderChanged, 0);
+	chrono::duration<double> elapsed = chrono::high_resolution_clock::now() - t0;
+	return elapsed.count();
+}
+
+// Exports whose outcome depends on the order the packs are applied in - must come out the same whether parsed or cached.
+static bool check_statuses(WED_LibraryMgr& mgr, const char * when)
+{
+	const char * fail = NULL;
+	vector<string> fresh;
+	mgr.GetResourceChildren("lib/mix", pack_New, fresh);
+
+	if(!mgr.IsResourceDeprecatedOrPrivate("lib/mix/private.obj"))			fail = "PRIVATE export is public";
+	else if(fresh.size() != 1 || fresh[0] != "lib/mix/new.obj")				fail = "PUBLIC <date> export is not new";
+	else if(mgr.GetNumVariants("lib/mix/shared.obj") != 2)					fail = "export from two packs is not two variants";
+	else if(mgr.GetResourcePath("lib/mix/shared.obj").find("Mix_A") == string::npos)	fail = "first variant is not from the first pack";
+	else if(mgr.GetNumVariants("lib/mix/backup.obj") != 1 ||
+			mgr.GetResourcePath("lib/mix/backup.obj").find("Mix_B") == string::npos)	fail = "EXPORT_BACKUP not replaced by a later EXPORT";
+	else if(!mgr.IsResourceDefault("lib/mix/lr_private.obj") ||
+			!mgr.IsResourceDeprecatedOrPrivate("lib/mix/lr_private.obj"))		fail = "default pack did not downgrade a custom export";
+	else if(!mgr.IsResourceDefault("lib/mix/lr_public.obj") ||
+			mgr.IsResourceDeprecatedOrPrivate("lib/mix/lr_public.obj"))			fail = "default pack export is not public";
+
+	if(fail)
+		printf("FAIL: %s: %s\n", when, fail);
+	return fail == NULL;
+}
+
+//	usage: <packages> <exports per package>
+int main(int argc, const char * argv[])
+{
+	int num_packs = argc > 1 ? atoi(argv[1]) : 500;
+	int num_exports = argc > 2 ? atoi(argv[2]) : 200;
+
+	char root[] = "/tmp/wed_libmgr_XXXXXX";
+	if(!mkdtemp(root)) { perror("mkdtemp"); return 1; }
+	setenv("XDG_CACHE_HOME", root, 1);
+	string csc = string(root) + DIR_STR "Custom Scenery";
+	FILE_make_dir_exist((string(root) + DIR_STR "Resources" DIR_STR "default scenery").c_str());
+
+	for(int p = 0; p < num_packs; ++p)
+	{
+		char pack[32];
+		snprintf(pack, sizeof(pack), "Lib_%03d", p);
+		string base = csc + DIR_STR + pack;
+		string txt = "A\n800\nLIBRARY\n\nPUBLIC\n";
+		for(int d = 0; d < 10; ++d)
+			FILE_make_dir_exist((base + DIR_STR "Objects" DIR_STR "Set_" + to_string(d)).c_str());
+		for(int i = 0; i < num_exports; ++i)
+		{
+			string f = "Set_" + to_string(i % 10) + DIR_STR "Tree_" + to_string(i) + ".obj";
+			bench_write_file(base + DIR_STR "Objects" DIR_STR + f, "");
+			txt += "EXPORT lib/bench/" + to_string(p) + "/tree_" + to_string(i) + ".obj objects/set_" + to_string(i % 10) + "/tree_" + to_string(i) + ".obj\n";
+		}
+		bench_write_file(base + DIR_STR "library.txt", txt);
+	}
+
+	const char * mix_packs[3][2] = {
+		{ "Custom Scenery" DIR_STR "Mix_A",
+			"PRIVATE\nEXPORT lib/mix/private.obj a.obj\n"
+			"PUBLIC 20991231\nEXPORT lib/mix/new.obj a.obj\n"
+			"PUBLIC\nEXPORT lib/mix/shared.obj a.obj\nEXPORT lib/mix/lr_private.obj a.obj\nEXPORT_BACKUP lib/mix/backup.obj a.obj\n" },
+		{ "Custom Scenery" DIR_STR "Mix_B",
+			"EXPORT lib/mix/shared.obj b.obj\nEXPORT lib/mix/backup.obj b.obj\n" },
+		{ "Resources" DIR_STR "default scenery" DIR_STR "Mix_LR",
+			"PRIVATE\nEXPORT lib/mix/lr_private.obj c.obj\nPUBLIC\nEXPORT lib/mix/lr_public.obj c.obj\n" } };
+	for(auto& m : mix_packs)
+	{
+		string base = string(root) + DIR_STR + m[0];
+		FILE_make_dir_exist(base.c_str());
+		for(const char * f : { "a.obj", "b.obj", "c.obj" })
+			bench_write_file(base + DIR_STR + f, "");
+		bench_write_file(base + DIR_STR "library.txt", string("A\n800\nLIBRARY\n\n") + m[1]);
+	}
+
+	WED_PackageMgr pmgr(root);
+	auto t0 = chrono::high_resolution_clock::now();
+	WED_LibraryMgr lmgr("");
+	chrono::duration<double> cold = chrono::high_resolution_clock::now() - t0;
+
+	string probe = "lib/bench/7/tree_3.obj";
+	string probe_path = lmgr.GetResourcePath(probe);
+	if(probe_path.find("Objects" DIR_STR "Set_3" DIR_STR "Tree_3.obj") == string::npos)
+	{
+		printf("FAIL: %s resolved to '%s'\n", probe.c_str(), probe_path.c_str());
+		return 1;
+	}
+	vector<string> all_paths;
+	for(int p = 0; p < num_packs; p += 37)
+		for(int i = 0; i < num_exports; i += 13)
+			all_paths.push_back(lmgr.GetResourcePath("lib/bench/" + to_string(p) + "/tree_" + to_string(i) + ".obj"));
+	if(!check_statuses(lmgr, "cold scan")) return 1;
+
+	double warm = bench_scan(lmgr);
+	if(!check_statuses(lmgr, "rescan")) return 1;
+
+	// Next session: drop what's in memory and start over from the cache file.
+	sLibCache.clear();
+	sLibCacheLoaded = false;
+	double reload = bench_scan(lmgr);
+	if(!check_statuses(lmgr, "rescan from cache file")) return 1;
+
+	int k = 0;
+	for(int p = 0; p < num_packs; p += 37)
+		for(int i = 0; i < num_exports; i += 13)
+			if(lmgr.GetResourcePath("lib/bench/" + to_string(p) + "/tree_" + to_string(i) + ".obj") != all_paths[k++])
+			{
+				printf("FAIL: cached scan resolves lib/bench/%d/tree_%d.obj differently\n", p, i);
+				return 1;
+			}
+
+	// An asset renamed to a different case must be re-resolved, though its library.txt is unchanged.
+	string renamed = probe_path;
+	renamed.replace(renamed.rfind("Tree_3.obj"), 10, "TREE_3.obj");
+	FILE_rename_file(probe_path.c_str(), renamed.c_str());
+	double after_rename = bench_scan(lmgr);
+	if(lmgr.GetResourcePath(probe) != renamed)
+	{
+		printf("FAIL: after renaming, %s still resolves to '%s'\n", probe.c_str(), lmgr.GetResourcePath(probe).c_str());
+		return 1;
+	}
+
+	// An edited library.txt must be re-parsed.
+	string lib = csc + DIR_STR "Lib_011" DIR_STR "library.txt";
+	FILE * fo = fopen(lib.c_str(), "a");
+	fputs("EXPORT lib/bench/added.obj objects/set_0/tree_0.obj\n", fo);
+	fclose(fo);
+	double after_edit = bench_scan(lmgr);
+	if(lmgr.GetResourcePath("lib/bench/added.obj").empty())
+	{
+		printf("FAIL: export added to %s not found\n", lib.c_str());
+		return 1;
+	}
+
+	printf("%d packages, %d exports each\n", num_packs, num_exports);
+	printf("cold scan             %8.3lf s\n", cold.count());
+	printf("rescan, same session  %8.3lf s\n", warm);
+	printf("rescan, cache file    %8.3lf s\n", reload);
+	printf("after asset rename    %8.3lf s\n", after_rename);
+	printf("after library edit    %8.3lf s\n", after_edit);
+
+	FILE_delete_dir_recursive(string(root) + DIR_STR);
+	printf("PASS\n");
+	return 0;
+}
+#endif
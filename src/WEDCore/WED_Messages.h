@@ -46,7 +46,9 @@ enum {
 	msg_SystemFolderChanged,
 	msg_SystemFolderUpdated,
 
-	msg_LibraryChanged
+	msg_LibraryChanged,
+
+	msg_ResourceLoaded						// Sent by the resource mgr when OBJs requested via GetObjAsync became available
 
 #if WITHNWLINK
 	,msg_NetworkStatusInfo
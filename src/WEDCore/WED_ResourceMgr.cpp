@@ -31,11 +31,13 @@
 
 #include "MemFileUtils.h"
 #include "XObjReadWrite.h"
+#include "ObjDraw.h"
 //#include "ObjConvert.h"
 #include "FileUtils.h"
 #include "WED_PackageMgr.h"
 #include "CompGeomDefs2.h"
 #include "MathUtils.h"
+#include "PerfUtils.h"
 
 #if IBM
 #define DIR_CHAR '\\'
@@ -93,20 +95,67 @@ static void process_texture_path(const string& path_of_obj, string& path_of_tex)
 	path_of_tex = parent + ".bmp";
 }
 
-WED_ResourceMgr::WED_ResourceMgr(WED_LibraryMgr * in_library) : mLibrary(in_library)
+// Rough estimate of the heap an OBJ holds on to, for the purpose of the memory budget only.
+static size_t obj_mem_size(const XObj8 * o)
 {
+	size_t sz = sizeof(XObj8);
+	sz += o->indices.size() * sizeof(int);
+	sz += (o->geo_tri.count() * 8 + o->geo_lines.count() * 6 + o->geo_lights.count() * 6) * sizeof(float);
+	sz += o->animation.size() * sizeof(XObjAnim8);
+	for (const auto& l : o->lods)
+		sz += sizeof(XObjLOD8) + l.cmds.size() * sizeof(XObjCmd8);
+	return sz;
+}
+
+WED_ResourceMgr::WED_ResourceMgr(WED_LibraryMgr * in_library) : mLibrary(in_library), mBudget(0),
+	mTimerOn(false), mQuit(false), mGeneration(0)
+{
+	memset(&mStats, 0, sizeof(mStats));
+	SetMemoryBudget((size_t) gResourceCacheMB * 1024 * 1024);
+
+	int num_workers = intlim((int) thread::hardware_concurrency() - 1, 1, 4);
+	for(int n = 0; n < num_workers; ++n)
+		mWorkers.push_back(thread(&WED_ResourceMgr::WorkerThread, this));
 }
 
 WED_ResourceMgr::~WED_ResourceMgr()
 {
+	{
+		lock_guard<mutex> lock(mJobLock);
+		mQuit = true;
+	}
+	mJobCond.notify_all();
+	for(auto& t : mWorkers)
+		t.join();
+
+	LOG_MSG("I/Res OBJ cache %d hits %d misses %d loads (%.1lf ms avg) %d evictions\n", mStats.hits, mStats.misses,
+		mStats.loads, mStats.loads ? mStats.load_seconds * 1000.0 / mStats.loads : 0.0, mStats.evictions);
 	Purge();
+	// No draw will come anymore - their VBOs go away with the GL context.
+	for(auto o : mRetired)
+		delete o;
 }
 
 void	WED_ResourceMgr::Purge(void)
 {
+	{
+		lock_guard<mutex> lock(mJobLock);
+		++mGeneration;
+		mJobs.clear();
+		for(auto& j : mDone)
+			for(auto o : j.result)
+				delete o;
+		mDone.clear();
+	}
+	mPending.clear();
+	mFailed.clear();
+	mLRU.clear();
+	mLRUInfo.clear();
+	mStats.bytes = 0;
+
 	for(auto& i : mObj)
 		for(auto j : i.second)
-			delete j;
+			Retire(j);
 	mObj.clear();
 
 	mPol.clear();
@@ -124,6 +173,174 @@ void	WED_ResourceMgr::Purge(void)
 	mAGP.clear();
 }
 
+void	WED_ResourceMgr::SetMemoryBudget(size_t bytes)
+{
+	mBudget = bytes;
+	if(mBudget && mStats.bytes > mBudget && !mTimerOn)
+	{
+		mTimerOn = true;
+		Start(0.1);
+	}
+}
+
+// Bumps vpath in the LRU. Whoever just put variants into mObj[vpath] passes their size, a plain hit passes nothing.
+void	WED_ResourceMgr::TouchObj(const string& vpath, bool pin, size_t added_bytes)
+{
+	auto i = mLRUInfo.find(vpath);
+	if(i == mLRUInfo.end())
+	{
+		lru_info_t info;
+		info.bytes = 0;
+		info.pinned = false;
+		mLRU.push_front(vpath);
+		info.pos = mLRU.begin();
+		i = mLRUInfo.insert(make_pair(vpath, info)).first;
+	}
+	else if(!i->second.pinned && i->second.pos != mLRU.begin())
+		mLRU.splice(mLRU.begin(), mLRU, i->second.pos);
+
+	i->second.bytes += added_bytes;
+	if(!i->second.pinned)
+		mStats.bytes += added_bytes;
+
+	if(pin && !i->second.pinned)
+	{
+		// Someone else (agp, fac, ...) holds on to this OBJ - so it must never be evicted.
+		mLRU.erase(i->second.pos);
+		mStats.bytes -= i->second.bytes;
+		i->second.pinned = true;
+	}
+
+	if(mBudget && mStats.bytes > mBudget && !mTimerOn)
+	{
+		mTimerOn = true;
+		Start(0.1);
+	}
+}
+
+void	WED_ResourceMgr::Trim(void)
+{
+	if(mBudget == 0) return;
+	int evicted = 0;
+	while(mStats.bytes > mBudget && mLRU.size() > 1)
+	{
+		string vpath = mLRU.back();
+		mLRU.pop_back();
+		auto i = mLRUInfo.find(vpath);
+		mStats.bytes -= i->second.bytes;
+		mLRUInfo.erase(i);
+
+		auto o = mObj.find(vpath);
+		if(o != mObj.end())
+		{
+			for(auto obj : o->second)
+				Retire(obj);
+			mObj.erase(o);
+		}
+		++evicted;
+	}
+	mStats.evictions += evicted;
+	if(evicted)
+		LOG_MSG("I/Res evicted %d OBJs, %.1lf MB in use\n", evicted, mStats.bytes / (1024.0 * 1024.0));
+}
+
+void	WED_ResourceMgr::Retire(const XObj8 * obj)
+{
+#if XOBJ8_USE_VBO
+	if(obj->geo_VBO)
+		mRetired.push_back(obj);
+	else
+#endif
+		delete obj;
+}
+
+void	WED_ResourceMgr::ReleaseRetired(void)
+{
+	for(auto o : mRetired)
+	{
+		ObjDraw8_ReleaseVBO(*o);
+		delete o;
+	}
+	mRetired.clear();
+}
+
+void	WED_ResourceMgr::WorkerThread(void)
+{
+	unique_lock<mutex> lock(mJobLock);
+	while(1)
+	{
+		mJobCond.wait(lock, [this]{ return mQuit || !mJobs.empty(); });
+		if(mQuit) return;
+
+		obj_job_t job = mJobs.front();
+		mJobs.pop_front();
+		lock.unlock();
+
+		unsigned long long t0 = query_hpc();
+		for(auto& p : job.paths)
+		{
+			XObj8 * o = LoadObj(p);
+			if(!o) break;
+			job.result.push_back(o);
+		}
+		job.seconds = hpc_to_microseconds(query_hpc() - t0) / 1000000.0;
+
+		lock.lock();
+		if(job.generation == mGeneration)
+			mDone.push_back(job);
+		else
+			for(auto o : job.result)
+				delete o;
+	}
+}
+
+void	WED_ResourceMgr::CollectAsync(void)
+{
+	vector<obj_job_t> done;
+	{
+		lock_guard<mutex> lock(mJobLock);
+		if(mDone.empty()) return;
+		done.swap(mDone);
+	}
+	for(auto& j : done)
+	{
+		mPending.erase(j.vpath);
+		++mStats.loads;
+		mStats.load_seconds += j.seconds;
+
+		vector<const XObj8 *>& variants(mObj[j.vpath]);
+		if(j.result.size() < j.paths.size())
+			mFailed.insert(j.vpath);
+		if(variants.size() == j.first_variant && !j.result.empty())
+		{
+			size_t bytes = 0;
+			for(auto o : j.result)
+				bytes += obj_mem_size(o);
+			variants.insert(variants.end(), j.result.begin(), j.result.end());
+			TouchObj(j.vpath, false, bytes);
+		}
+		else
+		{
+			for(auto o : j.result)
+				delete o;
+			if(variants.empty())
+				mObj.erase(j.vpath);
+		}
+	}
+	BroadcastMessage(msg_ResourceLoaded, 0);
+}
+
+void	WED_ResourceMgr::TimerFired(void)
+{
+	CollectAsync();
+	Trim();
+	if(mPending.empty() && (mBudget == 0 || mStats.bytes <= mBudget))
+	{
+		Stop();
+		mTimerOn = false;
+	}
+}
+
 bool	WED_ResourceMgr::GetAllInDir(const string& vdir, vector<pair<string, int> >& vpaths)
 {
 	vector<string> names;
@@ -184,6 +401,7 @@ bool	WED_ResourceMgr::GetObjRelative(const string& obj_path, const string& paren
 	{
 		if(GetObj(obj_path,obj))
 		{
+			TouchObj(obj_path, true);
 			return true;
 		}
 	}
@@ -219,6 +437,7 @@ bool	WED_ResourceMgr::GetObj(const string& vpath, XObj8 const *& obj, int varian
 	if(toupper(vpath[vpath.size()-3]) != 'O') return false;   // save time by not trying to load .agp's
 
 //printf("GetObj %s' V=%d\n", path.c_str(), variant);
+	CollectAsync();
 	auto i = mObj.find(vpath);
 	int first_needed = 0;
 	if(i != mObj.end())
@@ -226,6 +445,8 @@ bool	WED_ResourceMgr::GetObj(const string& vpath, XObj8 const *& obj, int varian
 		if(variant < i->second.size())
 		{
 			obj = i->second[variant];
+			++mStats.hits;
+			TouchObj(vpath, false);
 			return true;
 		}
 		else
@@ -233,26 +454,84 @@ bool	WED_ResourceMgr::GetObj(const string& vpath, XObj8 const *& obj, int varian
 	}
 
 	DebugAssert(variant < mLibrary->GetNumVariants(vpath));
+	++mStats.misses;
 
 //printf("GetObj trying to load '%s' V=%d/%d\n", path.c_str(), variant, n_variants);
+	size_t loaded_bytes = 0;
 	for (int v = first_needed; v <= variant; ++v)  // load only the variants we need but don't have yet
 	{
 		string p = mLibrary->GetResourcePath(vpath,v);
 //	if (!p.size()) p = mLibrary->CreateLocalResourcePath(path);
 		{
+			unsigned long long t0 = query_hpc();
 			XObj8 * new_obj = LoadObj(p);
+			mStats.load_seconds += hpc_to_microseconds(query_hpc() - t0) / 1000000.0;
+			++mStats.loads;
 			if(new_obj)
 			{
 				mObj[vpath].push_back(new_obj);
+				loaded_bytes += obj_mem_size(new_obj);
 				obj = new_obj;
 			}
 			else
 			{
 	//			obj = nullptr;
+				if(loaded_bytes)
+					TouchObj(vpath, false, loaded_bytes);
 				return false;
 			}
 		}
 	}
+	TouchObj(vpath, false, loaded_bytes);
+	return true;
+}
+
+bool	WED_ResourceMgr::GetObjAsync(const string& vpath, XObj8 const *& obj, int variant)
+{
+	if(toupper(vpath[vpath.size()-3]) != 'O') return false;
+
+	CollectAsync();
+	auto i = mObj.find(vpath);
+	int first_needed = 0;
+	if(i != mObj.end())
+	{
+		if(variant < i->second.size())
+		{
+			obj = i->second[variant];
+			++mStats.hits;
+			TouchObj(vpath, false);
+			return true;
+		}
+		else
+			first_needed = i->second.size();
+	}
+	if(mFailed.count(vpath))
+		return false;
+
+	obj = nullptr;
+	if(mPending.count(vpath))
+		return true;
+
+	obj_job_t job;
+	job.vpath = vpath;
+	job.first_variant = first_needed;
+	for (int v = first_needed; v <= variant; ++v)
+		job.paths.push_back(mLibrary->GetResourcePath(vpath,v));
+	job.seconds = 0.0;
+	{
+		lock_guard<mutex> lock(mJobLock);
+		job.generation = mGeneration;
+		mJobs.push_back(job);
+	}
+	mJobCond.notify_one();
+
+	++mStats.misses;
+	mPending.insert(vpath);
+	if(!mTimerOn)
+	{
+		mTimerOn = true;
+		Start(0.1);
+	}
 	return true;
 }
 
@@ -2306,3 +2585,203 @@ string	WED_ResourceMgr::GetJetwayVpath(const string& tunnel_vpath)
 }
 
 #endif
+
+#if UNIT_TEST
+// Headless test of async OBJ loading and eviction.  Link it without the library, the OBJ parser, GL and the GUI timer -
+// the stand-ins below replace them: every OBJ "parses" on a worker to the same made-up mesh, OBJs with "missing" in the
+// name fail, and the test ticks the timer itself.  Checks that GetObjAsync never parses on the calling thread, that
+// every OBJ arrives with a msg_ResourceLoaded, that the budget holds with the least recently used OBJs going first,
+// that the cached sizes add up without drifting on hits, that pinned OBJs are never evicted and that a Purge drops
+// parses still in flight.
+//	usage: <objs> <objs that fit the budget>
+#include <chrono>
+#include <atomic>
+#include "GUI_Timer.h"
+
+#define TEST_OBJ_INDICES	(64 * 1024)
+
+FILE *				gLogFile = nullptr;			// every eviction is logged
+int					gResourceCacheMB = 0;		// lives in WED_Document.cpp
+
+static thread::id	test_main_thread;
+static atomic<int>	test_main_parses(0);
+static atomic<int>	test_parses(0);
+
+bool	XObj8Read(const char * inFile, XObj8& outObj)
+{
+	if (this_thread::get_id() == test_main_thread && strstr(inFile, "sync") == NULL)
+		++test_main_parses;
+	++test_parses;
+	this_thread::sleep_for(chrono::milliseconds(1));
+	if (strstr(inFile, "missing"))
+		return false;
+	outObj.indices.resize(TEST_OBJ_INDICES);
+	outObj.lods.resize(1);
+	return true;
+}
+
+void	ObjDraw8_ReleaseVBO(const XObj8& obj) { }
+
+void	WED_clean_rpath(string& s) { }
+string	WED_LibraryMgr::GetResourcePath(const string& r, int variant)	{ return r; }
+int		WED_LibraryMgr::GetNumVariants(const string& r) const			{ return 1; }
+
+GUI_Timer::GUI_Timer(void) { }
+GUI_Timer::~GUI_Timer(void) { }
+void GUI_Timer::Start(float seconds) { }
+void GUI_Timer::Stop(void) { }
+
+class	test_listener : public GUI_Listener {
+public:
+	test_listener() : loaded(0) { }
+	virtual	void	ReceiveMessage(GUI_Broadcaster * inSrc, intptr_t inMsg, intptr_t inParam)
+	{
+		if (inMsg == msg_ResourceLoaded) ++loaded;
+	}
+	int loaded;
+};
+
+int main(int argc, const char * argv[])
+{
+	int n = argc > 1 ? atoi(argv[1]) : 40;
+	int fit = argc > 2 ? atoi(argv[2]) : 10;
+	test_main_thread = this_thread::get_id();
+
+	XObj8 sample;
+	sample.indices.resize(TEST_OBJ_INDICES);
+	sample.lods.resize(1);
+	size_t obj_bytes = obj_mem_size(&sample);
+
+	WED_ResourceMgr mgr(nullptr);
+	mgr.SetMemoryBudget(fit * obj_bytes);
+	test_listener listener;
+	mgr.AddListener(&listener);
+	WED_ResourceMgr::stats_t stats;
+
+	vector<string> names;
+	for (int i = 0; i < n; ++i)
+		names.push_back("/objs/" + to_string(i) + ".obj");
+
+	// Fetch the given OBJs until all of them are there, ticking the timer like the app does - at most a few seconds.
+	auto draw = [&](int first, int count) {
+		for (int tries = 0; tries < 5000; ++tries)
+		{
+			bool all = true;
+			for (int i = first; i < first + count; ++i)
+			{
+				const XObj8 * o;
+				if (!mgr.GetObjAsync(names[i], o) || o == nullptr)
+					all = false;
+			}
+			mgr.TimerFired();
+			if (all) return true;
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		return false;
+	};
+
+	// A screen of 'fit' OBJs at a time, like panning the map.
+	for (int i = 0; i + fit <= n; i += fit)
+	{
+		int loaded = listener.loaded;
+		if (!draw(i, fit) || listener.loaded == loaded)
+		{
+			printf("OBJs %d to %d never arrived, or without a msg_ResourceLoaded.\n", i, i + fit - 1);
+			return 1;
+		}
+		mgr.GetStats(stats);
+		if (stats.bytes > 2 * fit * obj_bytes)
+		{
+			printf("%.1lf OBJs worth of memory in use with a budget of %d.\n", (double) stats.bytes / obj_bytes, fit);
+			return 1;
+		}
+	}
+	if (test_main_parses)
+	{
+		printf("%d OBJs were parsed on the calling thread.\n", (int) test_main_parses);
+		return 1;
+	}
+
+	// Now the budget holds, the sizes add up, and hits don't change them.
+	mgr.TimerFired();
+	mgr.GetStats(stats);
+	size_t settled = stats.bytes;
+	if (settled > fit * obj_bytes || settled % obj_bytes != 0 || stats.evictions < n - fit)
+	{
+		printf("%.2lf OBJs in use after %d evictions, budget %d.\n", (double) settled / obj_bytes, stats.evictions, fit);
+		return 1;
+	}
+	for (int r = 0; r < 100; ++r)
+		draw(n - fit, fit);
+	mgr.GetStats(stats);
+	if (stats.bytes != settled)
+	{
+		printf("Hits changed the size in use from %llu to %llu.\n", (unsigned long long) settled, (unsigned long long) stats.bytes);
+		return 1;
+	}
+
+	// The oldest OBJ went first and comes back through the queue.
+	const XObj8 * o;
+	if (!mgr.GetObjAsync(names[0], o) || o != nullptr)
+	{
+		printf("The least recently used OBJ was not evicted.\n");
+		return 1;
+	}
+	if (!draw(0, 1))
+	{
+		printf("An evicted OBJ never came back.\n");
+		return 1;
+	}
+
+	// Missing ones fail once the worker is done with them.
+	bool failed = false;
+	for (int tries = 0; tries < 5000 && !failed; ++tries)
+	{
+		failed = !mgr.GetObjAsync("/objs/missing.obj", o);
+		mgr.TimerFired();
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+	if (!failed)
+	{
+		printf("A missing OBJ never failed.\n");
+		return 1;
+	}
+
+	// Pinned OBJs don't count against the budget and stay, however much is loaded after them.
+	if (!mgr.GetObjRelative("/objs/sync_pinned.obj", "/objs/parent.agp", o) || o == nullptr)
+	{
+		printf("GetObjRelative failed.\n");
+		return 1;
+	}
+	const XObj8 * pinned = o;
+	for (int i = 0; i + fit <= n; i += fit)
+		draw(i, fit);
+	mgr.TimerFired();
+	if (!mgr.GetObjAsync("/objs/sync_pinned.obj", o) || o != pinned)
+	{
+		printf("A pinned OBJ was evicted.\n");
+		return 1;
+	}
+
+	// Parses in flight during a Purge are dropped, not added to the emptied cache.
+	int parses = test_parses;
+	for (int i = 0; i < fit; ++i)
+		mgr.GetObjAsync("/objs/purged" + to_string(i) + ".obj", o);
+	mgr.Purge();
+	for (int tries = 0; tries < 50; ++tries)
+	{
+		mgr.TimerFired();
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+	mgr.GetStats(stats);
+	if (stats.bytes != 0)
+	{
+		printf("%.1lf OBJs in use after a Purge (%d parses ran).\n", (double) stats.bytes / obj_bytes, test_parses - parses);
+		return 1;
+	}
+
+	mgr.GetStats(stats);
+	printf("OK, %d OBJs: %d hits, %d misses, %d loads, %d evictions.\n", n, stats.hits, stats.misses, stats.loads, stats.evictions);
+	return 0;
+}
+#endif
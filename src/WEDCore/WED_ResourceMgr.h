@@ -34,6 +34,24 @@
 	In the case of OBJ, we use the OBJ_ package for preview and data management, thus an OBJ preview is an XObj8 struct.
 	For .pol since there is no package for .pol preview (since it is somewhat trivial) we define a struct.
 
+	ASYNC LOADING AND EVICTION
+
+	GetObjAsync never parses on the calling thread - a missing OBJ is queued for a small pool of worker threads and the
+	caller draws a placeholder until the object shows up. Finished objects are picked up on the main thread by a timer,
+	which then broadcasts msg_ResourceLoaded so the map can redraw.
+
+	Top level OBJs, i.e. those fetched by GetObj/GetObjAsync, are kept in LRU order and evicted once their estimated
+	memory exceeds the budget. Eviction only happens from the timer, i.e. between draws, so pointers handed out during a
+	draw stay valid for that draw. OBJs that other assets (agp, fac, for, str) point to are pinned and never evicted.
+	The timer has no GL context, so evicted OBJs that were drawn are parked until the next draw calls ReleaseRetired(),
+	which frees their VBOs and deletes them.
+
+	GetFac, GetFor, GetAGP and GetRoad stay synchronous. Their parsers resolve the OBJs they reference through
+	GetObjRelative, which fills mObj and the LRU - state only the main thread may touch - and the info they return keeps
+	raw pointers to those OBJs. Their callers also need the complete info right away, to draw footprints, hit test and
+	export, and a placeholder would be wrong for all of these. The OBJ meshes are the expensive part, and those already
+	come through the cache.
+
 	HERE'S THE HACK
 
 	Traditionally the UI interface for WED is firewalled off from the document class/implementation using a purely virtual
@@ -49,7 +67,12 @@
 #include "IBase.h"
 #include "XObjDefs.h"
 #include "CompGeomDefs2.h"
+#include "GUI_Timer.h"
 #include <list>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 class	WED_LibraryMgr;
 
@@ -247,7 +270,7 @@ class WED_JWFacades
 		string	find(WED_LibraryMgr* lmgr, WED_ResourceMgr* rmgr, const string& tunnel_vpath);
 };
 
-class WED_ResourceMgr : public GUI_Broadcaster, public GUI_Listener, public virtual IBase {
+class WED_ResourceMgr : public GUI_Broadcaster, public GUI_Listener, public GUI_Timer, public virtual IBase {
 public:
 
 					 WED_ResourceMgr(WED_LibraryMgr * in_library);
@@ -255,6 +278,18 @@ public:
 
 			void	Purge(void);
 
+	struct	stats_t {
+		int			hits;
+		int			misses;
+		int			loads;			// OBJs parsed, sync or async
+		int			evictions;
+		double		load_seconds;	// total time spent parsing, divide by loads for the average latency
+		size_t		bytes;			// estimated size of all evictable OBJs
+	};
+			void	GetStats(stats_t& out_stats) const { out_stats = mStats; }
+			void	SetMemoryBudget(size_t bytes);
+			void	ReleaseRetired(void);		// call from drawing code only - needs the GL context current
+
 			bool	GetFac(const string& vpath, fac_info_t const *& info, int variant =0);
 			bool	GetPol(const string& path, pol_info_t const *& info);
 			bool 	SetPolUV(const string& path, Bbox2 box);
@@ -265,6 +300,8 @@ public:
 
 			void	WritePol(const string& abspath, const pol_info_t& out_info); // side note: shouldn't this be in_info?
 			bool	GetObj(const string& path, XObj8 const *& obj, int variant = 0);
+						// Like GetObj, but never blocks: returns true with obj == nullptr while the object is still being parsed.
+			bool	GetObjAsync(const string& path, XObj8 const *& obj, int variant = 0);
 			bool	GetObjRelative(const string& obj_path, const string& parent_path, XObj8 const *& obj);
 			bool	GetAGP(const string& path, agp_t const *& info);
 			bool	GetRoad(const string& path, const road_info_t *& out_info);
@@ -274,10 +311,17 @@ public:
 							intptr_t				inMsg,
 							intptr_t				inParam);
 
+	virtual	void	TimerFired(void);
+
 			string	GetJetwayVpath(const string& tunnel_vpath);
 private:
 
-			XObj8 * LoadObj(const string& abspath);
+	static	XObj8 * LoadObj(const string& abspath);
+			void	TouchObj(const string& vpath, bool pin, size_t added_bytes = 0);
+			void	CollectAsync(void);
+			void	Trim(void);
+			void	Retire(const XObj8 * obj);
+			void	WorkerThread(void);
 			void    setup_tile(agp_t::tile_t * agp, int rotation, const string& path);
 
 	unordered_map<string,vector<fac_info_t> > mFac;
@@ -292,6 +336,36 @@ private:
 #endif
 	WED_LibraryMgr *				mLibrary;
 	WED_JWFacades					mJetways;
+
+	struct lru_info_t {
+		list<string>::iterator	pos;
+		size_t					bytes;
+		bool					pinned;
+	};
+	list<string>						mLRU;		// front is most recently used
+	unordered_map<string,lru_info_t>	mLRUInfo;
+	size_t								mBudget;
+	stats_t								mStats;
+	bool								mTimerOn;
+
+	struct obj_job_t {
+		string					vpath;
+		int						first_variant;
+		vector<string>			paths;
+		vector<XObj8 *>			result;
+		double					seconds;
+		int						generation;
+	};
+	vector<thread>						mWorkers;
+	mutex								mJobLock;
+	condition_variable					mJobCond;
+	deque<obj_job_t>					mJobs;
+	vector<obj_job_t>					mDone;
+	bool								mQuit;
+	int									mGeneration;	// bumped on Purge, so jobs started before get discarded
+	set<string>							mPending;		// main thread only
+	set<string>							mFailed;		// main thread only
+	vector<const XObj8 *>				mRetired;		// evicted, but VBOs still to be released by ReleaseRetired
 };
 
 #endif /* WED_ResourceMgr_H */
@@ -30,6 +30,9 @@
 #include "MemFileUtils.h"
 #include "TexUtils.h"
 #include "WED_PackageMgr.h"
+#include "WED_Messages.h"
+#include "WED_Globals.h"
+#include "MathUtils.h"
 
 #if APL
 	#include <OpenGL/gl.h>
@@ -37,16 +40,45 @@
 	#include <GL/gl.h>
 #endif
 
-WED_TexMgr::WED_TexMgr(const string& package) : mPackage(package)
+// Uploads per timer tick - at least one texture goes up per tick, no matter how big.
+#define UPLOAD_BYTES_PER_TICK	(16 * 1024 * 1024)
+
+// What a texture occupies on the GPU, roughly. Driver compression is assumed to get 4:1.
+static size_t tex_gpu_bytes(const TexDecoded& dec)
+{
+	if (dec.is_raw)
+		return dec.raw.size();
+	return (dec.flags & tex_Compress_Ok) ? dec.pixels.size() / 4 : dec.pixels.size();
+}
+
+WED_TexMgr::WED_TexMgr(const string& package) : mPackage(package), mBytes(0), mBudget(0), mUploadBudget(UPLOAD_BYTES_PER_TICK),
+	mTick(0), mMaxTexSize(0), mQueued(0), mNextJob(0), mDeferred(false), mActive(false), mTimerOn(false), mUploads(0), mEvictions(0), mQuit(false)
 {
+	SetMemoryBudget((size_t) gTextureCacheMB * 1024 * 1024);
+
+	int num_workers = intlim((int) thread::hardware_concurrency() - 1, 1, 4);
+	for(int n = 0; n < num_workers; ++n)
+		mWorkers.push_back(thread(&WED_TexMgr::WorkerThread, this));
 }
 
 WED_TexMgr::~WED_TexMgr()
 {
+	{
+		lock_guard<mutex> lock(mJobLock);
+		mQuit = true;
+		mJobs.clear();
+	}
+	mJobCond.notify_all();
+	for(auto& t : mWorkers)
+		t.join();
+	for(auto& j : mDone)
+		delete j.result;
+
+	LOG_MSG("I/Tex %d uploads, %d evictions, %.1lf MB resident\n", mUploads, mEvictions, mBytes / (1024.0 * 1024.0));
+
 	for(map<string,TexInfo *>::iterator t = mTexes.begin(); t != mTexes.end(); ++t)
 	{
-		GLuint id = t->second->tex_id;
-		glDeleteTextures(1, &id);
+		Release(t->second);
 		delete t->second;
 	}
 }
@@ -56,8 +88,8 @@ void 		WED_TexMgr::DropTexture(const char * path)
 	TexMap::iterator i = mTexes.find(path);
 	if (i != mTexes.end())
 	{
-		GLuint id = i->second->tex_id;
-		glDeleteTextures(1, &id);
+		CancelDecode(i->second);
+		Release(i->second);
 		delete i->second;
 		mTexes.erase(i);
 	}
@@ -65,17 +97,68 @@ void 		WED_TexMgr::DropTexture(const char * path)
 
 TexRef		WED_TexMgr::LookupTexture(const char * path, bool is_absolute, int flags)
 {
+	if (mMaxTexSize == 0)
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &mMaxTexSize);
+	CollectDecoded();
+
 	TexMap::iterator i = mTexes.find(path);
 	if (i == mTexes.end())
 	{
-		return LoadTexture(path, is_absolute,flags);
+		if ((flags & tex_Stream) == 0)
+			return LoadTexture(path, is_absolute,flags);
+
+		TexInfo * inf = new TexInfo;
+		inf->tex_id = 0;
+		inf->path = path;
+		inf->org_x = inf->vis_x = inf->act_x = 0;
+		inf->org_y = inf->vis_y = inf->act_y = 0;
+		inf->fpath = is_absolute ? path : gPackageMgr->ComputePath(mPackage, path);
+		inf->flags = flags;
+		inf->state = tex_Evicted;
+		inf->bytes = 0;
+		inf->last_tick = mTick;
+		inf->decoded = nullptr;
+		inf->job = 0;
+		mTexes[path] = inf;
+		QueueDecode(inf);
+		return inf;
+	}
+
+	TexInfo * inf = i->second;
+	if (inf->state == tex_Failed)
+		return NULL;
+	if (inf->state != tex_Resident)
+	{
+		if (flags & tex_Stream)
+		{
+			if (inf->state == tex_Evicted)
+				QueueDecode(inf);
+		}
+		else if (inf->state != tex_Decoded)
+		{
+			// Someone needs this one right now - don't wait for the worker, whose result gets dropped
+			CancelDecode(inf);
+			if (!LoadNow(inf))
+				return NULL;
+		}
 	}
-	return i->second;
+	MakeResident(inf, flags & tex_Stream);
+	Trim();
+	return inf;
 }
 
 int			WED_TexMgr::GetTexID(TexRef ref)
 {
-	return ((TexInfo *) ref)->tex_id;
+	TexInfo * inf = (TexInfo *) ref;
+	if (inf->state == tex_Evicted)
+	{
+		if (inf->flags & tex_Stream)
+			QueueDecode(inf);
+		else
+			LoadNow(inf);
+	}
+	MakeResident(inf, inf->flags & tex_Stream);
+	return inf->tex_id;
 }
 
 void		WED_TexMgr::GetTexInfo(
@@ -96,111 +179,520 @@ void		WED_TexMgr::GetTexInfo(
 	if (org_y) *org_y = i->org_y;
 }
 
+void		WED_TexMgr::SetMemoryBudget(size_t bytes)
+{
+	mBudget = bytes;
+	if (mBudget && mBytes > mBudget)
+		StartTimer();
+}
+
 WED_TexMgr::TexInfo *	WED_TexMgr::LoadTexture(const char * path, bool is_absolute, int flags)
 {
-	string fpath(is_absolute ? path : gPackageMgr->ComputePath(mPackage, path));
-	TexInfo * inf = NULL;
+	TexInfo * inf = new TexInfo;
+	inf->tex_id = 0;
+	inf->path = path;
+	inf->fpath = is_absolute ? path : gPackageMgr->ComputePath(mPackage, path);
+	inf->flags = flags;
+	inf->state = tex_Evicted;
+	inf->bytes = 0;
+	inf->last_tick = mTick;
+	inf->decoded = nullptr;
+	inf->job = 0;
+
+	if (!LoadNow(inf))
+	{
+		delete inf;
+		return NULL;
+	}
+	mTexes[path] = inf;
+	MakeResident(inf, false);
+	Trim();
+	return inf;
+}
+
+// Synchronous decode and upload, on the calling thread. Leaves inf either decoded or failed.
+bool		WED_TexMgr::LoadNow(TexInfo * inf)
+{
+	delete inf->decoded;
+	inf->decoded = new TexDecoded;
+	if (DecodeTextureFromFile(inf->fpath.c_str(), inf->flags, mMaxTexSize, true, *inf->decoded))
+	{
+		inf->state = tex_Decoded;
+		if (Upload(inf, *inf->decoded))
+			return true;
+		// Not a DDS/KTX2 flavor the card understands, let BitmapUtils decompress it
+		if (inf->decoded->is_raw && DecodeTextureFromFile(inf->fpath.c_str(), inf->flags, mMaxTexSize, false, *inf->decoded))
+			return Upload(inf, *inf->decoded);
+	}
+	delete inf->decoded;
+	inf->decoded = nullptr;
+	inf->state = tex_Failed;
+	return false;
+}
+
+void		WED_TexMgr::QueueDecode(TexInfo * inf)
+{
+	inf->state = tex_Queued;
+	inf->job = ++mNextJob;
+	++mQueued;
+
+	tex_job_t job;
+	job.job = inf->job;
+	job.path = inf->path;
+	job.fpath = inf->fpath;
+	job.flags = inf->flags;
+	job.result = nullptr;
+	job.ok = false;
+	{
+		lock_guard<mutex> lock(mJobLock);
+		mJobs.push_back(job);
+	}
+	mJobCond.notify_one();
+	StartTimer();
+}
+
+// Hand a decoded texture to GL, needs the GL context. On success the texture is resident and the decoded data is gone.
+bool		WED_TexMgr::Upload(TexInfo * inf, TexDecoded& dec)
+{
+	size_t bytes = tex_gpu_bytes(dec);
 
 	GLuint tn;
 	glGenTextures(1,&tn);
-#if LOAD_DDS_DIRECT || LOAD_KTX2_DIRECT
-	FILE * file = fopen(fpath.c_str(), "rb");
-	char c[8];
-	if (file && fread(c, 1, 8, file) == 8)
+	int siz_x, siz_y;
+	float s, t;
+	if (!UploadDecodedTexture(dec, tn, &siz_x, &siz_y, &s, &t))
 	{
-		if (strncmp(c, "DDS ",4) == 0)
+		glDeleteTextures(1, &tn);
+		return false;
+	}
+
+	inf->tex_id = tn;
+	inf->org_x = inf->act_x = siz_x;
+	inf->org_y = inf->act_y = siz_y;
+	inf->vis_x = (float) siz_x * s;
+	inf->vis_y = (float) siz_y * t;
+	inf->bytes = bytes;
+	inf->state = tex_Resident;
+	inf->lru = mLRU.insert(mLRU.begin(), inf);
+	delete inf->decoded;
+	inf->decoded = nullptr;
+
+	mBytes += bytes;
+	mUploadBudget -= min(mUploadBudget, bytes);
+	++mUploads;
+	if (mBudget && mBytes > mBudget)
+		StartTimer();
+	return true;
+}
+
+// Called on every use: uploads a decoded texture if this tick's budget allows and bumps it in the LRU.
+void		WED_TexMgr::MakeResident(TexInfo * inf, bool may_defer)
+{
+	inf->last_tick = mTick;
+	mActive = true;
+	if (inf->state == tex_Decoded)
+	{
+		if (mUploadBudget == 0 && may_defer)
+		{
+			mDeferred = true;
+			StartTimer();
+			return;
+		}
+		if (!Upload(inf, *inf->decoded))
 		{
-			fseek(file, 0, SEEK_END);
-			int fileLength = ftell(file);
-			fseek(file, 0, SEEK_SET);
-			char * buffer = new char[fileLength];
-			if (buffer)
+			if (inf->decoded->is_raw)
 			{
-				if (fread(buffer, 1, fileLength, file) == fileLength)
-				{
-					int siz_x, siz_y;
-					if (LoadTextureFromDDS(buffer, buffer + fileLength, tn, flags, &siz_x, &siz_y))
-					{
-//						printf("Direct loading DDS %s\n", fpath.c_str());
-						inf = new TexInfo;
-						inf->tex_id = tn;
-						inf->org_x = inf->vis_x = inf->act_x = siz_x;
-						inf->org_y = inf->vis_y = inf->act_y = siz_y;
-						mTexes[path] = inf;
-					}
-				}
-				delete [] buffer;
+				// The card did not like the DDS/KTX2 - decode it the slow way
+				delete inf->decoded;
+				inf->decoded = nullptr;
+				if (!LoadNow(inf))
+					return;
+			}
+			else
+			{
+				delete inf->decoded;
+				inf->decoded = nullptr;
+				inf->state = tex_Failed;
+				return;
 			}
 		}
-#if LOAD_KTX2_DIRECT
-		else if (strncmp(c, "\253KTX 20\273", 8) == 0)
+	}
+	if (inf->state == tex_Resident && inf->lru != mLRU.begin())
+		mLRU.splice(mLRU.begin(), mLRU, inf->lru);
+}
+
+void		WED_TexMgr::Release(TexInfo * inf)
+{
+	if (inf->state == tex_Resident)
+	{
+		GLuint id = inf->tex_id;
+		glDeleteTextures(1, &id);
+		mLRU.erase(inf->lru);
+		mBytes -= inf->bytes;
+		inf->tex_id = 0;
+		inf->bytes = 0;
+	}
+	delete inf->decoded;
+	inf->decoded = nullptr;
+	inf->state = tex_Evicted;
+}
+
+// Evict from the cold end of the LRU, sparing everything used since the last tick. Needs the GL context.
+void		WED_TexMgr::Trim(void)
+{
+	if (mBudget == 0) return;
+	while (mBytes > mBudget && !mLRU.empty() && mLRU.back()->last_tick != mTick)
+	{
+		Release(mLRU.back());
+		++mEvictions;
+	}
+}
+
+// Forget the decode inf waits for. If no worker has picked it up yet it never runs, otherwise its result is dropped.
+void		WED_TexMgr::CancelDecode(TexInfo * inf)
+{
+	if (inf->state != tex_Queued)
+		return;
+	{
+		lock_guard<mutex> lock(mJobLock);
+		for (deque<tex_job_t>::iterator j = mJobs.begin(); j != mJobs.end(); ++j)
+			if (j->job == inf->job)
+			{
+				mJobs.erase(j);
+				break;
+			}
+	}
+	--mQueued;
+	inf->job = 0;
+	inf->state = tex_Evicted;
+}
+
+void		WED_TexMgr::CollectDecoded(void)
+{
+	vector<tex_job_t> done;
+	{
+		lock_guard<mutex> lock(mJobLock);
+		if (mDone.empty()) return;
+		done.swap(mDone);
+	}
+	bool any = false;
+	for (auto& j : done)
+	{
+		TexMap::iterator i = mTexes.find(j.path);
+		if (i != mTexes.end() && i->second->state == tex_Queued && i->second->job == j.job)
 		{
-			fseek(file, 0, SEEK_END);
-			int fileLength = ftell(file);
-			fseek(file, 0, SEEK_SET);
-			char* buffer = new char[fileLength];
-			if (buffer)
+			TexInfo * inf = i->second;
+			inf->job = 0;
+			--mQueued;
+			if (j.ok)
 			{
-				if (fread(buffer, 1, fileLength, file) == fileLength)
-				{
-					int siz_x, siz_y;
-					if (LoadTextureFromKTX2(buffer, buffer + fileLength, tn, flags, &siz_x, &siz_y))
-					{
-						//						printf("Direct loading KTX2 %s\n", fpath.c_str());
-						inf = new TexInfo;
-						inf->tex_id = tn;
-						inf->org_x = inf->vis_x = inf->act_x = siz_x;
-						inf->org_y = inf->vis_y = inf->act_y = siz_y;
-						mTexes[path] = inf;
-					}
-				}
-				delete[] buffer;
+				inf->decoded = j.result;
+				inf->state = tex_Decoded;
+				j.result = nullptr;
+				any = true;
 			}
+			else
+				inf->state = tex_Failed;
 		}
-#endif
-		fclose(file);
+		delete j.result;
 	}
-	if(inf) return inf;
+	if (any)
+		BroadcastMessage(msg_ResourceLoaded, 0);
+}
 
-//	printf("Normal load %s\n", fpath.c_str());
-#endif
+void		WED_TexMgr::StartTimer(void)
+{
+	if (!mTimerOn)
+	{
+		mTimerOn = true;
+		Start(0.1);
+	}
+}
 
-#if NEW_TEX_LOAD_STRATEGY
-	// auto-detection of file type, basic on file content, only
+void		WED_TexMgr::TimerFired(void)
+{
+	++mTick;
+	mUploadBudget = UPLOAD_BYTES_PER_TICK;
+	if (mDeferred)
+	{
+		mDeferred = false;
+		BroadcastMessage(msg_ResourceLoaded, 0);
+	}
+	CollectDecoded();
+
+	// Over budget only matters while textures are being used, the next lookup trims
+	bool over_budget = mActive && mBudget && mBytes > mBudget;
+	mActive = false;
+	if (mQueued == 0 && !mDeferred && !over_budget)
+	{
+		Stop();
+		mTimerOn = false;
+	}
+}
+
+void		WED_TexMgr::WorkerThread(void)
+{
+	unique_lock<mutex> lock(mJobLock);
+	while (1)
+	{
+		mJobCond.wait(lock, [this]{ return mQuit || !mJobs.empty(); });
+		if (mQuit) return;
+
+		tex_job_t job = mJobs.front();
+		mJobs.pop_front();
+		int max_size = mMaxTexSize;
+		lock.unlock();
+
+		job.result = new TexDecoded;
+		job.ok = DecodeTextureFromFile(job.fpath.c_str(), job.flags, max_size, true, *job.result);
+
+		lock.lock();
+		mDone.push_back(job);
+	}
+}
+
+#if UNIT_TEST
+// Headless test of streaming and eviction.  Link it without GL, TexUtils and the GUI timer - the stand-ins below replace
+// them: every texture decodes to TEST_TEX_BYTES and gets a fake GL name, and the test ticks the timer itself.
+// Checks that the budget holds, that the least recently used textures go first, that nothing used this tick is evicted
+// and that an evicted streamed texture comes back through GetTexID alone.  Then holds decodes on purpose to check that
+// a texture dropped while being decoded doesn't get the old result, and that one dropped before a worker got to it
+// is never decoded.
+#include <chrono>
+#include <atomic>
+#include <functional>
+
+#define TEST_TEX_BYTES	(256 * 256 * 4)
+
+static set<GLuint>	sLiveTex;
+static GLuint		sNextTex = 1;
+
+static mutex		sDecodeLock;
+static set<string>	sDecoded;			// every path a worker started on
+static set<string>	sHeld;				// decodes of these wait until they are taken out
+static map<string,int>	sDecodeSize;	// width and height to decode a path to, 256 if not given
+static atomic<int>	sDecodesDone(0);
+
+void glGenTextures(GLsizei n, GLuint * t)				{ while (n--) sLiveTex.insert(*t++ = sNextTex++); }
+void glDeleteTextures(GLsizei n, const GLuint * t)		{ while (n--) sLiveTex.erase(*t++); }
+void glGetIntegerv(GLenum what, GLint * v)				{ *v = 4096; }
+
+bool DecodeTextureFromFile(const char * inFileName, int inFlags, int inMaxSize, bool inAllowRaw, TexDecoded& outTex)
+{
+	int size = 256;
+	{
+		lock_guard<mutex> lock(sDecodeLock);
+		sDecoded.insert(inFileName);
+		if (sDecodeSize.count(inFileName))
+			size = sDecodeSize[inFileName];
+	}
+	while (1)
 	{
-		int siz_x, siz_y;
-		float s,t;
-		if (LoadTextureFromFile(fpath.c_str(), tn, flags, &siz_x, &siz_y, &s,&t))
-#else
-	// loading based on file name suffix. With this method we preserve awareness of original image size.
-	// But with openGL 3.0 as new minimum requirement - all GPU's have to support non-power-2 textures,
-	// and only Orthophoto export would be affected. So thats unlikely to be a loss, ever.
-	ImageInfo	im;
-	if(MakeSupportedType(fpath.c_str(), &im) == 0)
-	{
-		int siz_x, siz_y;
-		float s,t;
-		if (LoadTextureFromImage(im, tn, flags, &siz_x, &siz_y, &s,&t))
-#endif
 		{
-			inf = new TexInfo;
-			inf->tex_id = tn;
-#if NEW_TEX_LOAD_STRATEGY
-			inf->org_x = siz_x;
-			inf->org_y = siz_y;
-#else
-			inf->org_x = im.width;
-			inf->org_y = im.height;
-#endif
-			inf->act_x = siz_x;
-			inf->act_y = siz_y;
-			inf->vis_x = (float) siz_x * s;
-			inf->vis_y = (float) siz_y * t;
-			mTexes[path] = inf;
+			lock_guard<mutex> lock(sDecodeLock);
+			if (sHeld.count(inFileName) == 0)
+				break;
 		}
-#if !NEW_TEX_LOAD_STRATEGY
-		DestroyBitmap(&im);
-#endif
+		this_thread::sleep_for(chrono::milliseconds(1));
 	}
-	return inf;
+	outTex.flags = inFlags;
+	outTex.width = outTex.height = size;
+	outTex.channels = 4;
+	outTex.mips = 1;
+	outTex.pixels.resize(size * size * 4);
+	++sDecodesDone;
+	return true;
+}
+
+static void	test_set(set<string>& s, const string& path, bool on)
+{
+	lock_guard<mutex> lock(sDecodeLock);
+	if (on)	s.insert(path);
+	else	s.erase(path);
+}
+
+static bool	test_started(const string& path)
+{
+	lock_guard<mutex> lock(sDecodeLock);
+	return sDecoded.count(path) > 0;
+}
+
+static bool	test_wait(function<bool ()> cond)
+{
+	for (int tries = 0; tries < 5000; ++tries)
+	{
+		if (cond()) return true;
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+	return false;
+}
+
+bool UploadDecodedTexture(TexDecoded& ioTex, int inTexNum, int * outWidth, int * outHeight, float * outS, float * outT)
+{
+	*outWidth = ioTex.width;
+	*outHeight = ioTex.height;
+	*outS = ioTex.s;
+	*outT = ioTex.t;
+	return true;
+}
+
+GUI_Timer::GUI_Timer(void) { }
+GUI_Timer::~GUI_Timer(void) { }
+void GUI_Timer::Start(float seconds) { }
+void GUI_Timer::Stop(void) { }
+
+//	usage: <textures> <textures that fit the budget>
+int main(int argc, const char * argv[])
+{
+	int n = argc > 1 ? atoi(argv[1]) : 40;
+	int fit = argc > 2 ? atoi(argv[2]) : 10;
+
+	WED_TexMgr mgr("");
+	mgr.SetMemoryBudget((size_t) fit * TEST_TEX_BYTES);
+
+	vector<string> names;
+	vector<TexRef> refs;
+	for (int i = 0; i < n; ++i)
+	{
+		names.push_back("/tex/" + to_string(i) + ".png");
+		refs.push_back(mgr.LookupTexture(names.back().c_str(), true, tex_Stream));
+	}
+
+	// Draw the given textures until all of them are up, ticking the timer like the app does - at most a few seconds.
+	auto draw = [&](int first, int count) {
+		for (int tries = 0; tries < 5000; ++tries)
+		{
+			bool all = true;
+			for (int i = first; i < first + count; ++i)
+				if (mgr.GetTexID(mgr.LookupTexture(names[i].c_str(), true, tex_Stream)) == 0)
+					all = false;
+			mgr.TimerFired();
+			if (all) return true;
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		return false;
+	};
+
+	// Sweep across all textures, a screen of 'fit' at a time, like panning the map.
+	for (int i = 0; i + fit <= n; i += fit)
+	{
+		if (!draw(i, fit))
+		{
+			printf("Textures %d to %d never got resident.\n", i, i + fit - 1);
+			return 1;
+		}
+		if (sLiveTex.size() > 2 * fit)
+		{
+			printf("%d textures resident with a budget of %d.\n", (int) sLiveTex.size(), fit);
+			return 1;
+		}
+	}
+
+	// Now everything but the last screen is gone - and the first textures went first.
+	mgr.LookupTexture(names[n - 1].c_str(), true, tex_Stream);
+	if (sLiveTex.size() > fit || mgr.GetTexID(refs[n - 1]) == 0)
+	{
+		printf("%d textures resident with a budget of %d after the sweep.\n", (int) sLiveTex.size(), fit);
+		return 1;
+	}
+
+	// The first texture was evicted; asking for its ID, without a lookup, has to bring it back.
+	if (mgr.GetTexID(refs[0]) != 0)
+	{
+		printf("The least recently used texture was not evicted.\n");
+		return 1;
+	}
+	for (int tries = 0; tries < 5000 && mgr.GetTexID(refs[0]) == 0; ++tries)
+	{
+		mgr.TimerFired();
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+	if (mgr.GetTexID(refs[0]) == 0)
+	{
+		printf("An evicted texture never came back through GetTexID.\n");
+		return 1;
+	}
+
+	auto resident = [&](const string& path) {
+		for (int tries = 0; tries < 5000; ++tries)
+		{
+			if (mgr.GetTexID(mgr.LookupTexture(path.c_str(), true, tex_Stream)) != 0)
+				return true;
+			mgr.TimerFired();
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		return false;
+	};
+
+	// Drop a texture while a worker decodes it and look it up again - the file now has a different size.  The old
+	// decode finishes first; only the new one may be used.
+	string redo("/tex/redo.png");
+	test_set(sHeld, redo, true);
+	mgr.LookupTexture(redo.c_str(), true, tex_Stream);
+	if (!test_wait([&]{ return test_started(redo); }))
+	{
+		printf("The decode never started.\n");
+		return 1;
+	}
+	mgr.DropTexture(redo.c_str());
+	{
+		lock_guard<mutex> lock(sDecodeLock);
+		sDecodeSize[redo] = 128;
+	}
+	int done = sDecodesDone;
+	TexRef redo_ref = mgr.LookupTexture(redo.c_str(), true, tex_Stream);
+	test_set(sHeld, redo, false);
+	if (!test_wait([&]{ return sDecodesDone >= done + 2; }))
+	{
+		printf("The decodes never finished.\n");
+		return 1;
+	}
+	int redo_x = 0;
+	bool redo_ok = resident(redo);
+	mgr.GetTexInfo(redo_ref, nullptr, nullptr, &redo_x, nullptr, nullptr, nullptr);
+	if (!redo_ok || redo_x != 128)
+	{
+		printf("A texture dropped during its decode got the stale result (%d pixels wide).\n", redo_x);
+		return 1;
+	}
+
+	// Keep every worker busy, queue one more and drop it - it must never be decoded.
+	vector<string> busy;
+	for (int i = 0; i < 8; ++i)
+	{
+		busy.push_back("/tex/busy" + to_string(i) + ".png");
+		test_set(sHeld, busy.back(), true);
+		mgr.LookupTexture(busy.back().c_str(), true, tex_Stream);
+	}
+	this_thread::sleep_for(chrono::milliseconds(50));
+	string dropped;
+	for (vector<string>::iterator b = busy.begin(); b != busy.end(); ++b)
+		if (!test_started(*b))
+		{
+			dropped = *b;
+			mgr.DropTexture(b->c_str());
+			break;
+		}
+	for (vector<string>::iterator b = busy.begin(); b != busy.end(); ++b)
+		test_set(sHeld, *b, false);
+	if (dropped.empty())
+	{
+		printf("More than 8 workers - can't check cancelling.\n");
+		return 1;
+	}
+	for (vector<string>::iterator b = busy.begin(); b != busy.end(); ++b)
+		if (*b != dropped && !resident(*b))
+		{
+			printf("%s never got resident.\n", b->c_str());
+			return 1;
+		}
+	if (test_started(dropped))
+	{
+		printf("A texture dropped before its decode started was decoded anyway.\n");
+		return 1;
+	}
+
+	printf("OK, %d textures, %d resident.\n", n, (int) sLiveTex.size());
+	return 0;
 }
+#endif
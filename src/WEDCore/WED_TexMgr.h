@@ -25,8 +25,36 @@
 #define WED_TexMgr_H
 
 #include "ITexMgr.h"
+#include "GUI_Broadcaster.h"
+#include "GUI_Timer.h"
+#include <list>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
-class WED_TexMgr : public virtual ITexMgr {
+struct	TexDecoded;
+
+/*
+	WED_TexMgr - textures are loaded on first lookup and kept around until dropped or evicted.
+
+	Lookups with tex_Stream never decode on the calling thread: the texture is queued for a small pool of worker threads
+	that read, decode and mipmap it into main memory. The TexRef is valid right away but has a tex ID of 0 until the
+	texture is uploaded. Uploads happen on the drawing thread, during lookups, and are limited per timer tick so that
+	a screen full of new textures does not stall a single frame. A msg_ResourceLoaded broadcast asks for the redraw.
+
+	Every decode request gets a new job number, which the texture remembers while it waits. A result is only taken if
+	it carries the number the texture is waiting for - dropping a texture, loading it synchronously or queueing it
+	again makes any decode still in flight stale, and its result is thrown away. Dropping also takes a request that no
+	worker has started off the queue.
+
+	Resident textures are kept in LRU order and evicted once their estimated size exceeds the budget (preferences/
+	TextureCacheMB). An evicted texture keeps its TexInfo, so TexRefs never dangle - it is simply reloaded the next
+	time it is looked up or its ID is asked for. A streamed one goes back on the decode queue and has an ID of 0 again
+	until it is uploaded. Textures used since the last timer tick are never evicted.
+*/
+
+class WED_TexMgr : public virtual ITexMgr, public GUI_Broadcaster, public GUI_Timer {
 public:
 
 						 WED_TexMgr(const string& package);
@@ -45,8 +73,19 @@ public:
 								int *	org_x,
 								int *	org_y);
 
+			void		SetMemoryBudget(size_t bytes);
+	virtual	void		TimerFired(void);
+
 private:
 
+	enum {
+		tex_Resident,		// uploaded, tex_id is valid
+		tex_Queued,			// waiting for or being decoded by a worker
+		tex_Decoded,		// decoded, waiting for its upload
+		tex_Evicted,		// was resident once, sizes are still valid
+		tex_Failed
+	};
+
 	struct	TexInfo {
 		int			tex_id;
 		int			vis_x;
@@ -55,6 +94,16 @@ private:
 		int			act_y;
 		int			org_x;
 		int			org_y;
+
+		string		path;			// key into mTexes
+		string		fpath;
+		int			flags;
+		int			state;
+		size_t		bytes;			// estimated GPU memory, while resident
+		int			last_tick;
+		list<TexInfo *>::iterator	lru;
+		TexDecoded *				decoded;
+		int							job;			// decode request we wait for, while queued
 	};
 
 	typedef map<string,TexInfo *>	TexMap;
@@ -64,7 +113,46 @@ private:
 	string	mPackage;
 
 	TexInfo *	LoadTexture(const char * path, bool is_absolute, int flags);
+	bool		LoadNow(TexInfo * inf);
+	void		QueueDecode(TexInfo * inf);
+	void		CancelDecode(TexInfo * inf);
+	bool		Upload(TexInfo * inf, TexDecoded& dec);
+	void		MakeResident(TexInfo * inf, bool may_defer);
+	void		Release(TexInfo * inf);
+	void		CollectDecoded(void);
+	void		Trim(void);
+	void		StartTimer(void);
+	void		WorkerThread(void);
+
+	struct	tex_job_t {
+		int				job;
+		string			path;		// key into mTexes
+		string			fpath;
+		int				flags;
+		TexDecoded *	result;
+		bool			ok;
+	};
+
+	list<TexInfo *>				mLRU;			// resident textures, front is most recently used
+	size_t						mBytes;
+	size_t						mBudget;
+	size_t						mUploadBudget;	// bytes left to upload until the next tick
+	int							mTick;
+	int							mMaxTexSize;
+	int							mQueued;		// main thread only
+	int							mNextJob;		// main thread only
+	bool						mDeferred;		// an upload was put off for lack of budget
+	bool						mActive;		// textures were used since the last tick
+	bool						mTimerOn;
+	int							mUploads;
+	int							mEvictions;
 
+	vector<thread>				mWorkers;
+	mutex						mJobLock;
+	condition_variable			mJobCond;
+	deque<tex_job_t>			mJobs;
+	vector<tex_job_t>			mDone;
+	bool						mQuit;
 };
 
 #endif /* WED_TexMgr_H */
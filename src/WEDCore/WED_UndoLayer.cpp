@@ -23,27 +23,207 @@
 
 #include "WED_UndoLayer.h"
 #include "WED_Persistent.h"
-#include "WED_Buffer.h"
 #include "WED_Archive.h"
 #include "WED_Messages.h"
 #include "AssertUtils.h"
-#include "WED_FastBuffer.h"
+#include "IODefs.h"
+#include <zlib.h>
 // NOTE: we could store no turd for created objs
 
+// Deltas and copies smaller than this are not worth a zlib stream
+#define	UNDO_ZIP_THRESHOLD	256
+
+class	WED_UndoWriter : public IOWriter {
+public:
+	WED_UndoWriter(vector<char>& buf) : mBuf(buf) { }
+
+	virtual	void	WriteShort(short v)		{ Write(&v, sizeof(v)); }
+	virtual	void	WriteInt(int v)			{ Write(&v, sizeof(v)); }
+	virtual	void	WriteFloat(float v)		{ Write(&v, sizeof(v)); }
+	virtual	void	WriteDouble(double v)	{ Write(&v, sizeof(v)); }
+	virtual	void	WriteBulk(const char * inBuf, int inLength, bool inZip) { Write(inBuf, inLength); }
+
+private:
+	void	Write(const void * p, int len) { mBuf.insert(mBuf.end(), (const char *) p, (const char *) p + len); }
+
+	vector<char>&	mBuf;
+};
+
+class	WED_UndoReader : public IOReader {
+public:
+	WED_UndoReader(const vector<char>& buf) : mPtr(buf.data()), mEnd(buf.data() + buf.size()) { }
+
+	virtual	void	ReadShort(short& v)		{ Read(&v, sizeof(v)); }
+	virtual	void	ReadInt(int& v)			{ Read(&v, sizeof(v)); }
+	virtual	void	ReadFloat(float& v)		{ Read(&v, sizeof(v)); }
+	virtual	void	ReadDouble(double& v)	{ Read(&v, sizeof(v)); }
+	virtual	void	ReadBulk(char * inBuf, int inLength, bool inZip) { Read(inBuf, inLength); }
+
+private:
+	void	Read(void * p, int len)
+	{
+		Assert(len <= mEnd - mPtr);
+		memcpy(p, mPtr, len);
+		mPtr += len;
+	}
+
+	const char *	mPtr;
+	const char *	mEnd;
+};
+
+static void put_varint(vector<char>& out, size_t v)
+{
+	while(v >= 0x80)
+	{
+		out.push_back((char) (v | 0x80));
+		v >>= 7;
+	}
+	out.push_back((char) v);
+}
+
+static size_t get_varint(const char *& p)
+{
+	size_t v = 0;
+	int shift = 0;
+	while(*p & 0x80)
+	{
+		v |= (size_t) (*p++ & 0x7F) << shift;
+		shift += 7;
+	}
+	v |= (size_t) (unsigned char) *p++ << shift;
+	return v;
+}
+
+static unsigned int fnv_hash(const char * p, size_t len)
+{
+	unsigned int h = 2166136261u;
+	while(len--)
+		h = (h ^ (unsigned char) *p++) * 16777619u;
+	return h;
+}
+
+/*	Delta of 'before' against 'after', so that apply_delta(after) gives 'before' back.  Serialized objects mostly
+	change in place (a moved node changes its coordinates, nothing else), so the two are compared position by position.
+	A common tail is split off first, so an insertion or removal somewhere in the middle - a node added to a polygon -
+	does not turn the whole rest of the object into literals.
+
+	Format:	before_len, after_len, tail_len, hash of after, then pairs of (match_len, literal_len, literal bytes) until
+	before_len - tail_len bytes are covered.  Match bytes come from after at the same position.  All lengths are varints.  */
+static void make_delta(const char * before, size_t n, const vector<char>& after, vector<char>& out)
+{
+	size_t m = after.size();
+	size_t tail = 0;
+	if(n != m)
+		while(tail < n && tail < m && before[n-1-tail] == after[m-1-tail])
+			++tail;
+	size_t body = n - tail;
+	size_t cmp = min(body, m - tail);
+
+	put_varint(out, n);
+	put_varint(out, m);
+	put_varint(out, tail);
+	unsigned int h = fnv_hash(after.data(), m);
+	out.insert(out.end(), (const char *) &h, (const char *) &h + sizeof(h));
+
+	size_t i = 0;
+	while(i < body)
+	{
+		size_t match = 0;
+		while(i + match < cmp && before[i + match] == after[i + match])
+			++match;
+		i += match;
+
+		// A literal runs until we hit 4 matching bytes in a row - anything shorter is cheaper to just copy.
+		size_t lit = i;
+		while(i < body)
+		{
+			size_t run = 0;
+			while(run < 4 && i + run < cmp && before[i + run] == after[i + run])
+				++run;
+			if(run == 4) break;
+			i += run ? run : 1;
+		}
+		put_varint(out, match);
+		put_varint(out, i - lit);
+		out.insert(out.end(), before + lit, before + i);
+	}
+}
+
+// Returns false if 'after' is not the state the delta was made against - then the original state can't be rebuilt.
+static bool apply_delta(const char * p, const vector<char>& after, vector<char>& out)
+{
+	size_t n = get_varint(p);
+	size_t m = get_varint(p);
+	size_t tail = get_varint(p);
+	unsigned int h;
+	memcpy(&h, p, sizeof(h));
+	p += sizeof(h);
+
+	// This happens if a WriteTo is not reproducible from its own ReadFrom, or something changed the object behind undo's back.
+	if(m != after.size() || h != fnv_hash(after.data(), after.size()) || tail > n || tail > m)
+	{
+		LOG_MSG("E/Undo object changed under an undo delta, %d vs %d bytes\n", (int) after.size(), (int) m);
+		return false;
+	}
+
+	out.clear();
+	out.reserve(n);
+	size_t body = n - tail;
+	while(out.size() < body)
+	{
+		size_t match = get_varint(p);
+		size_t lit = get_varint(p);
+		size_t pos = out.size();
+		if(pos + match > m || pos + match + lit > body)
+			return false;
+		out.insert(out.end(), after.begin() + pos, after.begin() + pos + match);
+		out.insert(out.end(), p, p + lit);
+		p += lit;
+	}
+	out.insert(out.end(), after.end() - tail, after.end());
+	return true;
+}
+
+// Appends a zlib stream of [p, p+len) to out, prefixed by len. Returns false and leaves out alone if that does not save anything.
+static bool deflate_into(const char * p, size_t len, vector<char>& out)
+{
+	uLongf zlen = compressBound(len);
+	vector<char> z(zlen);
+	if(compress2((Bytef *) z.data(), &zlen, (const Bytef *) p, len, 1) != Z_OK || zlen + 8 >= len)
+		return false;
+	put_varint(out, len);
+	out.insert(out.end(), z.begin(), z.begin() + zlen);
+	return true;
+}
+
+static void inflate_from(const char * p, size_t len, vector<char>& out)
+{
+	const char * start = p;
+	uLongf ulen = get_varint(p);
+	out.resize(ulen);
+	int err = uncompress((Bytef *) out.data(), &ulen, (const Bytef *) p, len - (p - start));
+	Assert(err == Z_OK && ulen == out.size());
+}
+
 WED_UndoLayer::WED_UndoLayer(WED_Archive * inArchive, const string& inName, const char * inFile, int inLine) :
-	mArchive(inArchive), mName(inName), mChangeMask(0), mFile(inFile), mLine(inLine)
+	mArchive(inArchive), mName(inName), mChangeMask(0), mFile(inFile), mLine(inLine), mRawSize(0), mCompacted(false)
 {
-	mStorage = new WED_FastBufferGroup;
 }
 
 WED_UndoLayer::~WED_UndoLayer(void)
 {
-//	for(ObjInfoMap::iterator i = mObjects.begin(); i != mObjects.end(); ++i)
-//	{
-//		if (i->second.buffer)
-//			delete i->second.buffer;
-//	}
-	delete mStorage;
+}
+
+void	WED_UndoLayer::Record(ObjInfo& info, WED_Persistent * inObject)
+{
+	Assert(!mCompacted);
+	info.encoding = enc_Raw;
+	info.offset = mRaw.size();
+	WED_UndoWriter writer(mRaw);
+	inObject->WriteTo(&writer);
+	writer.WriteInt(inObject->GetDirty());
+	info.length = mRaw.size() - info.offset;
+	mRawSize += info.length;
 }
 
 void 	WED_UndoLayer::ObjectCreated(WED_Persistent * inObject)
@@ -66,7 +246,9 @@ void 	WED_UndoLayer::ObjectCreated(WED_Persistent * inObject)
 		info.the_class = inObject->GetClass();
 		info.op = op_Created;
 		info.id = inObject->GetID();
-		info.buffer = NULL;
+		info.encoding = enc_None;
+		info.offset = 0;
+		info.length = 0;
 		mObjects.insert(ObjInfoMap::value_type(inObject->GetID(), info));
 	}
 }
@@ -90,10 +272,7 @@ void	WED_UndoLayer::ObjectChanged(WED_Persistent * inObject, int change_kind)
 		info.the_class = inObject->GetClass();
 		info.op = op_Changed;
 		info.id = inObject->GetID();
-		info.buffer = mStorage->MakeNewBuffer();
-//		info.buffer = new WED_Buffer;
-		inObject->WriteTo(info.buffer);
-		info.buffer->WriteInt(inObject->GetDirty());
+		Record(info, inObject);
 		mObjects.insert(ObjInfoMap::value_type(inObject->GetID(), info));
 	}
 	mArchive->BroadcastMessage(msg_ArchiveChangedEphemerally, GetChangeMask());
@@ -129,17 +308,121 @@ void	WED_UndoLayer::ObjectDestroyed(WED_Persistent * inObject)
 		info.the_class = inObject->GetClass();
 		info.op = op_Destroyed;
 		info.id = inObject->GetID();
-		info.buffer = mStorage->MakeNewBuffer();
-//		info.buffer = new WED_Buffer;
-		inObject->WriteTo(info.buffer);
-		info.buffer->WriteInt(inObject->GetDirty());
+		Record(info, inObject);
 		mObjects.insert(ObjInfoMap::value_type(inObject->GetID(), info));
 	}
 
 }
 
-void	WED_UndoLayer::Execute(void)
+void	WED_UndoLayer::Compact(void)
 {
+	if (mCompacted) return;
+	mCompacted = true;
+
+	vector<char>	now, delta, check;
+	for (ObjInfoMap::iterator i = mObjects.begin(); i != mObjects.end(); ++i)
+	{
+		ObjInfo& info = i->second;
+		if (info.encoding == enc_None) continue;
+
+		const char * raw = mRaw.data() + info.offset;
+		size_t raw_len = info.length;
+		info.offset = mPacked.size();
+
+		if (info.op == op_Changed)
+		{
+			WED_Persistent * obj = mArchive->Fetch(i->first);
+			Assert(obj != NULL);
+			now.clear();
+			WED_UndoWriter writer(now);
+			obj->WriteTo(&writer);
+			writer.WriteInt(obj->GetDirty());
+
+			delta.clear();
+			make_delta(raw, raw_len, now, delta);
+			// Only keep the delta if it really gives the original back - otherwise keep the full copy.
+			if (delta.size() < raw_len && apply_delta(delta.data(), now, check) && check.size() == raw_len &&
+				equal(check.begin(), check.end(), raw))
+			{
+				if (delta.size() >= UNDO_ZIP_THRESHOLD && deflate_into(delta.data(), delta.size(), mPacked))
+					info.encoding = enc_DeltaZ;
+				else
+				{
+					info.encoding = enc_Delta;
+					mPacked.insert(mPacked.end(), delta.begin(), delta.end());
+				}
+				info.length = mPacked.size() - info.offset;
+				continue;
+			}
+		}
+
+		if (raw_len >= UNDO_ZIP_THRESHOLD && deflate_into(raw, raw_len, mPacked))
+			info.encoding = enc_RawZ;
+		else
+		{
+			info.encoding = enc_Raw;
+			mPacked.insert(mPacked.end(), raw, raw + raw_len);
+		}
+		info.length = mPacked.size() - info.offset;
+	}
+	vector<char>().swap(mRaw);
+	mPacked.shrink_to_fit();
+}
+
+size_t	WED_UndoLayer::GetMemorySize(void) const
+{
+	return sizeof(*this) + mRaw.capacity() + mPacked.capacity() + mObjects.size() * (sizeof(ObjInfo) + 2 * sizeof(void *));
+}
+
+// Original state of one object, as written by WriteTo plus the dirty flag. Delta encoded objects need the current object.
+bool	WED_UndoLayer::Decode(const ObjInfo& info, vector<char>& out)
+{
+	const vector<char>& src(mCompacted ? mPacked : mRaw);
+	const char * p = src.data() + info.offset;
+	vector<char> delta, now;
+	switch(info.encoding) {
+	case enc_None:
+		out.clear();
+		break;
+	case enc_Raw:
+		out.assign(p, p + info.length);
+		break;
+	case enc_RawZ:
+		inflate_from(p, info.length, out);
+		break;
+	case enc_Delta:
+	case enc_DeltaZ:
+		{
+			WED_Persistent * obj = mArchive->Fetch(info.id);
+			Assert(obj != NULL);
+			WED_UndoWriter writer(now);
+			obj->WriteTo(&writer);
+			writer.WriteInt(obj->GetDirty());
+			if (info.encoding == enc_DeltaZ)
+			{
+				inflate_from(p, info.length, delta);
+				return apply_delta(delta.data(), now, out);
+			}
+			else
+				return apply_delta(p, now, out);
+		}
+	}
+	return true;
+}
+
+bool	WED_UndoLayer::Execute(void)
+{
+	// Rebuild all original states before touching anything - deltas are relative to the objects as they are now.
+	// If any of them can't be rebuilt, nothing is changed at all.
+	hash_map<int, vector<char> >	states;
+	for (ObjInfoMap::iterator i = mObjects.begin(); i != mObjects.end(); ++i)
+		if (i->second.op != op_Created)
+			if (!Decode(i->second, states[i->first]))
+			{
+				LOG_MSG("E/Undo cannot restore object %d for '%s' from %s:%d\n", i->first, mName.c_str(), mFile, mLine);
+				return false;
+			}
+
 	vector<WED_Persistent *>	needs_post_call;
 	int d;
 	for (ObjInfoMap::iterator i = mObjects.begin(); i != mObjects.end(); ++i)
@@ -148,34 +431,36 @@ void	WED_UndoLayer::Execute(void)
 		switch(i->second.op) {
 		case op_Created:
 			obj = mArchive->Fetch(i->first);
-			DebugAssert(i->second.buffer == NULL);
+			DebugAssert(i->second.encoding == enc_None);
 			Assert(obj != NULL);
 			obj->Delete();
 			break;
 		case op_Changed:
 			obj = mArchive->Fetch(i->first);
 			Assert(obj != NULL);
-			DebugAssert(i->second.buffer != NULL);
-			i->second.buffer->ResetRead();
-			obj->StateChanged();
-			if(obj->ReadFrom(i->second.buffer))
-				needs_post_call.push_back(obj);
-			i->second.buffer->ReadInt(d);
+			{
+				WED_UndoReader reader(states[i->first]);
+				obj->StateChanged();
+				if(obj->ReadFrom(&reader))
+					needs_post_call.push_back(obj);
+				reader.ReadInt(d);
+			}
 			obj->SetDirty(d);
 			break;
 		case op_Destroyed:
 			obj = WED_Persistent::CreateByClass(i->second.the_class, mArchive, i->first);
 			DebugAssert(obj != NULL);
-			DebugAssert(i->second.buffer != NULL);
-			i->second.buffer->ResetRead();
-			if(obj->ReadFrom(i->second.buffer))
-				needs_post_call.push_back(obj);
-			i->second.buffer->ReadInt(d);
+			{
+				WED_UndoReader reader(states[i->first]);
+				if(obj->ReadFrom(&reader))
+					needs_post_call.push_back(obj);
+				reader.ReadInt(d);
+			}
 			obj->SetDirty(d);
 			break;
 		}
 	}
 	for(vector<WED_Persistent *>::iterator o = needs_post_call.begin(); o != needs_post_call.end(); ++o)
 		(*o)->PostChangeNotify();
+	return true;
 }
-
@@ -25,13 +25,20 @@
 #define WED_UNDOLAYER_H
 
 class	WED_Archive;
-class	WED_Buffer;
-class	WED_FastBuffer;
-class	WED_FastBufferGroup;
 class	WED_Persistent;
 
 #define 	UNDO_DISCARD	((WED_UndoLayer *) -1)
 
+/*
+	WED_UndoLayer - STORAGE
+
+	While a command runs, the original state of every changed or destroyed object is appended to one raw buffer.
+	Once the command is done, Compact packs the layer: a changed object is stored as a delta of its original state
+	against its state right now, and anything big is deflated.  This works because undo is strictly LIFO - when the
+	layer is executed, every object it changed is back in exactly the state it had when the layer was compacted.
+	A drag that moves a few nodes of a big polygon thus costs a few bytes per node and step, not the whole object.
+*/
+
 
 class	WED_UndoLayer {
 public:
@@ -43,7 +50,11 @@ public:
 		void	ObjectChanged(WED_Persistent * inObject, int change_kind);
 		void	ObjectDestroyed(WED_Persistent * inObject);
 
-		void	Execute(void);
+		bool	Execute(void);		// false if the layer could not be applied - then nothing was changed
+		void	Compact(void);			// call once recording is done, before other changes happen
+
+		size_t	GetMemorySize(void) const;	// bytes held now
+		size_t	GetRawSize(void) const { return mRawSize; }	// bytes the full object copies took
 
 		string	GetName(void) const { return mName; }
 		const char * GetFile(void) const { return mFile; }
@@ -60,13 +71,26 @@ private:
 			op_Destroyed
 	};
 
+	enum LayerEncoding {
+			enc_None,			// op_Created, nothing stored
+			enc_Raw,			// verbatim copy
+			enc_RawZ,			// deflated copy
+			enc_Delta,			// delta against the current object
+			enc_DeltaZ			// deflated delta
+	};
+
 	struct ObjInfo {
 		LayerOp				op;
 		int					id;
 		const char *		the_class;
-		WED_FastBuffer *	buffer;
+		LayerEncoding		encoding;
+		size_t				offset;		// into mRaw until compacted, then into mPacked
+		int					length;
 	};
 
+	void	Record(ObjInfo& info, WED_Persistent * inObject);
+	bool	Decode(const ObjInfo& info, vector<char>& out);
+
 	typedef hash_map<int, ObjInfo>		ObjInfoMap;
 
 	ObjInfoMap				mObjects;
@@ -75,7 +99,10 @@ private:
 	const char *			mFile;
 	int						mLine;
 	int						mChangeMask;
-	WED_FastBufferGroup *	mStorage;
+	vector<char>			mRaw;
+	vector<char>			mPacked;
+	size_t					mRawSize;
+	bool					mCompacted;
 
 	// Things we do not allow
 	WED_UndoLayer();
@@ -27,6 +27,7 @@
 #include "AssertUtils.h"
 #include "WED_Messages.h"
 #include "PlatformUtils.h"
+#include "WED_Globals.h"
 // UNDO STACK ORDER IS:
 
 // CHRONOLOGICAL FROM BEGIN TO END
@@ -36,11 +37,14 @@
 #define WARN_IF_LESS_LEVEL	10
 #define MAX_UNDO_LEVELS 100   // now that WED is 64 bits - there is a LOT of virtual memory to keep this stuff around ...
                               // tested a large scenery (900 apts on US east coast, 1.2 Million items, 1 GB memory usage) and moved 
-										// the whole thing 10x - that is barely 200MB of undo buffer. No need to keep track of its size for now.
+										// the whole thing 10x - that is barely 200MB of undo buffer. Layers are delta compressed
+										// now, and their total size is limited by the undo budget as well.
 
 WED_UndoMgr::WED_UndoMgr(WED_Archive * inArchive, WED_UndoFatalErrorHandler * panic_handler) 
-	: mCommand(NULL), mArchive(inArchive), mPanicHandler(panic_handler), mUndoSinceMark(-1)
+	: mCommand(NULL), mArchive(inArchive), mPanicHandler(panic_handler), mUndoSinceMark(-1),
+	mBytes(0), mBudget(0), mRawBytes(0), mPackedBytes(0), mLayers(0)
 {
+	SetMemoryBudget((size_t) gUndoBudgetMB * 1024 * 1024);
 }
 
 WED_UndoMgr::~WED_UndoMgr()
@@ -48,10 +52,56 @@ WED_UndoMgr::~WED_UndoMgr()
 	DebugAssert(mCommand == NULL);
 	if (mCommand) delete mCommand;
 	mCommand = NULL;
+	if (mLayers)
+		LOG_MSG("I/Undo %d layers, %.1lf KB avg per layer, %.1lf KB avg as full copies\n", mLayers,
+			mPackedBytes / 1024.0 / mLayers, mRawBytes / 1024.0 / mLayers);
 	PurgeUndo();
 	PurgeRedo();
 }
 
+void	WED_UndoMgr::SetMemoryBudget(size_t bytes)
+{
+	mBudget = bytes;
+	Trim();
+}
+
+void	WED_UndoMgr::Push(LayerList& list, bool front, WED_UndoLayer * layer)
+{
+	size_t raw = layer->GetRawSize();
+	layer->Compact();
+	size_t packed = layer->GetMemorySize();
+	mRawBytes += raw;
+	mPackedBytes += packed;
+	++mLayers;
+	mBytes += packed;
+	if (front)
+		list.push_front(layer);
+	else
+		list.push_back(layer);
+}
+
+void	WED_UndoMgr::Pop(LayerList& list, bool front)
+{
+	WED_UndoLayer * layer = front ? list.front() : list.back();
+	mBytes -= layer->GetMemorySize();
+	delete layer;
+	if (front)
+		list.pop_front();
+	else
+		list.pop_back();
+}
+
+// Drop the oldest undo levels until we are within budget. The most recent level always stays.
+void	WED_UndoMgr::Trim(void)
+{
+	while (mUndo.size() > MAX_UNDO_LEVELS)
+		Pop(mUndo, true);
+	while (mBudget && mBytes > mBudget && !mRedo.empty())
+		Pop(mRedo, false);
+	while (mBudget && mBytes > mBudget && mUndo.size() > 1)
+		Pop(mUndo, true);
+}
+
 static const char * trim_file(const char * p)
 {
 	const char * ret = p;
@@ -66,12 +116,8 @@ static const char * trim_file(const char * p)
 
 void	WED_UndoMgr::__StartCommand(const string& inName, const char * file, int line)
 {
-	while(mUndo.size() > MAX_UNDO_LEVELS)
-	{
-		delete mUndo.front();
-		mUndo.pop_front();
-	}
-	
+	Trim();
+
 	// This is the asset case that often burns us: a command is started WHILE another command is going on.  This happens due to
 	// either bad UI code or unknown weird shit from the window mgr.
 	if (mCommand != NULL)
@@ -103,11 +149,12 @@ void	WED_UndoMgr::CommitCommand(void)
 		return;
 	}
 	PurgeRedo();
-	mUndo.push_back(mCommand);
+	Push(mUndo, false, mCommand);
 	int change_mask = mCommand->GetChangeMask();
 	mCommand = NULL;
 	mArchive->BroadcastMessage(msg_ArchiveChanged,change_mask);
 	if (mUndoSinceMark >= 0)  mUndoSinceMark++;
+	Trim();
 }
 
 void	WED_UndoMgr::AbortCommand(void)
@@ -177,11 +224,18 @@ void	WED_UndoMgr::Undo(void)
 	WED_UndoLayer * redo = new WED_UndoLayer(mArchive, undo->GetName(), undo->GetFile(), undo->GetLine());
 	mArchive->SetUndo(redo);
 	int change_mask = undo->GetChangeMask();
-	undo->Execute();
+	bool ok = undo->Execute();
 	mArchive->SetUndo(NULL);
-	mRedo.push_front(redo);
-	delete undo;
-	mUndo.pop_back();
+	if (!ok)
+	{
+		// Every older layer builds on this one, so none of them can be undone either.  Nothing was changed yet.
+		delete redo;
+		PurgeUndo();
+		DoUserAlert("WED could not undo the last operation - the undo history has been cleared.  Your data has not been changed.");
+		return;
+	}
+	Push(mRedo, true, redo);
+	Pop(mUndo, false);
 	mArchive->mOpCount--;
 	mArchive->mCacheKey++;
 	mArchive->BroadcastMessage(msg_ArchiveChanged,change_mask);
@@ -195,11 +249,17 @@ void	WED_UndoMgr::Redo(void)
 	WED_UndoLayer * undo = new WED_UndoLayer(mArchive, redo->GetName(), redo->GetFile(), redo->GetLine());
 	mArchive->SetUndo(undo);
 	int change_mask = redo->GetChangeMask();
-	redo->Execute();
+	bool ok = redo->Execute();
 	mArchive->SetUndo(NULL);
-	mUndo.push_back(undo);
-	delete redo;
-	mRedo.pop_front();
+	if (!ok)
+	{
+		delete undo;
+		PurgeRedo();
+		DoUserAlert("WED could not redo the operation - the redo history has been cleared.  Your data has not been changed.");
+		return;
+	}
+	Push(mUndo, false, undo);
+	Pop(mRedo, true);
 	mArchive->mOpCount++;
 	mArchive->mCacheKey++;
 	mArchive->BroadcastMessage(msg_ArchiveChanged,change_mask);
@@ -208,17 +268,15 @@ void	WED_UndoMgr::Redo(void)
 
 void	WED_UndoMgr::PurgeUndo(void)
 {
-	for (LayerList::iterator l = mUndo.begin(); l != mUndo.end(); ++l)
-		delete *l;
-	mUndo.clear();
+	while (!mUndo.empty())
+		Pop(mUndo, true);
 	mUndoSinceMark = -1;
 }
 
 void	WED_UndoMgr::PurgeRedo(void)
 {
-	for (LayerList::iterator l = mRedo.begin(); l != mRedo.end(); ++l)
-		delete *l;
-	mRedo.clear();
+	while (!mRedo.empty())
+		Pop(mRedo, true);
 }
 
 bool	WED_UndoMgr::ReleaseMemory(void)
@@ -227,8 +285,7 @@ bool	WED_UndoMgr::ReleaseMemory(void)
 	if (mUndo.empty() && mRedo.empty()) return false;
 	if (mUndo.size() > WARN_IF_LESS_LEVEL)
 	{
-		delete mUndo.front();
-		mUndo.pop_front();
+		Pop(mUndo, true);
 		return true;
 	}
 
@@ -240,8 +297,154 @@ bool	WED_UndoMgr::ReleaseMemory(void)
 		return true;
 	}
 
-	delete mUndo.front();
-	mUndo.pop_front();
+	Pop(mUndo, true);
 	return true;
 
 }
+
+#if UNIT_TEST
+// Memory per undo level on a scripted editing session of one big airport polygon, made of a WED_AirportChain and its
+// WED_AirportNodes like the polygon tools make it, and a delta that no longer fits its object.
+//	usage: <nodes in the polygon> <edit steps, at most MAX_UNDO_LEVELS - 1>
+
+#include "WED_AirportChain.h"
+#include "WED_AirportNode.h"
+#include "WED_EnumSystem.h"
+#include "PerfUtils.h"
+
+extern void WED_AirportChain_Register();
+extern void WED_AirportNode_Register();
+
+FILE *	gLogFile = stdout;
+int		gUndoBudgetMB = 512;
+void	DoUserAlert(const char * msg) { printf("Alert: %s\n", msg); }
+
+// The polygon as the map sees it: its nodes in order, with their locations.
+static vector<pair<int, Point2> > test_state(WED_AirportChain * chain)
+{
+	vector<pair<int, Point2> > ret;
+	for (int n = 0; n < chain->CountChildren(); ++n)
+	{
+		WED_AirportNode * node = static_cast<WED_AirportNode *>(chain->GetNthChild(n));
+		Point2 p;
+		node->GetLocation(gis_Geo, p);
+		ret.push_back(make_pair(node->GetID(), p));
+	}
+	return ret;
+}
+
+int main(int argc, const char * argv[])
+{
+	int nodes = argc > 1 ? atoi(argv[1]) : 20000;
+	int steps = min(argc > 2 ? atoi(argv[2]) : MAX_UNDO_LEVELS - 1, MAX_UNDO_LEVELS - 1);
+
+	ENUM_Init();
+	WED_AirportChain_Register();
+	WED_AirportNode_Register();
+
+	WED_Archive archive(NULL);
+	WED_UndoMgr undo(&archive, NULL);
+	undo.SetMemoryBudget(0);
+	archive.SetUndoManager(&undo);
+
+	archive.StartCommand("Create");
+	WED_AirportChain * chain = WED_AirportChain::CreateTyped(&archive);
+	chain->SetName("Boundary");
+	chain->SetClosed(1);
+	for (int i = 0; i < nodes; ++i)
+	{
+		double a = 2.0 * M_PI * i / nodes;
+		WED_AirportNode * node = WED_AirportNode::CreateTyped(&archive);
+		node->SetParent(chain, i);
+		node->SetName("Node");
+		node->SetLocation(gis_Geo, Point2(-71.0 + 0.1 * cos(a), 42.0 + 0.1 * sin(a)));
+	}
+	archive.CommitCommand();
+	vector<pair<int, Point2> > start = test_state(chain);
+	size_t created = undo.GetMemoryUsed();
+
+	// Mostly single node drags, now and then a node is inserted or deleted or the whole polygon moves.
+	// The last step inserts a node, so the chain's own undo data is a delta.
+	srand(1);
+	unsigned long long t0 = query_hpc();
+	for (int s = 0; s < steps; ++s)
+	{
+		archive.StartCommand("Edit");
+		int n = rand() % chain->CountChildren();
+		WED_AirportNode * node = static_cast<WED_AirportNode *>(chain->GetNthChild(n));
+		if (s % 50 == 37)
+			for (int i = 0; i < chain->CountChildren(); ++i)
+			{
+				WED_AirportNode * node = static_cast<WED_AirportNode *>(chain->GetNthChild(i));
+				Point2 p;
+				node->GetLocation(gis_Geo, p);
+				node->SetLocation(gis_Geo, p + Vector2(1e-4, 1e-4));
+			}
+		else if (s % 25 == 0 || s == steps - 1)
+		{
+			WED_AirportNode * added = WED_AirportNode::CreateTyped(&archive);
+			added->SetParent(chain, n);
+			added->SetName("Node");
+			Point2 p;
+			node->GetLocation(gis_Geo, p);
+			added->SetLocation(gis_Geo, p + Vector2(1e-5, 0.0));
+		}
+		else if (s % 25 == 12)
+		{
+			node->SetParent(NULL, 0);
+			node->Delete();
+		}
+		else
+		{
+			Point2 p;
+			node->GetLocation(gis_Geo, p);
+			node->SetLocation(gis_Geo, p + Vector2(1e-6, -1e-6));
+		}
+		archive.CommitCommand();
+	}
+	double t_edit = hpc_to_microseconds(query_hpc() - t0) / 1000.0;
+	vector<pair<int, Point2> > last = test_state(chain);
+
+	printf("%d nodes, %d steps: %.1lf KB per undo level, %.3lf ms per step\n", nodes, steps,
+		(undo.GetMemoryUsed() - created) / 1024.0 / steps, t_edit / steps);
+
+	t0 = query_hpc();
+	for (int s = 0; s < steps; ++s)
+		undo.Undo();
+	double t_undo = hpc_to_microseconds(query_hpc() - t0) / 1000.0;
+	if (test_state(chain) != start)
+	{
+		printf("Undo did not restore the polygon.\n");
+		return 1;
+	}
+	t0 = query_hpc();
+	for (int s = 0; s < steps; ++s)
+		undo.Redo();
+	double t_redo = hpc_to_microseconds(query_hpc() - t0) / 1000.0;
+	if (test_state(chain) != last)
+	{
+		printf("Redo did not restore the polygon.\n");
+		return 1;
+	}
+	printf("undo %.3lf ms, redo %.3lf ms per step\n", t_undo / steps, t_redo / steps);
+
+	// Change the chain behind undo's back.  The last layer's delta of it no longer applies, so undo must refuse
+	// and leave the polygon alone instead of rebuilding garbage.
+	archive.SetUndo(UNDO_DISCARD);
+	chain->SetName("Changed");
+	archive.SetUndo(NULL);
+	undo.Undo();
+	string name;
+	chain->GetName(name);
+	if (test_state(chain) != last || name != "Changed" || undo.HasUndo() || undo.HasRedo())
+	{
+		printf("Undo applied a delta to a polygon it was not made against.\n");
+		return 1;
+	}
+
+	archive.SetUndoManager(NULL);
+	printf("OK\n");
+	return 0;
+}
+
+#endif
@@ -73,15 +73,28 @@ public:
 	// From GUI_MemoryHog
 	virtual	bool	ReleaseMemory(void);
 
+	void	SetMemoryBudget(size_t bytes);
+	size_t	GetMemoryUsed(void) const { return mBytes; }
+
 private:
 
 	typedef list<WED_UndoLayer *>	LayerList;
 
+	void	Push(LayerList& list, bool front, WED_UndoLayer * layer);
+	void	Pop(LayerList& list, bool front);
+	void	Trim(void);
+
 	LayerList 		mUndo;
 	LayerList		mRedo;
 
 	int				mUndoSinceMark;
 
+	size_t			mBytes;			// held by all layers in mUndo and mRedo
+	size_t			mBudget;		// 0 = only MAX_UNDO_LEVELS applies
+	size_t			mRawBytes;		// stats - what all layers ever committed would take as full copies
+	size_t			mPackedBytes;	// ... and what they took compacted
+	int				mLayers;
+
 	WED_UndoLayer *				mCommand;
 	WED_Archive *				mArchive;
 	WED_UndoFatalErrorHandler *	mPanicHandler;
@@ -10,6 +10,7 @@ CACHE_CacheObject::CACHE_CacheObject()
 	  m_domain(cache_domain_none),
 	  m_last_error_type(cache_error_type_none),
 	  m_last_time_modified(0),
+	  m_bytes_on_disk(0),
 	  m_last_url(""),
 	  m_RAII_curl_hndl(NULL)
 {
@@ -74,6 +75,11 @@ void             CACHE_CacheObject::set_last_time_modified(time_t mtime)
 	m_last_time_modified = mtime;
 }
 
+long long        CACHE_CacheObject::get_bytes_on_disk() const
+{
+	return m_bytes_on_disk;
+}
+
 void CACHE_CacheObject::create_RAII_curl_hndl(const string& url, int buf_reserve_size)
 {
 	//Close off any previous handles to make way for this new one
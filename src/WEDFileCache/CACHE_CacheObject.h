@@ -52,6 +52,8 @@ public:
 	time_t           get_last_time_modified() const;
 	void             set_last_time_modified(time_t mtime);
 
+	long long        get_bytes_on_disk() const;
+
 	void             create_RAII_curl_hndl(const string& url, int buf_reserve_size=0);
 
 	//Returns the current RAII_CurlHandle object or NULL if there is none
@@ -92,6 +94,9 @@ private:
 	//The last time the file was modified on disk
 	time_t m_last_time_modified;
 
+	//Size of the file on disk, as recorded in the manifest
+	long long m_bytes_on_disk;
+
 	//The curl_http_get_file that is associated with this cache_object
 	//Deleted on curl_http_get_file being done (error or not) and WED_file_cache_shutdown
 	RAII_CurlHandle* m_RAII_curl_hndl;
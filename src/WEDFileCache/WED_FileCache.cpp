@@ -80,12 +80,13 @@ bool WED_file_cache_response::operator!=(const WED_file_cache_response& rhs) con
 }
 //---------------------------------------------------------------------------//
 
-void WED_FileCache::init(void)
+void WED_FileCache::init(long long max_bytes, const string& folder)
 {
 #if DEV
 	StElapsedTime	etime("Cache init time");
 #endif
 	//Get the cache folder path
+	if(folder.empty())
 	{
 		CACHE_folder = GetCacheFolder();
 		if(CACHE_folder.empty())
@@ -93,10 +94,95 @@ void WED_FileCache::init(void)
 
 		CACHE_folder += DIR_STR "wed_file_cache";
 	}
+	else
+		CACHE_folder = folder;
+	CACHE_manifest = CACHE_folder + ".manifest";
+	CACHE_max_bytes = max_bytes;
 
 	if(FILE_make_dir_exist(CACHE_folder.c_str()))
 		AssertPrintf("Could not find or make the file cache, please check if you have sufficient rights to use the folder %s", CACHE_folder.c_str());
 
+	if(!read_manifest())
+		import_cache_info_files();
+
+	if(CACHE_max_bytes > 0 && CACHE_bytes > CACHE_max_bytes)
+		evict(NULL);
+	else
+		write_manifest();
+}
+
+CACHE_CacheObject * WED_FileCache::add_file(const string& path, CACHE_domain domain, time_t mtime, long long bytes)
+{
+	CACHE_CacheObject *& co = CACHE_file_cache[path];
+	if(co)
+		CACHE_bytes -= co->m_bytes_on_disk;
+	else
+		co = new CACHE_CacheObject();
+
+	co->m_domain = domain;
+	co->m_last_time_modified = mtime;
+	co->m_bytes_on_disk = bytes;
+	co->set_disk_location(path);
+	CACHE_bytes += bytes;
+	return co;
+}
+
+// Returns false if there is no manifest (yet). A file may be in the manifest more than once, if it was downloaded again -
+// the last line wins, so all lines are read before anything is expired. Files that have grown too old are deleted.
+bool WED_FileCache::read_manifest(void)
+{
+	RAII_FileHandle f(CACHE_manifest, "r");
+	if(f() == NULL)
+		return false;
+
+	struct manifest_line { long long mtime, bytes; int domain; };
+	hash_map<string, manifest_line> last_lines;
+	vector<string> paths;		// in the order first seen
+
+	char line[2048];
+	while(fgets(line, sizeof(line), f()))
+	{
+		manifest_line l;
+		int path_start = 0;
+		if(sscanf(line, "%lld %d %lld %n", &l.mtime, &l.domain, &l.bytes, &path_start) != 3 || path_start == 0)
+			continue;
+		if(l.domain <= cache_domain_none || l.domain >= cache_domain_end)
+			continue;
+
+		string path(CACHE_folder + DIR_STR + (line + path_start));
+		while(!path.empty() && (path.back() == '\n' || path.back() == '\r'))
+			path.pop_back();
+
+		pair<hash_map<string, manifest_line>::iterator, bool> i = last_lines.insert(make_pair(path, l));
+		if(i.second)
+			paths.push_back(path);
+		else
+			i.first->second = l;
+	}
+
+	time_t now = time(NULL);
+	for(vector<string>::iterator p = paths.begin(); p != paths.end(); ++p)
+	{
+		const manifest_line& l(last_lines[*p]);
+		if(difftime(now, l.mtime) < GetDomainPolicy((CACHE_domain) l.domain).cache_domain_pol_max_seconds_on_disk)
+			add_file(*p, (CACHE_domain) l.domain, l.mtime, l.bytes);
+		else
+		{
+			hash_map<string, CACHE_CacheObject* >::iterator itr = CACHE_file_cache.find(*p);
+			if(itr != CACHE_file_cache.end())
+				remove_cache_object(itr);
+#if !KEEP_EXPIRED_CACHE_FILES
+			FILE_delete_file(p->c_str(), false);
+#endif
+		}
+	}
+	return true;
+}
+
+// Caches from before the manifest have a .cache_object_info json file next to every file. Read them all one last time
+// and delete them, the manifest written after this takes over.
+void WED_FileCache::import_cache_info_files(void)
+{
 	vector<string> files;
 	vector<string> dirs;
 #if KEEP_EXPIRED_CACHE_FILES
@@ -157,8 +243,6 @@ void WED_FileCache::init(void)
 
 		for (auto p : paired_files)
 		{
-			CACHE_file_cache.push_back(new CACHE_CacheObject());
-
 			bool info_read_success = false;
 
 			string content;
@@ -173,21 +257,24 @@ void WED_FileCache::init(void)
 
 				if(json_parse_result == true)
 				{
-					CACHE_file_cache.back()->m_last_time_modified = root["last_time_modified"].asInt();
-					CACHE_file_cache.back()->m_domain = static_cast<CACHE_domain>(root["domain"].asInt());
-					CACHE_file_cache.back()->set_disk_location(files[p.first]);
+					time_t mtime = root["last_time_modified"].asInt();
+					CACHE_domain domain = static_cast<CACHE_domain>(root["domain"].asInt());
+					struct stat meta_data;
 
-					time_t age = difftime(now,CACHE_file_cache.back()->m_last_time_modified);
+					time_t age = difftime(now,mtime);
 
-					if(age < (GetDomainPolicy(CACHE_file_cache.back()->m_domain)).cache_domain_pol_max_seconds_on_disk /* + margin ? */)
+					if(domain > cache_domain_none && domain < cache_domain_end &&
+					   age < (GetDomainPolicy(domain)).cache_domain_pol_max_seconds_on_disk /* + margin ? */ &&
+					   FILE_get_file_meta_data(files[p.first], meta_data) == 0)
+					{
+						add_file(files[p.first], domain, mtime, meta_data.st_size);
 						info_read_success = true;
+					}
 				}
 			}
 
 			if(info_read_success == false)
 			{
-				delete CACHE_file_cache.back();
-				CACHE_file_cache.pop_back();
 #if KEEP_EXPIRED_CACHE_FILES
 				files_to_delete.push_back(p.first);
 				files_to_delete.push_back(p.second);
@@ -196,6 +283,8 @@ void WED_FileCache::init(void)
 				FILE_delete_file(files[p.second].c_str(), false);
 #endif
 			}
+			else
+				FILE_delete_file(files[p.second].c_str(), false);
 		}
 		
 		// now find empty directories and delete those, too
@@ -227,6 +316,66 @@ void WED_FileCache::init(void)
 	}
 }
 
+static void print_manifest_line(FILE * f, const CACHE_CacheObject& co, size_t folder_len)
+{
+	fprintf(f, "%lld %d %lld %s\n", (long long) co.get_last_time_modified(), (int) co.get_domain(),
+		co.get_bytes_on_disk(), co.get_disk_location().c_str() + folder_len + 1);
+}
+
+void WED_FileCache::append_manifest(const CACHE_CacheObject& co)
+{
+	RAII_FileHandle f(CACHE_manifest, "a");
+	if(f() != NULL)
+		print_manifest_line(f(), co, CACHE_folder.size());
+}
+
+// Writes one line per file we have, to a temporary first so a crash never leaves a half manifest behind.
+void WED_FileCache::write_manifest(void)
+{
+	string tmp_path(CACHE_manifest + ".tmp");
+	bool ok = false;
+	{
+		RAII_FileHandle f(tmp_path, "w");
+		if(f() != NULL)
+		{
+			for(hash_map<string, CACHE_CacheObject* >::iterator itr = CACHE_file_cache.begin(); itr != CACHE_file_cache.end(); ++itr)
+				if(itr->second->m_bytes_on_disk > 0 && !itr->second->get_disk_location().empty())
+					print_manifest_line(f(), *itr->second, CACHE_folder.size());
+			ok = ferror(f()) == 0;
+		}
+	}
+	if(ok)
+	{
+		FILE_delete_file(CACHE_manifest.c_str(), false);
+		ok = FILE_rename_file(tmp_path.c_str(), CACHE_manifest.c_str()) == 0;
+	}
+	if(!ok)
+		LOG_MSG("E/Cache could not write %s\n", CACHE_manifest.c_str());
+}
+
+// Deletes the oldest files until the cache is 10% under its budget, so this full pass over all files only runs once in a
+// while. Files being downloaded and keep are spared.
+void WED_FileCache::evict(const CACHE_CacheObject * keep)
+{
+	vector<pair<time_t, string> > by_age;
+	for(hash_map<string, CACHE_CacheObject* >::iterator itr = CACHE_file_cache.begin(); itr != CACHE_file_cache.end(); ++itr)
+		if(itr->second != keep && itr->second->m_bytes_on_disk > 0 && itr->second->get_RAII_curl_hndl() == NULL)
+			by_age.push_back(make_pair(itr->second->get_last_time_modified(), itr->first));
+	sort(by_age.begin(), by_age.end());
+
+	long long target = CACHE_max_bytes - CACHE_max_bytes / 10;
+	int evicted = 0;
+	for(vector<pair<time_t, string> >::iterator a = by_age.begin(); a != by_age.end() && CACHE_bytes > target; ++a)
+	{
+		hash_map<string, CACHE_CacheObject* >::iterator itr = CACHE_file_cache.find(a->second);
+		FILE_delete_file(a->second.c_str(), false);
+		remove_cache_object(itr);
+		++evicted;
+	}
+	LOG_MSG("I/Cache evicted %d files, %.1lf MB left\n", evicted, CACHE_bytes / (1024.0 * 1024.0));
+	write_manifest();
+}
+
 //returns an error string if there is one
 static void interpret_error(curl_http_get_file& mCurl, string& out_error_human, CACHE_error_type& out_error_type)
 {
@@ -294,9 +443,12 @@ static void interpret_error(curl_http_get_file& mCurl, string& out_error_human,
 
 WED_file_cache_response WED_FileCache::start_new_cache_object(WED_file_cache_request req)
 {
-	CACHE_file_cache.push_back(new CACHE_CacheObject());
-	CACHE_CacheObject& co = *CACHE_file_cache.back();
+	CACHE_CacheObject *& slot = CACHE_file_cache[url_to_cache_path(req)];
+	DebugAssert(slot == NULL);
+	slot = new CACHE_CacheObject();
+	CACHE_CacheObject& co = *slot;
 	
+	co.m_domain = req.in_domain;
 	co.create_RAII_curl_hndl(req.in_url);
 	
 	return WED_file_cache_response(co.get_RAII_curl_hndl()->get_curl_handle().get_progress(),
@@ -306,9 +458,10 @@ WED_file_cache_response WED_FileCache::start_new_cache_object(WED_file_cache_req
 								   cache_status_downloading);
 }
 
-void WED_FileCache::remove_cache_object(vector<CACHE_CacheObject* >::iterator itr)
+void WED_FileCache::remove_cache_object(hash_map<string, CACHE_CacheObject* >::iterator itr)
 {
-	delete *itr;
+	CACHE_bytes -= itr->second->m_bytes_on_disk;
+	delete itr->second;
 	CACHE_file_cache.erase(itr);
 }
 
@@ -343,18 +496,7 @@ WED_file_cache_response WED_FileCache::request_file(const WED_file_cache_request
 	---------------------------------------------------------------------------
 	*/
 	
-	vector<CACHE_CacheObject* >::iterator itr = CACHE_file_cache.begin();
-	for ( ; itr != CACHE_file_cache.end(); ++itr)
-	{
-		if((**itr).get_disk_location() == url_to_cache_path(req))
-		{
-			break;
-		}
-		else if ((**itr).get_last_url() == req.in_url)
-		{
-			break;
-		}
-	}
+	hash_map<string, CACHE_CacheObject* >::iterator itr = CACHE_file_cache.find(url_to_cache_path(req));
 
 	if(itr == CACHE_file_cache.end()) //1. Not in CACHE_file_cache?
 	{
@@ -362,10 +504,10 @@ WED_file_cache_response WED_FileCache::request_file(const WED_file_cache_request
 		return start_new_cache_object(req);
 	}
 	
-	CACHE_CacheObject & co = **itr;
+	CACHE_CacheObject & co = *itr->second;
 
 	//2. In CACHE_file_cache with active cURL_handle?
-	if((**itr).get_RAII_curl_hndl() != NULL)
+	if(co.get_RAII_curl_hndl() != NULL)
 	{
 		curl_http_get_file & hndl = co.get_RAII_curl_hndl()->get_curl_handle();
 		
@@ -384,7 +526,7 @@ WED_file_cache_response WED_FileCache::request_file(const WED_file_cache_request
 				/*
 				1. Create if prefixed dir does not exist
 				2. Attempt to save the file itself
-				3. Attempt to save the cache_object_info json
+				3. Record it in the manifest
 				
 				Either it all is saved perfectly or we delete it all and report an error. This is an all or nothing situation.
 				*/
@@ -392,62 +534,51 @@ WED_file_cache_response WED_FileCache::request_file(const WED_file_cache_request
 				res.out_path = url_to_cache_path(req);
 				FILE_make_dir_exist(string(CACHE_folder + DIR_STR + req.in_folder_prefix).c_str());
 
-				//We test if file and cache_file_info file save PERFECECTLY, with NO issues
+				//We test if file saves PERFECECTLY, with NO issues
 				//If anything went wrong we call it an error
 				bool good_file_save = false;
+				long long bytes = 0;
 
 				//Attempt to save the file content
-				RAII_FileHandle f(res.out_path,"wb");
-				
-				if(f() != NULL)
 				{
-					const vector<char>& buf = co.get_RAII_curl_hndl()->get_dest_buffer();
-					for(vector<char>::const_iterator itr = buf.begin(); itr != buf.end(); ++itr)
+					RAII_FileHandle f(res.out_path,"wb");
+					
+					if(f() != NULL)
 					{
-						fprintf(f(),"%c",*itr);
-					}
+						const vector<char>& buf = co.get_RAII_curl_hndl()->get_dest_buffer();
+						if(!buf.empty())
+							fwrite(buf.data(), 1, buf.size(), f());
+						bytes = buf.size();
 
-					good_file_save = ferror(f()) == 0 ? true : false;
+						good_file_save = ferror(f()) == 0 ? true : false;
+					}
 				}
 
-				bool good_info_save = false;
-
-				RAII_FileHandle cache_object_info(string(res.out_path).append(CACHE_INFO_FILE_EXT), "w");
-				if(cache_object_info() != NULL && good_file_save == true)
+				struct stat meta_data;
+				if(good_file_save == true && FILE_get_file_meta_data(res.out_path, meta_data) == 0)
 				{
-					Json::Value root(Json::objectValue);
-
-					root["domain"] = Json::Value(static_cast<int>(req.in_domain));
-
-					struct stat meta_data;
-					if(FILE_get_file_meta_data(res.out_path, meta_data) == 0)
-					{
-						root["last_time_modified"] = Json::Value((Json::Value::Int64)meta_data.st_mtime);
-						co.set_last_time_modified(meta_data.st_mtime);
-
-						fprintf(cache_object_info(),"%s", Json::FastWriter().write(root).c_str());
-
-						good_info_save = ferror(cache_object_info()) == 0 ? true : false;
-					}
+					CACHE_bytes += bytes - co.m_bytes_on_disk;
+					co.m_bytes_on_disk = bytes;
+					co.set_last_time_modified(meta_data.st_mtime);
+					co.set_disk_location(res.out_path);
+					append_manifest(co);
+					printf("Success: %s\n", res.out_path.c_str());// out_error_human.c_str());
 				}
-
-				if(good_file_save == false || good_info_save == false)
+				else
 				{
-					FILE_delete_file(f.path().c_str(), false);
-					FILE_delete_file(cache_object_info.path().c_str(), false);
+					FILE_delete_file(res.out_path.c_str(), false);
 					res.out_error_human = res.out_path + " could not be saved, check if the folder or file is in use or if you have sufficient privaleges";
 					printf("%s",res.out_error_human.c_str());
 					co.set_last_error_type(cache_error_type_disk_write);
 				}
-				else
-				{
-					printf("Success: %s\n", res.out_path.c_str());// out_error_human.c_str());
-				}
 #endif
 				res.out_error_type = co.get_last_error_type();
 				co.set_disk_location(res.out_path);
 				co.close_RAII_curl_hndl();
 
+				if(CACHE_max_bytes > 0 && CACHE_bytes > CACHE_max_bytes)
+					evict(&co);
+
 				return res;
 			}
 			else
@@ -480,12 +611,12 @@ WED_file_cache_response WED_FileCache::request_file(const WED_file_cache_request
 		{
 			return WED_file_cache_response(-1, "Cache cooling after failed network attempt, please wait: " + to_string(seconds_left) + " seconds...", cache_error_type_none, "", cache_status_cooling);
 		}
-		else if(FILE_exists((*itr)->get_disk_location().c_str()) == true) //Check if file was deleted between requests
+		else if(FILE_exists(co.get_disk_location().c_str()) == true) //Check if file was deleted between requests
 		{
 			if(co.needs_refresh(pol) == false)
 			{
-				DebugAssert((*itr)->get_disk_location() != "");
-				return WED_file_cache_response(-1, "", cache_error_type_none, (*itr)->get_disk_location(), cache_status_available);
+				DebugAssert(co.get_disk_location() != "");
+				return WED_file_cache_response(-1, "", cache_error_type_none, co.get_disk_location(), cache_status_available);
 			}
 			else
 			{
@@ -519,12 +650,102 @@ vector<string> WED_FileCache::get_files_available(CACHE_domain domain, string fo
 
 WED_FileCache::~WED_FileCache()
 {
-	for(vector<CACHE_CacheObject* >::iterator co = CACHE_file_cache.begin();
+	for(hash_map<string, CACHE_CacheObject* >::iterator co = CACHE_file_cache.begin();
 		co != CACHE_file_cache.end();
 		++co)
 	{
-		delete *co;
+		delete co->second;
 	}
 	CACHE_file_cache.clear();
 }
 //---------------------------------------------------------------------------//
+
+#if UNIT_TEST
+#include "PerfUtils.h"
+
+// Benchmark with a synthetic cache in <folder>: a manifest of <entries> slippy map tiles, <files> of them actually on disk.
+// Times init() and request_file() for the files on disk, against finding the same paths by a scan over all of them - which
+// is what every request cost before the cache had an index. Also checks that a file listed first as expired and then again
+// as current, after it was downloaded again, is kept.
+//	usage: <folder> <entries> <files>
+int main(int argc, const char * argv[])
+{
+	if(argc < 2)
+	{
+		printf("usage: %s <folder> [entries] [files]\n", argv[0]);
+		return 1;
+	}
+	string folder(argv[1]);
+	int entries = argc > 2 ? atoi(argv[2]) : 500000;
+	int files   = argc > 3 ? atoi(argv[3]) : 2000;
+	files = intlim(files, 1, entries);
+
+	vector<WED_file_cache_request>	reqs;
+	vector<string>					paths;
+	FILE_make_dir_exist(folder.c_str());
+	{
+		RAII_FileHandle f(folder + ".manifest", "w");
+		time_t now = time(NULL);
+		for(int i = 0; i < entries; ++i)
+		{
+			char prefix[64], url[128];
+			snprintf(prefix, sizeof(prefix), "tile.example.org" DIR_STR "17" DIR_STR "%d", i / 256);
+			snprintf(url, sizeof(url), "https://tile.example.org/17/%d/%d.png", i / 256, i % 256);
+			reqs.push_back(WED_file_cache_request(cache_domain_osm_tile, prefix, url));
+			string rel = string(prefix) + DIR_STR + FILE_get_file_name(url);
+			paths.push_back(folder + DIR_STR + rel);
+			fprintf(f(), "%lld %d %d %s\n", (long long) now, (int) cache_domain_osm_tile, 1000, rel.c_str());
+		}
+	}
+	vector<int> on_disk;
+	for(int i = 0; i < files; ++i)
+	{
+		int n = (long long) i * entries / files;
+		on_disk.push_back(n);
+		FILE_make_dir_exist(FILE_get_dir_name(paths[n]).c_str());
+		RAII_FileHandle f(paths[n], "wb");
+		fprintf(f(), "tile %d\n", n);
+	}
+
+	// The first file on disk was downloaded again: an expired line for it, then a current one. It has to survive init.
+	{
+		RAII_FileHandle f(folder + ".manifest", "a");
+		string rel = paths[on_disk[0]].substr(folder.size() + 1);
+		fprintf(f(), "%lld %d %d %s\n", 0LL, (int) cache_domain_osm_tile, 1000, rel.c_str());
+		fprintf(f(), "%lld %d %d %s\n", (long long) time(NULL), (int) cache_domain_osm_tile, 1000, rel.c_str());
+	}
+
+	WED_FileCache cache;
+	unsigned long long t0 = query_hpc();
+	cache.init(0, folder);
+	double init_ms = hpc_to_microseconds(query_hpc() - t0) / 1000.0;
+	if(!FILE_exists(paths[on_disk[0]].c_str()))
+	{
+		printf("A file expired by an older manifest line was deleted.\n");
+		return 1;
+	}
+
+	int found = 0;
+	t0 = query_hpc();
+	for(vector<int>::iterator n = on_disk.begin(); n != on_disk.end(); ++n)
+		if(cache.request_file(reqs[*n]).out_status == cache_status_available)
+			++found;
+	double lookup_us = hpc_to_microseconds(query_hpc() - t0) / files;
+
+	int scanned = 0;
+	t0 = query_hpc();
+	for(vector<int>::iterator n = on_disk.begin(); n != on_disk.end(); ++n)
+		if(find(paths.begin(), paths.end(), paths[*n]) != paths.end())
+			++scanned;
+	double scan_us = hpc_to_microseconds(query_hpc() - t0) / files;
+
+	printf("%d entries: init %.1lf ms, request_file %.2lf us per file on disk, linear scan %.2lf us per lookup.\n",
+		entries, init_ms, lookup_us, scan_us);
+	if(found != files || scanned != files)
+	{
+		printf("Found %d and scanned %d of %d files.\n", found, scanned, files);
+		return 1;
+	}
+	return 0;
+}
+#endif
@@ -39,6 +39,12 @@ class CACHE_CacheObject;
 		* Clients can use the error information to decide whether or not to try again
 	- Cached files that are too old are re-downloaded
 	- A cache domain policy determines maximum age and minimum cool down periods
+
+	Cache objects are indexed by their path in the cache folder, which follows from the domain's folder prefix and the URL.
+	What is on disk is recorded in one manifest next to the cache folder, a line per file with its time, domain and size -
+	new downloads are appended, init() reads it back instead of walking the folder and rewrites it compacted. Caches from
+	before the manifest, with a .cache_object_info file next to each file, are imported once. When the files exceed the
+	size budget, the oldest are deleted until the cache is 10% under it.
 */
 
 enum CACHE_status
@@ -88,9 +94,9 @@ struct WED_file_cache_response
 class WED_FileCache
 {
 	public:
-							WED_FileCache(void) {};
+							WED_FileCache(void) : CACHE_bytes(0), CACHE_max_bytes(0) {};
 							~WED_FileCache(void); // WED_file_cache_shutdown()
-		void				init(void);           // WED_file_cache_init()
+		void				init(long long max_bytes, const string& folder = ""); // WED_file_cache_init(), 0 = no size limit, default folder is in the OS cache
 
 		WED_file_cache_response	request_file(const WED_file_cache_request& req);
 		string			file_in_cache(const WED_file_cache_request& req);
@@ -101,11 +107,20 @@ class WED_FileCache
 		vector<string>	get_files_available(CACHE_domain domain, string folder_prefix);
 		WED_file_cache_response Request_file(const WED_file_cache_request& req);
 		WED_file_cache_response start_new_cache_object(WED_file_cache_request req);
-		void 				remove_cache_object(vector<CACHE_CacheObject* >::iterator itr);
+		void 				remove_cache_object(hash_map<string, CACHE_CacheObject* >::iterator itr);
+		CACHE_CacheObject *	add_file(const string& path, CACHE_domain domain, time_t mtime, long long bytes);
+		bool				read_manifest(void);
+		void				import_cache_info_files(void);
+		void				append_manifest(const CACHE_CacheObject& co);
+		void				write_manifest(void);
+		void				evict(const CACHE_CacheObject * keep);
 
 		const string 	CACHE_INFO_FILE_EXT = ".cache_object_info";
 		string 			CACHE_folder;	                  // The fully qualified path to the file cache folder
-		vector<CACHE_CacheObject* > CACHE_file_cache;   // Our vector of CacheObjects
+		string			CACHE_manifest;                 // The manifest file, next to the folder
+		hash_map<string, CACHE_CacheObject* > CACHE_file_cache;   // Our CacheObjects, by url_to_cache_path()
+		long long		CACHE_bytes;                    // Size of all files in the manifest
+		long long		CACHE_max_bytes;
 };
 
 extern WED_FileCache gFileCache;
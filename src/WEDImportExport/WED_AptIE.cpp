@@ -60,6 +60,7 @@
 #include "PlatformUtils.h"
 #include "FileUtils.h"
 #include "STLUtils.h"
+#include "MathUtils.h"
 
 //WEDUtils
 #include "WED_HierarchyUtils.h"
@@ -67,6 +68,8 @@
 
 #include "WED_UIDefs.h"
 #include <stdarg.h>
+#include <memory>
+#include <functional>
 
 
 #if ERROR_CHECK
@@ -460,12 +463,67 @@ void	AptExportRecursive(WED_Thing * what, AptVector& apts, vector<WED_TaxiRoute
 	}
 }
 
-void	WED_AptExport(WED_Thing * container, const char * file_path, bool DockingJetways)
+// Hands out the airports one at a time, in hierarchy order, so the export never holds all of them at once. Anything that is not
+// inside an airport goes with the airport before it, same as with AptExportRecursive for the whole hierarchy.
+static void AptExportStreamRecursive(WED_Thing * what, AptVector& apt, vector<WED_TaxiRoute *>& edges, bool DockingJetways,
+                                     const function<void(AptInfo_t&)>& emit)
 {
-	AptVector	apts;
+	WED_Entity * ent = dynamic_cast<WED_Entity *>(what);
+	if (ent && ent->GetHidden()) return;
+
+	const char * cls = what->GetClass();
+	if (cls == WED_Airport::sClass)
+	{
+		if (!apt.empty())
+			emit(apt.back());
+		apt.clear();
+		AptExportRecursive(what, apt, edges, DockingJetways);
+	}
+	else if (cls == WED_Group::sClass)
+	{
+		int cc = what->CountChildren();
+		for (int i = 0; i < cc; ++i)
+			AptExportStreamRecursive(what->GetNthChild(i), apt, edges, DockingJetways, emit);
+	}
+	else
+		AptExportRecursive(what, apt, edges, DockingJetways);
+}
+
+static void AptExportStream(WED_Thing * container, bool DockingJetways, const function<void(AptInfo_t&)>& emit)
+{
+	AptVector	apt;
 	vector<WED_TaxiRoute *> edges;
-	AptExportRecursive(container, apts, edges, DockingJetways);
-	WriteAptFile(file_path,apts, get_apt_export_version());
+	AptExportStreamRecursive(container, apt, edges, DockingJetways, emit);
+	if (!apt.empty())
+		emit(apt.back());
+}
+
+void	WED_AptExport(WED_Thing * container, const char * file_path, bool DockingJetways)
+{
+	// Converting airports needs the document, so it stays on this thread. Formatting the text is about as much work, so that's
+	// what the writer's threads do.
+	int threads = intlim((int) thread::hardware_concurrency() - 1, 0, 4);
+	FILE * fi = nullptr;
+	unique_ptr<AptFileWriter> out;
+	bool opened = false;
+
+	AptExportStream(container, DockingJetways, [&](AptInfo_t& apt) {
+		if (!opened)
+		{
+			opened = true;
+			fi = fopen(file_path, "wb");
+			if (fi)
+				out.reset(new AptFileWriter((int (*)(void *, const char *, ...)) fprintf, fi, get_apt_export_version(), threads));
+		}
+		if (out)
+			out->write(std::move(apt));
+	});
+
+	out.reset();                   // writes the footer
+	if (fi)
+		fclose(fi);
+	if (!opened)                   // like WriteAptFile, no airports means no file
+		remove(file_path);
 }
 
 void	WED_AptExport(
@@ -473,10 +531,8 @@ void	WED_AptExport(
 				int (*			print_func)(void *, const char *, ...),
 				void *			ref)
 {
-	AptVector	apts;
-	vector<WED_TaxiRoute *> edges;
-	AptExportRecursive(container, apts, edges, true);
-	WriteAptFileProcs(print_func, ref, apts, get_apt_export_version());
+	AptFileWriter out(print_func, ref, get_apt_export_version());
+	AptExportStream(container, true, [&](AptInfo_t& apt) { out.write(std::move(apt)); });
 }
 
 
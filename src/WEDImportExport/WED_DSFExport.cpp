@@ -80,11 +80,103 @@ struct DSF_export_info_t
 	string		orthoFile;     // path to last orthoImage - so we know if there is a 2nd one to deal with - in which case we drop the first
 
 	bool		DockingJetways;
+	WED_ExportJobs * jobs;     // if set, tile and texture writes go to worker threads
 
-	DSF_export_info_t() : DockingJetways(true) { orthoImg.data = NULL; }
+	DSF_export_info_t() : DockingJetways(true), jobs(nullptr) { orthoImg.data = NULL; }
 };
 
 extern int gOrthoExport;
+extern int gOrthoFastDDS;
+
+//---------------------------------------------------------------------------------------------------------------------------------------
+
+WED_ExportJobs::WED_ExportJobs(ProgressFunc progress) : m_progress(progress), m_reported(-1), m_busy(0), m_queued(0), m_finished(0), m_quit(false)
+{
+	int n = intlim(thread::hardware_concurrency(), 2, 8);
+	for(int i = 0; i < n; ++i)
+		m_threads.push_back(thread(&WED_ExportJobs::worker, this));
+}
+
+WED_ExportJobs::~WED_ExportJobs()
+{
+	wait();
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_work.notify_all();
+	for(auto& t : m_threads)
+		t.join();
+}
+
+void WED_ExportJobs::queue(const function<void()>& job)
+{
+	unique_lock<mutex> lock(m_mutex);
+	m_done.wait(lock, [this] { return m_jobs.size() + m_busy < 2 * m_threads.size(); });
+	m_jobs.push_back(job);
+	++m_queued;
+	m_work.notify_one();
+	int finished = m_finished, queued = m_queued;
+	lock.unlock();
+	report(finished, queued);
+}
+
+void WED_ExportJobs::after(const function<void()>& job)
+{
+	m_after.push_back(job);
+}
+
+void WED_ExportJobs::wait()
+{
+	int finished, queued;
+	{
+		unique_lock<mutex> lock(m_mutex);
+		while(!m_jobs.empty() || m_busy)
+		{
+			finished = m_finished;
+			queued = m_queued;
+			lock.unlock();
+			report(finished, queued);
+			lock.lock();
+			m_done.wait(lock, [this, finished] { return m_finished != finished; });
+		}
+		finished = m_finished;
+		queued = m_queued;
+	}
+	report(finished, queued);
+	vector<function<void()> > after_jobs;
+	after_jobs.swap(m_after);
+	for(auto& j : after_jobs)
+		j();
+}
+
+void WED_ExportJobs::worker()
+{
+	unique_lock<mutex> lock(m_mutex);
+	while(1)
+	{
+		m_work.wait(lock, [this] { return m_quit || !m_jobs.empty(); });
+		if(m_jobs.empty())
+			return;
+		function<void()> job = m_jobs.front();
+		m_jobs.pop_front();
+		++m_busy;
+		lock.unlock();
+		job();
+		lock.lock();
+		--m_busy;
+		++m_finished;
+		m_done.notify_all();
+	}
+}
+
+void WED_ExportJobs::report(int finished, int queued)
+{
+	if(finished == m_reported)
+		return;
+	m_reported = finished;
+	PROGRESS_SHOW(m_progress, 0, 1, "Writing scenery files", finished, queued);
+}
 
 //---------------------------------------------------------------------------------------------------------------------------------------
 
@@ -2125,15 +2217,24 @@ static int	DSF_ExportTileRecursive(
 																				0, 0, DDSwidth, DDSheight);
 							LOG_MSG("I/DSF exporting ortho tile %s scaled\n", absPathDDS.c_str());
 						}
-						if(gOrthoExport)
-						{
-							if(DDSInfo.channels == 3)
-								ConvertBitmapToAlpha(&DDSInfo,false);
-							int BCMethod = hasPartialTransparency(&DDSInfo) ? 3 : 1;
-							WriteBitmapToDDS_MT(DDSInfo, BCMethod, absPathDDS.c_str(), mip_filter_box);
-						}
+						bool as_dds = gOrthoExport;
+						int encoder = gOrthoFastDDS ? dds_encode_fast : dds_encode_best;
+						auto write_tex = [DDSInfo, absPathDDS, as_dds, encoder]() mutable {
+							if(as_dds)
+							{
+								if(DDSInfo.channels == 3)
+									ConvertBitmapToAlpha(&DDSInfo,false);
+								int BCMethod = hasPartialTransparency(&DDSInfo) ? 3 : 1;
+								WriteBitmapToDDS_MT(DDSInfo, BCMethod, absPathDDS.c_str(), mip_filter_box, encoder);
+							}
+							else
+								WriteBitmapToPNG(&DDSInfo, absPathDDS.c_str(), NULL, 0, 2.2);
+							DestroyBitmap(&DDSInfo);
+						};
+						if(export_info->jobs)
+							export_info->jobs->queue(write_tex);
 						else
-							WriteBitmapToPNG(&DDSInfo, absPathDDS.c_str(), NULL, 0, 2.2);
+							write_tex();
 					}
 				}
 				else if(date_cmpr_res == dcr_error)
@@ -2143,24 +2244,31 @@ static int	DSF_ExportTileRecursive(
 					return -1;
 				}
 
-				if(!FILE_exists(absPathPOL.c_str()))
-				{
-					ImageInfo DDSInfo;
-					if(CreateBitmapFromDDS(absPathDDS.c_str(), &DDSInfo) == 0)
+				Bbox2 b;
+				orth->GetBounds(gis_Geo, b);
+				auto write_pol = [absPathPOL, absPathDDS, relativePathDDS, b, rmgr]() {
+					if(!FILE_exists(absPathPOL.c_str()))
 					{
-						Bbox2 b;
-						orth->GetBounds(gis_Geo, b);
-						Point2 center = b.centroid();
-						//-------------------------------------------
-						pol_info_t out_info = { FILE_get_file_name(relativePathDDS), false,
-							/*SCALE*/ (float) LonLatDistMeters(b.p1,Point2(b.p2.x(), b.p1.y())), (float) LonLatDistMeters(b.p1,Point2(b.p1.x(), b.p2.y())),  // althought its irrelevant here
-							false, false,
-							/*LAYER_GROUP*/ "TERRAIN", +1,
-							/*LOAD_CENTER*/ (float) center.y(), (float) center.x(), (float) LonLatDistMeters(b.p1,b.p2), intmax2(DDSInfo.height,DDSInfo.width) };
-						rmgr->WritePol(absPathPOL, out_info);
-						DestroyBitmap(&DDSInfo);
+						ImageInfo DDSInfo;
+						if(CreateBitmapFromDDS(absPathDDS.c_str(), &DDSInfo) == 0)
+						{
+							Point2 center = b.centroid();
+							//-------------------------------------------
+							pol_info_t out_info = { FILE_get_file_name(relativePathDDS), false,
+								/*SCALE*/ (float) LonLatDistMeters(b.p1,Point2(b.p2.x(), b.p1.y())), (float) LonLatDistMeters(b.p1,Point2(b.p1.x(), b.p2.y())),  // althought its irrelevant here
+								false, false,
+								/*LAYER_GROUP*/ "TERRAIN", +1,
+								/*LOAD_CENTER*/ (float) center.y(), (float) center.x(), (float) LonLatDistMeters(b.p1,b.p2), intmax2(DDSInfo.height,DDSInfo.width) };
+							rmgr->WritePol(absPathPOL, out_info);
+							DestroyBitmap(&DDSInfo);
+						}
 					}
-				}
+				};
+				// the .pol needs the texture on disk, and writing it rescans the library - so it waits for the workers, on this thread.
+				if(export_info->jobs)
+					export_info->jobs->after(write_pol);
+				else
+					write_pol();
 
 				what->StartOperation("Norm Ortho");
 				orth->Rescale(gis_UV, UVbounds, UVbounds_used);
@@ -2342,6 +2450,16 @@ int DSF_ExportTile(WED_Thing * base, IResolver * resolver, const string& pkg, in
 		FILE_make_dir_exist(buffer);
 
 		snprintf(buffer, 255, "%sEarth nav data" DIR_STR "%+03d%+04d" DIR_STR "%+03d%+04d.dsf", pkg.c_str(), latlon_bucket(y), latlon_bucket(x), y, x);
+		if(export_info && export_info->jobs)
+		{
+			// The writer owns everything the tile needs by now - encoding and writing it is the slow part.
+			string path(buffer);
+			export_info->jobs->queue([writer, path]() {
+				DSFWriteToFile(path.c_str(), writer);
+				DSFDestroyWriter(writer);
+			});
+			return entities;
+		}
 		DSFWriteToFile(buffer, writer);
 	}
 
@@ -2361,7 +2479,7 @@ int DSF_ExportTile(WED_Thing * base, IResolver * resolver, const string& pkg, in
 	return entities;
 }
 
-int DSF_Export(WED_Thing * base, IResolver * resolver, const string& package, set<WED_Thing *>& problem_children)
+int DSF_Export(WED_Thing * base, IResolver * resolver, const string& package, set<WED_Thing *>& problem_children, WED_ExportJobs * jobs)
 {
 #if DEV
 	StElapsedTime	etime("Export time");
@@ -2384,6 +2502,7 @@ int DSF_Export(WED_Thing * base, IResolver * resolver, const string& package, se
 
 	DSF_export_info_t DSF_export_info;   // We kept the last loaded orthoimage open, so it does not have to be loaded repeatedly. This gates parallel DSF exports.
 	DSF_export_info.DockingJetways = gExportTarget >= wet_xplane_1200;
+	DSF_export_info.jobs = jobs;
 
 	for (int y = tile_south; y < tile_north; ++y)
 	{
@@ -2464,3 +2583,339 @@ int DSF_ExportAirportOverlay(IResolver * resolver, WED_Airport  * apt, const str
 	else
 		return 0;
 }
+
+#if UNIT_TEST
+// Headless check that a scenery pack exported with the WED_ExportJobs workers is byte for byte what a serial export writes.
+// A made-up document - an airport, objects, draped polygons, lines and two orthophotos cut from one image, spread over four
+// tiles - is exported like WED did before the job pool, and through WED_ExportPackToPath. Every file in the two packs -
+// DSF tiles, apt.dat, the orthophoto .dds/.png and .pol files - has to be the same, and the .pol files have to be written
+// on the exporting thread.
+//	usage: <scratch directory> <rounds>
+
+#include "WED_SceneryPackExport.h"
+#include "WED_AptIE.h"
+#include "WED_UndoMgr.h"
+#include "WED_Runway.h"
+#include "WED_RunwayNode.h"
+#include "WED_Ring.h"
+#include "WED_SimpleBoundaryNode.h"
+#include "WED_SimpleBezierBoundaryNode.h"
+#include "WED_Globals.h"
+#include "WED_LibraryMgr.h"
+#include "PerfUtils.h"
+
+#define TEST_CLASSES \
+	_R(WED_Group) _R(WED_Airport) _R(WED_Runway) _R(WED_RunwayNode) _R(WED_ObjPlacement) _R(WED_PolygonPlacement) \
+	_R(WED_LinePlacement) _R(WED_Ring) _R(WED_SimpleBoundaryNode) _R(WED_SimpleBezierBoundaryNode) \
+	_R(WED_DrapedOrthophoto) _R(WED_TextureNode)
+
+#define _R(x)	extern void x##_Register();
+TEST_CLASSES
+#undef _R
+
+FILE *				gLogFile = stderr;
+int					gOrthoExport = 1;			// these four live in WED_Document.cpp, DDS is the default
+int					gOrthoFastDDS = 0;
+int					gIsFeet = 0;
+int					gUndoBudgetMB = 512;
+
+static thread::id	test_main_thread;
+static int			test_pol_written = 0;
+static int			test_pol_off_thread = 0;
+static int			test_alerts = 0;
+
+// What the real WED_ResourceMgr::WritePol writes - without the library rescan.
+void WED_ResourceMgr::WritePol(const string& abspath, const pol_info_t& out_info)
+{
+	++test_pol_written;
+	if(this_thread::get_id() != test_main_thread)
+		++test_pol_off_thread;
+	FILE * fi = fopen(abspath.c_str(), "w");
+	if(!fi)	return;
+	fprintf(fi,"A\n850\nDRAPED_POLYGON\n\n");
+	fprintf(fi,"# Created by WED " WED_VERSION_STRING "\n");
+	fprintf(fi,out_info.wrap ? "TEXTURE %s\n" : "TEXTURE_NOWRAP %s\n", out_info.base_tex.c_str());
+	fprintf(fi,"SCALE %.1lf %.1lf\n",out_info.proj_s,out_info.proj_t);
+	fprintf(fi,"LOAD_CENTER %lf %lf %.1f %d\n", out_info.latitude, out_info.longitude,out_info.height_Meters,out_info.ddsHeight_Pxls);
+	if(!out_info.group.empty())
+		fprintf(fi,"LAYER_GROUP %s %d\n",out_info.group.c_str(), out_info.group_offset);
+	fclose(fi);
+}
+
+class	WED_TestTexMgr : public ITexMgr {
+public:
+	virtual	TexRef	LookupTexture(const char * path, bool is_absolute, int flags) { return nullptr; }
+	virtual	void	DropTexture(const char * path) { }
+	virtual	int		GetTexID(TexRef ref) { return 0; }
+	virtual	void	GetTexInfo(TexRef ref, int * vis_x, int * vis_y, int * act_x, int * act_y, int * org_x, int * org_y) { }
+};
+
+static WED_TestTexMgr	test_tex_mgr;
+
+ITexMgr *			WED_GetTexMgr(IResolver * resolver)			{ return &test_tex_mgr; }
+WED_ResourceMgr *	WED_GetResourceMgr(IResolver * resolver)	{ return nullptr; }
+WED_LibraryMgr *	WED_GetLibraryMgr(IResolver * resolver)		{ return nullptr; }
+void				DoUserAlert(const char * msg)				{ ++test_alerts; printf("Alert: %s\n", msg); }
+int					ConfirmMessage(const char * msg, const char * proceed, const char * cancel) { return 0; }
+
+// Stand-ins for what the entities ask the library about in the property editor and previews - the export does not.
+WED_Airport *		WED_GetParentAirport(WED_Thing * who)	{ return nullptr; }
+void				WED_GetAllRunwaysTwoway(const WED_Airport * airport, set<int>& runways) { }
+bool	WED_ResourceMgr::GetFac(const string& vpath, fac_info_t const *& info, int variant)	{ return false; }
+bool	WED_ResourceMgr::GetObj(const string& path, XObj8 const *& obj, int variant)		{ return false; }
+bool	WED_ResourceMgr::GetAGP(const string& path, agp_t const *& info)					{ return false; }
+string	WED_LibraryMgr::GetResourcePath(const string& r, int variant)	{ return string(); }
+bool	WED_LibraryMgr::IsResourceDefault(const string& r) const		{ return false; }
+bool	WED_LibraryMgr::IsResourceLocal(const string& r) const			{ return true; }
+bool	WED_LibraryMgr::GetLineVpath(int lt, string& vpath)				{ return false; }
+bool	WED_LibraryMgr::GetSurfVpath(int surf, string& vpath)			{ return false; }
+int		WED_LibraryMgr::GetSurfEnum(const string& vpath)				{ return -1; }
+
+static double test_rand(double lo, double hi) { return lo + (hi - lo) * rand() / (double) RAND_MAX; }
+
+template <class T>
+static T * test_make(WED_Thing * parent, const string& name)
+{
+	T * t = T::CreateTyped(parent->GetArchive());
+	t->SetParent(parent, parent->CountChildren());
+	t->SetName(name);
+	return t;
+}
+
+template <class N>
+static void test_ring(WED_Thing * parent, const Point2& c, double r, int n)
+{
+	WED_Ring * ring = test_make<WED_Ring>(parent, "ring");
+	for(int k = 0; k < n; ++k)
+	{
+		double a = 2.0 * M_PI * k / n;
+		test_make<N>(ring, "node")->SetLocation(gis_Geo, c + Vector2(r * cos(a), r * sin(a)));
+	}
+}
+
+static WED_Group * test_document(WED_Archive * archive)
+{
+	srand(1);
+	WED_Group * world = WED_Group::CreateTyped(archive);
+	world->SetName("world");
+
+	WED_Airport * apt = test_make<WED_Airport>(world, "Test Field");
+	apt->SetICAO("XTST");
+	apt->SetAirportType(type_Airport);
+	WED_Runway * rwy = test_make<WED_Runway>(apt, "09/27");
+	test_make<WED_RunwayNode>(rwy, "09")->SetLocation(gis_Geo, Point2(-71.51, 42.50));
+	test_make<WED_RunwayNode>(rwy, "27")->SetLocation(gis_Geo, Point2(-71.49, 42.50));
+	for(int i = 0; i < 200; ++i)
+	{
+		WED_ObjPlacement * obj = test_make<WED_ObjPlacement>(apt, "hangar");
+		obj->SetResource("lib/test/hangar_" + to_string(i % 5) + ".obj");
+		obj->SetLocation(gis_Geo, Point2(test_rand(-71.52, -71.48), test_rand(42.49, 42.51)));
+		obj->SetHeading(test_rand(0, 360));
+	}
+
+	// Four tiles around -71, 42 - every tile gets objects, polygons with holes and lines, some crossing into the neighbour
+	for(int i = 0; i < 4000; ++i)
+	{
+		WED_ObjPlacement * obj = test_make<WED_ObjPlacement>(world, "object");
+		obj->SetResource("lib/test/object_" + to_string(i % 20) + ".obj");
+		obj->SetLocation(gis_Geo, Point2(test_rand(-72.0, -70.0), test_rand(41.0, 43.0)));
+		obj->SetHeading(test_rand(0, 360));
+	}
+	for(int i = 0; i < 400; ++i)
+	{
+		WED_PolygonPlacement * pol = test_make<WED_PolygonPlacement>(world, "polygon");
+		pol->SetResource("lib/test/polygon_" + to_string(i % 10) + ".pol");
+		pol->SetHeading(test_rand(0, 360));
+		Point2 c(test_rand(-71.99, -70.01), test_rand(41.01, 42.99));
+		if(i % 2)
+			test_ring<WED_SimpleBoundaryNode>(pol, c, 0.005, 4 + i % 12);
+		else
+		{
+			test_ring<WED_SimpleBezierBoundaryNode>(pol, c, 0.005, 4 + i % 12);
+			test_ring<WED_SimpleBezierBoundaryNode>(pol, c, 0.002, 4);
+		}
+	}
+	for(int i = 0; i < 200; ++i)
+	{
+		WED_LinePlacement * lin = test_make<WED_LinePlacement>(world, "line");
+		lin->SetResource("lib/test/line_" + to_string(i % 4) + ".lin");
+		Point2 p(test_rand(-71.99, -70.05), test_rand(41.01, 42.99));
+		for(int k = 0; k < 5; ++k)
+			test_make<WED_SimpleBoundaryNode>(lin, "node")->SetLocation(gis_Geo, p + Vector2(k * 0.01, test_rand(-1e-3, 1e-3)));
+	}
+
+	// Two orthophotos, the west and east half of one image, in two tiles
+	for(int i = 0; i < 2; ++i)
+	{
+		WED_DrapedOrthophoto * orth = test_make<WED_DrapedOrthophoto>(world, i ? "ortho_east.dds" : "ortho_west.dds");
+		orth->SetResource("ortho/image.png");
+		WED_Ring * ring = test_make<WED_Ring>(orth, "ring");
+		Point2 geo[4] = { Point2(-71.02, 41.98), Point2(-70.98, 41.98), Point2(-70.98, 42.02), Point2(-71.02, 42.02) };
+		Point2 uv[4] = { Point2(0.0, 0.0), Point2(0.5, 0.0), Point2(0.5, 1.0), Point2(0.0, 1.0) };
+		for(int k = 0; k < 4; ++k)
+		{
+			WED_TextureNode * n = test_make<WED_TextureNode>(ring, "node");
+			n->SetLocation(gis_Geo, geo[k] + Vector2(i ? 0.04 : -0.04, i ? 0.04 : -0.04));
+			n->SetLocation(gis_UV, uv[k] + Vector2(i ? 0.5 : 0.0, 0.0));
+		}
+	}
+	return world;
+}
+
+// The source image of the orthophotos, inside the pack
+static bool test_image(const string& pack)
+{
+	ImageInfo img;
+	if(CreateNewBitmap(1024, 512, 3, &img))
+		return false;
+	for(int y = 0; y < img.height; ++y)
+	for(int x = 0; x < img.width; ++x)
+	{
+		unsigned char * p = img.data + y * (img.width * img.channels + img.pad) + x * img.channels;
+		p[0] = x ^ y; p[1] = x * 3 + y; p[2] = (x / 64 + y / 64) % 2 ? 200 : 40;
+	}
+	FILE_make_dir_exist((pack + "ortho").c_str());
+	int err = WriteBitmapToPNG(&img, (pack + "ortho" DIR_STR "image.png").c_str(), NULL, 0, 2.2);
+	DestroyBitmap(&img);
+	return err == 0;
+}
+
+// What WED_ExportPackToPath did before the job pool
+static void test_export_serial(WED_Thing * root, const string& pack, set<WED_Thing *>& problem_children)
+{
+	if(DSF_Export(root, nullptr, pack, problem_children) == -1)
+		return;
+	FILE_make_dir_exist((pack + "Earth nav data").c_str());
+	WED_AptExport(root, (pack + "Earth nav data" DIR_STR "apt.dat").c_str());
+}
+
+static vector<float>	test_progress;
+
+static bool test_progress_func(int stage, int stage_count, const char * stage_name, float progress)
+{
+	if(this_thread::get_id() != test_main_thread)
+		progress = -1.0f;
+	test_progress.push_back(progress);
+	return false;
+}
+
+// Every file in the pack, relative to it
+static set<string> test_files(const string& pack)
+{
+	vector<string> files, dirs;
+	FILE_get_directory_recursive(pack.substr(0, pack.size() - 1), files, dirs);
+	set<string> ret;
+	for(auto& f : files)
+		ret.insert(f.substr(pack.size()));
+	return ret;
+}
+
+static bool test_same_file(const string& a, const string& b)
+{
+	FILE * fa = fopen(a.c_str(), "rb");
+	FILE * fb = fopen(b.c_str(), "rb");
+	bool same = fa && fb;
+	while (same)
+	{
+		char ba[65536], bb[65536];
+		size_t la = fread(ba, 1, sizeof(ba), fa);
+		size_t lb = fread(bb, 1, sizeof(bb), fb);
+		same = la == lb && memcmp(ba, bb, la) == 0;
+		if (la == 0) break;
+	}
+	if (fa) fclose(fa);
+	if (fb) fclose(fb);
+	return same;
+}
+
+int main(int argc, const char * argv[])
+{
+	string dir = string(argc > 1 ? argv[1] : ".") + DIR_STR;
+	int rounds = argc > 2 ? atoi(argv[2]) : 3;
+	test_main_thread = this_thread::get_id();
+
+	ENUM_Init();
+	#define _R(x)	x##_Register();
+	TEST_CLASSES
+	#undef _R
+
+	WED_Archive archive(nullptr);
+	WED_UndoMgr undo(&archive, nullptr);
+	archive.SetUndoManager(&undo);
+	archive.StartCommand("Make test document");
+	WED_Group * world = test_document(&archive);
+	archive.CommitCommand();
+
+	string serial = dir + "serial_pack" DIR_STR;
+	string pooled = dir + "pooled_pack" DIR_STR;
+	FILE_delete_dir_recursive(serial);
+	FILE_make_dir_exist(serial.c_str());
+	if(!test_image(serial))
+	{
+		printf("Could not write the orthophoto source image.\n");
+		return 1;
+	}
+
+	set<WED_Thing *> problem_children;
+	unsigned long long t0 = query_hpc();
+	test_export_serial(world, serial, problem_children);
+	double t_serial = hpc_to_microseconds(query_hpc() - t0) / 1000.0;
+	set<string> files = test_files(serial);
+	int pols = test_pol_written;
+	if(!problem_children.empty() || test_alerts || files.size() < 8 || pols != 2)
+	{
+		printf("The serial export failed: %d problem items, %d alerts, %d files, %d .pol files.\n",
+			(int) problem_children.size(), test_alerts, (int) files.size(), pols);
+		return 1;
+	}
+
+	double t_pooled = 0.0;
+	for (int r = 0; r < rounds; ++r)
+	{
+		FILE_delete_dir_recursive(pooled);
+		FILE_make_dir_exist(pooled.c_str());
+		test_image(pooled);
+		test_progress.clear();
+		test_pol_written = test_pol_off_thread = 0;
+
+		t0 = query_hpc();
+		WED_ExportPackToPath(world, nullptr, pooled, problem_children, test_progress_func);
+		t_pooled += hpc_to_microseconds(query_hpc() - t0) / 1000.0;
+
+		if(!problem_children.empty() || test_alerts)
+		{
+			printf("Round %d: %d problem items, %d alerts.\n", r, (int) problem_children.size(), test_alerts);
+			return 1;
+		}
+		if(test_pol_written != pols || test_pol_off_thread)
+		{
+			printf("Round %d: %d .pol files written, %d of them on a worker.\n", r, test_pol_written, test_pol_off_thread);
+			return 1;
+		}
+		if(test_progress.empty() || test_progress.back() != 1.0f || count(test_progress.begin(), test_progress.end(), -1.0f))
+		{
+			printf("Round %d: %d progress reports, the last one %.2f - they all must come from the exporting thread and end at 1.\n",
+				r, (int) test_progress.size(), test_progress.empty() ? 0.0f : test_progress.back());
+			return 1;
+		}
+		set<string> pooled_files = test_files(pooled);
+		if(pooled_files != files)
+		{
+			printf("Round %d: the pack written with the job pool has %d files, the serial one %d.\n", r, (int) pooled_files.size(), (int) files.size());
+			return 1;
+		}
+		for(auto& f : files)
+			if(!test_same_file(serial + f, pooled + f))
+			{
+				printf("Round %d: %s written with the job pool differs from the serial one.\n", r, f.c_str());
+				return 1;
+			}
+	}
+	FILE_delete_dir_recursive(serial);
+	FILE_delete_dir_recursive(pooled);
+
+	printf("OK, %d files, %d rounds: serial %.0lf ms, with %d workers %.0lf ms per round.\n", (int) files.size(), rounds, t_serial,
+		intlim(thread::hardware_concurrency(), 2, 8), t_pooled / rounds);
+	return 0;
+}
+#endif
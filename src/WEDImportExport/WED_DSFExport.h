@@ -24,13 +24,54 @@
 #ifndef WED_DSFExport_H
 #define WED_DSFExport_H
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include "ProgressUtils.h"
+
 class	IResolver;
 class	WED_Thing;
 class	WED_Airport;
 struct	DSF_export_info_t;
 
-// You will need the IResolver in case you're handling a orthophoto
-int DSF_Export(WED_Thing * base, IResolver * resolver, const string& in_package, set<WED_Thing *>& problem_items);
+// Worker threads for the parts of a scenery pack export that never touch the document: encoding and writing DSF tiles,
+// orthophoto textures and apt.dat.  The main thread keeps walking the document and queues work as it goes.  Jobs that have
+// to run on the main thread once the files exist (e.g. writing .pol files, which rescans the library) are queued with
+// after() and run by wait().  Destroying the pool waits, too.  Progress of the queued jobs is reported to the ProgressFunc,
+// always on the thread that owns the pool.
+
+class WED_ExportJobs {
+public:
+	WED_ExportJobs(ProgressFunc progress = nullptr);
+	~WED_ExportJobs();
+
+	void	queue(const function<void()>& job);			// blocks while too many jobs are in flight, to bound memory use
+	void	after(const function<void()>& job);
+	void	wait();
+
+private:
+	void	worker();
+	void	report(int finished, int queued);
+
+	ProgressFunc				m_progress;
+	int							m_reported;
+	vector<thread>				m_threads;
+	mutex						m_mutex;
+	condition_variable			m_work;
+	condition_variable			m_done;
+	deque<function<void()> >	m_jobs;
+	vector<function<void()> >	m_after;
+	int							m_busy;
+	int							m_queued;
+	int							m_finished;
+	bool						m_quit;
+};
+
+// You will need the IResolver in case you're handling a orthophoto.  Without a job pool the export is serial and
+// complete on return, with one the last tiles may still be writing until the pool is waited on.
+int DSF_Export(WED_Thing * base, IResolver * resolver, const string& in_package, set<WED_Thing *>& problem_items, WED_ExportJobs * jobs = nullptr);
 int DSF_ExportTile(WED_Thing * base, IResolver * resolver, const string& pkg, int x, int y, set <WED_Thing *>& problem_children, DSF_export_info_t * export_info = nullptr);
 
 // 
@@ -1105,7 +1105,20 @@ public:
 								BeginPolygon, BeginPolygonWinding, AddPolygonPoint,EndPolygonWinding, EndPolygon, AddRasterData, SetFilter };
 
 		LOG_MSG("I/DSF Importing binary DSF from %s\n",file_name);
-		int res = DSFReadFile(file_name, malloc, free, &cb, NULL, this);
+		int res;
+		if(cull_bounds.empty())
+			res = DSFReadFile(file_name, malloc, free, &cb, NULL, this);
+		else
+		{
+			// let the reader skip point pools and whole commands outside the bounds
+			vector<double> bounds;
+			for(const auto& b : cull_bounds)
+			{
+				bounds.push_back(b.xmin()); bounds.push_back(b.ymin());
+				bounds.push_back(b.xmax()); bounds.push_back(b.ymax());
+			}
+			res = DSFReadFilePartial(file_name, malloc, free, &cb, NULL, bounds.data(), cull_bounds.size(), this);
+		}
 
 		for(int i = 0; i < dsf_cat_DIM; ++i)
 		if(bucket_parents[i])
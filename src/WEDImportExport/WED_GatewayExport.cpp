@@ -209,29 +209,41 @@ static void encodeblock( unsigned char in[3], unsigned char out[4], int len )
     out[3] = (unsigned char) (len > 2 ? cb64[ in[2] & 0x3f ] : '=');
 }
 
-static int file_to_uu64(const string& path, string& enc)
-{
-	enc.clear();
-	FILE * fi = fopen(path.c_str(),"rb");
-	if(fi == NULL)
-		return errno;
-
-	while(!feof(fi))
+// Encodes two 6 bit groups at a time - a 4096 entry table of character pairs turns each 3 byte group into two lookups.
+struct uu64_pair_table {
+	char pair[4096][2];
+	uu64_pair_table()
 	{
-		unsigned char buf[3];
-		int rd = fread(buf,1,3,fi);
-		if(rd <= 0)
-			break;
+		for(int i = 0; i < 4096; ++i)
+		{
+			pair[i][0] = cb64[i >> 6];
+			pair[i][1] = cb64[i & 0x3f];
+		}
+	}
+};
 
-		char out[5];
+static void mem_to_uu64(const vector<char>& data, string& enc)
+{
+	static const uu64_pair_table tbl;
 
-		encodeblock(buf, (unsigned char *) out, rd);
-		out[4] = 0;
-		enc += out;
-	}
+	size_t n = data.size();
+	enc.resize((n + 2) / 3 * 4);
 
-	fclose(fi);
-	return 0;
+	const unsigned char * in = (const unsigned char *) data.data();
+	char * out = &enc[0];
+	size_t full = n - n % 3;
+	for(size_t i = 0; i < full; i += 3, out += 4)
+	{
+		unsigned int b = (in[i] << 16) | (in[i+1] << 8) | in[i+2];
+		memcpy(out,     tbl.pair[b >> 12],   2);
+		memcpy(out + 2, tbl.pair[b & 0xfff], 2);
+	}
+	if(full < n)
+	{
+		unsigned char tail[3] = { 0 };
+		memcpy(tail, in + full, n - full);
+		encodeblock(tail, (unsigned char *) out, n - full);
+	}
 }
 
 //------------------------------------------------------------------------------------------------------------
@@ -595,16 +607,20 @@ void WED_GatewayExportDialog::Submit()
 //		FILE_compress_dir(preview_folder, preview_zip, icao + "_Scenery_Pack/");
 		FILE_delete_dir_recursive(preview_folder);
 
-		Assert(FILE_compress_dir(targ_folder, targ_folder_zip, string()) == 0);
+		// The master zip never goes to disk - it is zipped into memory and encoded straight from there.
+		vector<char> master_zip;
+		Assert(FILE_compress_dir(targ_folder, master_zip, string()) == 0);
 		FILE_delete_dir_recursive(targ_folder);
-
-		string uu64;
-		file_to_uu64(targ_folder_zip, uu64);
-		#if !KEEP_UPLOAD_MASTER_ZIP
-		FILE_delete_file(targ_folder_zip.c_str(), false);
+		#if KEEP_UPLOAD_MASTER_ZIP
+		if(FILE * zf = fopen(targ_folder_zip.c_str(), "wb"))
+		{
+			fwrite(master_zip.data(), 1, master_zip.size(), zf);
+			fclose(zf);
+		}
 		#endif
 
-		Json::Value		scenery;
+		Json::Value		req;
+		Json::Value&	scenery = req["scenery"];				// build in place, no copy of the blob into req
 
 		for(int key_enum = wed_AddMetaDataBegin + 1; key_enum < wed_AddMetaDataEnd; ++key_enum)
 		{
@@ -655,13 +671,15 @@ void WED_GatewayExportDialog::Submit()
 
 		LOG_MSG("I/GWExp\n %s", scenery.toStyledString().c_str());
 
-		scenery["masterZipBlob"] = uu64;
+		{
+			string uu64;
+			mem_to_uu64(master_zip, uu64);
+			vector<char>().swap(master_zip);
+			scenery["masterZipBlob"] = uu64;
+		}
 		scenery["password"] = pwd;
 		scenery["userId"] = uname;
 
-		Json::Value req;
-		req["scenery"] = scenery;
-
 		string reqstr=req.toStyledString();
 
 //		printf("%s\n",reqstr.c_str());
@@ -44,9 +44,12 @@
 
 #include <iostream>
 
-void	WED_ExportPackToPath(WED_Thing * root, IResolver * resolver, const string& in_path, set<WED_Thing *>& problem_children)
+void	WED_ExportPackToPath(WED_Thing * root, IResolver * resolver, const string& in_path, set<WED_Thing *>& problem_children, ProgressFunc progress)
 {
-	int result = DSF_Export(root, resolver, in_path,problem_children);
+	// DSF tiles and textures are written by the workers while we keep walking the document
+	WED_ExportJobs jobs(progress);
+
+	int result = DSF_Export(root, resolver, in_path,problem_children, &jobs);
 	if (result == -1)
 		return;
 
@@ -55,6 +58,7 @@ void	WED_ExportPackToPath(WED_Thing * root, IResolver * resolver, const string&
 
 	FILE_make_dir_exist(apt_dir.c_str());
 	WED_AptExport(root, apt.c_str());
+	jobs.wait();
 }
 
 
@@ -96,6 +100,12 @@ namespace
 
 void dummyPrintf(void * ref, const char * fmt, ...) { return; }
 
+static bool	ExportProgress(int stage, int stage_count, const char * stage_name, float progress)
+{
+	LOG_MSG("I/exp %s: %d%%\n", stage_name, (int) (progress * 100.0f));
+	return false;
+}
+
 static void	DoHueristicAnalysisAndAutoUpgrade(IResolver* resolver)
 {
 	LOG_MSG("I/exp Starting upgrade heuristics\n");
@@ -629,7 +639,7 @@ void	WED_DoExportPack(WED_Document * resolver, WED_MapPane * pane)
 	string pack_base;
 	l->LookupPath(pack_base);
 
-	WED_ExportPackToPath(g, resolver, pack_base, problem_children);
+	WED_ExportPackToPath(g, resolver, pack_base, problem_children, ExportProgress);
 
 #if !TYLER_MODE
 	if (gExportTarget == wet_gateway)
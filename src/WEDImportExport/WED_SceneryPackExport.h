@@ -30,7 +30,9 @@ class	IResolver;
 class 	WED_MapPane;
 class	WED_Document;
 
-void	WED_ExportPackToPath(WED_Thing * root, IResolver * resolver, const string& in_path, set<WED_Thing *>& problem_children);
+#include "ProgressUtils.h"
+
+void	WED_ExportPackToPath(WED_Thing * root, IResolver * resolver, const string& in_path, set<WED_Thing *>& problem_children, ProgressFunc progress = nullptr);
 
 // Top level commands for WED.
 int		WED_CanExportPack(IResolver * resolver, string& ioname);
@@ -16,6 +16,7 @@
 #include "AssertUtils.h"
 #include "GISUtils.h"
 #include "MathUtils.h"
+#include "PerfUtils.h"
 #include "TexUtils.h"
 #include "XESConstants.h"
 #include "GUI_DrawUtils.h"
@@ -49,6 +50,39 @@ void		WED_ATCLayer::DrawVisualization(bool inCurrent, GUI_GraphState * g)
 	mGTEdges.clear();
 	mStarts.clear();
 	mATCEdges.clear();
+	mRibbonVerts.clear();
+	mRibbonColors.clear();
+	mLabels.clear();
+}
+
+void		WED_ATCLayer::DrawStructure(bool inCurrent, GUI_GraphState * g)
+{
+	if(!mRibbonVerts.empty())
+	{
+		g->SetState(false, 0, false, false, true, false, false);
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glEnableClientState(GL_COLOR_ARRAY);
+		glVertexPointer(2, GL_FLOAT, 0, mRibbonVerts.data());
+		glColorPointer(4, GL_FLOAT, 0, mRibbonColors.data());
+		glDrawArrays(GL_TRIANGLES, 0, mRibbonVerts.size() / 2);
+		glDisableClientState(GL_COLOR_ARRAY);
+		glDisableClientState(GL_VERTEX_ARRAY);
+	}
+	const float white[4] = { 1, 1, 1, 1 };
+	for (const auto& l : mLabels)
+	{
+		glPushMatrix();
+		glTranslatef(l.xy.x(), l.xy.y(), 0);
+		glRotatef(l.hdg, 0, 0, 1);
+		GUI_FontDraw(g, font_UI_Basic, white, 0, -4, l.name.c_str(), align_Center);
+		glPopMatrix();
+	}
+	if(!mLabels.empty())
+		g->SetTexUnits(0);
+
+	mRibbonVerts.clear();
+	mRibbonColors.clear();
+	mLabels.clear();
 }
 
 static double box_edge_distance(Point2 p, const Bbox2 b)   // returns positive if inside box, negative if outside
@@ -259,6 +293,116 @@ static void	Quad_2to4pix(const Point2 ends[2], double width_pix, Point2 corners[
 	corners[2] = ends[1] + perp;
 }
 
+#define ATC_RIBBON_CACHE_MAX	50000			// routes cached before we throw everything out - keeps deleted routes from piling up
+
+bool WED_ATCRouteInfo::operator==(const WED_ATCRouteInfo& rhs) const
+{
+	return ends[0] == rhs.ends[0] && ends[1] == rhs.ends[1] && icao_width == rhs.icao_width &&
+		hot == rhs.hot && ils == rhs.ils && rwy == rhs.rwy && road == rhs.road && one_way == rhs.one_way && aircraft == rhs.aircraft &&
+		name == rhs.name;
+}
+
+static void set_color(float c[4], float r, float g, float b, float a)
+{
+	c[0] = r; c[1] = g; c[2] = b; c[3] = a;
+}
+
+void WED_ATCRibbonBuild(const WED_ATCRouteInfo& info, WED_ATCRibbon& r)
+{
+	r.info = info;
+
+	int mtr1, mtr2;
+	if (info.road)
+		mtr1 = mtr2 = info.one_way ? 4.0 : 8.0;
+	else
+		switch (info.icao_width)
+		{
+		default:
+		case width_A:	mtr1 = 4.5;		mtr2 = 15.0;	break;
+		case width_B:	mtr1 = 6.0;		mtr2 = 24.0;	break;
+		case width_C:	mtr1 = 9.0;		mtr2 = 36.0;	break;
+		case width_D:	mtr1 = 14.0;	mtr2 = 52.0;	break;
+		case width_E:	mtr1 = 14.0;	mtr2 = 65.0;	break;
+		case width_F:	mtr1 = 16.0;	mtr2 = 80.0;	break;
+		}
+	r.mtr1 = mtr1;
+	r.mtr2 = mtr2;
+
+	if (info.rwy && info.hot)
+		set_color(r.color, 0.9, 0.1, 0.7, 0.5);  // purple
+	else if (info.hot)
+		set_color(r.color, 1, 0, 0, 0.5);        // red
+	else if (info.ils)
+		set_color(r.color, 0.8, 0.5, 0, 0.5);    // orange
+	else if (info.road) //Warning! Because a ground route can also have IsRunway() == true, this check must come first
+		set_color(r.color, 1, 1, 1, 0.4);        // white
+	else if (info.rwy)
+		set_color(r.color, 0.0, 0.2, 0.6, 0.4);  // blue
+	else
+		set_color(r.color, 1, 1, 0, 0.6);        // yellow
+
+	// outlines are laid out in meters around the first end, so the arrow heads are square at any latitude
+	Point2 origin(0, 0);
+	Point2 ends_m[2] = { origin, origin + VectorLLToMeters(info.ends[0], Vector2(info.ends[0], info.ends[1])) };
+	Quad_2to4pix(ends_m, mtr1, r.c);
+	Quad_2to4pix(ends_m, mtr2, r.d);
+
+	r.np = 4;
+	if (info.one_way)
+	{
+		make_arrow_line(r.c);
+		make_arrow_line(r.d);
+		r.np = 5;
+	}
+	for (int i = 0; i < r.np; ++i)
+	{
+		r.c[i] = info.ends[0] + VectorMetersToLL(info.ends[0], Vector2(origin, r.c[i]));
+		r.d[i] = info.ends[0] + VectorMetersToLL(info.ends[0], Vector2(origin, r.d[i]));
+	}
+}
+
+const WED_ATCRibbon * WED_ATCRibbonCache::find(const void * key, long long archive_key) const
+{
+	auto e = mEntries.find(key);
+	if (e == mEntries.end() || e->second.archive_key != archive_key)
+		return NULL;
+	return &e->second.ribbon;
+}
+
+const WED_ATCRibbon& WED_ATCRibbonCache::update(const void * key, long long archive_key, const WED_ATCRouteInfo& info)
+{
+	auto e = mEntries.find(key);
+	if (e == mEntries.end())
+		e = mEntries.insert(make_pair(key, entry())).first;
+	else if (e->second.ribbon.info == info)
+	{
+		e->second.archive_key = archive_key;
+		return e->second.ribbon;
+	}
+	WED_ATCRibbonBuild(info, e->second.ribbon);
+	e->second.archive_key = archive_key;
+	++mBuilds;
+	return e->second.ribbon;
+}
+
+// Adds a fan of np pixel points to the ribbon triangles, with the route's color at the given alpha.
+static void add_fan(const Point2 * pts, int np, const float color[4], float alpha, vector<float>& verts, vector<float>& colors)
+{
+	for (int i = 1; i < np - 1; ++i)
+	{
+		const Point2 * tri[3] = { pts, pts + i, pts + i + 1 };
+		for (int v = 0; v < 3; ++v)
+		{
+			verts.push_back(tri[v]->x());
+			verts.push_back(tri[v]->y());
+			colors.push_back(color[0]);
+			colors.push_back(color[1]);
+			colors.push_back(color[2]);
+			colors.push_back(alpha);
+		}
+	}
+}
+
 
 bool	WED_ATCLayer::DrawEntityStructure		(bool inCurrent, IGISEntity * entity, GUI_GraphState * g, bool selected, bool locked)
 {
@@ -318,46 +462,42 @@ bool	WED_ATCLayer::DrawEntityStructure		(bool inCurrent, IGISEntity * entity, GU
 		WED_TaxiRoute* seg = dynamic_cast<WED_TaxiRoute*>(entity);
 		DebugAssert(seg);
 
-		int icao_width = seg->GetWidth();
-		bool hot = seg->HasHotArrival() || seg->HasHotDepart();
-		bool ils = seg->HasHotILS();
-		bool rwy = seg->IsRunway();
-		bool road = seg->AllowTrucks() && !seg->AllowAircraft();
-		bool one_way = seg->IsOneway();
-
-		int mtr1, mtr2;
-		if (road)
-			mtr1 = mtr2 = one_way ? 4.0 : 8.0;
-		else
-			switch (icao_width)
+		long long key_a = seg->GetArchive()->CacheKey();
+		const WED_ATCRibbon * r = mRibbons.find(seg, key_a);
+		if (!r)
+		{
+			if (mRibbons.size() > ATC_RIBBON_CACHE_MAX)         // forget routes that got deleted meanwhile
+				mRibbons.clear();
+
+			WED_ATCRouteInfo info;
+			seg->GetNthPoint(0)->GetLocation(gis_Geo, info.ends[0]);
+			seg->GetNthPoint(seg->GetNumPoints() - 1)->GetLocation(gis_Geo, info.ends[1]);
+			info.icao_width = seg->GetWidth();
+			info.hot = seg->HasHotArrival() || seg->HasHotDepart();
+			info.ils = seg->HasHotILS();
+			info.rwy = seg->IsRunway();
+			info.road = seg->AllowTrucks() && !seg->AllowAircraft();
+			info.one_way = seg->IsOneway();
+			info.aircraft = seg->AllowAircraft();
+			if (info.aircraft)
 			{
-			default:
-			case width_A:	mtr1 = 4.5;		mtr2 = 15.0;	break;
-			case width_B:	mtr1 = 6.0;		mtr2 = 24.0;	break;
-			case width_C:	mtr1 = 9.0;		mtr2 = 36.0;	break;
-			case width_D:	mtr1 = 14.0;	mtr2 = 52.0;	break;
-			case width_E:	mtr1 = 14.0;	mtr2 = 65.0;	break;
-			case width_F:	mtr1 = 16.0;	mtr2 = 80.0;	break;
+				if(seg->GetRunway() != atc_rwy_None)   // ideally this would not be needed, but cant figure a way to fix up name upon earth.wed.xml import
+					info.name = ENUM_Desc(seg->GetRunway());
+				else
+					seg->GetName(info.name);
 			}
+			r = &mRibbons.update(seg, key_a, info);
+		}
 
-		mtr1 *= GetZoomer()->GetPPM();
-		mtr2 *= GetZoomer()->GetPPM();
-
-		if (rwy && hot)
-			glColor4f(0.9, 0.1, 0.7, 0.5);  // purple
-		else if (hot)
-			glColor4f(1, 0, 0, 0.5);        // red
-		else if (ils)
-			glColor4f(0.8, 0.5, 0, 0.5);    // orange
-		else if (road) //Warning! Because a ground route can also have IsRunway() == true, this check must come first
-			glColor4f(1, 1, 1, 0.4);        // white
-		else if (rwy)
-			glColor4f(0.0, 0.2, 0.6, 0.4);  // blue
-		else
-			glColor4f(1, 1, 0, 0.6);        // yellow
+		double mtr1 = r->mtr1 * GetZoomer()->GetPPM();
+		double mtr2 = r->mtr2 * GetZoomer()->GetPPM();
+		bool road = r->info.road;
+		bool one_way = r->info.one_way;
 
 #if HAS_CURVED_ATC_ROUTE
 
+		glColor4fv(r->color);
+
 		IGISPointSequence* ps = SAFE_CAST(IGISPointSequence, seg);
 		vector<Point2>	pts, d;
 		PointSequenceToVector(ps, GetZoomer(), pts, false, true);
@@ -435,10 +575,7 @@ bool	WED_ATCLayer::DrawEntityStructure		(bool inCurrent, IGISEntity * entity, GU
 
 		if (!road) // draw the less opaque wingspan indication
 		{
-			GLfloat currentColor[4];
-			glGetFloatv(GL_CURRENT_COLOR, currentColor);
-			currentColor[3] = 0.25;
-			glColor4fv(currentColor);
+			glColor4f(r->color[0], r->color[1], r->color[2], 0.25);
 			glBegin(GL_TRIANGLE_STRIP);
 			glVertex2v(d.data(), d.size());
 			glEnd();
@@ -449,28 +586,14 @@ bool	WED_ATCLayer::DrawEntityStructure		(bool inCurrent, IGISEntity * entity, GU
 		Vector2 label_dir = Vector2(pts[pts.size() / 2 - 1], pts[pts.size() / 2]);
 #else
 		Point2 ends[2];
-		seg->GetNthPoint(0)->GetLocation(gis_Geo, ends[0]);
-		seg->GetNthPoint(1)->GetLocation(gis_Geo, ends[1]);
+		Point2 c[5], d[5];
+		int np = r->np;
 
-		Point2	c[5], d[5];
+		GetZoomer()->LLToPixelv(ends, r->info.ends, 2);
+		GetZoomer()->LLToPixelv(c, r->c, np);
+		GetZoomer()->LLToPixelv(d, r->d, np);
 
-		GetZoomer()->LLToPixelv(ends, ends, 2);
-		Quad_2to4pix(ends, mtr1, c);
-		Quad_2to4pix(ends, mtr2, d);
-
-//		Quad_2to4(ends, mtr1, c);
-//		Quad_2to4(ends, mtr2, d);
-//		GetZoomer()->LLToPixelv(c, c, 4);
-//		GetZoomer()->LLToPixelv(d, d, 4);
-
-		int np = 4;
-		if(one_way)
-		{
-			make_arrow_line(c);
-			make_arrow_line(d);
-			np = 5;
-		}
-		else
+		if(!one_way)
 		{   // help visibility of vertices by creating little gaps in most opaque part of routeS
 			Vector2 dir(c[0],c[1]);
 			dir.normalize();
@@ -480,45 +603,28 @@ bool	WED_ATCLayer::DrawEntityStructure		(bool inCurrent, IGISEntity * entity, GU
 			c[2] -= dir;
 			c[3] += dir;
 		}
-		glBegin(GL_TRIANGLE_FAN);
-		glVertex2v(c,np);
-		glEnd();
+		add_fan(c, np, r->color, r->color[3], mRibbonVerts, mRibbonColors);
 
 		if (!road) // draw the less opaque wingspan indication
-		{
-			GLfloat currentColor[4];
-			glGetFloatv(GL_CURRENT_COLOR, currentColor);
-			currentColor[3] = 0.25;
-			glColor4fv(currentColor);
-			glBegin(GL_TRIANGLE_FAN);
-			glVertex2v(d, np);
-			glEnd();
-		}
+			add_fan(d, np, r->color, 0.25, mRibbonVerts, mRibbonColors);
+
 		Point2 label_xy = Midpoint2(ends[0], ends[1]);
 		Vector2 label_dir(ends[1], ends[0]);
 #endif
 
-		if (seg->AllowAircraft())              // display name of taxi route
+		if (r->info.aircraft)              // display name of taxi route
 		{
-			string nam;
-			if(seg->GetRunway() != atc_rwy_None)   // ideally this would not be needed, but cant figure a way to fix up name upon earth.wed.xml import
-				nam = ENUM_Desc(seg->GetRunway());
-			else
-				seg->GetName(nam);
-
+			const string& nam = r->info.name;
 			if(!nam.empty())
 			{
 				if (mtr1 > 20 &&
 					 ends[0].squared_distance(ends[1]) > sqr(20+6.0*nam.size()))      // draw labels only if segment long enough
 				{
-					glPushMatrix();
-					glTranslatef(label_xy.x(), label_xy.y(), 0);
-					float hdg = fltwrap(atan2f(label_dir.dy, label_dir.dx) * RAD_TO_DEG, -90, 90);
-					glRotatef(hdg,0,0,1);
-					const float white[4] = { 1, 1, 1, 1 };
-					GUI_FontDraw(g, font_UI_Basic, white, 0, -4, nam.c_str(), align_Center);
-					glPopMatrix();
-					g->SetTexUnits(0);
+					label_t l;
+					l.xy = label_xy;
+					l.hdg = fltwrap(atan2f(label_dir.dy, label_dir.dx) * RAD_TO_DEG, -90, 90);
+					l.name = nam;
+					mLabels.push_back(l);
 				}
 			}
 			mATCEdges.push_back(Segment2(ends[0], ends[1]));
@@ -690,3 +796,88 @@ void		WED_ATCLayer::GetCaps(bool& draw_ent_v, bool& draw_ent_s, bool& cares_abou
 	draw_ent_s = true;
 	wants_clicks = false;
 }
+
+#if UNIT_TEST
+// Headless test of the ribbon cache: a big airport's worth of taxi routes goes through the cache like it does while panning, then
+// after an edit somewhere else and after moving one route.  Checks that only new or changed routes get built and that the ribbons
+// come out the right width in meters.  No GL calls.
+//	usage: <number of routes>
+int main(int argc, const char * argv[])
+{
+	int n = argc > 1 ? atoi(argv[1]) : 10000;
+
+	srand(1);
+	vector<WED_ATCRouteInfo> routes(n);
+	for (int i = 0; i < n; ++i)
+	{
+		WED_ATCRouteInfo& r = routes[i];
+		r.ends[0] = Point2(-84.43 + (i % 100) * 2e-4, 33.63 + (i / 100) * 2e-4);
+		r.ends[1] = r.ends[0] + Vector2((rand() / (double) RAND_MAX - 0.5) * 4e-4, (rand() / (double) RAND_MAX - 0.5) * 4e-4);
+		r.icao_width = width_A + i % 6;
+		r.hot = i % 7 == 0;
+		r.ils = i % 11 == 0;
+		r.rwy = i % 13 == 0;
+		r.road = i % 5 == 0;
+		r.one_way = i % 3 == 0;
+		r.aircraft = !r.road;
+		r.name = r.aircraft ? "A" + to_string(i % 40) : "";
+	}
+
+	WED_ATCRibbonCache cache;
+	auto pass = [&](long long archive_key, int& hits) {
+		hits = 0;
+		unsigned long long t0 = query_hpc();
+		for (int i = 0; i < n; ++i)
+			if (cache.find(&routes[i], archive_key))
+				++hits;
+			else
+				cache.update(&routes[i], archive_key, routes[i]);
+		return hpc_to_microseconds(query_hpc() - t0) / 1000000.0;
+	};
+
+	int hits;
+	double t_first = pass(1, hits);
+	if (hits != 0 || cache.builds() != n)
+	{
+		printf("First frame: %d hits, %d builds.\n", hits, cache.builds());
+		return 1;
+	}
+	double t_pan = pass(1, hits);
+	if (hits != n || cache.builds() != n)
+	{
+		printf("Panning: %d hits, %d builds.\n", hits, cache.builds());
+		return 1;
+	}
+	double t_edit = pass(2, hits);
+	if (hits != 0 || cache.builds() != n)
+	{
+		printf("After an unrelated edit: %d hits, %d builds.\n", hits, cache.builds());
+		return 1;
+	}
+	routes[n / 2].ends[1].y_ += 1e-5;
+	pass(3, hits);
+	if (cache.builds() != n + 1 || cache.find(&routes[n / 2], 3)->c[1].y() == cache.find(&routes[n / 2], 3)->d[0].y())
+	{
+		printf("After moving a route: %d builds.\n", cache.builds());
+		return 1;
+	}
+
+	for (int i = 0; i < n; ++i)
+	{
+		const WED_ATCRibbon& r = *cache.find(&routes[i], 3);
+		const WED_ATCRouteInfo& info = routes[i];
+		double w1 = r.info.one_way ? LonLatDistMeters(r.c[0], r.c[4]) : LonLatDistMeters(r.c[0], r.c[3]);
+		double w2 = r.info.one_way ? LonLatDistMeters(r.d[0], r.d[4]) : LonLatDistMeters(r.d[0], r.d[3]);
+		double tip = r.info.one_way ? LonLatDistMeters(r.c[2], info.ends[1]) : 0.0;
+		if (fabs(w1 - r.mtr1) > 0.01 || fabs(w2 - r.mtr2) > 0.01 || tip > 0.01 || r.np != (info.one_way ? 5 : 4))
+		{
+			printf("Route %d: ribbon %.3lf m wide for %.1lf, wingspan %.3lf m for %.1lf, arrow tip %.3lf m off.\n", i, w1, r.mtr1, w2, r.mtr2, tip);
+			return 1;
+		}
+	}
+
+	printf("%d routes: built in %.2lf ms, found while panning in %.2lf ms, checked after an edit in %.2lf ms.\n", n,
+		t_first * 1000.0, t_pan * 1000.0, t_edit * 1000.0);
+	return 0;
+}
+#endif
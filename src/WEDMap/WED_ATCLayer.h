@@ -14,6 +14,47 @@
 
 class WED_RampPosition;
 
+// What a taxi route's ribbon is made of - everything DrawEntityStructure needs from the entity.
+struct WED_ATCRouteInfo {
+	Point2		ends[2];            // lon/lat
+	int			icao_width;
+	bool		hot, ils, rwy, road, one_way, aircraft;
+	string		name;               // label, empty if there is none
+
+	bool operator==(const WED_ATCRouteInfo& rhs) const;
+	bool operator!=(const WED_ATCRouteInfo& rhs) const { return !(*this == rhs); }
+};
+
+// The ribbon of one taxi route: the route outline and the wider wingspan outline, as fans of 4 or 5 (one-way arrow) points.  Kept
+// in lon/lat with the widths in meters, so panning and zooming only needs them projected again.
+struct WED_ATCRibbon {
+	WED_ATCRouteInfo	info;
+	float				color[4];
+	double				mtr1, mtr2;       // width of the route and of the wingspan indication, meters
+	int					np;
+	Point2				c[5], d[5];
+};
+
+// Ribbons by route, no GL in here.  A ribbon found with the archive's current CacheKey() is good as is.  After any edit, the caller
+// reads the route again and update() only rebuilds the ribbons whose route actually changed.
+class WED_ATCRibbonCache {
+public:
+						 WED_ATCRibbonCache() : mBuilds(0) { }
+
+	const WED_ATCRibbon *	find(const void * key, long long archive_key) const;    // NULL if never built or the archive changed since
+	const WED_ATCRibbon&	update(const void * key, long long archive_key, const WED_ATCRouteInfo& info);
+	void					clear(void) { mEntries.clear(); }
+	int						size(void) const { return mEntries.size(); }
+	int						builds(void) const { return mBuilds; }            // ribbons built so far
+
+private:
+	struct entry { long long archive_key; WED_ATCRibbon ribbon; };
+	unordered_map<const void *, entry>	mEntries;
+	int									mBuilds;
+};
+
+void WED_ATCRibbonBuild(const WED_ATCRouteInfo& info, WED_ATCRibbon& out_ribbon);
+
 class	WED_ATCLayer : public WED_MapLayer {
 public:
 
@@ -24,6 +65,7 @@ public:
 	virtual	void		GetCaps(bool& draw_ent_v, bool& draw_ent_s, bool& cares_about_sel, bool& wants_clicks);
 
 	virtual	void		DrawVisualization(bool inCurrent, GUI_GraphState * g);              // for clearing rubberband data
+	virtual	void		DrawStructure(bool inCurrent, GUI_GraphState * g);                  // for drawing the taxi route ribbons
 	virtual	void		DrawSelected(bool inCurrent, GUI_GraphState * g);              // for drawing rubberband lines
 
 private:
@@ -33,6 +75,13 @@ private:
 
 	vector<Segment2>	mStarts;     // ramp start locations - for A/C taxi paths
 	vector<Segment2>	mATCEdges;
+
+	struct label_t { Point2 xy; float hdg; string name; };
+
+	WED_ATCRibbonCache	mRibbons;
+	vector<float>		mRibbonVerts;    // x, y per vertex, triangles
+	vector<float>		mRibbonColors;   // r, g, b, a per vertex
+	vector<label_t>		mLabels;
 };
 
 void WED_ATCLayer_DrawAircraft(WED_RampPosition * pos, GUI_GraphState * g, WED_MapZoomerNew * z);
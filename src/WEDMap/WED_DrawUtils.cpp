@@ -21,12 +21,17 @@
  *
  */
 
+#if !APL
+	#include "glew.h"
+#endif
 #include "WED_DrawUtils.h"
+#include "GUI_GraphState.h"
 #include "IGIS.h"
 #include "WED_MapZoomerNew.h"
 #include "WED_UIDefs.h"
 #include "MathUtils.h"
 #include "WED_EnumSystem.h"
+#include "PerfUtils.h"
 
 #if LIBTESS
 	#include "tesselator.h"
@@ -136,10 +141,10 @@ static void CALLBACK TessVertexUVh(const Point2 * p, float * h)
 }
 #endif
 
-void glPolygon2(const vector<Point2>& pts, bool has_uv, const vector<int>& extra_contours, bool show_all, float height)
-{
 #if LIBTESS
-	TESStesselator * tess = tessNewTess(NULL);
+// Feeds the outer ring and holes to libtess, returns the number of holes.
+static int TessAddContours(TESStesselator * tess, const vector<Point2>& pts, bool has_uv, const vector<int>& extra_contours)
+{
 	int n_holes = 0;
 #if 1 //  2 * sizeof(TESSReal) == sizeof(Point2)
 	const Point2* pts_p(pts.data());
@@ -182,6 +187,15 @@ void glPolygon2(const vector<Point2>& pts, bool has_uv, const vector<int>& extra
 	if(!raw_pts.empty())
 		tessAddContour(tess, 2, &raw_pts[0], 2 * sizeof(TESSreal), raw_pts.size() / 2);
 #endif
+	return n_holes;
+}
+#endif
+
+void glPolygon2(const vector<Point2>& pts, bool has_uv, const vector<int>& extra_contours, bool show_all, float height)
+{
+#if LIBTESS
+	TESStesselator * tess = tessNewTess(NULL);
+	int n_holes = TessAddContours(tess, pts, has_uv, extra_contours);
 
 	if(tessTesselate(tess, TESS_WINDING_POSITIVE, TESS_POLYGONS, 3, 2, 0))
 	{
@@ -272,6 +286,122 @@ void glPolygon2(const vector<Point2>& pts, bool has_uv, const vector<int>& extra
 #endif
 }
 
+/*
+	Tesselation cache for glPolygon2Cached.  The triangles only depend on the points, the contour layout and show_all, so an entry
+	is good exactly as long as all of them are identical - comparing them is a lot cheaper than libtess.  Edits elsewhere in the
+	archive, hover and selection redraws leave the points alone and hit; moving the view or the polygon's own nodes misses.
+	libtess only ever hands back triangles made of the input vertices (unless the contours self-intersect), so we keep them as
+	input vertex numbers.  Self-intersecting polygons that need new vertices are flagged and simply go to glPolygon2 every time.
+*/
+
+#if LIBTESS
+
+#define TESS_CACHE_MAX	50000			// entries per cache before we throw everything out - keeps dead entities from piling up
+
+struct tess_cache_entry {
+	bool			show_all;
+	vector<int>		contours;
+	vector<Point2>	pts;
+	bool			reusable;			// false if libtess had to add vertices - draw with glPolygon2 instead
+	vector<int>		tris;				// 3 input vertex numbers per triangle - empty if nothing is to be drawn
+};
+
+static unordered_map<const void *, tess_cache_entry>	sTessCache[2];		// without, with UV
+
+// Tesselates the polygon into cache entry e.  Same acceptance rule as glPolygon2.
+static void TessToCache(const vector<Point2>& pts, bool has_uv, const vector<int>& extra_contours, bool show_all, tess_cache_entry& e)
+{
+	e.reusable = true;
+	e.tris.clear();
+
+	TESStesselator * tess = tessNewTess(NULL);
+	int n_holes = TessAddContours(tess, pts, has_uv, extra_contours);
+	if(tessTesselate(tess, TESS_WINDING_POSITIVE, TESS_POLYGONS, 3, 2, 0))
+	{
+		int tri_count = tessGetElementCount(tess);
+		if(show_all || tri_count-2*n_holes+2 == (pts.size() / (has_uv ? 2 : 1)))
+		{
+			const TESSindex * vert_idx = tessGetElements(tess);
+			const TESSindex * vidx = tessGetVertexIndices(tess);
+			e.tris.reserve(3 * tri_count);
+			for(int i = 0; i < 3 * tri_count; ++i)
+			{
+				TESSindex v = vidx[vert_idx[i]];
+				if(v == TESS_UNDEF)
+				{
+					e.reusable = false;
+					e.tris.clear();
+					break;
+				}
+				e.tris.push_back(v);
+			}
+		}
+	}
+	tessDeleteTess(tess);
+}
+
+// Finds or (re)builds the cache entry for this polygon.
+static const tess_cache_entry& TessCacheFetch(const void * key,
+					const vector<Point2>& pts, bool has_uv, const vector<int>& extra_contours, bool show_all)
+{
+	unordered_map<const void *, tess_cache_entry>& cache(sTessCache[has_uv ? 1 : 0]);
+	unordered_map<const void *, tess_cache_entry>::iterator i = cache.find(key);
+
+	if(i == cache.end() || i->second.show_all != show_all || i->second.contours != extra_contours || i->second.pts != pts)
+	{
+		if(i == cache.end())
+		{
+			if(cache.size() >= TESS_CACHE_MAX)
+				cache.clear();
+			i = cache.insert(make_pair(key, tess_cache_entry())).first;
+		}
+		tess_cache_entry& e(i->second);
+		e.show_all = show_all;
+		e.contours = extra_contours;
+		e.pts = pts;
+		TessToCache(pts, has_uv, extra_contours, show_all, e);
+	}
+	return i->second;
+}
+
+#endif
+
+void glPolygon2Cached(const void * key,
+					const vector<Point2>& pts, bool has_uv, const vector<int>& extra_contours, bool show_all, float height)
+{
+#if LIBTESS
+	const tess_cache_entry& e(TessCacheFetch(key, pts, has_uv, extra_contours, show_all));
+	if(!e.reusable)
+	{
+		glPolygon2(pts, has_uv, extra_contours, show_all, height);
+		return;
+	}
+	if(e.tris.empty())
+		return;
+
+	int stride = has_uv ? 2 : 1;
+	glBegin(GL_TRIANGLES);
+	for(vector<int>::const_iterator t = e.tris.begin(); t != e.tris.end(); ++t)
+	{
+		const Point2& p(pts[stride * *t]);
+		if(has_uv)				glTexCoord2(pts[stride * *t + 1]);
+		if(height == -1.0f)		glVertex2d(p.x(), p.y());
+		else					glVertex3d(p.x(), height, p.y());
+	}
+	glEnd();
+#else
+	glPolygon2(pts, has_uv, extra_contours, show_all, height);
+#endif
+}
+
+void glPolygon2CacheFlush(void)
+{
+#if LIBTESS
+	sTessCache[0].clear();
+	sTessCache[1].clear();
+#endif
+}
+
 #define 	line_TaxiWayHatch  line_BoundaryEdge+1
 #define 	line_BChequered    line_BoundaryEdge+2
 #define 	line_BBrokenWhite  line_BoundaryEdge+3
@@ -655,3 +785,359 @@ void BoxToPoints(const Point2& p1, const Point2& p2, WED_MapZoomerNew * z, vecto
 		pts.push_back(z->LLToPixel(p1 - dLon * 0.5 ));
 }
 
+
+WED_QuadBatch::WED_QuadBatch() : mUsed(0), mCur(-1), mSlot(0), mComplete(true), mNext(0), mUploaded(false), mVBO(0)
+{
+	color(255, 255, 255);
+}
+
+WED_QuadBatch::~WED_QuadBatch()
+{
+	if(mVBO) glDeleteBuffers(1, &mVBO);
+}
+
+void WED_QuadBatch::begin(int layer, int tex_id, TexRef tex, bool repeat_t)
+{
+	color(255, 255, 255);
+	if(mCur >= 0 && mBuckets[mCur].slot == mSlot && mBuckets[mCur].layer == layer && mBuckets[mCur].tex_id == tex_id)
+		return;
+	for(mCur = 0; mCur < mUsed; ++mCur)
+		if(mBuckets[mCur].slot == mSlot && mBuckets[mCur].layer == layer && mBuckets[mCur].tex_id == tex_id)
+			return;
+	if(mUsed == mBuckets.size())
+		mBuckets.push_back(bucket());
+	mCur = mUsed++;
+	mBuckets[mCur].slot = mSlot;
+	mBuckets[mCur].layer = layer;
+	mBuckets[mCur].tex_id = tex_id;
+	mBuckets[mCur].tex = tex;
+	mBuckets[mCur].repeat_t = repeat_t;
+	mBuckets[mCur].verts.clear();
+}
+
+void WED_QuadBatch::finish(void)
+{
+	build(mVerts, mRuns);
+	mNext = 0;
+	mUploaded = false;
+}
+
+bool WED_QuadBatch::empty(void) const
+{
+	return quad_count() == 0;
+}
+
+int WED_QuadBatch::quad_count(void) const
+{
+	int n = 0;
+	for(int b = 0; b < mUsed; ++b)
+		n += mBuckets[b].verts.size();
+	return n / 4;
+}
+
+int WED_QuadBatch::layer(void) const
+{
+	return mCur >= 0 ? mBuckets[mCur].layer : 0;
+}
+
+bool WED_QuadBatch::reusable(ITexMgr * tman) const
+{
+	if(!mComplete) return false;
+	for(int b = 0; b < mUsed; ++b)                 // GetTexID also keeps streamed textures from being evicted as unused
+		if(mBuckets[b].tex && tman->GetTexID(mBuckets[b].tex) != mBuckets[b].tex_id)
+			return false;
+	return true;
+}
+
+void WED_QuadBatch::build(vector<vert>& out_verts, vector<run>& out_runs) const
+{
+	vector<pair<pair<int, int>, int> > order;      // (slot, layer), bucket - buckets are already in order of first use
+	for(int b = 0; b < mUsed; ++b)
+		if(!mBuckets[b].verts.empty())
+			order.push_back(make_pair(make_pair(mBuckets[b].slot, mBuckets[b].layer), b));
+	sort(order.begin(), order.end());
+
+	out_verts.clear();
+	out_runs.clear();
+	for(vector<pair<pair<int, int>, int> >::iterator o = order.begin(); o != order.end(); ++o)
+	{
+		const bucket& b = mBuckets[o->second];
+		run r = { b.slot, b.layer, b.tex_id, b.repeat_t, (int) out_verts.size(), (int) b.verts.size() };
+		out_runs.push_back(r);
+		out_verts.insert(out_verts.end(), b.verts.begin(), b.verts.end());
+	}
+}
+
+void WED_QuadBatch::draw(GUI_GraphState * g, int below_slot)
+{
+	if(mNext >= mRuns.size() || mRuns[mNext].slot >= below_slot) return;
+
+	g->SetState(false,1,false,true,true,false,false);
+	glFrontFace(GL_CCW);
+
+	if(!mVBO) { glGenBuffers(1, &mVBO);                                                    CHECK_GL_ERR }
+	glBindBuffer(GL_ARRAY_BUFFER, mVBO);                                                    CHECK_GL_ERR
+	if(!mUploaded)
+	{
+		glBufferData(GL_ARRAY_BUFFER, mVerts.size() * sizeof(vert), mVerts.data(), GL_STATIC_DRAW); CHECK_GL_ERR
+		mUploaded = true;
+	}
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glTexCoordPointer(2, GL_FLOAT, sizeof(vert), (void *) offsetof(vert, s));
+	glVertexPointer  (2, GL_FLOAT, sizeof(vert), (void *) offsetof(vert, x));
+	glColorPointer   (4, GL_UNSIGNED_BYTE, sizeof(vert), (void *) offsetof(vert, rgba));
+
+	for( ; mNext < mRuns.size() && mRuns[mNext].slot < below_slot; ++mNext)
+	{
+		g->BindTex(mRuns[mNext].tex_id, 0);
+		if(mRuns[mNext].repeat_t)
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glDrawArrays(GL_QUADS, mRuns[mNext].first, mRuns[mNext].count);
+	}
+
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glColor3f(1,1,1);                              // the current color is undefined after drawing from a color array
+	glBindBuffer(GL_ARRAY_BUFFER, 0);                                                       CHECK_GL_ERR
+	glFrontFace(GL_CW);
+}
+
+void WED_QuadBatch::clear(void)
+{
+	for(int b = 0; b < mUsed; ++b)
+		mBuckets[b].verts.clear();
+	mUsed = 0;
+	mCur = -1;
+	mSlot = 0;
+	mComplete = true;
+	mVerts.clear();
+	mRuns.clear();
+	mNext = 0;
+	mUploaded = false;
+}
+
+#if UNIT_TEST && LIBTESS
+// Headless benchmark of the tesselation cache: a pile of taxiway-sized polygons (some with a hole) redrawn the way the map does -
+// every other frame the view zooms, the frames in between redraw the same view after an edit elsewhere.  Tesselated every frame
+// the way glPolygon2 does vs. fetched through the cache.  Then moves one vertex of a concave polygon, keeping the vertex count, and
+// checks that the cache gives what a fresh tesselation gives.  No GL calls.
+static int bench_tess_cache(int polys, int frames)
+{
+
+	vector<vector<Point2> >	shapes(polys);
+	vector<vector<int> >	holes(polys);
+	srand(1);
+	for(int p = 0; p < polys; ++p)
+	{
+		int n = 40 + rand() % 300;
+		Point2 c(rand() % 20000, rand() % 20000);
+		double r = 50.0 + rand() % 200;
+		for(int k = 0; k < n; ++k)
+		{
+			double a = 2.0 * M_PI * k / n;
+			double w = r * (1.0 + 0.2 * sin(5.0 * a));
+			shapes[p].push_back(Point2(c.x() + w * cos(a), c.y() + w * sin(a)));
+		}
+		if(p % 3 == 0)
+		{
+			holes[p].push_back(shapes[p].size());
+			for(int k = 0; k < 12; ++k)
+			{
+				double a = -2.0 * M_PI * k / 12;
+				shapes[p].push_back(Point2(c.x() + 0.3 * r * cos(a), c.y() + 0.3 * r * sin(a)));
+			}
+		}
+	}
+
+	long long tris_direct = 0, tris_cached = 0;
+	double secs_direct[2] = { 0.0, 0.0 }, secs_cached[2] = { 0.0, 0.0 };		// zooming, same view
+	vector<Point2>		pts;
+	tess_cache_entry	scratch;
+	for(int f = 0; f < frames; ++f)
+	{
+		int same_view = f % 2;
+		double zoom = 1.0 + 0.05 * (f / 2);
+		for(int cached = 0; cached < 2; ++cached)
+		{
+			unsigned long long t0 = query_hpc();
+			for(int p = 0; p < polys; ++p)
+			{
+				pts = shapes[p];
+				for(vector<Point2>::iterator i = pts.begin(); i != pts.end(); ++i)
+					*i = Point2(i->x() * zoom + 100.0, i->y() * zoom - 100.0);
+				if(cached)
+					tris_cached += TessCacheFetch(&shapes[p], pts, false, holes[p], false).tris.size() / 3;
+				else
+				{
+					TessToCache(pts, false, holes[p], false, scratch);
+					tris_direct += scratch.tris.size() / 3;
+				}
+			}
+			(cached ? secs_cached : secs_direct)[same_view] += hpc_to_microseconds(query_hpc() - t0) / 1000000.0;
+		}
+	}
+
+	int half = max(frames / 2, 1);
+	printf("%d polygons, %d frames: tesselating %.2lf ms/frame, cached %.2lf ms/frame when zooming, %.2lf ms/frame in the same view (%.1fx).\n",
+		polys, frames, 1000.0 * (secs_direct[0] + secs_direct[1]) / max(frames, 1), 1000.0 * secs_cached[0] / half, 1000.0 * secs_cached[1] / half,
+		secs_direct[1] / max(secs_cached[1], 1.0e-9));
+	if(tris_direct != tris_cached)
+	{
+		printf("Triangle counts differ: %lld vs %lld.\n", tris_direct, tris_cached);
+		return 1;
+	}
+
+	// An L whose reflex corner gets pulled out - libtess triangulates the result differently, so a stale entry would show.
+	vector<Point2>	l_shape = { Point2(0,0), Point2(10,0), Point2(10,4), Point2(4,4), Point2(4,10), Point2(0,10) };
+	vector<int>		no_holes;
+	tess_cache_entry	fresh;
+	const tess_cache_entry& first(TessCacheFetch(&l_shape, l_shape, false, no_holes, false));
+	vector<int> first_tris(first.tris);
+	l_shape[3] = Point2(8, 8);
+	TessToCache(l_shape, false, no_holes, false, fresh);
+	if(TessCacheFetch(&l_shape, l_shape, false, no_holes, false).tris != fresh.tris || fresh.tris == first_tris)
+	{
+		printf("Moved vertex did not re-tesselate.\n");
+		return 1;
+	}
+	return 0;
+}
+
+// Texture IDs as a streaming ITexMgr hands them out - ref n is texture n until evict() takes it away.
+struct test_tex_mgr : public ITexMgr {
+	set<intptr_t>	evicted;
+	virtual	TexRef	LookupTexture(const char * path, bool is_absolute, int flags) { return nullptr; }
+	virtual	void 	DropTexture(const char * path) { }
+	virtual	int		GetTexID(TexRef ref) { return evicted.count((intptr_t) ref) ? 0 : (int) (intptr_t) ref; }
+	virtual	void	GetTexInfo(TexRef ref, int * vis_x, int * vis_y, int * act_x, int * act_y, int * org_x, int * org_y) { }
+};
+
+// Line markings of a big airport through WED_QuadBatch: chains of segments with one of a dozen line textures, a few on a second
+// layer.  Reports draw calls vs. the one glBegin/glEnd per quad of immediate mode, and checks that the runs come sorted by layer
+// and cover every quad exactly once.  Then times the frames where nothing changed, which only check that the batch is still good,
+// and checks that an evicted texture or a line left out makes the batch unusable.  No GL calls.
+static int bench_quad_batch(int chains, int frames)
+{
+	test_tex_mgr					tman;
+	WED_QuadBatch					batch;
+	vector<WED_QuadBatch::vert>		verts;
+	vector<WED_QuadBatch::run>		runs;
+	double secs = 0.0;
+	int quads = 0;
+
+	for(int f = 0; f < frames; ++f)
+	{
+		srand(2);
+		unsigned long long t0 = query_hpc();
+		for(int c = 0; c < chains; ++c)
+		{
+			int layer = 2200 + (c % 10 == 0);
+			int tex = 1 + rand() % 12;
+			int segs = 2 + rand() % 40;
+			Point2 p(rand() % 20000, rand() % 20000);
+			batch.begin(layer, tex, (TexRef) (intptr_t) tex);
+			for(int k = 0; k < segs; ++k)
+			{
+				Point2 q(p.x() + 20.0, p.y() + (k % 2 ? 5.0 : -5.0));
+				batch.vertex(0.0f, k       , Point2(p.x(), p.y() - 1.0));
+				batch.vertex(1.0f, k       , Point2(p.x(), p.y() + 1.0));
+				batch.vertex(1.0f, k + 1.0f, Point2(q.x(), q.y() + 1.0));
+				batch.vertex(0.0f, k + 1.0f, Point2(q.x(), q.y() - 1.0));
+				p = q;
+			}
+		}
+		quads = batch.quad_count();
+		batch.finish();
+		secs += hpc_to_microseconds(query_hpc() - t0) / 1000000.0;
+		if(f < frames - 1)
+			batch.clear();
+	}
+	batch.build(verts, runs);
+
+	double secs_kept = 0.0;
+	for(int f = 0; f < frames; ++f)
+	{
+		unsigned long long t0 = query_hpc();
+		if(!batch.reusable(&tman))
+		{
+			printf("Unchanged batch not reusable.\n");
+			return 1;
+		}
+		batch.rewind();
+		secs_kept += hpc_to_microseconds(query_hpc() - t0) / 1000000.0;
+	}
+	tman.evicted.insert(7);
+	if(batch.reusable(&tman))
+	{
+		printf("Batch reusable after its texture got evicted.\n");
+		return 1;
+	}
+	tman.evicted.clear();
+	batch.incomplete();
+	if(batch.reusable(&tman))
+	{
+		printf("Batch reusable though a line was left out.\n");
+		return 1;
+	}
+
+	int first = 0;
+	for(vector<WED_QuadBatch::run>::iterator r = runs.begin(); r != runs.end(); ++r)
+	{
+		if(r->first != first || r->count % 4 || !r->repeat_t || (r != runs.begin() && r->layer < (r-1)->layer))
+		{
+			printf("Bad run: layer %d tex %d first %d count %d.\n", r->layer, r->tex_id, r->first, r->count);
+			return 1;
+		}
+		first += r->count;
+	}
+	if(first != verts.size() || verts.size() != quads * 4)
+	{
+		printf("Batched %d vertices for %d quads.\n", (int) verts.size(), quads);
+		return 1;
+	}
+	printf("%d line chains, %d quads: %d draw calls batched vs. %d immediate, %.2lf ms/frame to batch, %.4lf ms/frame when kept.\n",
+		chains, quads, (int) runs.size(), quads, 1000.0 * secs / max(frames, 1), 1000.0 * secs_kept / max(frames, 1));
+	return 0;
+}
+
+// Slots keep the batch in step with what the caller draws itself: a line, an item drawn directly, another line of the same layer
+// and texture, then a tinted icon that must not get its wrap mode changed.  The two lines must not merge across the item.
+static int check_quad_batch_slots(void)
+{
+	WED_QuadBatch				batch;
+	vector<WED_QuadBatch::vert>	verts;
+	vector<WED_QuadBatch::run>	runs;
+
+	batch.set_slot(1);                             // drawn before item 1, the one drawn directly
+	batch.begin(2200, 5);
+	for(int v = 0; v < 4; ++v) batch.vertex(0, 0, Point2(v, 0));
+	batch.set_slot(2);                             // after it
+	batch.begin(2201, 9, nullptr, false);
+	batch.color(25, 25, 25, 128);
+	for(int v = 0; v < 4; ++v) batch.vertex(0, 0, Point2(v, 2));
+	batch.begin(2200, 5);
+	for(int v = 0; v < 4; ++v) batch.vertex(0, 0, Point2(v, 1));
+	batch.build(verts, runs);
+
+	if(runs.size() != 3 || runs[0].slot != 1 || runs[1].slot != 2 || runs[1].layer != 2200 || runs[2].tex_id != 9 || runs[2].repeat_t ||
+		verts[runs[1].first].y != 1 || verts[runs[2].first].rgba[0] != 25 || verts[runs[2].first].rgba[3] != 128 || verts[0].rgba[0] != 255)
+	{
+		printf("Slots, layers or colors out of order in %d runs.\n", (int) runs.size());
+		return 1;
+	}
+	return 0;
+}
+
+//	usage: <polygons> <frames> <line chains>
+int main(int argc, const char * argv[])
+{
+	int polys  = argc > 1 ? atoi(argv[1]) : 3000;
+	int frames = argc > 2 ? atoi(argv[2]) : 30;
+	int chains = argc > 3 ? atoi(argv[3]) : 5000;
+
+	return bench_tess_cache(polys, frames) || bench_quad_batch(chains, frames) || check_quad_batch_slots();
+}
+#endif
@@ -25,6 +25,8 @@
 #define WED_DrawUtils_H
 
 #include "CompGeomDefs2.h"
+#include "ITexMgr.h"
+#include <limits.h>
 #include "WED_Colors.h"
 #if APL
 #include <OpenGL/gl.h>
@@ -68,6 +70,62 @@ int BezierPtsCount(const Bezier2& b, WED_MapZoomerNew * z);
 // So it's an interleaved array.  This is what PointSequenceToVector returns too.
 void glPolygon2(const vector<Point2>& pts, bool has_uv, const vector<int>& extra_contours, bool show_all, float height = -1);
 
+// Same as glPolygon2, but the triangulation is kept and reused as long as pts, extra_contours and show_all are identical to the last
+// call with the same key, which identifies the polygon (the entity).  Flush drops every cached triangulation.
+void glPolygon2Cached(const void * key,
+					const vector<Point2>& pts, bool has_uv, const vector<int>& extra_contours, bool show_all, float height = -1);
+void glPolygon2CacheFlush(void);
+
+// Collects textured quads by draw layer and texture, so a whole layer of line previews and markings goes out as one glDrawArrays per
+// texture instead of one glBegin/glEnd per quad.  Filling, finish() and reusable() are plain C++, only draw() touches GL.
+// The quads stay in the batch and in its vertex buffer until the next clear(), so a frame where nothing changed draws the
+// batch of an earlier frame again without rebuilding or uploading anything.
+// Quads also go into a slot, set before filling them: draw() puts out slot by slot, so the caller can interleave the batch
+// with things it draws itself.  Within a slot they go by layer, then texture.
+class WED_QuadBatch {
+public:
+	struct vert { GLfloat s, t, x, y; GLubyte rgba[4]; };
+	struct run  { int slot; int layer; int tex_id; bool repeat_t; int first; int count; };
+
+				 WED_QuadBatch();
+				~WED_QuadBatch();
+
+	void		set_slot(int slot) { mSlot = slot; }           // following begin()s go into this slot
+	void		begin(int layer, int tex_id, TexRef tex = nullptr, bool repeat_t = true);  // following vertices go with this layer and
+	                                                           // texture, in white.  repeat_t false leaves the texture's wrap mode alone
+	void		color(GLubyte r, GLubyte g, GLubyte b, GLubyte a = 255) { mColor[0] = r; mColor[1] = g; mColor[2] = b; mColor[3] = a; }
+	void		vertex(float s, float t, const Point2& p)      // 4 vertices per quad, in the order one would glBegin(GL_QUADS) them
+				{ vector<vert>& v = mBuckets[mCur].verts; v.push_back(vert()); v.back().s = s; v.back().t = t; v.back().x = p.x(); v.back().y = p.y();
+				  memcpy(v.back().rgba, mColor, 4); }
+	void		incomplete(void) { mComplete = false; }       // something was left out, e.g. its texture isn't loaded yet
+	void		finish(void);                                  // done filling - sorts the quads for drawing
+
+	bool		empty(void) const;
+	int			quad_count(void) const;
+	int			layer(void) const;                             // of the last begin()
+	bool		reusable(ITexMgr * tman) const;                // nothing was left out and every texture still has the same ID
+	void		build(vector<vert>& out_verts, vector<run>& out_runs) const;   // sorted by slot and layer, textures in order of first use
+
+	void		rewind(void) { mNext = 0; }                    // start drawing from the first slot again
+	void		draw(GUI_GraphState * g, int below_slot = INT_MAX);  // draws the runs of all slots before below_slot not yet drawn
+	void		clear(void);
+
+private:
+	struct bucket { int slot; int layer; int tex_id; TexRef tex; bool repeat_t; vector<vert> verts; };
+
+	vector<bucket>	mBuckets;      // only the first mUsed are in use, the others keep their storage for the next frame
+	int				mUsed;
+	int				mCur;
+	int				mSlot;
+	GLubyte			mColor[4];
+	bool			mComplete;
+	vector<vert>	mVerts;        // what finish() built, and mVBO holds once mUploaded
+	vector<run>		mRuns;
+	int				mNext;         // next run to draw
+	bool			mUploaded;
+	GLuint			mVBO;
+};
+
 // returns if points were dropped due to being indistinguishably close
 void PointSequenceToVector(IGISPointSequence* ps, WED_MapZoomerNew* z, vector<Point2>& pts, bool get_uv,
 	bool dupFirst = false   /* duplicate first / last node even on closed rings. Not desired to build polygons, but desired to draw lines */ 
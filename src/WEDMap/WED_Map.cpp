@@ -522,7 +522,7 @@ void		WED_Map::ReceiveMessage(
 							intptr_t				inMsg,
 							intptr_t				inParam)
 {
-	if(inMsg == msg_ArchiveChanged)	Refresh();
+	if(inMsg == msg_ArchiveChanged || inMsg == msg_ResourceLoaded)	Refresh();
 }
 
 IGISEntity *	WED_Map::GetGISBase()
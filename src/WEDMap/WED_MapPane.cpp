@@ -56,6 +56,8 @@
 #include "WED_GroupCommands.h"
 #include "WED_LibraryListAdapter.h"
 #include "WED_LibraryMgr.h"
+#include "WED_ResourceMgr.h"
+#include "WED_TexMgr.h"
 #include "IDocPrefs.h"
 #include "WED_Orthophoto.h"
 #if WITHNWLINK
@@ -310,6 +312,9 @@ WED_MapPane::WED_MapPane(GUI_Commander * cmdr, double map_bounds[4], IResolver *
 	// messages (secretly it's our document's GetArchive() member) and anyone who needs it (our map).
 
 	archive->AddListener(mMap);
+	WED_GetResourceMgr(resolver)->AddListener(mMap);		// redraw when objects loaded in the background become available
+	if (WED_TexMgr * tman = dynamic_cast<WED_TexMgr *>(WED_GetTexMgr(resolver)))
+		tman->AddListener(mMap);						// ... and textures, too
 
 	// This is a band-aid.  We don't restore the current tab in the tab hierarchy (as of WED 1.5) so we don't get a tab changed message.  Instead we just
 	// are always in the selection tab.  So mostly that means the defaults for things like filters are fine, but for the ATC layer it needs to be off!
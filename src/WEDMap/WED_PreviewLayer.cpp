@@ -163,7 +163,7 @@ static bool setup_taxi_texture(int surface_code, double heading, const Point2& c
 static bool setup_pol_texture(ITexMgr * tman, const pol_info_t& pol, double heading, bool no_proj, const Point2& centroid, GUI_GraphState * g,
 							WED_MapZoomerNew * z, float alpha, bool isAbsPath = true)
 {
-	TexRef	ref = tman->LookupTexture(pol.base_tex.c_str(),true, pol.wrap ? (tex_Compress_Ok|tex_Wrap|tex_Always_Pad) : tex_Compress_Ok|tex_Always_Pad);
+	TexRef	ref = tman->LookupTexture(pol.base_tex.c_str(),true, pol.wrap ? (tex_Compress_Ok|tex_Wrap|tex_Always_Pad|tex_Stream) : tex_Compress_Ok|tex_Always_Pad|tex_Stream);
 	if(ref == NULL) return false;
 	int tex_id = tman->GetTexID(ref);
 
@@ -324,8 +324,8 @@ void draw_obj_at_ll(ITexMgr * tman, const XObj8 * o, const Point2& loc, float ag
 	ObjDrawFuncs10_t draw_funcs = { Obj_SetupPoly, Obj_SetupLine, Obj_SetupLight, Obj_SetupMovie, Obj_SetupPanel, Obj_TexCoord,
 								Obj_TexCoordPointer, anim_cb, Obj_SetDraped, Obj_SetNoDraped };
 
-	TexRef	ref = tman->LookupTexture(o->texture.c_str() ,true, tex_Wrap|tex_Compress_Ok|tex_Always_Pad);
-	TexRef	ref2 = o->texture_draped.empty() ? ref : tman->LookupTexture(o->texture_draped.c_str() ,true, tex_Wrap|tex_Compress_Ok|tex_Always_Pad);
+	TexRef	ref = tman->LookupTexture(o->texture.c_str() ,true, tex_Wrap|tex_Compress_Ok|tex_Always_Pad|tex_Stream);
+	TexRef	ref2 = o->texture_draped.empty() ? ref : tman->LookupTexture(o->texture_draped.c_str() ,true, tex_Wrap|tex_Compress_Ok|tex_Always_Pad|tex_Stream);
 	int id1 = ref  ? tman->GetTexID(ref ) : 0;
 	int id2 = ref2 ? tman->GetTexID(ref2) : 0;
 	g->SetTexUnits(1);
@@ -525,11 +525,25 @@ static double PixelSize(const WED_GISPoint * point, double diameterMeters, const
 	return zoomer->PixelSize(ll, diameterMeters);
 }
 
+// What GUI_PlotIcon would draw, into the batch instead.
+static void batch_icon(WED_QuadBatch& batch, int layer, const char * res, const Point2& pt, float angle, float scale,
+	GLubyte r, GLubyte g, GLubyte b, GLubyte a)
+{
+	float st_xy[16];
+	int tex_id = GUI_PlotIconQuad(res, pt.x(), pt.y(), angle, scale, st_xy);
+	batch.begin(layer, tex_id, nullptr, false);
+	batch.color(r, g, b, a);
+	for(int n = 0; n < 4; ++n)
+		batch.vertex(st_xy[4*n], st_xy[4*n+1], Point2(st_xy[4*n+2], st_xy[4*n+3]));
+}
+
 struct	preview_runway : public WED_PreviewItem {
 	WED_Runway * rwy;
 	int			 do_shoulders;
 	IResolver * res;
-	preview_runway(WED_Runway * r, int l, int is_shoulders, IResolver * re) : WED_PreviewItem(l), rwy(r), do_shoulders(is_shoulders), res(re) { }
+	WED_QuadBatch * batch;
+	preview_runway(WED_Runway * r, int l, int is_shoulders, IResolver * re, WED_QuadBatch * b) : WED_PreviewItem(l), rwy(r), do_shoulders(is_shoulders), res(re), batch(b) { }
+	virtual	const void * batch_key(void) { return rwy; }
 	virtual void draw_it(WED_MapZoomerNew * zoomer, GUI_GraphState * g, float mPavementAlpha)
 	{
 		Point2 	corners[4], shoulders[8], blas1[4], blas2[4];
@@ -559,14 +573,46 @@ struct	preview_runway : public WED_PreviewItem {
 			kill_transform();
 			g->SetState(false,0,false, true,true, false,false);
 		}
+		double z = zoomer->GetPPM();
+		if (z > 0.2 && gExportTarget >= wet_xplane_1200)
+		{
+			AptRunway_t info;
+			rwy->Export(info);
+			g->SetState(false,0,false, true,true, false,false);
+			for(int dir = 0 ; dir <= 1; dir++)
+				if(info.skid_len[dir] > 0.0 && info.skids[dir] > 0.0)
+				{
+					Point2 skids[4];
+					Vector2 direction(corners[0], corners[1]);
+					Vector2 width(corners[1], corners[2]);
+					width *= 0.25;
+					
+					double skid_ends[2];
+					skid_ends[dir] = 0.1;
+					skid_ends[1-dir] = 0.5 + 0.3 * (1.0 - doblim(info.skid_len[dir],0,1));
+				
+					skids[0] = corners[0] + width + direction * skid_ends[0];
+					skids[1] = corners[1] + width - direction * skid_ends[1];
+					skids[2] = corners[2] - width - direction * skid_ends[1];
+					skids[3] = corners[3] - width + direction * skid_ends[0];
+					
+					glColor4f(0,0,0,0.1);
+					glShape2v(GL_QUADS, skids, 4);
+				}	
+		}
+	}
+	virtual void batch_it(WED_MapZoomerNew * zoomer)
+	{
 		double z = zoomer->GetPPM();
 		if (z > 0.2)                     // draw some well know sign and light positions
 		{
+			Point2 	corners[4];
+			rwy->GetCorners(gis_Geo,corners);
+			zoomer->LLToPixelv(corners, corners, 4);
 			AptRunway_t info;
 			rwy->Export(info);
 			if(info.has_distance_remaining)
 			{
-				glColor3ub(25,25,25);
 				for(int dir = 0 ; dir <= 1; dir++)
 				{
 					Point2 lpos = corners[2*dir];
@@ -583,16 +629,14 @@ struct	preview_runway : public WED_PreviewItem {
 					{
 						lpos += direction;
 						rpos += direction;
-						GUI_PlotIcon(g,"map_taxisign.png",lpos.x(),lpos.y(),sign_hdg, max(0.4, z * 0.05));
-						GUI_PlotIcon(g,"map_taxisign.png",rpos.x(),rpos.y(),sign_hdg, max(0.4, z * 0.05));
+						batch_icon(*batch, get_layer(), "map_taxisign.png", lpos, sign_hdg, max(0.4, z * 0.05), 25,25,25,255);
+						batch_icon(*batch, get_layer(), "map_taxisign.png", rpos, sign_hdg, max(0.4, z * 0.05), 25,25,25,255);
 					}
 				}
 			}
 			for(int dir = 0 ; dir <= 1; dir++)
 				if(info.app_light_code[dir])
 				{
-					glColor4ub(255,255,255,128);
-
 					double spacing = 200*FT_TO_MTR;
 					double length = 1400*FT_TO_MTR;
 					if(info.app_light_code[dir] == apt_app_ALSFI || info.app_light_code[dir] == apt_app_ALSFII ||
@@ -622,39 +666,16 @@ struct	preview_runway : public WED_PreviewItem {
 						for(int n = 0; n < 5; n++)
 						{
 							if(n != 2)
-								GUI_PlotIcon(g,"map_light.png",rollbar.x(),rollbar.y(),sign_hdg, max(0.3, z * 0.05));
+								batch_icon(*batch, get_layer(), "map_light.png", rollbar, sign_hdg, max(0.3, z * 0.05), 255,255,255,128);
 							rollbar += rbar_dir;
 						}
 					}
 					for(int n = 0; n < num_lgts; n++)
 					{
 						lpos += vec_lgts;
-						GUI_PlotIcon(g,"map_light.png",lpos.x(),lpos.y(),sign_hdg, max(0.3, z * 0.05));
+						batch_icon(*batch, get_layer(), "map_light.png", lpos, sign_hdg, max(0.3, z * 0.05), 255,255,255,128);
 					}
 				}
-			g->SetState(false,0,false, true,true, false,false);
-			
-			if(gExportTarget >= wet_xplane_1200)
-				for(int dir = 0 ; dir <= 1; dir++)
-					if(info.skid_len[dir] > 0.0 && info.skids[dir] > 0.0)
-					{
-						Point2 skids[4];
-						Vector2 direction(corners[0], corners[1]);
-						Vector2 width(corners[1], corners[2]);
-						width *= 0.25;
-						
-						double skid_ends[2];
-						skid_ends[dir] = 0.1;
-						skid_ends[1-dir] = 0.5 + 0.3 * (1.0 - doblim(info.skid_len[dir],0,1));
-					
-						skids[0] = corners[0] + width + direction * skid_ends[0];
-						skids[1] = corners[1] + width - direction * skid_ends[1];
-						skids[2] = corners[2] - width - direction * skid_ends[1];
-						skids[3] = corners[3] - width + direction * skid_ends[0];
-						
-						glColor4f(0,0,0,0.1);
-						glShape2v(GL_QUADS, skids, 4);
-					}	
 		}
 	}
 };
@@ -718,7 +739,7 @@ struct	preview_polygon : public WED_PreviewItem {
 		if (!pts.empty())
 		{
 			glFrontFace(GL_CCW);
-			glPolygon2(pts, has_uv, hole_starts, false);
+			glPolygon2Cached(pol, pts, has_uv, hole_starts, false);
 			glFrontFace(GL_CW);
 		}
 	}
@@ -776,7 +797,7 @@ struct	preview_forest : public preview_polygon {
 	}
 };
 
-static void draw_line_preview(const vector<Point2>& pts, const lin_info_t& linfo, int l, double PPM)
+static void draw_line_preview(WED_QuadBatch& batch, const vector<Point2>& pts, const lin_info_t& linfo, int l, double PPM)
 {
 	double half_width =  (linfo.s2[l]-linfo.s1[l]) / 2.0 * linfo.scale_s * PPM;
 	double offset     = ((linfo.s2[l]+linfo.s1[l]) / 2.0 - linfo.sm[l]) * linfo.scale_s * PPM;
@@ -854,15 +875,13 @@ static void draw_line_preview(const vector<Point2>& pts, const lin_info_t& linfo
 		{
 			double cap_len_t = linfo.start_caps[l].t2 - linfo.start_caps[l].t1;
 			double t = min(startcap_t, uv_t2 - uv_t1);
-			glBegin(GL_QUADS);
-				glTexCoord2f(linfo.start_caps[l].s1,linfo.start_caps[l].t2-startcap_t); glVertex2(start_left);
-				glTexCoord2f(linfo.start_caps[l].s2,linfo.start_caps[l].t2-startcap_t); glVertex2(start_right);
-				start_left  = Segment2(start_left, end_left).midpoint(t/(uv_t2 - uv_t1));
-				start_right = Segment2(start_right, end_right).midpoint(t/(uv_t2 - uv_t1));
-				startcap_t -= t;
-				glTexCoord2f(linfo.start_caps[l].s2,linfo.start_caps[l].t2-startcap_t); glVertex2(start_right);
-				glTexCoord2f(linfo.start_caps[l].s1,linfo.start_caps[l].t2-startcap_t); glVertex2(start_left);
-			glEnd();
+			batch.vertex(linfo.start_caps[l].s1,linfo.start_caps[l].t2-startcap_t, start_left);
+			batch.vertex(linfo.start_caps[l].s2,linfo.start_caps[l].t2-startcap_t, start_right);
+			start_left  = Segment2(start_left, end_left).midpoint(t/(uv_t2 - uv_t1));
+			start_right = Segment2(start_right, end_right).midpoint(t/(uv_t2 - uv_t1));
+			startcap_t -= t;
+			batch.vertex(linfo.start_caps[l].s2,linfo.start_caps[l].t2-startcap_t, start_right);
+			batch.vertex(linfo.start_caps[l].s1,linfo.start_caps[l].t2-startcap_t, start_left);
 			if(startcap_t > 0.0) continue;
 			uv_t1 = 0.0;
 			uv_t2 -= cap_len_t;
@@ -871,14 +890,12 @@ static void draw_line_preview(const vector<Point2>& pts, const lin_info_t& linfo
 		if(j >= start_of_endcap)
 		{
 			endcap_frac_t = min(endcap_frac_t,uv_t2 - uv_t1);
-			glBegin(GL_QUADS);
-				glTexCoord2f(linfo.end_caps[l].s2,linfo.end_caps[l].t2-endcap_t + endcap_frac_t); glVertex2(end_right);
-				glTexCoord2f(linfo.end_caps[l].s1,linfo.end_caps[l].t2-endcap_t + endcap_frac_t); glVertex2(end_left);
-				end_left  = Segment2(end_left, start_left).midpoint(endcap_frac_t/(uv_t2 - uv_t1));
-				end_right = Segment2(end_right, start_right).midpoint(endcap_frac_t/(uv_t2 - uv_t1));
-				glTexCoord2f(linfo.end_caps[l].s1,linfo.end_caps[l].t2-endcap_t); glVertex2(end_left);
-				glTexCoord2f(linfo.end_caps[l].s2,linfo.end_caps[l].t2-endcap_t); glVertex2(end_right);
-			glEnd();
+			batch.vertex(linfo.end_caps[l].s2,linfo.end_caps[l].t2-endcap_t + endcap_frac_t, end_right);
+			batch.vertex(linfo.end_caps[l].s1,linfo.end_caps[l].t2-endcap_t + endcap_frac_t, end_left);
+			end_left  = Segment2(end_left, start_left).midpoint(endcap_frac_t/(uv_t2 - uv_t1));
+			end_right = Segment2(end_right, start_right).midpoint(endcap_frac_t/(uv_t2 - uv_t1));
+			batch.vertex(linfo.end_caps[l].s1,linfo.end_caps[l].t2-endcap_t, end_left);
+			batch.vertex(linfo.end_caps[l].s2,linfo.end_caps[l].t2-endcap_t, end_right);
 			endcap_t -= endcap_frac_t;
 			endcap_frac_t = 1.0;           // cram as much endcap as it gets into the next segment
 			if(j > start_of_endcap) continue;
@@ -886,12 +903,10 @@ static void draw_line_preview(const vector<Point2>& pts, const lin_info_t& linfo
 
 		if(j == pts.size()-2 && linfo.align > 0) uv_t2 = round_by_parts(uv_t2 - (linfo.end_caps.size() > l ? linfo.end_caps[l].t2-linfo.end_caps[l].t1 : 0.0), linfo.align);
 
-		glBegin(GL_QUADS);
-			glTexCoord2f(linfo.s1[l],uv_t1 + d1); glVertex2(start_left);
-			glTexCoord2f(linfo.s2[l],uv_t1 - d1); glVertex2(start_right);
-			glTexCoord2f(linfo.s2[l],uv_t2 - d2); glVertex2(end_right);
-			glTexCoord2f(linfo.s1[l],uv_t2 + d2); glVertex2(end_left);
-		glEnd();
+		batch.vertex(linfo.s1[l],uv_t1 + d1, start_left);
+		batch.vertex(linfo.s2[l],uv_t1 - d1, start_right);
+		batch.vertex(linfo.s2[l],uv_t2 - d2, end_right);
+		batch.vertex(linfo.s1[l],uv_t2 + d2, end_left);
 
 	}
 }
@@ -899,8 +914,11 @@ static void draw_line_preview(const vector<Point2>& pts, const lin_info_t& linfo
 struct	preview_line : WED_PreviewItem {
 	WED_LinePlacement * lin;
 	IResolver * resolver;
-	preview_line(WED_LinePlacement * ln, int l, IResolver * r) : WED_PreviewItem(l), lin(ln), resolver(r) {}
-	virtual void draw_it(WED_MapZoomerNew * zoomer, GUI_GraphState * g, float mPavementAlpha)
+	WED_QuadBatch * batch;
+	preview_line(WED_LinePlacement * ln, int l, IResolver * r, WED_QuadBatch * b) : WED_PreviewItem(l), lin(ln), resolver(r), batch(b) {}
+	virtual	const void * batch_key(void) { return lin; }
+	virtual	bool batch_only(void) { return true; }
+	virtual void batch_it(WED_MapZoomerNew * zoomer)
 	{
 		WED_ResourceMgr * rmgr = WED_GetResourceMgr(resolver);
 		string vpath;
@@ -909,29 +927,26 @@ struct	preview_line : WED_PreviewItem {
 		if (!rmgr->GetLin(vpath,linfo)) return;
 
 		ITexMgr *	tman = WED_GetTexMgr(resolver);
-		TexRef tref = tman->LookupTexture(linfo->base_tex.c_str(),true,tex_Compress_Ok);
+		TexRef tref = tman->LookupTexture(linfo->base_tex.c_str(),true,tex_Compress_Ok|tex_Stream);
 		int tex_id = 0;
 		if(tref) tex_id = tman->GetTexID(tref);
 
 		if(!tex_id)
+		{
+			if(tref) batch->incomplete();		// still streaming in
 			return;
-
-		g->SetState(false,1,false,true,true,false,false);
-		g->BindTex(tex_id,0);
-		glColor3f(1,1,1);
-		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		}
 
 		IGISPointSequence * ps = SAFE_CAST(IGISPointSequence,lin);
 		if(ps)
 		{
-			glFrontFace(GL_CCW);
+			batch->begin(get_layer(), tex_id, tref);
 			for (int l = 0; l < linfo->s1.size(); ++l)
 			{
 				vector<Point2>	pts;
 				PointSequenceToVector(ps, zoomer, pts, false, true);
-				draw_line_preview(pts, *linfo, l, zoomer->GetPPM());
+				draw_line_preview(*batch, pts, *linfo, l, zoomer->GetPPM());
 			}
-			glFrontFace(GL_CW);
 		}
 	}
 };
@@ -1038,15 +1053,17 @@ struct	preview_string : WED_PreviewItem {
 struct	preview_airportlines : WED_PreviewItem {
 	IGISPointSequence * ps;
 	IResolver * res;
+	WED_QuadBatch * batch;
 
-	preview_airportlines(IGISPointSequence * ips, int l, IResolver * r) : WED_PreviewItem(l), ps(ips), res(r) {}
-	virtual void draw_it(WED_MapZoomerNew * zoomer, GUI_GraphState * g, float mPavementAlpha)
+	preview_airportlines(IGISPointSequence * ips, int l, IResolver * r, WED_QuadBatch * b) : WED_PreviewItem(l), ps(ips), res(r), batch(b) {}
+	virtual	const void * batch_key(void) { return ps; }
+	virtual	bool batch_only(void) { return true; }
+	virtual void batch_it(WED_MapZoomerNew * zoomer)
 	{
 //		if(zoomer->GetPPM() * 0.3 < MIN_PIXELS_PREVIEW) return;      // cutoff size for real preview, average line width is 0.3m
 //		IGISPointSequence * ps = SAFE_CAST(IGISPointSequence,chn);
 //		if(!ps) return;
 
-		glFrontFace(GL_CCW);
 		int i = 0;
 		while (i < ps->GetNumSides())
 		{
@@ -1067,6 +1084,7 @@ struct	preview_airportlines : WED_PreviewItem {
 			string vpath;
 			const lin_info_t * linfo = nullptr;
 			int tex_id = 0;
+			TexRef tref = nullptr;
 			WED_ResourceMgr * rmgr = WED_GetResourceMgr(res);
 			ITexMgr         * tman = WED_GetTexMgr(res);
 			WED_LibraryMgr  * lmgr = WED_GetLibraryMgr(res);
@@ -1074,18 +1092,15 @@ struct	preview_airportlines : WED_PreviewItem {
 			if (lmgr->GetLineVpath(t, vpath))
 				if (rmgr->GetLin(vpath, linfo))
 				{
-					TexRef tref = tman->LookupTexture(linfo->base_tex.c_str(),true,tex_Compress_Ok);
+					tref = tman->LookupTexture(linfo->base_tex.c_str(),true,tex_Compress_Ok|tex_Stream);
 					if(tref) tex_id = tman->GetTexID(tref);
+					if(tref && !tex_id) batch->incomplete();		// still streaming in
 				}
 
 			if(tex_id)
 			{
 				vector<Point2> pts;
-
-				g->SetState(false,1,false,true,true,false,false);
-				g->BindTex(tex_id,0);
-				glColor3f(1,1,1);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+				batch->begin(get_layer(), tex_id, tref);
 
 				for ( ; i < ps->GetNumSides(); ++i)
 				{
@@ -1112,13 +1127,12 @@ struct	preview_airportlines : WED_PreviewItem {
 
 				for (int l = 0; l < linfo->s1.size(); ++l)
 				{
-					draw_line_preview(pts, *linfo, l, zoomer->GetPPM());
+					draw_line_preview(*batch, pts, *linfo, l, zoomer->GetPPM());
 				}
 			}
 			else
 				++i; // in case we cang get the attributes, skip to next node. If we dont, we'll loop indefinitely;
 		}
-		glFrontFace(GL_CW);
 	}
 };
 
@@ -1446,7 +1460,7 @@ struct	preview_ortho : public preview_polygon {
 		{
 			string rpath;
 			orth->GetResource(rpath);
-			TexRef	tref = tman->LookupTexture(rpath.c_str(), false, tex_Compress_Ok|tex_Linear);
+			TexRef	tref = tman->LookupTexture(rpath.c_str(), false, tex_Compress_Ok|tex_Linear|tex_Stream);
 			if(tref == NULL) return;
 			if(int tex_id = tman->GetTexID(tref))
 			{
@@ -1491,10 +1505,24 @@ struct	preview_object : public WED_PreviewItem {
 
 		float agl = obj->HasCustomMSL() > 1 ? obj->GetCustomMSL() : 0.0;
 
-		if (rmgr->GetObj(vpath, o))
+		if (rmgr->GetObjAsync(vpath, o))
 		{
-			draw_obj_at_ll(tman, o, loc, agl, obj->GetHeading() + zoomer->GetRotation(loc), g, zoomer);
+			if(o)
+				draw_obj_at_ll(tman, o, loc, agl, obj->GetHeading() + zoomer->GetRotation(loc), g, zoomer);
 //			draw_obj_at_ll(tman, o, loc, agl, obj->GetHeading(), g, zoomer);
+			else
+			{
+				// still being loaded in the background - mark the spot until it shows up
+				loc = zoomer->LLToPixel(loc);
+				g->SetState(false, 0, false, false, false, false, false);
+				glColor3f(0.6, 0.6, 0.6);
+				glBegin(GL_LINE_LOOP);
+				glVertex2f(loc.x() - 4, loc.y() - 4);
+				glVertex2f(loc.x() + 4, loc.y() - 4);
+				glVertex2f(loc.x() + 4, loc.y() + 4);
+				glVertex2f(loc.x() - 4, loc.y() + 4);
+				glEnd();
+			}
 		}
 		else if (rmgr->GetAGP(vpath, agp))
 			draw_agp_at_ll(tman, agp, loc, agl, obj->GetHeading(), g, zoomer, preview_level);
@@ -1820,7 +1848,7 @@ struct	preview_road : WED_PreviewItem {
 		auto& rd = roads_i->second;
 		ITexMgr *	tman = WED_GetTexMgr(resolver);
 		if (rd.tex_idx >= rds->textures.size()) return;
-		TexRef tref = tman->LookupTexture(rds->textures[rd.tex_idx].c_str(),true,tex_Wrap+tex_Mipmap+tex_Linear);
+		TexRef tref = tman->LookupTexture(rds->textures[rd.tex_idx].c_str(),true,tex_Wrap+tex_Mipmap+tex_Linear+tex_Stream);
 
 		int tex_id = 0;
 		if(tref) tex_id = tman->GetTexID(tref);
@@ -1902,12 +1930,14 @@ WED_PreviewLayer::WED_PreviewLayer(GUI_Pane * host, WED_MapZoomerNew * zoomer, I
 	mObjDensity(6),
 	mRunwayLayer(group_RunwaysBegin),
 	mTaxiLayer(group_TaxiwaysBegin),
-	mShoulderLayer(group_ShouldersBegin)
+	mShoulderLayer(group_ShouldersBegin),
+	mLineBatch(new WED_QuadBatch), mLineKeyArchive(-1), mLineKeyZoomer(-1), mLineKeyItems(0)
 {
 }
 
 WED_PreviewLayer::~WED_PreviewLayer()
 {
+	delete mLineBatch;
 }
 
 void		WED_PreviewLayer::GetCaps						(bool& draw_ent_v, bool& draw_ent_s, bool& cares_about_sel, bool& wants_clicks)
@@ -1932,9 +1962,9 @@ bool		WED_PreviewLayer::DrawEntityVisualization		(bool inCurrent, IGISEntity * e
 		if(rwy)
 		{
 			mPreviewItems.push_back(new preview_runway(rwy, mRunwayLayer++ - (rwy->GetSurface() >= surf_Grass ?
-				 group_RunwaysBegin - group_UnpavedRunwaysBegin : 0), 0, GetResolver()));
+				 group_RunwaysBegin - group_UnpavedRunwaysBegin : 0), 0, GetResolver(), mLineBatch));
 
-			mPreviewItems.push_back(new preview_runway(rwy, mShoulderLayer++, 1, GetResolver()));
+			mPreviewItems.push_back(new preview_runway(rwy, mShoulderLayer++, 1, GetResolver(), mLineBatch));
 		}
 	}
 	else if (sub_class == WED_Helipad::sClass)
@@ -1960,14 +1990,14 @@ bool		WED_PreviewLayer::DrawEntityVisualization		(bool inCurrent, IGISEntity * e
 			if(PixelSize(taxi, 0.4, GetZoomer()) > mOptions.minLineThicknessPixels)        // there can be so many, make visibility decision here already for performance
 			{
 				IGISPointSequence * ps = taxi->GetOuterRing();
-				mPreviewItems.push_back(new preview_airportlines(ps, group_Markings, GetResolver()));
+				mPreviewItems.push_back(new preview_airportlines(ps, group_Markings, GetResolver(), mLineBatch));
 				mPreviewItems.push_back(new preview_airportlights(ps, group_Objects, GetResolver()));
 
 				int n = taxi->GetNumHoles();
 				for (int i = 0; i < n; ++i)
 				{
 					IGISPointSequence * ps = taxi->GetNthHole(i);
-					mPreviewItems.push_back(new preview_airportlines(ps, group_Markings, GetResolver()));
+					mPreviewItems.push_back(new preview_airportlines(ps, group_Markings, GetResolver(), mLineBatch));
 					mPreviewItems.push_back(new preview_airportlights(ps, group_Objects, GetResolver()));
 				}
 			}
@@ -2050,7 +2080,7 @@ bool		WED_PreviewLayer::DrawEntityVisualization		(bool inCurrent, IGISEntity * e
 			}
 			// criteria matches where mRealLines disappear in StructureLayer
 			if(PixelSize(line, lwidth, GetZoomer()) > mOptions.minLineThicknessPixels)
-				mPreviewItems.push_back(new preview_line(line, lg, GetResolver()));
+				mPreviewItems.push_back(new preview_line(line, lg, GetResolver(), mLineBatch));
 		}
 	}
 	else if(sub_class == WED_AirportChain::sClass)
@@ -2059,7 +2089,7 @@ bool		WED_PreviewLayer::DrawEntityVisualization		(bool inCurrent, IGISEntity * e
 			// criteria matches where mRealLines disappear in StructureLayer
 			if(PixelSize(chn, 0.4, GetZoomer()) > mOptions.minLineThicknessPixels)
 			{
-				mPreviewItems.push_back(new preview_airportlines(chn, group_Markings, GetResolver()));
+				mPreviewItems.push_back(new preview_airportlines(chn, group_Markings, GetResolver(), mLineBatch));
 				mPreviewItems.push_back(new preview_airportlights(chn, group_Objects, GetResolver()));
 			}
 	}
@@ -2129,14 +2159,58 @@ bool		WED_PreviewLayer::DrawEntityVisualization		(bool inCurrent, IGISEntity * e
 void		WED_PreviewLayer::DrawVisualization			(bool inCurent, GUI_GraphState * g)
 {
 	// This is called after per-entity visualization; we have one preview item for everything we need.
-	// sort, draw, nuke 'em.
+	// sort, draw, nuke 'em.  Lines, markings and runway icons go into mLineBatch.
+
+	WED_GetResourceMgr(GetResolver())->ReleaseRetired();		// OBJs evicted since the last draw - we have the GL context now
 
-	sort(mPreviewItems.begin(),mPreviewItems.end(),sort_item_by_layer());
-	for(vector<WED_PreviewItem *>::iterator i = mPreviewItems.begin(); i != mPreviewItems.end(); ++i)
+	// Stable, so items of the same layer keep the order we got them in and the batch can slot in between them: the quads of
+	// item n go out right before the first item after n that draws anything itself.  Lines in a row share that slot, so
+	// their quads still go out as one draw per layer and texture.
+	stable_sort(mPreviewItems.begin(),mPreviewItems.end(),sort_item_by_layer());
+	int n_items = mPreviewItems.size();
+	vector<int> slots(n_items);
+	for(int i = n_items - 1, next = n_items; i >= 0; --i)
 	{
-		(*i)->draw_it(GetZoomer(), g, mPavementAlpha);
-		delete *i;
+		slots[i] = next;
+		if(!mPreviewItems[i]->batch_only())
+			next = i;
+	}
+
+	// The batch quads are in pixels, so they are good as long as the archive and the view are unchanged, the same items
+	// put quads into the same slots and all their textures are still loaded.  Only then the batch of the last frame gets drawn again.
+	long long key_a = WED_GetWorld(GetResolver())->GetArchive()->CacheKey();
+	long long key_z = GetZoomer()->CacheKey();
+	size_t key_i = 0;
+	for(int i = 0; i < n_items; ++i)
+		if(const void * k = mPreviewItems[i]->batch_key())
+			key_i = (key_i * 31 + std::hash<const void *>()(k) + mPreviewItems[i]->get_layer()) * 31 + slots[i];
+
+	if(key_a != mLineKeyArchive || key_z != mLineKeyZoomer || key_i != mLineKeyItems || !mLineBatch->reusable(WED_GetTexMgr(GetResolver())))
+	{
+		mLineBatch->clear();
+		for(int i = 0; i < n_items; ++i)
+			if(mPreviewItems[i]->batch_key())
+			{
+				mLineBatch->set_slot(slots[i]);
+				mPreviewItems[i]->batch_it(GetZoomer());
+			}
+		mLineBatch->finish();
+		mLineKeyArchive = key_a;
+		mLineKeyZoomer = key_z;
+		mLineKeyItems = key_i;
+	}
+	mLineBatch->rewind();
+
+	for(int i = 0; i < n_items; ++i)
+	{
+		if(!mPreviewItems[i]->batch_only())
+		{
+			mLineBatch->draw(g, i + 1);
+			mPreviewItems[i]->draw_it(GetZoomer(), g, mPavementAlpha);
+		}
+		delete mPreviewItems[i];
 	}
+	mLineBatch->draw(g);
 	mPreviewItems.clear();
 	mRunwayLayer=	group_RunwaysBegin;
 	mTaxiLayer=		group_TaxiwaysBegin;
@@ -29,6 +29,7 @@
 struct	XObj8;
 struct	agp_t;
 class	ITexMgr;
+class	WED_QuadBatch;
 
 // We need int values for layer groups - these weird numbers actually came out of X-Plane's internal engine...who knew.
 // The important thing is that the spacing is enough to ensure separation even when we have lots of runways or taxiways.
@@ -70,7 +71,12 @@ struct	WED_PreviewItem {
 	WED_PreviewItem(int l) : layer(l) { }
 	virtual ~WED_PreviewItem() { }
 	virtual	int	 get_layer(void) { return layer; }
-	virtual void draw_it(WED_MapZoomerNew * zoomer, GUI_GraphState * g, float pavement_alpha)=0;
+	virtual void draw_it(WED_MapZoomerNew * zoomer, GUI_GraphState * g, float pavement_alpha) { }
+	// Items that put quads into the batch return their entity here, and fill it in batch_it.  Their quads go out after the item's
+	// draw_it and before the next item that has anything left to draw itself.
+	virtual	const void * batch_key(void) { return nullptr; }
+	virtual	void batch_it(WED_MapZoomerNew * zoomer) { }
+	virtual	bool batch_only(void) { return false; }				// draw_it has nothing to draw
 };
 
 
@@ -103,6 +109,10 @@ private:
 	int							mRunwayLayer;		// Keep adding 1 to layer as we find runways, etc.  This means the runway's layer order
 	int							mTaxiLayer;			// IS the hierarchy/export order, which is good.
 	int							mShoulderLayer;
+	WED_QuadBatch *				mLineBatch;			// line, marking and runway icon quads, kept until the archive, view or the items drawn change
+	long long					mLineKeyArchive;
+	long long					mLineKeyZoomer;
+	size_t						mLineKeyItems;
 	Options						mOptions;
 
 };
@@ -61,6 +61,10 @@
 							// Since zoom goes by 1.2x steps - it matters little w.r.t "sharpness"
 							// but saves on average 34% of all tile loads
 
+#define MAX_TILE_DOWNLOADS 6 // concurrent downloads. OSM's tile usage policy asks for no more than 2
+#define MAX_TILE_DECODES  16  // tiles waiting for or being decoded by the workers
+#define TILE_CACHE_MB     64  // texture memory before least recently used tiles get evicted
+
 #define PREDEFINED_MAPS 2
 
 static const char * attributions[PREDEFINED_MAPS] = {
@@ -175,21 +179,37 @@ static void get_tile_range_for_box(const double bounds[4], int z, int tiles[4])
 
 WED_SlippyMap::WED_SlippyMap(GUI_Pane * h, WED_MapZoomerNew * zoomer, IResolver * resolver)
 	: WED_MapLayer(h, zoomer, resolver),
-	m_cache_request(NULL),
+	m_bytes(0),
+	m_frame(0),
+	m_quit(false),
 	mMapMode(0)
 {
 }
 
 WED_SlippyMap::~WED_SlippyMap()
 {
-	delete m_cache_request;
-	m_cache_request = NULL;
+	{
+		lock_guard<mutex> lock(m_job_lock);
+		m_quit = true;
+		m_jobs.clear();
+	}
+	m_job_cond.notify_all();
+	for(auto& t : m_workers)
+		t.join();
+	for(auto& j : m_done)
+		if(j.result)
+		{
+			DestroyBitmap(j.result);
+			delete j.result;
+		}
+	// No draw will come anymore - the textures go away with the GL context.
 }
 
 void	WED_SlippyMap::DrawVisualization(bool inCurrent, GUI_GraphState * g)
 {
 	if (mMapMode ==0) return;
-	finish_loading_tile();
+	++m_frame;
+	collect_decoded();
 
 	double map_bounds[4];
 
@@ -205,6 +225,11 @@ void	WED_SlippyMap::DrawVisualization(bool inCurrent, GUI_GraphState * g)
 	int min_zoom = flt_abs(map_bounds[1]) > 60.0 ? MIN_ZOOM-1 : MIN_ZOOM; // get those ant/artic designers a bit more visibility
 	if(z_max < min_zoom) return;
 
+	double pixel_bounds[4];
+	zoomer->GetPixelBounds(pixel_bounds[0], pixel_bounds[1], pixel_bounds[2], pixel_bounds[3]);
+	Point2 view_center((pixel_bounds[0] + pixel_bounds[2]) * 0.5, (pixel_bounds[1] + pixel_bounds[3]) * 0.5);
+	vector<pair<double, WED_file_cache_request> > missing;   // tiles we don't have yet, by squared pixel distance to the view center
+
 	int want = 0, got = 0, bad = 0;
 	for(int z = max(min_zoom,z_max-1); z <= z_max; ++z)      // Display only the next lower zoom level
 	{                                                        // avoids having to load up to 4x14 extra tiles at ZL16
@@ -263,13 +288,17 @@ void	WED_SlippyMap::DrawVisualization(bool inCurrent, GUI_GraphState * g)
 			//The potential place the tile could appear on disk, were it to be downloaded or have been downloaded
 			string potential_path = gFileCache.url_to_cache_path(WED_file_cache_request(cache_domain_osm_tile, folder_prefix , url));
 
-			if (m_cache.count(potential_path))
+			map<string,tile_t>::iterator t = m_cache.find(potential_path);
+			if (t != m_cache.end())
 			{
 				++got;
 
-				int id = m_cache[potential_path];
+				int id = t->second.tex_id;
 				if(id != 0)
 				{
+					t->second.last_frame = m_frame;
+					m_lru.splice(m_lru.begin(), m_lru, t->second.lru);
+
 					g->SetState(0, 1, 0, 0, 0, 0, 0);
 					glColor4f(1,1,1,1);
 					g->BindTex(id, 0);
@@ -291,14 +320,46 @@ void	WED_SlippyMap::DrawVisualization(bool inCurrent, GUI_GraphState * g)
 					++bad;
 				}
 			}
-			else if(m_cache_request == NULL)
+			else if (m_decoding.count(potential_path) == 0)
 			{
-				m_cache_request = new WED_file_cache_request(cache_domain_osm_tile, folder_prefix, url);
+				Point2 tile_center((pbounds[0].x() + pbounds[3].x()) * 0.5, (pbounds[0].y() + pbounds[3].y()) * 0.5);
+				missing.push_back(make_pair(Vector2(view_center, tile_center).squared_length(),
+										WED_file_cache_request(cache_domain_osm_tile, folder_prefix, url)));
 			}
 		}
 	}
 
-	if (m_cache_request)
+	// Keep a few downloads going for the tiles closest to the center. The file cache keeps downloads that are started,
+	// so a tile that drops out of this list because the view moved on is simply picked up again once it comes back.
+	stable_sort(missing.begin(), missing.end(),
+		[](const pair<double, WED_file_cache_request>& a, const pair<double, WED_file_cache_request>& b) { return a.first < b.first; });
+
+	int max_downloads = mMapMode == 1 ? 2 : MAX_TILE_DOWNLOADS;
+	int downloads = 0, cooling = 0;
+	for(auto& m : missing)
+	{
+		if (downloads >= max_downloads || m_decoding.size() >= MAX_TILE_DECODES)
+			break;
+		WED_file_cache_response res = gFileCache.request_file(m.second);
+		if (res.out_status == cache_status_available)
+			queue_decode(res.out_path);
+		else if (res.out_status == cache_status_downloading)
+			++downloads;
+		else if (res.out_status == cache_status_cooling)
+			++cooling;
+		else
+		{
+			string path = gFileCache.url_to_cache_path(m.second);
+			LOG_MSG("E/Sli cache error %s: %d\n%s\n", path.c_str(), res.out_error_type, res.out_error_human.c_str());
+			tile_t& bad_tile = m_cache[path];
+			bad_tile.tex_id = 0;
+			bad_tile.bytes = 0;
+			bad_tile.last_frame = m_frame;
+			bad_tile.lru = m_lru.end();
+		}
+	}
+
+	if (downloads || cooling || !m_decoding.empty())
 	{
 		this->Start(0.05);
 	}
@@ -306,9 +367,10 @@ void	WED_SlippyMap::DrawVisualization(bool inCurrent, GUI_GraphState * g)
 	{
 		this->Stop();
 	}
+	trim_cache();
 
-	char str[30];
-	snprintf(str, sizeof(str), "%d/%d Tiles %d errs" , got, want, bad);
+	char str[60];
+	snprintf(str, sizeof(str), "%d/%d Tiles %d errs %d loading" , got, want, bad, (int) (downloads + m_decoding.size()));
 
 	int bnds[4];
 	GetHost()->GetBounds(bnds);
@@ -368,69 +430,138 @@ static bool is_ESRI_blank(const string& path, const ImageInfo& info)
 	return same_grey;
 }
 
-void	WED_SlippyMap::finish_loading_tile()
+// Runs on the worker threads: read the tile and apply our color changes. Returns null for bad or blank tiles.
+static ImageInfo * decode_tile(const string& path, int mode, bool& is_blank)
 {
-	if (m_cache_request != NULL)
+	is_blank = false;
+	ImageInfo * info = new ImageInfo;
+	int r = CreateBitmapFromPNG(path.c_str(), info, false, 0);
+	if(r != 0)
+		r = CreateBitmapFromJPEG(path.c_str(), info);
+	if (r != 0)
 	{
-		WED_file_cache_response res = gFileCache.request_file(*m_cache_request);
-		if (res.out_status == cache_status_available)
+		delete info;
+		return nullptr;
+	}
+
+	if (info->channels == 3)                                                        // apply to color changes
+		for (int x = 0; x < info->height * (info->width + info->pad) * info->channels; x += info->channels)
 		{
-			struct ImageInfo info;
-			int r = CreateBitmapFromPNG(res.out_path.c_str(), &info, false, 0);
-			if(r != 0)
-				r = CreateBitmapFromJPEG(res.out_path.c_str(), &info);
-			if (r == 0)
-			{
-				if (info.channels == 3)                                                        // apply to color changes
-					for (int x = 0; x < info.height * (info.width + info.pad) * info.channels; x += info.channels)
-					{
-						double BRIGHTNESS = -20;
-						double SATURATION = 1.0;
-						if (mMapMode == 1) { BRIGHTNESS = -140.0; SATURATION = 0.4; }
+			double BRIGHTNESS = -20;
+			double SATURATION = 1.0;
+			if (mode == 1) { BRIGHTNESS = -140.0; SATURATION = 0.4; }
 
-						int val = 0.3 * info.data[x] + 0.6 * info.data[x + 1] + 0.1 * info.data[x + 2];  // deliberately not HSV weighing - want red's brighter
-						for (int c = 0; c < info.channels; ++c)
-							info.data[x + c] = intlim((1.0 - SATURATION) * val + SATURATION * info.data[x + c] + BRIGHTNESS, 0, 255);
-					}
-				if (is_ESRI_blank(res.out_path, info))
-				{
-					m_cache[res.out_path] = 0;
-				}
-				else
-				{
-					GLuint tex_id;
-					glGenTextures(1, &tex_id);
-					if (LoadTextureFromImage(info, tex_id, tex_Linear, NULL, NULL, NULL, NULL))
-					{
-						m_cache[res.out_path] = tex_id;
-					}
-					else
-					{
-						LOG_MSG("E/Sli bad png or JPG in %s\n", res.out_path.c_str());
-						m_cache[res.out_path] = 0;
-					}
-				}
+			int val = 0.3 * info->data[x] + 0.6 * info->data[x + 1] + 0.1 * info->data[x + 2];  // deliberately not HSV weighing - want red's brighter
+			for (int c = 0; c < info->channels; ++c)
+				info->data[x + c] = intlim((1.0 - SATURATION) * val + SATURATION * info->data[x + c] + BRIGHTNESS, 0, 255);
+		}
+
+	if (is_ESRI_blank(path, *info))
+	{
+		is_blank = true;
+		DestroyBitmap(info);
+		delete info;
+		return nullptr;
+	}
+	return info;
+}
+
+void	WED_SlippyMap::queue_decode(const string& path)
+{
+	if(m_workers.empty())                   // most of the time the map is off - so only start them once there is a tile
+	{
+		int num_workers = intlim((int) thread::hardware_concurrency() - 1, 1, 3);
+		for(int n = 0; n < num_workers; ++n)
+			m_workers.push_back(thread(&WED_SlippyMap::worker_thread, this));
+	}
+	m_decoding.insert(path);
+
+	tile_job_t job;
+	job.path = path;
+	job.mode = mMapMode;
+	job.result = nullptr;
+	job.is_blank = false;
+	{
+		lock_guard<mutex> lock(m_job_lock);
+		m_jobs.push_back(job);
+	}
+	m_job_cond.notify_one();
+}
+
+// Upload whatever the workers finished, needs the GL context.
+void	WED_SlippyMap::collect_decoded()
+{
+	vector<tile_job_t> done;
+	{
+		lock_guard<mutex> lock(m_job_lock);
+		if (m_done.empty()) return;
+		done.swap(m_done);
+	}
+	for (auto& j : done)
+	{
+		m_decoding.erase(j.path);
+		tile_t& t = m_cache[j.path];
+		t.tex_id = 0;
+		t.bytes = 0;
+		t.last_frame = m_frame;
+		t.lru = m_lru.end();
+
+		if (j.result)
+		{
+			GLuint tex_id;
+			glGenTextures(1, &tex_id);
+			if (LoadTextureFromImage(*j.result, tex_id, tex_Linear, NULL, NULL, NULL, NULL))
+			{
+				t.tex_id = tex_id;
+				t.bytes = j.result->width * j.result->height * 4;
+				t.lru = m_lru.insert(m_lru.begin(), j.path);
+				m_bytes += t.bytes;
 			}
 			else
 			{
-				LOG_MSG("E/Sli bad png or JPG in %s\n", res.out_path.c_str());
-				m_cache[res.out_path] = 0;
+				glDeleteTextures(1, &tex_id);
+				LOG_MSG("E/Sli bad png or JPG in %s\n", j.path.c_str());
 			}
-			DestroyBitmap(&info);
-			delete m_cache_request;
-			m_cache_request = NULL;
+			DestroyBitmap(j.result);
+			delete j.result;
 		}
-		else if (res.out_status == cache_status_error)
-		{
-			int code = res.out_error_type;
+		else if (!j.is_blank)
+			LOG_MSG("E/Sli bad png or JPG in %s\n", j.path.c_str());
+	}
+}
 
-			LOG_MSG("E/Sli cache error %s: %d\n%s\n", res.out_path.c_str(), code, res.out_error_human.c_str());
+// Evict from the cold end of the LRU, sparing everything drawn this frame. Needs the GL context.
+void	WED_SlippyMap::trim_cache()
+{
+	while (m_bytes > TILE_CACHE_MB * 1024 * 1024 && !m_lru.empty())
+	{
+		map<string,tile_t>::iterator t = m_cache.find(m_lru.back());
+		if (t->second.last_frame == m_frame)
+			break;
+		GLuint id = t->second.tex_id;
+		glDeleteTextures(1, &id);
+		m_bytes -= t->second.bytes;
+		m_cache.erase(t);
+		m_lru.pop_back();
+	}
+}
 
-			m_cache[res.out_path] = 0;
+void	WED_SlippyMap::worker_thread()
+{
+	unique_lock<mutex> lock(m_job_lock);
+	while (1)
+	{
+		m_job_cond.wait(lock, [this]{ return m_quit || !m_jobs.empty(); });
+		if (m_quit) return;
 
-			delete m_cache_request;
-			m_cache_request = NULL;
-		}
+		tile_job_t job = m_jobs.front();
+		m_jobs.pop_front();
+		lock.unlock();
+
+		job.result = decode_tile(job.path, job.mode, job.is_blank);
+
+		lock.lock();
+		m_done.push_back(job);
 	}
 }
 
@@ -490,3 +621,207 @@ int		WED_SlippyMap::GetMode(void)
 {
 	return mMapMode;
 }
+
+#if UNIT_TEST
+// Headless test of the tile pipeline. Link it without GL, the GUI, the bitmap loaders and the file cache - the stand-ins below
+// replace them: every tile is "downloaded" on its second request, decodes to a 256x256 RGB image and gets a fake GL name.
+// Checks that no decoder threads exist while the map is off, that the workers do all the decoding once it is on, that the
+// texture budget holds while panning, that evicted tiles are decoded again and that nothing drawn in a frame gets evicted - even
+// when the view needs more than the budget.
+#include "PerfUtils.h"
+#include <dirent.h>
+#include <chrono>
+#include <atomic>
+
+#define TEST_TILE_BYTES	(256 * 256 * 4)
+
+static set<GLuint>		sLiveTex;
+static GLuint			sNextTex = 1;
+static set<GLuint>		sBound;                  // textures drawn this frame
+static bool				sTimerOn = false;
+static thread::id		sMainThread;
+static atomic<int>		sWorkerDecodes(0), sMainDecodes(0);
+static set<string>		sRequested;
+
+void glGenTextures(GLsizei n, GLuint * t)				{ while (n--) sLiveTex.insert(*t++ = sNextTex++); }
+void glDeleteTextures(GLsizei n, const GLuint * t)		{ while (n--) sLiveTex.erase(*t++); }
+void glBegin(GLenum mode)								{ }
+void glEnd(void)										{ }
+void glColor4f(GLfloat r, GLfloat g, GLfloat b, GLfloat a)	{ }
+void glTexCoord2f(GLfloat s, GLfloat t)					{ }
+void glVertex2d(GLdouble x, GLdouble y)					{ }
+void glVertex2f(GLfloat x, GLfloat y)					{ }
+
+int CreateBitmapFromPNG(const char * inFilePath, struct ImageInfo * outImageInfo, bool leaveIndexed, float target_gamma)
+{
+	if (this_thread::get_id() == sMainThread) ++sMainDecodes; else ++sWorkerDecodes;
+	outImageInfo->width = outImageInfo->height = 256;
+	outImageInfo->pad = 0;
+	outImageInfo->channels = 3;
+	outImageInfo->data = new unsigned char[256 * 256 * 3];
+	memset(outImageInfo->data, 128, 256 * 256 * 3);
+	return 0;
+}
+int CreateBitmapFromJPEG(const char * inFilePath, struct ImageInfo * outImageInfo)	{ return 1; }
+void DestroyBitmap(const struct ImageInfo * inImageInfo)	{ delete [] inImageInfo->data; }
+
+bool LoadTextureFromImage(ImageInfo& inInfo, int inTexNum, int inFlags, int * outWidth, int * outHeight, float * outS, float * outT)
+{
+	return sLiveTex.count(inTexNum) != 0;
+}
+
+void GUI_GraphState::EnableLighting(bool lighting)		{ }
+void GUI_GraphState::SetTexUnits(int count)				{ }
+void GUI_GraphState::EnableFog(bool fog)				{ }
+void GUI_GraphState::EnableAlpha(bool test, bool blend)	{ }
+void GUI_GraphState::EnableDepth(bool read, bool write)	{ }
+void GUI_GraphState::BindTex(int id, int unit)			{ sBound.insert(id); }
+void GUI_FontDraw(GUI_GraphState * inState, int inFontID, const float color[4], float inX, float inY, const char * inString, int inAlign) { }
+float GUI_MeasureRange(int inFontID, const char * inStart, const char * inEnd) { return 100.0; }
+
+// The host is never dereferenced: GetBounds is the stand-in below and the timer never fires.
+void GUI_Pane::GetBounds(int outBounds[4])				{ outBounds[0] = outBounds[1] = 0; outBounds[2] = 1600; outBounds[3] = 1000; }
+
+GUI_Timer::GUI_Timer(void) { }
+GUI_Timer::~GUI_Timer(void) { }
+void GUI_Timer::Start(float seconds) { sTimerOn = true; }
+void GUI_Timer::Stop(void) { sTimerOn = false; }
+
+WED_MapLayer::WED_MapLayer(GUI_Pane * h, WED_MapZoomerNew * z, IResolver * i) : mZoomer(z), mResolver(i), mHost(h), mVisible(false) { }
+WED_MapLayer::~WED_MapLayer() { }
+void WED_MapLayer::SetVisible(bool visibility)			{ mVisible = visibility; }
+void WED_MapLayer::ToggleVisible(void)					{ mVisible = !mVisible; }
+
+FILE * gLogFile = stdout;
+string gCustomSlippyMap;
+WED_FileCache gFileCache;
+WED_FileCache::~WED_FileCache(void) { }
+WED_file_cache_request::WED_file_cache_request(CACHE_domain domain, const string& folder_prefix, const string& url)
+	: in_domain(domain), in_folder_prefix(folder_prefix), in_url(url) { }
+WED_file_cache_response::WED_file_cache_response(float download_progress, string error_human, CACHE_error_type error_type, string path, CACHE_status status)
+	: out_download_progress(download_progress), out_error_human(error_human), out_error_type(error_type), out_path(path), out_status(status) { }
+
+string WED_FileCache::url_to_cache_path(const WED_file_cache_request& req)
+{
+	return "/cache/" + req.in_folder_prefix + "/" + req.in_url;
+}
+
+WED_file_cache_response WED_FileCache::request_file(const WED_file_cache_request& req)
+{
+	string path = url_to_cache_path(req);
+	if (sRequested.insert(path).second)
+		return WED_file_cache_response(0.0, "", cache_error_type_none, "", cache_status_downloading);
+	return WED_file_cache_response(100.0, "", cache_error_type_none, path, cache_status_available);
+}
+
+struct test_zoomer_t : public WED_MapZoomerNew {     // what WED_Map does for its layers
+	using WED_MapZoomerNew::SetPixelBounds;
+};
+
+static int thread_count()
+{
+	int n = 0;
+	if (DIR * d = opendir("/proc/self/task"))
+	{
+		while (struct dirent * e = readdir(d))
+			if (e->d_name[0] != '.') ++n;
+		closedir(d);
+	}
+	return n;
+}
+
+//	usage: <number of views to pan across>
+int main(int argc, const char * argv[])
+{
+	int views = argc > 1 ? atoi(argv[1]) : 12;
+	sMainThread = this_thread::get_id();
+
+	test_zoomer_t zoomer;
+	zoomer.SetPixelBounds(0, 0, 1600, 1000);
+	zoomer.SetMapLogicalBounds(-180, -85, 180, 85);
+	GUI_GraphState g;
+
+	auto show = [&](int v) { zoomer.ZoomShowArea(-71.10 + v * 0.04, 42.35, -71.068 + v * 0.04, 42.365); };
+
+	int threads = thread_count();
+	WED_SlippyMap * map = new WED_SlippyMap(nullptr, &zoomer, nullptr);
+	show(0);
+	map->DrawVisualization(true, &g);
+	if (thread_count() != threads || sWorkerDecodes + sMainDecodes)
+	{
+		printf("Map off: %d threads running, %d were before, %d tiles decoded.\n", thread_count(), threads, (int) (sWorkerDecodes + sMainDecodes));
+		return 1;
+	}
+
+	map->SetMode(1);
+
+	// Draw until all tiles of the view are up and the timer is off, like the app does on each timer tick - at most a few seconds.
+	auto draw = [&](int v) {
+		if (v >= 0) show(v);
+		for (int tries = 0; tries < 5000; ++tries)
+		{
+			sBound.clear();
+			map->DrawVisualization(true, &g);
+			for (auto id : sBound)
+				if (sLiveTex.count(id) == 0)
+				{
+					printf("View %d: texture %d was drawn and evicted in the same frame.\n", v, id);
+					return -1;
+				}
+			if (!sTimerOn) return (int) sBound.size();
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		printf("View %d: tiles never got resident.\n", v);
+		return -1;
+	};
+
+	unsigned long long t0 = query_hpc();
+	int first = draw(0);
+	if (first <= 0 || thread_count() <= threads)
+	{
+		printf("Map on: %d tiles drawn, %d threads running.\n", first, thread_count());
+		return 1;
+	}
+	for (int v = 1; v < views; ++v)
+	{
+		int drawn = draw(v);
+		if (drawn <= 0) return 1;
+		if (sLiveTex.size() * TEST_TILE_BYTES > TILE_CACHE_MB * 1024 * 1024 + drawn * TEST_TILE_BYTES)
+		{
+			printf("View %d: %d textures resident with a budget of %d.\n", v, (int) sLiveTex.size(), TILE_CACHE_MB * 1024 * 1024 / TEST_TILE_BYTES);
+			return 1;
+		}
+	}
+	double secs = hpc_to_microseconds(query_hpc() - t0) / 1000000.0;
+
+	int decodes = sWorkerDecodes;
+	int drawn = draw(0);
+	int again = sWorkerDecodes - decodes;
+	if (drawn != first || again == 0 || sMainDecodes)
+	{
+		printf("Back to the first view: %d tiles drawn, %d decoded again, %d on the main thread.\n", drawn, again, (int) sMainDecodes);
+		return 1;
+	}
+
+	// A view with more tiles than the budget holds - all of them stay, nothing gets evicted while it is drawn.
+	zoomer.SetPixelBounds(0, 0, 6400, 4000);
+	zoomer.ZoomShowArea(-71.10, 42.35, -70.972, 42.41);
+	int big = draw(-1);
+	if (big * TEST_TILE_BYTES <= TILE_CACHE_MB * 1024 * 1024 || sLiveTex.size() < big)
+	{
+		printf("Big view: %d tiles drawn, %d resident.\n", big, (int) sLiveTex.size());
+		return 1;
+	}
+
+	int live = sLiveTex.size();
+	delete map;
+	if (sLiveTex.size() != live || thread_count() != threads)		// no GL without a context, the textures go with it
+	{
+		printf("After deleting the map: %d of %d textures, %d threads left.\n", (int) sLiveTex.size(), live, thread_count());
+		return 1;
+	}
+	printf("%d views of %d tiles: %d decoded by the workers in %.2lf s, %d decoded again, %d resident after a view of %d.\n", views, first,
+		decodes, secs, again, live, big);
+	return 0;
+}
+#endif
@@ -25,10 +25,21 @@
 #ifndef WED_SlippyMap_h
 #define WED_SlippyMap_h
 
-class	WED_file_cache_request;
+struct	ImageInfo;
 
 #include "GUI_Timer.h"
 #include "WED_MapLayer.h"
+#include <list>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+/*
+	WED_SlippyMap - tiles are fetched through the file cache, several at a time and nearest to the view center first.
+	Downloaded tiles are decoded (and color adjusted) by a few worker threads, started with the first tile, the GL upload
+	happens on the drawing thread. Textures are kept in LRU order and evicted once they exceed the tile budget - but never while visible.
+*/
 
 enum yCoord_t { yNone, yNormal, yYahoo, yOSGeo };
 
@@ -46,13 +57,39 @@ public:
 
 private:
 
-			void	finish_loading_tile();
+	struct	tile_t {
+		int		tex_id;             // 0 for tiles that failed or are blank
+		size_t	bytes;
+		int		last_frame;
+		list<string>::iterator	lru;
+	};
+
+	struct	tile_job_t {
+		string		path;
+		int			mode;
+		ImageInfo *	result;         // null if the tile could not be decoded or is blank
+		bool		is_blank;
+	};
+
+			void	collect_decoded();
+			void	queue_decode(const string& path);
+			void	trim_cache();
+			void	worker_thread();
 			int 	get_zl_for_map(double in_ppm, double lattitude);
 
-	WED_file_cache_request* m_cache_request;
+	//The texture cache, where they key is the tile texture path on disk
+	map<string,tile_t>	m_cache;
+	list<string>		m_lru;          // resident textures, front is most recently used
+	size_t				m_bytes;
+	int					m_frame;
+	set<string>			m_decoding;     // main thread only
 
-	//The texture cache, where they key is the tile texture path on disk and the value is the texture id
-	map<string,int>	m_cache;
+	vector<thread>		m_workers;
+	mutex				m_job_lock;
+	condition_variable	m_job_cond;
+	deque<tile_job_t>	m_jobs;
+	vector<tile_job_t>	m_done;
+	bool				m_quit;
 
 			int		mMapMode;
 			string	url_printf_fmt;
@@ -592,7 +592,7 @@ bool		WED_StructureLayer::DrawEntityStructure		(bool inCurrent, IGISEntity * ent
 
 					glColor4fv(WED_Color_RGBA_Alpha(struct_color, HILIGHT_ALPHA, storage));
 					glFrontFace(GL_CCW);
-					glPolygon2(pts, false, hole_starts, false);
+					glPolygon2Cached(poly, pts, false, hole_starts, false);
 					glFrontFace(GL_CW);
 				}
 			}
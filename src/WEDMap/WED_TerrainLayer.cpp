@@ -21,6 +21,9 @@
  *
  */
 
+#if !APL
+	#include "glew.h"
+#endif
 #include "WED_TerrainLayer.h"
 #include "GUI_Pane.h"
 #include "GUI_Fonts.h"
@@ -36,22 +39,35 @@
 #include "PlatformUtils.h"
 #include "GISUtils.h"
 #include "XESConstants.h"
+#include "MathUtils.h"
+#include "PerfUtils.h"
 
 #if APL
 	#include <OpenGL/gl.h>
 #else
 	#include <GL/gl.h>
 #endif
+#include <unordered_set>
 
 
 WED_TerrainLayer::WED_TerrainLayer(GUI_Pane * host, WED_MapZoomerNew * zoomer, IResolver * resolver) :
-	WED_MapLayer(host,zoomer,resolver)
+	WED_MapLayer(host,zoomer,resolver),
+	mQuit(false)
 {
     SetVisible(false);
 }
 
 WED_TerrainLayer::~WED_TerrainLayer()
 {
+	{
+		lock_guard<mutex> lock(mJobLock);
+		mQuit = true;
+		mJobs.clear();
+	}
+	mJobCond.notify_all();
+	if (mWorker.joinable())
+		mWorker.join();
+	// No draw will come anymore - the buffers go away with the GL context.
 }
 
 static bool NextPass(int finished_pass_index, void* inRef) { return true; }
@@ -184,6 +200,212 @@ static int AcceptRasterDef(const char* inPath, void* inRef)
 	return 1;
 }
 
+#define LOD_LEVELS        6
+#define LOD_FINEST_CELL   (1.0 / 2048.0)  // ~50m, about as close as mesh vertices get away from coastlines
+#define LOD_MAX_ERROR_PIX 4.0             // mesh lines closer than this can't be told apart anyways
+
+struct lod_edge_t {
+	int block;
+	int color;
+	int v1, v2;
+	bool operator<(const lod_edge_t& rhs) const { return block == rhs.block ? color < rhs.color : block < rhs.block; }
+};
+
+static int BlockOf(const terrain_t& tile, const Point2& p)
+{
+	int bx = intlim((p.x() - tile.bounds.xmin()) / tile.bounds.xspan() * TERRAIN_BLOCKS, 0, TERRAIN_BLOCKS - 1);
+	int by = intlim((p.y() - tile.bounds.ymin()) / tile.bounds.yspan() * TERRAIN_BLOCKS, 0, TERRAIN_BLOCKS - 1);
+	return bx + by * TERRAIN_BLOCKS;
+}
+
+static Point2 BlockOrigin(const terrain_t& tile, int block)
+{
+	return Point2(tile.bounds.xmin() + tile.bounds.xspan() * (block % TERRAIN_BLOCKS) / TERRAIN_BLOCKS,
+	              tile.bounds.ymin() + tile.bounds.yspan() * (block / TERRAIN_BLOCKS) / TERRAIN_BLOCKS);
+}
+
+// Vertex clustering: the first vertex found in each grid cell stands in for all others in that cell, edges whose ends land in the
+// same cell disappear. The edges that are left are kept, so the wireframe stays connected. As the cells of each level are made of
+// four cells of the previous one, each level can be collapsed from the edges of the previous level instead of from the whole mesh.
+static void CollapseEdges(const terrain_t& tile, const vector<Point2>& pts, const vector<lod_edge_t>& in, double cell, vector<lod_edge_t>& out)
+{
+	vector<int> rep(pts.size(), -1);
+	unordered_map<long long, int> cells;
+	cells.reserve(in.size());
+	auto rep_of = [&](int v) {
+		if (rep[v] < 0)
+		{
+			long long key = (long long) floor((pts[v].x() - tile.bounds.xmin()) / cell) << 32 |
+			                (unsigned int) floor((pts[v].y() - tile.bounds.ymin()) / cell);
+			rep[v] = cells.insert(make_pair(key, v)).first->second;
+		}
+		return rep[v];
+	};
+
+	vector<int> order;                      // the vertices in the order they came from the mesh, to pick the same ones on every level
+	for (const auto& e : in)
+		for (int v : { e.v1, e.v2 })
+			if (rep[v] == -1)
+			{
+				rep[v] = -2;
+				order.push_back(v);
+			}
+	sort(order.begin(), order.end());
+	for (int v : order)
+	{
+		rep[v] = -1;
+		rep_of(v);
+	}
+
+	unordered_set<long long> seen;
+	seen.reserve(in.size());
+	out.clear();
+	for (const auto& e : in)
+	{
+		int a = rep[e.v1];
+		int b = rep[e.v2];
+		if (a == b) continue;
+		if (a > b) swap(a, b);
+		if (seen.insert((long long) a << 32 | b).second)
+			out.push_back({ BlockOf(tile, Point2((pts[a].x() + pts[b].x()) * 0.5, (pts[a].y() + pts[b].y()) * 0.5)), e.color, a, b });
+	}
+}
+
+// Puts the edges into runs by block and color, with the vertices relative to their block.
+static void BuildLOD(const terrain_t& tile, const vector<Point2>& pts, vector<lod_edge_t>& edges, double cell, terrain_t::lod_t& lod)
+{
+	stable_sort(edges.begin(), edges.end());
+
+	lod.cell = cell;
+	lod.verts.clear();
+	lod.edges.clear();
+	lod.runs.clear();
+	lod.edges.reserve(edges.size() * 2);
+
+	vector<int> idx(pts.size()), idx_block(pts.size(), -1);     // vertex -> index, valid if its from the current block
+	Point2 origin;
+	for (const auto& e : edges)
+	{
+		if (lod.runs.empty() || lod.runs.back().block != e.block || lod.runs.back().color != e.color)
+		{
+			origin = BlockOrigin(tile, e.block);
+			lod.runs.push_back({ e.block, e.color, (int) lod.edges.size(), 0, Bbox2() });
+		}
+		for (int v : { e.v1, e.v2 })
+		{
+			if (idx_block[v] != e.block)
+			{
+				idx_block[v] = e.block;
+				idx[v] = lod.verts.size() / 2;
+				lod.verts.push_back(pts[v].x() - origin.x());
+				lod.verts.push_back(pts[v].y() - origin.y());
+			}
+			lod.edges.push_back(idx[v]);
+			lod.runs.back().bounds += pts[v];
+		}
+		lod.runs.back().count += 2;
+	}
+}
+
+// Calls f(lower vertex, higher vertex, color) for all edges of all triangles of the mesh, vid being the vertex of each patch vertex.
+template <class F>
+static void ForEachEdge(const terrain_t& tile, const vector<int>& vid, F f)
+{
+	const int * v = vid.data();
+	for (const auto& p : tile.patches)
+	{
+		for (int i = 2; i < p.verts.size(); i++)
+		{
+			int tri[3];
+			switch (p.topology)
+			{
+				case 0:	if (i % 3 != 2) continue;
+						tri[0] = v[i - 2]; tri[1] = v[i - 1]; tri[2] = v[i]; break;
+				case 1: tri[0] = v[i - 2]; tri[1] = v[i - 1]; tri[2] = v[i]; break;   // STRIP
+				case 2: tri[0] = v[0];     tri[1] = v[i - 1]; tri[2] = v[i]; break;   // FAN
+				default: continue;
+			}
+			for (int k = 0; k < 3; k++)
+				if (tri[k] != tri[(k + 1) % 3])
+					f(min(tri[k], tri[(k + 1) % 3]), max(tri[k], tri[(k + 1) % 3]), p.color);
+		}
+		v += p.verts.size();
+	}
+}
+
+static void BuildLODs(terrain_t& tile)
+{
+	// the vertices of all patches, with the ones shared between patches merged
+	vector<Point2> pts;
+	vector<int> vid;
+	unordered_map<long long, int> ids;
+	size_t n = 0;
+	for (const auto& p : tile.patches)
+		n += p.verts.size();
+	vid.reserve(n);
+	ids.reserve(n / 2);
+	for (const auto& p : tile.patches)
+		for (const auto& pv : p.verts)
+		{
+			long long key = llround((pv.LonLat.x() - tile.bounds.xmin()) * 1e8) << 32 | (unsigned int) llround((pv.LonLat.y() - tile.bounds.ymin()) * 1e8);
+			auto i = ids.insert(make_pair(key, (int) pts.size()));
+			if (i.second)
+				pts.push_back(pv.LonLat);
+			vid.push_back(i.first->second);
+		}
+	ids.clear();
+
+	// all edges of the mesh, once. Bucketed by their lower vertex in two passes, much faster than hashing them.
+	vector<int> first(pts.size() + 1, 0);
+	ForEachEdge(tile, vid, [&](int a, int b, int c) { first[a + 1]++; });
+	for (int i = 0; i < pts.size(); i++)
+		first[i + 1] += first[i];
+	vector<int> fill(first.begin(), first.end() - 1);
+	vector<pair<int, int> > ends(first.back());            // other vertex, color
+	ForEachEdge(tile, vid, [&](int a, int b, int c) { ends[fill[a]++] = make_pair(b, c); });
+	fill.clear();
+
+	vector<lod_edge_t> edges;
+	edges.reserve(first.back() / 2);
+	for (int a = 0; a < pts.size(); a++)
+		for (int i = first[a]; i < first[a + 1]; i++)
+		{
+			int b = ends[i].first;
+			int j = first[a];
+			while (ends[j].first != b) j++;
+			if (j == i)
+				edges.push_back({ BlockOf(tile, Point2((pts[a].x() + pts[b].x()) * 0.5, (pts[a].y() + pts[b].y()) * 0.5)), ends[i].second, a, b });
+		}
+	first.clear();
+	ends.clear();
+
+	tile.lods.assign(1, terrain_t::lod_t());
+	BuildLOD(tile, pts, edges, 0.0, tile.lods[0]);
+
+	vector<lod_edge_t> coarse;
+	double cell = LOD_FINEST_CELL;
+	for (int l = 1; l < LOD_LEVELS; l++, cell *= 2.0)
+	{
+		CollapseEdges(tile, pts, edges, cell, coarse);
+		if (coarse.size() < tile.lods.back().edges.size() / 2 * 0.8)      // not worth it otherwise
+		{
+			tile.lods.push_back(terrain_t::lod_t());
+			BuildLOD(tile, pts, coarse, cell, tile.lods.back());
+		}
+		edges.swap(coarse);
+	}
+}
+
+void WED_TerrainLayer::FreeBuffers(terrain_t& t)
+{
+	for (auto& l : t.lods)
+		if (l.vbo[0])
+		{
+			glDeleteBuffers(2, l.vbo);
+			l.vbo[0] = l.vbo[1] = 0;
+		}
+}
+
 void WED_TerrainLayer::LoadTerrain(Bbox2& bounds)
 {
 	// ToDo: move this into PackageMgr, so its updated when XPlaneFolder changes and re-used when another scenery is opened
@@ -202,6 +424,7 @@ void WED_TerrainLayer::LoadTerrain(Bbox2& bounds)
 				far_tile = t.first;
 			}
 		}
+		FreeBuffers(mTerrains[far_tile]);
 		mTerrains.erase(far_tile);
 		//printf("%ld mTerrains, nuked %s\n", mTerrains.size(), far_tile.c_str());
 	}
@@ -209,25 +432,145 @@ void WED_TerrainLayer::LoadTerrain(Bbox2& bounds)
 	set<string> vpaths;
 	add_all_global_DSF(bounds, vpaths);
 
+	for (const auto& v : vpaths)
+	{
+		if (mTerrains.find(v) != mTerrains.end() || !mLoading.insert(v).second) continue;
+		if (!mWorker.joinable())
+			mWorker = thread(&WED_TerrainLayer::WorkerThread, this);
+		{
+			lock_guard<mutex> lock(mJobLock);
+			mJobs.push_back(v);
+		}
+		mJobCond.notify_one();
+	}
+	if (mLoading.empty())
+		Stop();
+	else
+		Start(0.1);
+}
+
+// Hand the tiles the worker finished over to drawing.
+void WED_TerrainLayer::CollectLoaded(void)
+{
+	vector<pair<string, terrain_t> > done;
+	{
+		lock_guard<mutex> lock(mJobLock);
+		if (mDone.empty()) return;
+		done.swap(mDone);
+	}
+	for (auto& d : done)
+	{
+		mLoading.erase(d.first);
+		mTerrains[d.first] = move(d.second);
+	}
+}
+
+// Runs on the worker thread: reading a tile and building its LODs takes a second or more.
+void WED_TerrainLayer::WorkerThread(void)
+{
 	DSFCallbacks_t cb = { NextPass, AcceptTerrainDef, AcceptObjectDef, AcceptPolygonDef, AcceptNetworkDef, AcceptRasterDef, AcceptProperty,
 					BeginPatch, BeginPrimitive, AddPatchVertex, EndPrimitive, EndPatch,
 					AddObjectWithMode, BeginSegment, AddSegmentShapePoint, EndSegment,
 					BeginPolygon, BeginPolygonWinding, AddPolygonPoint,EndPolygonWinding, EndPolygon, AddRasterData, SetFilter_ };
 
-	for (const auto& v : vpaths)
+	unique_lock<mutex> lock(mJobLock);
+	while (1)
 	{
-		if (mTerrains.find(v) != mTerrains.end()) continue;
-		terrain_t& tile = mTerrains[v];
+		mJobCond.wait(lock, [this]{ return mQuit || !mJobs.empty(); });
+		if (mQuit) return;
+
+		string v = mJobs.front();
+		mJobs.pop_front();
+		lock.unlock();
+
+		terrain_t tile = terrain_t();
 		tile.current_color = 0;                      // initially abuse this for keeping track of terrain_def indices
 		if (DSFReadFile(v.c_str(), malloc, free, &cb, NULL, &tile) == dsf_ErrOK)
 		{
 			int lon, lat;
 			if(sscanf(v.substr(v.length() - 11, 7).c_str(), "%d%d", &lat, &lon) == 2)
+			{
 				tile.bounds = { {(double) lon, (double) lat}, {(double) lon + 1, (double) lat + 1} };
+				BuildLODs(tile);
+			}
 		}
+
+		lock.lock();
+		mDone.push_back(make_pair(v, move(tile)));
 	}
 }
 
+void WED_TerrainLayer::TimerFired(void)
+{
+	if (IsVisible())
+		GetHost()->Refresh();
+	else
+		Stop();
+}
+
+void WED_TerrainLayer::DrawMesh(terrain_t& t, const Bbox2& viewport, const float colors[][4])
+{
+	if (t.lods.empty()) return;
+
+	int l = 0;                       // the coarsest level whose error isn't visible at this zoom
+	while (l + 1 < t.lods.size() && t.lods[l + 1].cell * DEG_TO_MTR_LAT * GetZoomer()->GetPPM() < LOD_MAX_ERROR_PIX)
+		l++;
+	auto& lod = t.lods[l];
+
+	if (!lod.vbo[0])
+	{
+		glGenBuffers(2, lod.vbo);                                                                                         CHECK_GL_ERR
+		glBindBuffer(GL_ARRAY_BUFFER, lod.vbo[0]);
+		glBufferData(GL_ARRAY_BUFFER, lod.verts.size() * sizeof(float), lod.verts.data(), GL_STATIC_DRAW);                 CHECK_GL_ERR
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lod.vbo[1]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, lod.edges.size() * sizeof(unsigned int), lod.edges.data(), GL_STATIC_DRAW);  CHECK_GL_ERR
+		vector<float>().swap(lod.verts);                       // only the runs are needed from here on
+		vector<unsigned int>().swap(lod.edges);
+	}
+	else
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, lod.vbo[0]);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lod.vbo[1]);
+	}
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(2, GL_FLOAT, 0, 0);
+
+	// The map projection isn't linear, but across a block it is close enough to its tangent - which goes into the modelview
+	// matrix. Its only drawn in the 2D map, so there is no camera to tell about it.
+	int block = -1;
+	for (const auto& r : lod.runs)
+		if (r.bounds.overlap(viewport))
+		{
+			if (r.block != block)
+			{
+				if (block >= 0) glPopMatrix();
+				block = r.block;
+
+				Point2 o = BlockOrigin(t, block);
+				double h = t.bounds.xspan() / TERRAIN_BLOCKS * 0.5;
+				Point2 c(o.x() + h, o.y() + h);
+				Point2 pc = GetZoomer()->LLToPixel(c);
+				Vector2 dx(GetZoomer()->LLToPixel(Point2(c.x() - h, c.y())), GetZoomer()->LLToPixel(Point2(c.x() + h, c.y())));
+				Vector2 dy(GetZoomer()->LLToPixel(Point2(c.x(), c.y() - h)), GetZoomer()->LLToPixel(Point2(c.x(), c.y() + h)));
+				dx /= 2.0 * h;
+				dy /= 2.0 * h;
+				GLdouble m[16] = { dx.dx, dx.dy, 0.0, 0.0,
+				                   dy.dx, dy.dy, 0.0, 0.0,
+				                   0.0,   0.0,   1.0, 0.0,
+				                   pc.x() - h * (dx.dx + dy.dx), pc.y() - h * (dx.dy + dy.dy), 0.0, 1.0 };
+				glPushMatrix();
+				glMultMatrixd(m);
+			}
+			glColor4fv(colors[r.color]);
+			glDrawElements(GL_LINES, r.count, GL_UNSIGNED_INT, (void *) (r.first * sizeof(unsigned int)));
+		}
+	if (block >= 0) glPopMatrix();
+
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);                                                                                     CHECK_GL_ERR
+}
+
 void		WED_TerrainLayer::DrawVisualization		(bool inCurrent, GUI_GraphState * g)
 {
 	double ll,lb,lr,lt;	// logical boundary
@@ -242,10 +585,12 @@ void		WED_TerrainLayer::DrawVisualization		(bool inCurrent, GUI_GraphState * g)
 	const float ter_color[3][4] = {	{ 0.4, 0.4, 0.9, 1.0 },         // water
 									{ 0.4, 0.7, 0.5, 1.0 },         // apts
 									{ 0.8, 0.6, 0.4, 1.0 }, };      // everything else
-	if (PPM > 0.05) 	// caveat: dont make terrain mesh visibility to exceed 6 tiles total - it causes cache trashing in LoadTerrain()
+	int tiles = (ceil(map_viewport.xmax()) - floor(map_viewport.xmin())) * (ceil(map_viewport.ymax()) - floor(map_viewport.ymin()));
+	if (tiles <= 6) 	// caveat: dont make terrain mesh visibility to exceed 6 tiles total - it causes cache trashing in LoadTerrain()
 	{
+		CollectLoaded();
 		LoadTerrain(map_viewport);
-		for (const auto& ter : mTerrains)
+		for (auto& ter : mTerrains)
 			if (ter.second.bounds.overlap(map_viewport))
 			{
 				auto t = &ter.second;
@@ -300,66 +645,12 @@ void		WED_TerrainLayer::DrawVisualization		(bool inCurrent, GUI_GraphState * g)
 #define P2PIX(v) GetZoomer()->LLToPixel((v).LonLat)
 
 				// mesh visualization
+				DrawMesh(ter.second, map_viewport, ter_color);
+
+				// vertex annotations
 				for (const auto& p : t->patches)
 				if(p.bounds.overlap(map_viewport))
 				{
-
-					glColor4fv(ter_color[p.color]);
-					auto v = p.verts.begin();
-					switch(p.topology)
-					{ 
-						case 0:
-							while (v != p.verts.end())
-							{
-								glBegin(GL_LINE_LOOP);
-								for (int i = 0; i < 3; i++)
-								{
-									glVertex2(P2PIX(*v));
-									v++;
-								}
-								glEnd();
-							}
-							break;
-						case 2:           // FAN
-						{
-							glBegin(GL_LINE_LOOP);
-							Point2 origin = P2PIX(*v); 
-							v++;
-							glVertex2(origin);
-							while (v != p.verts.end())
-							{
-								glVertex2(P2PIX(*v));
-								v++;
-							}
-							glEnd();
-							v = p.verts.begin() + 2;
-							glBegin(GL_LINES);
-							while (v != p.verts.end())
-							{
-								glVertex2(origin);
-								glVertex2(P2PIX(*v));
-								v++;
-							}
-							glEnd();
-							break;
-						}
-						case 1:           // STRIP
-						{
-							glBegin(GL_LINE_STRIP);
-							Point2 last_pt = P2PIX(*v);	
-							v++;
-							while (v != p.verts.end())
-							{
-								Point2 this_pt = P2PIX(*v);	
-								v++;
-								glVertex2(this_pt);
-								glVertex2(last_pt);
-								last_pt = this_pt;
-							}
-							glEnd();
-							break;
-						}
-					}
 					if (PPM > 1.0)
 					{
 						for(const auto& v : p.verts)
@@ -391,9 +682,120 @@ void		WED_TerrainLayer::DrawVisualization		(bool inCurrent, GUI_GraphState * g)
 //				glDisable(GL_LINE_STIPPLE);
 			}
 	}
+	else
+		Stop();                 // nothing gets drawn - tiles still loading are picked up once zoomed in again
 }
 
 void		WED_TerrainLayer::GetCaps(bool& draw_ent_v, bool& draw_ent_s, bool& cares_about_sel, bool& wants_clicks)
 {
 	draw_ent_v = draw_ent_s = cares_about_sel = wants_clicks = 0;
 }
+
+#if UNIT_TEST
+// Headless test of the LOD builder: a tile of jittered grid mesh, made of strips, fans and plain triangles in all three colors like
+// a real DSF has them. Checks that level 0 has every edge of the mesh exactly once, that the runs are sorted and cover all edges,
+// that all vertices of each level are within a cell of where the mesh has one and that the levels get coarser.  No GL calls.
+//	usage: <grid points per side>
+int main(int argc, const char * argv[])
+{
+	int n = argc > 1 ? atoi(argv[1]) : 1000;
+	double d = 1.0 / (n - 1);
+
+	terrain_t tile;
+	tile.bounds = Bbox2(-71, 42, -70, 43);
+	srand(1);
+	auto pt = [&](int x, int y) {
+		double jx = (x > 0 && x < n - 1) ? (rand() / (double) RAND_MAX - 0.5) * d * 0.5 : 0.0;   // keep the tile edges straight
+		double jy = (y > 0 && y < n - 1) ? (rand() / (double) RAND_MAX - 0.5) * d * 0.5 : 0.0;
+		double c[7] = { tile.bounds.xmin() + x * d + jx, tile.bounds.ymin() + y * d + jy, 100.0, 0.0, 0.0, 0.0, 0.0 };
+		return terrain_t::vert_data_t(c);
+	};
+	vector<terrain_t::vert_data_t> grid;
+	for (int y = 0; y < n; y++)
+		for (int x = 0; x < n; x++)
+			grid.push_back(pt(x, y));
+
+	for (int y = 0; y < n - 1; y++)
+	{
+		terrain_t::patch_t p;                          // a strip per row, split into triangles and fans at some rows
+		p.color = y % 3;
+		p.topology = y % 5 == 0 ? 0 : (y % 7 == 0 ? 2 : 1);
+		for (int x = 0; x < n - 1; x++)
+		{
+			const auto& a = grid[x + y * n];     const auto& b = grid[x + 1 + y * n];
+			const auto& c = grid[x + (y + 1) * n]; const auto& e = grid[x + 1 + (y + 1) * n];
+			if (p.topology == 0)
+				p.verts.insert(p.verts.end(), { a, b, c, b, e, c });
+			else if (p.topology == 2)
+			{
+				tile.patches.push_back(p);
+				tile.patches.back().verts = { b, e, c, a };
+			}
+			else
+			{
+				if (x == 0) p.verts.insert(p.verts.end(), { c, a });
+				p.verts.insert(p.verts.end(), { e, b });
+			}
+		}
+		if (p.topology != 2)
+			tile.patches.push_back(p);
+	}
+
+	unsigned long long t0 = query_hpc();
+	BuildLODs(tile);
+	double secs = hpc_to_microseconds(query_hpc() - t0) / 1000000.0;
+
+	int mesh_edges = 2 * n * (n - 1) + (n - 1) * (n - 1);
+	int mesh_verts = n * n;
+	if (tile.lods.empty() || tile.lods[0].cell != 0.0 || tile.lods[0].edges.size() != mesh_edges * 2)
+	{
+		printf("Level 0 has %d edges, the mesh %d.\n", tile.lods.empty() ? 0 : (int) tile.lods[0].edges.size() / 2, mesh_edges);
+		return 1;
+	}
+	for (int l = 0; l < tile.lods.size(); l++)
+	{
+		const auto& lod = tile.lods[l];
+		int first = 0;
+		for (int r = 0; r < lod.runs.size(); r++)
+		{
+			const auto& run = lod.runs[r];
+			if (run.first != first || run.count % 2 ||
+				(r > 0 && (run.block < lod.runs[r - 1].block || (run.block == lod.runs[r - 1].block && run.color <= lod.runs[r - 1].color))))
+			{
+				printf("Level %d: bad run, block %d color %d first %d count %d.\n", l, run.block, run.color, run.first, run.count);
+				return 1;
+			}
+			Point2 o = BlockOrigin(tile, run.block);
+			Bbox2 bounds(run.bounds);
+			bounds.expand(1e-6);
+			for (int i = run.first; i < run.first + run.count; i++)
+			{
+				if (lod.edges[i] >= lod.verts.size() / 2)
+				{
+					printf("Level %d: index %d out of range.\n", l, lod.edges[i]);
+					return 1;
+				}
+				Point2 p(o.x() + lod.verts[2 * lod.edges[i]], o.y() + lod.verts[2 * lod.edges[i] + 1]);
+				int gx = intlim(round((p.x() - tile.bounds.xmin()) / d), 0, n - 1);
+				int gy = intlim(round((p.y() - tile.bounds.ymin()) / d), 0, n - 1);
+				if (p.squared_distance(grid[gx + gy * n].LonLat) > 1e-12 || !bounds.contains(p))
+				{
+					printf("Level %d: vertex %.8lf %.8lf is not on the mesh.\n", l, p.x(), p.y());
+					return 1;
+				}
+			}
+			first += run.count;
+		}
+		if (first != lod.edges.size() || (l > 0 && lod.edges.size() >= tile.lods[l - 1].edges.size()))
+		{
+			printf("Level %d: %d edges.\n", l, (int) lod.edges.size() / 2);
+			return 1;
+		}
+		printf("Level %d: cell %4.0lf m, %8d edges, %8d vertices, %4d runs, used below %.3lf px/m.\n", l, lod.cell * DEG_TO_MTR_LAT,
+			(int) lod.edges.size() / 2, (int) lod.verts.size() / 2, (int) lod.runs.size(),
+			l > 0 ? LOD_MAX_ERROR_PIX / (lod.cell * DEG_TO_MTR_LAT) : INFINITY);
+	}
+	printf("%d mesh vertices, %d edges: %d levels built in %.0lf ms.\n", mesh_verts, mesh_edges, (int) tile.lods.size(), secs * 1000.0);
+	return 0;
+}
+#endif
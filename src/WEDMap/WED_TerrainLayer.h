@@ -24,9 +24,14 @@
 #ifndef WED_TerrainLayer_H
 #define WED_TerrainLayer_H
 
+#include "GUI_Timer.h"
 #include "WED_MapLayer.h"
 #include "CompGeomDefs2.h"
 #include "CompGeomDefs3.h"
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 struct terrain_t {
 	int		index;
@@ -53,15 +58,35 @@ struct terrain_t {
 		vector<vert_data_t> verts;
 	};
 	vector<patch_t> patches;
+
+	// The mesh wireframe at a few levels of detail, built once at load time. Level 0 is every edge of the mesh, the coarser
+	// levels snap the vertices to ever larger grid cells and drop the edges that collapse. To keep the vertices as floats
+	// without losing precision, the tile is cut into blocks and the vertices are relative to the SW corner of their block.
+	struct lod_t {
+		struct run_t { int block; int color; int first; int count; Bbox2 bounds; };
+
+		double		cell;                   // grid cell size in degrees, i.e. the largest error, 0.0 for the full mesh
+		vector<float>	verts;              // x,y pairs, emptied once they are in the vbo
+		vector<unsigned int> edges;         // index pairs, sorted by block and color, emptied once they are in the vbo
+		vector<run_t>	runs;
+		unsigned int	vbo[2];             // vertex and index buffer, created on first draw
+
+		lod_t() : cell(0.0) { vbo[0] = vbo[1] = 0; }
+	};
+	vector<lod_t> lods;
 };
 
+#define TERRAIN_BLOCKS 8                    // blocks per tile side
+
 enum {
 	color_water,
 	color_airport,
 	color_land
 };
 
-class WED_TerrainLayer : public WED_MapLayer {
+// Tiles are read and their LODs built by a worker thread, started with the first tile. The drawing thread picks them up
+// and does all the GL work, so buffers are only ever created and freed from DrawVisualization.
+class WED_TerrainLayer : public WED_MapLayer, public GUI_Timer {
 public:
 
 						 WED_TerrainLayer(GUI_Pane * host, WED_MapZoomerNew * zoomer, IResolver * resolver);
@@ -69,11 +94,24 @@ public:
 
 	virtual	void		DrawVisualization		(bool inCurrent, GUI_GraphState * g);
 	virtual	void		GetCaps(bool& draw_ent_v, bool& draw_ent_s, bool& cares_about_sel, bool& wants_clicks);
+	virtual	void		TimerFired(void);
 
 private:
 
 	void				LoadTerrain(Bbox2& bounds);
+	void				CollectLoaded(void);
+	void				WorkerThread(void);
+	void				DrawMesh(terrain_t& t, const Bbox2& viewport, const float colors[][4]);
+	void				FreeBuffers(terrain_t& t);
 	unordered_map<string,terrain_t>	mTerrains;
+	set<string>			mLoading;           // main thread only
+
+	thread				mWorker;
+	mutex				mJobLock;
+	condition_variable	mJobCond;
+	deque<string>		mJobs;
+	vector<pair<string, terrain_t> >	mDone;
+	bool				mQuit;
 };
 
 #endif /* WED_TerrainLayer_H */
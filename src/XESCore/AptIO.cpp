@@ -29,6 +29,7 @@
 #include "AssertUtils.h"
 #include "CompGeomUtils.h"
 #include "STLUtils.h"
+#include <stdarg.h>
 
 #include "WED_Version.h"
 // for now
@@ -178,7 +179,7 @@ static void	print_apt_poly(int (*fprintf)(void * fi, const char * fmt, ...), voi
 				else
 					fprintf(fi, " %d", *a);
 			}
-		fputs(CRLF, (FILE *) fi);
+		fprintf(fi, CRLF);
 	}
 }
 
@@ -1271,7 +1272,7 @@ bool	WriteAptFileOpen(FILE * fi, const AptVector& inApts, int version)
 	return WriteAptFileProcs((int (*)(void *, const char *,...))fprintf,fi,inApts,version);
 }
 
-bool	WriteAptFileProcs(int (* fprintf)(void * fi, const char * fmt, ...), void * fi, const AptVector& inApts, int version)
+void	WriteAptFileHeader(int (* fprintf)(void * fi, const char * fmt, ...), void * fi, int version)
 {
 	DebugAssert(version == 850 || version == 1000 || version == 1050 || version == 1100 || version == 1130 || version == 1200);
 	fprintf(fi, "%c" CRLF, APL ? 'A' : 'I');
@@ -1280,367 +1281,483 @@ bool	WriteAptFileProcs(int (* fprintf)(void * fi, const char * fmt, ...), void *
 #else
 	fprintf(fi, "%d Generated by WorldEditor %s" CRLF, version, WED_VERSION_STRING);
 #endif
+}
 
+void	WriteAptFileAirport(int (* fprintf)(void * fi, const char * fmt, ...), void * fi, const AptInfo_t& airport, int version)
+{
 	bool has_atc = (version >= 1000);
 	bool has_atc2 = (version >= 1050);
 	bool has_atc3 = (version >= 1100);
 
-	for (AptVector::const_iterator apt = inApts.begin(); apt != inApts.end(); ++apt)
-	{
-		fprintf(fi, CRLF);
-		fprintf(fi, "%d %6d %d %d %s %s" CRLF, apt->kind_code, apt->elevation_ft,
-				version < 1000 ? apt->has_atc_twr : 0, apt->default_buildings,
-				apt->icao.c_str(), apt->name.c_str());
+	const AptInfo_t * apt = &airport;
+	fprintf(fi, CRLF);
+	fprintf(fi, "%d %6d %d %d %s %s" CRLF, apt->kind_code, apt->elevation_ft,
+			version < 1000 ? apt->has_atc_twr : 0, apt->default_buildings,
+			apt->icao.c_str(), apt->name.c_str());
 
-		for(int i = 0; i < apt->meta_data.size(); ++i)
-		{
+	for(int i = 0; i < apt->meta_data.size(); ++i)
+	{
 #if TYLER_MODE
-			if(apt->meta_data.at(i).second.empty()) continue;
+		if(apt->meta_data.at(i).second.empty()) continue;
 #endif
-			string key = apt->meta_data.at(i).first;
-			string value = apt->meta_data.at(i).second;
-
-			if (key == "faa_code"  ||
-				key == "iata_code" ||
-				key == "icao_code" ||
-				key == "region_code")
-			{
-				//Convert each to
-				::transform(value.begin(), value.end(), value.begin(), ::toupper);
-			}
-
-			fprintf(fi, "%d %s %s" CRLF, apt_meta_data, key.c_str(), value.c_str());
-		}
+		string key = apt->meta_data.at(i).first;
+		string value = apt->meta_data.at(i).second;
 
-		for (AptRunwayVector::const_iterator rwy = apt->runways.begin(); rwy != apt->runways.end(); ++rwy)
+		if (key == "faa_code"  ||
+			key == "iata_code" ||
+			key == "icao_code" ||
+			key == "region_code")
 		{
-			fprintf(fi,"%d %4.2f %d %d %.2f %d %d %d "
-						"%3s" LLFMT " %.0f %.0f %d %d %d %d "
-						"%s" LLFMT " %.0f %.0f %d %d %d %d" CRLF,
-						apt_rwy_new, rwy->width_mtr,
-						version >= 1200 ? rwy->surf_code : XP11_pave_type(rwy->surf_code),
-						version >= 1200 ? rwy->shoulder_code : XP11_pave_type(rwy->shoulder_code), rwy->roughness_ratio,
-						rwy->has_centerline, rwy->edge_light_code, rwy->has_distance_remaining,
-						rwy->id[0].c_str(),CGAL2DOUBLE(rwy->ends.source().y()),CGAL2DOUBLE(rwy->ends.source().x()), rwy->disp_mtr[0], rwy->blas_mtr[0],
-						rwy->marking_code[0], rwy->app_light_code[0], rwy->has_tdzl[0],
-						(version >= 1200 || rwy->reil_code[0] <= 2) ? rwy->reil_code[0] : 0,
-						rwy->id[1].c_str(),CGAL2DOUBLE(rwy->ends.target().y()),CGAL2DOUBLE(rwy->ends.target().x()), rwy->disp_mtr[1], rwy->blas_mtr[1],
-						rwy->marking_code[1], rwy->app_light_code[1], rwy->has_tdzl[1],
-						(version >= 1200 || rwy->reil_code[1] <= 2) ? rwy->reil_code[1] : 0);
-
-			if(version >= 1200 && rwy->has_105)
-				fprintf(fi,"%d %d %d %.1f %4.2f %4.2f %4.2f %4.2f" CRLF, apt_rwy_skids,
-						rwy->mark_color, rwy->mark_size, rwy->number_size,
-						rwy->skids[0], rwy->skid_len[0], rwy->skids[1], rwy->skid_len[1]);
+			//Convert each to
+			::transform(value.begin(), value.end(), value.begin(), ::toupper);
 		}
 
-		for(AptSealaneVector::const_iterator sea = apt->sealanes.begin(); sea != apt->sealanes.end(); ++sea)
-		{
-			fprintf(fi,"%d %4.2f %d %s" LLFMT2 " %s" LLFMT2 CRLF,
-					apt_sea_new, sea->width_mtr, sea->has_buoys,
-					sea->id[0].c_str(), CGAL2DOUBLE(sea->ends.source().y()), CGAL2DOUBLE(sea->ends.source().x()),
-					sea->id[1].c_str(), CGAL2DOUBLE(sea->ends.target().y()), CGAL2DOUBLE(sea->ends.target().x()));
-		}
+		fprintf(fi, "%d %s %s" CRLF, apt_meta_data, key.c_str(), value.c_str());
+	}
 
-		for (AptPavementVector::const_iterator pav = apt->pavements.begin(); pav != apt->pavements.end(); ++pav)
-		{
-			double heading, len;
-			POINT2	center;
-			EndsToCenter(pav->ends, center, len, heading);
-			fprintf(fi,"%d" LLFMT " %s %.1lf %6.0lf %4d.%04d %4d.%04d %4.0f "
-					   "%d%d%d%d%d%d %02d %d %d %3.2f %d %3d.%03d" CRLF, apt_rwy_old,
-				CGAL2DOUBLE(center.y()), CGAL2DOUBLE(center.x()), pav->name.c_str(), heading, len * MTR_TO_FT,
-				pav->disp1_ft, pav->disp2_ft, pav->blast1_ft, pav->blast2_ft, pav->width_ft,
-				pav->vap_lites_code1,
-				pav->edge_lites_code1,
-				pav->app_lites_code1,
-				pav->vap_lites_code2,
-				pav->edge_lites_code2,
-				pav->app_lites_code2,
-				pav->surf_code,
-				pav->shoulder_code,
-				pav->marking_code,
-				pav->roughness_ratio, pav->distance_markings, pav->vasi_angle1, pav->vasi_angle2);
-		}
+	for (AptRunwayVector::const_iterator rwy = apt->runways.begin(); rwy != apt->runways.end(); ++rwy)
+	{
+		fprintf(fi,"%d %4.2f %d %d %.2f %d %d %d "
+					"%3s" LLFMT " %.0f %.0f %d %d %d %d "
+					"%s" LLFMT " %.0f %.0f %d %d %d %d" CRLF,
+					apt_rwy_new, rwy->width_mtr,
+					version >= 1200 ? rwy->surf_code : XP11_pave_type(rwy->surf_code),
+					version >= 1200 ? rwy->shoulder_code : XP11_pave_type(rwy->shoulder_code), rwy->roughness_ratio,
+					rwy->has_centerline, rwy->edge_light_code, rwy->has_distance_remaining,
+					rwy->id[0].c_str(),CGAL2DOUBLE(rwy->ends.source().y()),CGAL2DOUBLE(rwy->ends.source().x()), rwy->disp_mtr[0], rwy->blas_mtr[0],
+					rwy->marking_code[0], rwy->app_light_code[0], rwy->has_tdzl[0],
+					(version >= 1200 || rwy->reil_code[0] <= 2) ? rwy->reil_code[0] : 0,
+					rwy->id[1].c_str(),CGAL2DOUBLE(rwy->ends.target().y()),CGAL2DOUBLE(rwy->ends.target().x()), rwy->disp_mtr[1], rwy->blas_mtr[1],
+					rwy->marking_code[1], rwy->app_light_code[1], rwy->has_tdzl[1],
+					(version >= 1200 || rwy->reil_code[1] <= 2) ? rwy->reil_code[1] : 0);
+
+		if(version >= 1200 && rwy->has_105)
+			fprintf(fi,"%d %d %d %.1f %4.2f %4.2f %4.2f %4.2f" CRLF, apt_rwy_skids,
+					rwy->mark_color, rwy->mark_size, rwy->number_size,
+					rwy->skids[0], rwy->skid_len[0], rwy->skids[1], rwy->skid_len[1]);
+	}
 
+	for(AptSealaneVector::const_iterator sea = apt->sealanes.begin(); sea != apt->sealanes.end(); ++sea)
+	{
+		fprintf(fi,"%d %4.2f %d %s" LLFMT2 " %s" LLFMT2 CRLF,
+				apt_sea_new, sea->width_mtr, sea->has_buoys,
+				sea->id[0].c_str(), CGAL2DOUBLE(sea->ends.source().y()), CGAL2DOUBLE(sea->ends.source().x()),
+				sea->id[1].c_str(), CGAL2DOUBLE(sea->ends.target().y()), CGAL2DOUBLE(sea->ends.target().x()));
+	}
 
-		for(AptHelipadVector::const_iterator heli = apt->helipads.begin(); heli != apt->helipads.end(); ++heli)
-		{
-			fprintf(fi,"%d %s" LLFMT " %.1lf %.2f %.2f %d %d %d %.2f %d" CRLF,
-				apt_heli_new, heli->id.c_str(), CGAL2DOUBLE(heli->location.y()), CGAL2DOUBLE(heli->location.x()), heli->heading, heli->length_mtr, heli->width_mtr,
-						version >= 1200 ? heli->surface_code : XP11_pave_type(heli->surface_code), heli->marking_code,
-						version >= 1200 ? heli->shoulder_code : XP11_pave_type(heli->shoulder_code), heli->roughness_ratio, heli->edge_light_code);
-		}
+	for (AptPavementVector::const_iterator pav = apt->pavements.begin(); pav != apt->pavements.end(); ++pav)
+	{
+		double heading, len;
+		POINT2	center;
+		EndsToCenter(pav->ends, center, len, heading);
+		fprintf(fi,"%d" LLFMT " %s %.1lf %6.0lf %4d.%04d %4d.%04d %4.0f "
+				   "%d%d%d%d%d%d %02d %d %d %3.2f %d %3d.%03d" CRLF, apt_rwy_old,
+			CGAL2DOUBLE(center.y()), CGAL2DOUBLE(center.x()), pav->name.c_str(), heading, len * MTR_TO_FT,
+			pav->disp1_ft, pav->disp2_ft, pav->blast1_ft, pav->blast2_ft, pav->width_ft,
+			pav->vap_lites_code1,
+			pav->edge_lites_code1,
+			pav->app_lites_code1,
+			pav->vap_lites_code2,
+			pav->edge_lites_code2,
+			pav->app_lites_code2,
+			pav->surf_code,
+			pav->shoulder_code,
+			pav->marking_code,
+			pav->roughness_ratio, pav->distance_markings, pav->vasi_angle1, pav->vasi_angle2);
+	}
 
-		for (AptTaxiwayVector::const_iterator taxi = apt->taxiways.begin(); taxi != apt->taxiways.end(); ++taxi)
-		{
-			fprintf(fi, "%d %d %.2f %.1f" NFMT CRLF, apt_taxi_new, 
-			version >= 1200 ? taxi->surface_code : XP11_pave_type(taxi->surface_code), taxi->roughness_ratio, taxi->heading N(taxi));
-			print_apt_poly(fprintf,fi,taxi->area, version);
-		}
 
-		for (AptBoundaryVector::const_iterator bound = apt->boundaries.begin(); bound != apt->boundaries.end(); ++bound)
-		{
-			fprintf(fi, "%d" NFMT CRLF, apt_boundary N(bound));
-			print_apt_poly(fprintf,fi,bound->area, version);
-		}
+	for(AptHelipadVector::const_iterator heli = apt->helipads.begin(); heli != apt->helipads.end(); ++heli)
+	{
+		fprintf(fi,"%d %s" LLFMT " %.1lf %.2f %.2f %d %d %d %.2f %d" CRLF,
+			apt_heli_new, heli->id.c_str(), CGAL2DOUBLE(heli->location.y()), CGAL2DOUBLE(heli->location.x()), heli->heading, heli->length_mtr, heli->width_mtr,
+					version >= 1200 ? heli->surface_code : XP11_pave_type(heli->surface_code), heli->marking_code,
+					version >= 1200 ? heli->shoulder_code : XP11_pave_type(heli->shoulder_code), heli->roughness_ratio, heli->edge_light_code);
+	}
 
-		for (AptMarkingVector::const_iterator lin = apt->lines.begin(); lin != apt->lines.end(); ++lin)
-		{
-			fprintf(fi, "%d" NFMT CRLF, apt_free_chain N(lin));
-			print_apt_poly(fprintf,fi,lin->area, version);
-		}
+	for (AptTaxiwayVector::const_iterator taxi = apt->taxiways.begin(); taxi != apt->taxiways.end(); ++taxi)
+	{
+		fprintf(fi, "%d %d %.2f %.1f" NFMT CRLF, apt_taxi_new, 
+		version >= 1200 ? taxi->surface_code : XP11_pave_type(taxi->surface_code), taxi->roughness_ratio, taxi->heading N(taxi));
+		print_apt_poly(fprintf,fi,taxi->area, version);
+	}
 
-		for (AptLightVector::const_iterator light = apt->lights.begin(); light != apt->lights.end(); ++light)
-		{
-			fprintf(fi,"%d" LLFMT " %d %.1lf %.2f" NFMT CRLF,
-					apt_papi, CGAL2DOUBLE(light->location.y()), CGAL2DOUBLE(light->location.x()), light->light_code,
-					light->heading, light->angle N(light));
-		}
+	for (AptBoundaryVector::const_iterator bound = apt->boundaries.begin(); bound != apt->boundaries.end(); ++bound)
+	{
+		fprintf(fi, "%d" NFMT CRLF, apt_boundary N(bound));
+		print_apt_poly(fprintf,fi,bound->area, version);
+	}
 
-		for (AptSignVector::const_iterator sign = apt->signs.begin(); sign != apt->signs.end(); ++sign)
-		{
-			fprintf(fi,"%d" LLFMT " %.1lf %d %d %s" CRLF,
-					apt_sign, CGAL2DOUBLE(sign->location.y()), CGAL2DOUBLE(sign->location.x()), sign->heading,
-					sign->style_code, sign->size_code, sign->text.c_str());
-		}
+	for (AptMarkingVector::const_iterator lin = apt->lines.begin(); lin != apt->lines.end(); ++lin)
+	{
+		fprintf(fi, "%d" NFMT CRLF, apt_free_chain N(lin));
+		print_apt_poly(fprintf,fi,lin->area, version);
+	}
 
+	for (AptLightVector::const_iterator light = apt->lights.begin(); light != apt->lights.end(); ++light)
+	{
+		fprintf(fi,"%d" LLFMT " %d %.1lf %.2f" NFMT CRLF,
+				apt_papi, CGAL2DOUBLE(light->location.y()), CGAL2DOUBLE(light->location.x()), light->light_code,
+				light->heading, light->angle N(light));
+	}
 
-		if (apt->tower.draw_obj != -1)
-			fprintf(fi, "%d" LLFMT2 " %.0f %d" NFMT CRLF, apt_tower_loc,
-				CGAL2DOUBLE(apt->tower.location.y()), CGAL2DOUBLE(apt->tower.location.x()), apt->tower.height_ft,
-				apt->tower.draw_obj N(apt));
+	for (AptSignVector::const_iterator sign = apt->signs.begin(); sign != apt->signs.end(); ++sign)
+	{
+		fprintf(fi,"%d" LLFMT " %.1lf %d %d %s" CRLF,
+				apt_sign, CGAL2DOUBLE(sign->location.y()), CGAL2DOUBLE(sign->location.x()), sign->heading,
+				sign->style_code, sign->size_code, sign->text.c_str());
+	}
+
+
+	if (apt->tower.draw_obj != -1)
+		fprintf(fi, "%d" LLFMT2 " %.0f %d" NFMT CRLF, apt_tower_loc,
+			CGAL2DOUBLE(apt->tower.location.y()), CGAL2DOUBLE(apt->tower.location.x()), apt->tower.height_ft,
+			apt->tower.draw_obj N(apt));
 
-		for (AptGateVector::const_iterator gate = apt->gates.begin(); gate != apt->gates.end(); ++gate)
+	for (AptGateVector::const_iterator gate = apt->gates.begin(); gate != apt->gates.end(); ++gate)
+	{
+		if((gate->type == atc_ramp_misc && gate->equipment == atc_traffic_all) || gate->equipment == 0 || !has_atc)
 		{
-			if((gate->type == atc_ramp_misc && gate->equipment == atc_traffic_all) || gate->equipment == 0 || !has_atc)
-			{
-				fprintf(fi, "%d" LLFMT " %.1f %s" CRLF, apt_startup_loc,
-					CGAL2DOUBLE(gate->location.y()), CGAL2DOUBLE(gate->location.x()), gate->heading, gate->name.c_str());
-			}
-			else
+			fprintf(fi, "%d" LLFMT " %.1f %s" CRLF, apt_startup_loc,
+				CGAL2DOUBLE(gate->location.y()), CGAL2DOUBLE(gate->location.x()), gate->heading, gate->name.c_str());
+		}
+		else
+		{
+			//--1300 lat lon heading misc|gate|tie_down|hangar traffic name
+			fprintf(fi, "%d" LLFMT2 " %.1f %s ", 
+				apt_startup_loc_new, //1300
+				CGAL2DOUBLE(gate->location.y()),//lat
+				CGAL2DOUBLE(gate->location.x()),//lon
+				gate->heading,//heading
+				ramp_type_strings[gate->type]//human readable ramp type name
+			);
+			print_bitfields(fprintf,fi,gate->equipment, equip_strings);
+		
+			fprintf(fi, " %s" CRLF, gate->name.c_str()); //name
+			//-------------------------------------------------------------
+
+			if(has_atc2)
 			{
-				//--1300 lat lon heading misc|gate|tie_down|hangar traffic name
-				fprintf(fi, "%d" LLFMT2 " %.1f %s ", 
-					apt_startup_loc_new, //1300
-					CGAL2DOUBLE(gate->location.y()),//lat
-					CGAL2DOUBLE(gate->location.x()),//lon
-					gate->heading,//heading
-					ramp_type_strings[gate->type]//human readable ramp type name
+				//--1301 size ramp_operation_type airlines-------------------
+				//Ex:1301 E 3 air del chl <- made up space seperated lines
+				fprintf(fi, "%2d %c %s ",
+					apt_startup_loc_extended,//1301
+					'A' + gate->width,//size
+					ramp_operation_type_strings[gate->ramp_op_type]//human readable ramp_operation_type
 				);
-				print_bitfields(fprintf,fi,gate->equipment, equip_strings);
-			
-				fprintf(fi, " %s" CRLF, gate->name.c_str()); //name
-				//-------------------------------------------------------------
 
-				if(has_atc2)
+				if(gate->airlines.empty() == false)
 				{
-					//--1301 size ramp_operation_type airlines-------------------
-					//Ex:1301 E 3 air del chl <- made up space seperated lines
-					fprintf(fi, "%2d %c %s ",
-						apt_startup_loc_extended,//1301
-						'A' + gate->width,//size
-						ramp_operation_type_strings[gate->ramp_op_type]//human readable ramp_operation_type
-					);
-
-					if(gate->airlines.empty() == false)
-					{
-						fprintf(fi,"%s", gate->airlines.c_str());
-					}
-				
-					fputs(CRLF, (FILE *) fi);//Row is over
-					//---------------------------------------------------------
+					fprintf(fi,"%s", gate->airlines.c_str());
 				}
+			
+				fprintf(fi, CRLF);//Row is over
+				//---------------------------------------------------------
 			}
 		}
+	}
 
-		if (apt->beacon.color_code != apt_beacon_none)
-			fprintf(fi, "%d" LLFMT " %d" NFMT CRLF, apt_beacon,CGAL2DOUBLE( apt->beacon.location.y()),
-				CGAL2DOUBLE(apt->beacon.location.x()), apt->beacon.color_code N(apt));
+	if (apt->beacon.color_code != apt_beacon_none)
+		fprintf(fi, "%d" LLFMT " %d" NFMT CRLF, apt_beacon,CGAL2DOUBLE( apt->beacon.location.y()),
+			CGAL2DOUBLE(apt->beacon.location.x()), apt->beacon.color_code N(apt));
 
-		for (AptWindsockVector::const_iterator sock = apt->windsocks.begin(); sock != apt->windsocks.end(); ++sock)
-		{
-			fprintf(fi, "%d" LLFMT " %d" NFMT CRLF, apt_windsock, CGAL2DOUBLE(sock->location.y()), CGAL2DOUBLE(sock->location.x()),
-				sock->lit N(sock));
-		}
+	for (AptWindsockVector::const_iterator sock = apt->windsocks.begin(); sock != apt->windsocks.end(); ++sock)
+	{
+		fprintf(fi, "%d" LLFMT " %d" NFMT CRLF, apt_windsock, CGAL2DOUBLE(sock->location.y()), CGAL2DOUBLE(sock->location.x()),
+			sock->lit N(sock));
+	}
 
-		for (AptATCFreqVector::const_iterator atc = apt->atc.begin(); atc != apt->atc.end(); ++atc)
-		{
-			if(version < 1130)
-				fprintf(fi, "%2d %5d %s" CRLF, atc->atc_type, atc->freq / 10, atc->name.c_str());
-			else
-				fprintf(fi, "%2d %6d %s" CRLF, atc->atc_type + (apt_freq_awos_1k-apt_freq_awos), atc->freq, atc->name.c_str());
+	for (AptATCFreqVector::const_iterator atc = apt->atc.begin(); atc != apt->atc.end(); ++atc)
+	{
+		if(version < 1130)
+			fprintf(fi, "%2d %5d %s" CRLF, atc->atc_type, atc->freq / 10, atc->name.c_str());
+		else
+			fprintf(fi, "%2d %6d %s" CRLF, atc->atc_type + (apt_freq_awos_1k-apt_freq_awos), atc->freq, atc->name.c_str());
 
-		}
+	}
 
-		if(has_atc)
+	if(has_atc)
+	{
+		for(AptFlowVector::const_iterator flow = apt->flows.begin(); flow != apt->flows.end(); ++flow)
 		{
-			for(AptFlowVector::const_iterator flow = apt->flows.begin(); flow != apt->flows.end(); ++flow)
-			{
-				fprintf(fi,"%2d %s" CRLF, apt_flow_def, flow->name.c_str());
-
-				for(AptWindRuleVector::const_iterator wind = flow->wind_rules.begin(); wind != flow->wind_rules.end(); ++wind)
-					fprintf(fi,"%2d %s %03d %03d %d" CRLF, apt_flow_wind, wind->icao.c_str(), wind->dir_lo_degs_mag, wind->dir_hi_degs_mag, wind->max_speed_knots);
+			fprintf(fi,"%2d %s" CRLF, apt_flow_def, flow->name.c_str());
 
-				fprintf(fi,"%2d %s %d" CRLF, apt_flow_ceil, flow->icao.c_str(), flow->ceiling_ft);
+			for(AptWindRuleVector::const_iterator wind = flow->wind_rules.begin(); wind != flow->wind_rules.end(); ++wind)
+				fprintf(fi,"%2d %s %03d %03d %d" CRLF, apt_flow_wind, wind->icao.c_str(), wind->dir_lo_degs_mag, wind->dir_hi_degs_mag, wind->max_speed_knots);
 
-				fprintf(fi,"%2d %s %.1f" CRLF, apt_flow_vis, flow->icao.c_str(), flow->visibility_sm);
+			fprintf(fi,"%2d %s %d" CRLF, apt_flow_ceil, flow->icao.c_str(), flow->ceiling_ft);
 
-				for(AptTimeRuleVector::const_iterator time = flow->time_rules.begin(); time != flow->time_rules.end(); ++time)
-					fprintf(fi,"%2d %04d %04d" CRLF, apt_flow_time, time->start_zulu, time->end_zulu);
+			fprintf(fi,"%2d %s %.1f" CRLF, apt_flow_vis, flow->icao.c_str(), flow->visibility_sm);
 
-				if(!flow->pattern_runway.empty() && flow->pattern_side)
-				{
-					fprintf(fi,"%02d %s ", apt_flow_pattern, flow->pattern_runway.c_str());
-					print_bitfields(fprintf,fi,flow->pattern_side,pattern_strings);
-					fprintf(fi,CRLF);
-				}
+			for(AptTimeRuleVector::const_iterator time = flow->time_rules.begin(); time != flow->time_rules.end(); ++time)
+				fprintf(fi,"%2d %04d %04d" CRLF, apt_flow_time, time->start_zulu, time->end_zulu);
 
-				for(AptRunwayRuleVector::const_iterator	rule = flow->runway_rules.begin(); rule != flow->runway_rules.end(); ++rule)
-				{
-					if(version < 1130)
-						fprintf(fi,"%2d %s %5d ",apt_flow_rwy_rule, rule->runway.c_str(), rule->dep_freq / 10);
-					else
-						fprintf(fi,"%2d %s %6d ",apt_flow_rwy_rule1k, rule->runway.c_str(), rule->dep_freq);
-					print_bitfields(fprintf,fi,rule->operations, op_strings);
-					fprintf(fi," ");
-					print_bitfields(fprintf,fi,rule->equipment, equip_strings);
-					fprintf(fi," %03d%03d %03d%03d" NFMT CRLF, rule->dep_heading_lo, rule->dep_heading_hi, rule->ini_heading_lo, rule->ini_heading_hi N(rule));
-				}
+			if(!flow->pattern_runway.empty() && flow->pattern_side)
+			{
+				fprintf(fi,"%02d %s ", apt_flow_pattern, flow->pattern_runway.c_str());
+				print_bitfields(fprintf,fi,flow->pattern_side,pattern_strings);
+				fprintf(fi,CRLF);
 			}
 
-			//If we have airplane taxi edges or service roads edges
-			if (!apt->taxi_route.edges.empty() || !apt->taxi_route.service_roads.empty())
+			for(AptRunwayRuleVector::const_iterator	rule = flow->runway_rules.begin(); rule != flow->runway_rules.end(); ++rule)
 			{
-				//write taxi route network name
-				fprintf(fi, "%2d %s" CRLF, apt_taxi_header, apt->taxi_route.name.c_str());
+				if(version < 1130)
+					fprintf(fi,"%2d %s %5d ",apt_flow_rwy_rule, rule->runway.c_str(), rule->dep_freq / 10);
+				else
+					fprintf(fi,"%2d %s %6d ",apt_flow_rwy_rule1k, rule->runway.c_str(), rule->dep_freq);
+				print_bitfields(fprintf,fi,rule->operations, op_strings);
+				fprintf(fi," ");
+				print_bitfields(fprintf,fi,rule->equipment, equip_strings);
+				fprintf(fi," %03d%03d %03d%03d" NFMT CRLF, rule->dep_heading_lo, rule->dep_heading_hi, rule->ini_heading_lo, rule->ini_heading_hi N(rule));
+			}
+		}
 
-				//write all nodes in network
-				for (vector<AptRouteNode_t>::const_iterator n = apt->taxi_route.nodes.begin();
-					n != apt->taxi_route.nodes.end();
-					++n)
-				{
-					fprintf(fi, "%d" LLFMT2 " both %d" NFMT CRLF, apt_taxi_node, n->location.y(), n->location.x(), n->id N(n));
-				}
+		//If we have airplane taxi edges or service roads edges
+		if (!apt->taxi_route.edges.empty() || !apt->taxi_route.service_roads.empty())
+		{
+			//write taxi route network name
+			fprintf(fi, "%2d %s" CRLF, apt_taxi_header, apt->taxi_route.name.c_str());
+
+			//write all nodes in network
+			for (vector<AptRouteNode_t>::const_iterator n = apt->taxi_route.nodes.begin();
+				n != apt->taxi_route.nodes.end();
+				++n)
+			{
+				fprintf(fi, "%d" LLFMT2 " both %d" NFMT CRLF, apt_taxi_node, n->location.y(), n->location.x(), n->id N(n));
 			}
+		}
 
-			//If we have any, write all edges
-			if (!apt->taxi_route.edges.empty())
+		//If we have any, write all edges
+		if (!apt->taxi_route.edges.empty())
+		{
+			for(vector<AptRouteEdge_t>::const_iterator e = apt->taxi_route.edges.begin(); e != apt->taxi_route.edges.end(); ++e)
 			{
-				for(vector<AptRouteEdge_t>::const_iterator e = apt->taxi_route.edges.begin(); e != apt->taxi_route.edges.end(); ++e)
+				fprintf(fi,"%2d %d %d %s ", apt_taxi_edge, e->src, e->dst, e->oneway ? "oneway" : "twoway");
+				if(e->runway)
+					fprintf(fi,"runway");
+				else
 				{
-					fprintf(fi,"%2d %d %d %s ", apt_taxi_edge, e->src, e->dst, e->oneway ? "oneway" : "twoway");
-					if(e->runway)
-						fprintf(fi,"runway");
-					else
-					{
-						fprintf(fi,"taxiway");
-						if(has_atc2)
-							fprintf(fi,"_%c", 'A' + e->width);
-					}
-					fprintf(fi," %s" CRLF, e->name.c_str());
+					fprintf(fi,"taxiway");
+					if(has_atc2)
+						fprintf(fi,"_%c", 'A' + e->width);
+				}
+				fprintf(fi," %s" CRLF, e->name.c_str());
 
 #if HAS_CURVED_ATC_ROUTE
-					for(vector<pair<Point2,bool> >::const_iterator s = e->shape.begin(); s != e->shape.end(); ++s)
-						fprintf(fi,"%d" LLFMT2 CRLF, (s->second && has_atc3) ? apt_taxi_control : apt_taxi_shape, s->first.y(), s->first.x());
+				for(vector<pair<Point2,bool> >::const_iterator s = e->shape.begin(); s != e->shape.end(); ++s)
+					fprintf(fi,"%d" LLFMT2 CRLF, (s->second && has_atc3) ? apt_taxi_control : apt_taxi_shape, s->first.y(), s->first.x());
 #else
-					for(vector<pair<Point2,bool> >::const_iterator s = e->shape.begin(); s != e->shape.end(); ++s)
-						fprintf(fi,"%d" LLFMT2 CRLF, apt_taxi_shape, s->first.y(), s->first.x());
+				for(vector<pair<Point2,bool> >::const_iterator s = e->shape.begin(); s != e->shape.end(); ++s)
+					fprintf(fi,"%d" LLFMT2 CRLF, apt_taxi_shape, s->first.y(), s->first.x());
 #endif
-					if(!e->hot_depart.empty())
-					{
-						fprintf(fi,"%2d departure", apt_taxi_active);
-						for(set<string>::const_iterator s = e->hot_depart.begin(); s != e->hot_depart.end(); ++s)
-							fprintf(fi,"%c%s", s == e->hot_depart.begin() ? ' ' : ',', s->c_str());
-						fprintf(fi,CRLF);
-					}
-					if(!e->hot_arrive.empty())
-					{
-						fprintf(fi,"%2d arrival", apt_taxi_active);
-						for(set<string>::const_iterator s = e->hot_arrive.begin(); s != e->hot_arrive.end(); ++s)
-							fprintf(fi,"%c%s", s == e->hot_arrive.begin() ? ' ' : ',', s->c_str());
-						fprintf(fi,CRLF);
-					}
-					if(!e->hot_ils.empty())
-					{
-						fprintf(fi,"%2d ils", apt_taxi_active);
-						for(set<string>::const_iterator s = e->hot_ils.begin(); s != e->hot_ils.end(); ++s)
-							fprintf(fi,"%c%s", s == e->hot_ils.begin() ? ' ' : ',', s->c_str());
-						fprintf(fi,CRLF);
-					}
+				if(!e->hot_depart.empty())
+				{
+					fprintf(fi,"%2d departure", apt_taxi_active);
+					for(set<string>::const_iterator s = e->hot_depart.begin(); s != e->hot_depart.end(); ++s)
+						fprintf(fi,"%c%s", s == e->hot_depart.begin() ? ' ' : ',', s->c_str());
+					fprintf(fi,CRLF);
+				}
+				if(!e->hot_arrive.empty())
+				{
+					fprintf(fi,"%2d arrival", apt_taxi_active);
+					for(set<string>::const_iterator s = e->hot_arrive.begin(); s != e->hot_arrive.end(); ++s)
+						fprintf(fi,"%c%s", s == e->hot_arrive.begin() ? ' ' : ',', s->c_str());
+					fprintf(fi,CRLF);
+				}
+				if(!e->hot_ils.empty())
+				{
+					fprintf(fi,"%2d ils", apt_taxi_active);
+					for(set<string>::const_iterator s = e->hot_ils.begin(); s != e->hot_ils.end(); ++s)
+						fprintf(fi,"%c%s", s == e->hot_ils.begin() ? ' ' : ',', s->c_str());
+					fprintf(fi,CRLF);
 				}
 			}
+		}
 
-			//If we have any, write all service roads
-			if (has_atc3)
+		//If we have any, write all service roads
+		if (has_atc3)
+		{
+			for (vector<AptServiceRoadEdge_t>::const_iterator e = apt->taxi_route.service_roads.begin(); e != apt->taxi_route.service_roads.end(); ++e)
 			{
-				for (vector<AptServiceRoadEdge_t>::const_iterator e = apt->taxi_route.service_roads.begin(); e != apt->taxi_route.service_roads.end(); ++e)
-				{
-					fprintf(fi, "%d %d %d %s" NFMT CRLF, apt_taxi_truck_edge, e->src, e->dst, e->oneway ? "oneway" : "twoway" N(e));
+				fprintf(fi, "%d %d %d %s" NFMT CRLF, apt_taxi_truck_edge, e->src, e->dst, e->oneway ? "oneway" : "twoway" N(e));
 #if HAS_CURVED_ATC_ROUTE
-					for (vector<pair<Point2, bool> >::const_iterator s = e->shape.begin(); s != e->shape.end(); ++s)
-						fprintf(fi, "%d" LLFMT2 CRLF, (s->second && has_atc3) ? apt_taxi_control : apt_taxi_shape, s->first.y(), s->first.x());
+				for (vector<pair<Point2, bool> >::const_iterator s = e->shape.begin(); s != e->shape.end(); ++s)
+					fprintf(fi, "%d" LLFMT2 CRLF, (s->second && has_atc3) ? apt_taxi_control : apt_taxi_shape, s->first.y(), s->first.x());
 #else
-					for (vector<pair<Point2, bool> >::const_iterator s = e->shape.begin(); s != e->shape.end(); ++s)
-						fprintf(fi, "%d" LLFMT2 CRLF, apt_taxi_shape, s->first.y(), s->first.x());
+				for (vector<pair<Point2, bool> >::const_iterator s = e->shape.begin(); s != e->shape.end(); ++s)
+					fprintf(fi, "%d" LLFMT2 CRLF, apt_taxi_shape, s->first.y(), s->first.x());
 #endif
-				}
 			}
+		}
 
-			int num_service_truck_pieces = apt->truck_parking.size() + apt->truck_destinations.size();
+		int num_service_truck_pieces = apt->truck_parking.size() + apt->truck_destinations.size();
 
-			if (num_service_truck_pieces > 0)
+		if (num_service_truck_pieces > 0)
+		{
+			if (has_atc3)
 			{
-				if (has_atc3)
+				for (auto trk = apt->truck_parking.cbegin(); trk != apt->truck_parking.cend(); ++trk )
 				{
-					for (auto trk = apt->truck_parking.cbegin(); trk != apt->truck_parking.cend(); ++trk )
-					{
-						//Don't export car count unless our type is baggage_train
-						int car_count = trk->parking_type == apt_truck_baggage_train ? trk->train_car_count : 0;
-
-						fprintf(fi, "%d" LLFMT2 " %.1f %s %d" NFMT CRLF,
-							apt_truck_parking, trk->location.y_, trk->location.x_, trk->heading,
-							truck_type_strings[trk->parking_type], car_count N(trk));
-						if(version >= 1200 && !trk->vpath.empty())
-							fprintf(fi, "%d %s" CRLF,
-								apt_truck_custom, trk->vpath.c_str());
-					}
+					//Don't export car count unless our type is baggage_train
+					int car_count = trk->parking_type == apt_truck_baggage_train ? trk->train_car_count : 0;
+
+					fprintf(fi, "%d" LLFMT2 " %.1f %s %d" NFMT CRLF,
+						apt_truck_parking, trk->location.y_, trk->location.x_, trk->heading,
+						truck_type_strings[trk->parking_type], car_count N(trk));
+					if(version >= 1200 && !trk->vpath.empty())
+						fprintf(fi, "%d %s" CRLF,
+							apt_truck_custom, trk->vpath.c_str());
 				}
+			}
 
-				if (has_atc3)
+			if (has_atc3)
+			{
+				for (AptTruckDestinationVector::const_iterator dst = apt->truck_destinations.begin(); dst != apt->truck_destinations.end(); ++dst)
 				{
-					for (AptTruckDestinationVector::const_iterator dst = apt->truck_destinations.begin(); dst != apt->truck_destinations.end(); ++dst)
-					{
-						fprintf(fi, "%d" LLFMT2 " %.1f ",
-							apt_truck_destination, dst->location.y_, dst->location.x_, dst->heading);
+					fprintf(fi, "%d" LLFMT2 " %.1f ",
+						apt_truck_destination, dst->location.y_, dst->location.x_, dst->heading);
 
-						for (set<int>::const_iterator tt = dst->truck_types.begin(); tt != dst->truck_types.end(); ++tt)
-						{
-							fprintf(fi, tt == dst->truck_types.begin() ? "%s" : "|%s",
-								truck_type_strings[*tt]);
-						}
-						fprintf(fi, NFMT CRLF N(dst));
+					for (set<int>::const_iterator tt = dst->truck_types.begin(); tt != dst->truck_types.end(); ++tt)
+					{
+						fprintf(fi, tt == dst->truck_types.begin() ? "%s" : "|%s",
+							truck_type_strings[*tt]);
 					}
+					fprintf(fi, NFMT CRLF N(dst));
 				}
 			}
-
-			if(version >= 1200)
-				for (auto const& jetway : apt->jetways)
-				{
-					fprintf(fi, "%d" LLFMT " %4.1f %d %d %.1f %4.2f %.1f" CRLF,
-						apt_jetway, jetway.location.y(), jetway.location.x(), jetway.install_heading,
-						jetway.style_code, jetway.size_code, jetway.parked_tunnel_heading,
-						jetway.parked_tunnel_length, jetway.parked_cab_heading);
-					if (!jetway.vpath.empty())
-						fprintf(fi, "%d %s" CRLF,
-							apt_jetway_custom, jetway.vpath.c_str());
-				}
 		}
+
+		if(version >= 1200)
+			for (auto const& jetway : apt->jetways)
+			{
+				fprintf(fi, "%d" LLFMT " %4.1f %d %d %.1f %4.2f %.1f" CRLF,
+					apt_jetway, jetway.location.y(), jetway.location.x(), jetway.install_heading,
+					jetway.style_code, jetway.size_code, jetway.parked_tunnel_heading,
+					jetway.parked_tunnel_length, jetway.parked_cab_heading);
+				if (!jetway.vpath.empty())
+					fprintf(fi, "%d %s" CRLF,
+						apt_jetway_custom, jetway.vpath.c_str());
+			}
 	}
+}
+
+void	WriteAptFileFooter(int (* fprintf)(void * fi, const char * fmt, ...), void * fi)
+{
 	fprintf(fi, "%d" CRLF, apt_done);
+}
+
+bool	WriteAptFileProcs(int (* fprintf)(void * fi, const char * fmt, ...), void * fi, const AptVector& inApts, int version)
+{
+	WriteAptFileHeader(fprintf, fi, version);
+	for (AptVector::const_iterator apt = inApts.begin(); apt != inApts.end(); ++apt)
+		WriteAptFileAirport(fprintf, fi, *apt, version);
+	WriteAptFileFooter(fprintf, fi);
 	return true;
 }
 
+static int	string_printf(void * ref, const char * fmt, ...)
+{
+	string * s = (string *) ref;
+	char buf[1024];
+	va_list args, args2;
+	va_start(args, fmt);
+	va_copy(args2, args);
+	int n = vsnprintf(buf, sizeof(buf), fmt, args);
+	if (n >= (int) sizeof(buf))
+	{
+		size_t old_size = s->size();
+		s->resize(old_size + n + 1);
+		vsnprintf(&(*s)[old_size], n + 1, fmt, args2);
+		s->resize(old_size + n);
+	}
+	else if (n > 0)
+		s->append(buf, n);
+	va_end(args2);
+	va_end(args);
+	return n;
+}
+
+AptFileWriter::AptFileWriter(int (* print_func)(void *, const char *, ...), void * ref, int version, int threads) :
+	m_print(print_func), m_ref(ref), m_version(version), m_quit(false)
+{
+	WriteAptFileHeader(m_print, m_ref, m_version);
+	for (int i = 0; i < threads; ++i)
+		m_threads.push_back(thread(&AptFileWriter::worker, this));
+}
+
+AptFileWriter::~AptFileWriter()
+{
+	flush(true);
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_work.notify_all();
+	for (auto& t : m_threads)
+		t.join();
+	WriteAptFileFooter(m_print, m_ref);
+}
+
+void	AptFileWriter::write(AptInfo_t&& apt)
+{
+	if (m_threads.empty())
+	{
+		WriteAptFileAirport(m_print, m_ref, apt, m_version);
+		return;
+	}
+	slot_t * s = new slot_t;
+	s->apt = std::move(apt);
+	s->done = false;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_out.push_back(s);
+		m_todo.push_back(s);
+	}
+	m_work.notify_one();
+	flush(false);
+}
+
+// Writes out what is done, in order. Unless all, only waits if too many airports are pending.
+void	AptFileWriter::flush(bool all)
+{
+	while (1)
+	{
+		slot_t * s;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			if (m_out.empty()) return;
+			if (!m_out.front()->done)
+			{
+				if (!all && m_out.size() < 4 * m_threads.size()) return;
+				m_done.wait(lock, [this] { return m_out.front()->done; });
+			}
+			s = m_out.front();
+			m_out.pop_front();
+		}
+		m_print(m_ref, "%s", s->text.c_str());
+		delete s;
+	}
+}
+
+void	AptFileWriter::worker()
+{
+	unique_lock<mutex> lock(m_mutex);
+	while (1)
+	{
+		m_work.wait(lock, [this] { return m_quit || !m_todo.empty(); });
+		if (m_todo.empty())
+			return;
+		slot_t * s = m_todo.front();
+		m_todo.pop_front();
+		lock.unlock();
+		WriteAptFileAirport(string_printf, &s->text, s->apt, m_version);
+		s->apt = AptInfo_t();
+		lock.lock();
+		s->done = true;
+		m_done.notify_all();
+	}
+}
+
 
 #if OPENGL_MAP
 
@@ -2034,3 +2151,144 @@ bool	CheckATCRouting(const AptInfo_t& io_apt)
 
 	return true;
 }
+
+#if UNIT_TEST
+#include "PerfUtils.h"
+#include <sys/resource.h>
+
+// A made up airport, most are small - every tenth is a big one with lots of taxiways, markings, routing and gates.
+static void	MakeTestAirport(int n, AptInfo_t& apt)
+{
+	srand(n);
+	bool big = n % 10 == 0;
+	Point2 c(-170.0 + (n % 340), -60.0 + (n / 340) % 120 + 0.5);
+	auto near = [&](double r) { return Point2(c.x() + r * (rand() / (double) RAND_MAX - 0.5), c.y() + r * (rand() / (double) RAND_MAX - 0.5)); };
+
+	apt = AptInfo_t();
+	apt.kind_code = apt_airport;
+	apt.icao = "X" + to_string(n);
+	apt.name = "Test Airport " + to_string(n);
+	apt.elevation_ft = n % 5000;
+	apt.meta_data.push_back(make_pair(string("city"), string("Some City")));
+	apt.meta_data.push_back(make_pair(string("country"), string("Some Country")));
+	apt.meta_data.push_back(make_pair(string("icao_code"), apt.icao));
+	apt.tower.draw_obj = -1;
+
+	for (int i = 0; i < (big ? 3 : 1); ++i)
+	{
+		AptRunway_t r = AptRunway_t();
+		r.ends = Segment2(near(0.02), near(0.02));
+		r.width_mtr = 45;
+		r.surf_code = 1;
+		r.id[0] = "09";
+		r.id[1] = "27";
+		apt.runways.push_back(r);
+	}
+	for (int i = 0; i < (big ? 60 : 3); ++i)
+	{
+		AptTaxiway_t t = AptTaxiway_t();
+		t.surface_code = 1;
+		Point2 o = near(0.02);
+		for (int k = 0; k < 8; ++k)
+		{
+			AptLinearSegment_t s;
+			s.code = k == 7 ? apt_rng_seg : (k % 3 ? apt_lin_seg : apt_lin_crv);
+			s.pt = Point2(o.x() + 0.001 * cos(k * 0.8), o.y() + 0.001 * sin(k * 0.8));
+			s.ctrl = Point2(s.pt.x() + 0.0002, s.pt.y());
+			if (k % 2) s.attributes.insert(1 + k % 3);
+			t.area.push_back(s);
+		}
+		apt.taxiways.push_back(t);
+	}
+	for (int i = 0; i < (big ? 80 : 4); ++i)
+	{
+		AptMarking_t m;
+		Point2 o = near(0.02);
+		for (int k = 0; k < 10; ++k)
+		{
+			AptLinearSegment_t s;
+			s.code = k == 9 ? apt_end_seg : apt_lin_seg;
+			s.pt = Point2(o.x() + 0.0001 * k, o.y() + 0.00005 * k);
+			s.ctrl = s.pt;
+			s.attributes.insert(1);
+			m.area.push_back(s);
+		}
+		apt.lines.push_back(m);
+	}
+	int nodes = big ? 200 : 10;
+	apt.taxi_route.name = apt.icao;
+	for (int i = 0; i < nodes; ++i)
+		apt.taxi_route.nodes.push_back({ "", i, near(0.02) });
+	for (int i = 0; i < nodes * 5 / 4; ++i)
+	{
+		AptRouteEdge_t e;
+		e.src = i % nodes;
+		e.dst = (i * 7 + 1) % nodes;
+		e.oneway = i % 2;
+		e.runway = 0;
+		e.width = 3;
+		e.name = "A" + to_string(i % 10);
+		if (i % 4 == 0) e.shape.push_back(make_pair(near(0.02), true));
+		apt.taxi_route.edges.push_back(e);
+	}
+	for (int i = 0; i < (big ? 40 : 2); ++i)
+	{
+		AptGate_t g = AptGate_t();
+		g.location = near(0.02);
+		g.heading = i * 10.0;
+		g.type = atc_ramp_gate;
+		g.equipment = atc_traffic_jets | atc_traffic_heavies;
+		g.width = 3;
+		g.name = "Gate " + to_string(i);
+		apt.gates.push_back(g);
+	}
+}
+
+// Memory and time to write a big apt.dat: collecting all airports in an AptVector before writing them, like exports used to, vs.
+// streaming them through AptFileWriter one at a time - on this thread or formatted by worker threads. Making up the airports
+// stands in for converting them from a WED document. Run one mode per process, to see the peak memory of each.
+//	usage: all|stream|<threads> <output file> [airports]
+int main(int argc, const char * argv[])
+{
+	if (argc < 3)
+	{
+		printf("usage: all|stream|<threads> <output file> [airports]\n");
+		return 1;
+	}
+	int count = argc > 3 ? atoi(argv[3]) : 35000;
+	FILE * fi = fopen(argv[2], "wb");
+	if (!fi) return 1;
+
+	unsigned long long t0 = query_hpc();
+	if (strcmp(argv[1], "all") == 0)
+	{
+		AptVector apts(count);
+		for (int n = 0; n < count; ++n)
+			MakeTestAirport(n, apts[n]);
+		WriteAptFileOpen(fi, apts, LATEST_APT_VERSION);
+	}
+	else
+	{
+		AptFileWriter out((int (*)(void *, const char *, ...)) fprintf, fi, LATEST_APT_VERSION, atoi(argv[1]));
+		AptInfo_t apt;
+		for (int n = 0; n < count; ++n)
+		{
+			MakeTestAirport(n, apt);
+			out.write(std::move(apt));
+		}
+	}
+	long size = ftell(fi);
+	fclose(fi);
+	double secs = hpc_to_microseconds(query_hpc() - t0) / 1000000.0;
+
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+#if APL
+	long peak_mb = ru.ru_maxrss >> 20;       // bytes on macOS, kilobytes elsewhere
+#else
+	long peak_mb = ru.ru_maxrss >> 10;
+#endif
+	printf("%s: %d airports, %ld MB written in %.2lf s, peak memory %ld MB.\n", argv[1], count, size >> 20, secs, peak_mb);
+	return 0;
+}
+#endif
@@ -28,6 +28,10 @@ struct XAtomContainer;
 
 #include "AptDefs.h"
 #include <set>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #define LATEST_APT_VERSION 1200
 
@@ -40,6 +44,43 @@ bool	WriteAptFile(const char * inFileName, const AptVector& outApts, int version
 bool	WriteAptFileOpen(FILE * inFile, const AptVector& outApts, int version);
 bool	WriteAptFileProcs(int (* print_func)(void *, const char *, ...), void * ref, const AptVector& outApts, int version);
 
+// The same in pieces - the header, each airport, then the footer - for writers that don't want all airports in memory at once.
+void	WriteAptFileHeader(int (* print_func)(void *, const char *, ...), void * ref, int version);
+void	WriteAptFileAirport(int (* print_func)(void *, const char *, ...), void * ref, const AptInfo_t& apt, int version);
+void	WriteAptFileFooter(int (* print_func)(void *, const char *, ...), void * ref);
+
+// Writes airports as they are handed in, so only a few are ever held in memory. With threads, the airports are formatted on
+// worker threads and the text still goes out in the order they came in, always through print_func on the calling thread.
+// The footer is written when the writer is destroyed.
+class AptFileWriter {
+public:
+			 AptFileWriter(int (* print_func)(void *, const char *, ...), void * ref, int version, int threads = 0);
+			~AptFileWriter();
+
+	void	write(AptInfo_t&& apt);
+
+private:
+	struct slot_t {
+		AptInfo_t	apt;
+		string		text;
+		bool		done;
+	};
+
+	void	worker();
+	void	flush(bool all);
+
+	int (*				m_print)(void *, const char *, ...);
+	void *				m_ref;
+	int					m_version;
+	vector<thread>		m_threads;
+	mutex				m_mutex;
+	condition_variable	m_work;
+	condition_variable	m_done;
+	deque<slot_t *>		m_out;				// in the order the airports came in
+	deque<slot_t *>		m_todo;
+	bool				m_quit;
+};
+
 // Convert 810 to 850 layout
 void	ConvertForward(AptInfo_t& io_apt);
 
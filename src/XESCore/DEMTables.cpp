@@ -25,7 +25,10 @@
 #include "EnumSystem.h"
 #include "DEMDefs.h"
 #include "Zoning.h"
+#include "PerfUtils.h"
 #include <ctype.h>
+#include <float.h>
+#include <math.h>
 //#include "CoverageFinder.h"
 
 // Sergio's rule spreadsheets from v8/v9 used an older syntax.  Andras has since normalized the syntax 
@@ -222,6 +225,7 @@ static void 	AddRuleInfoPair(NaturalTerrainRule_t& rule, NaturalTerrainInfo_t& i
 	}
 	
 	gNaturalTerrainRules.push_back(rule);
+	NaturalTerrainRulesChanged();
 }
 
 bool HandleFlags(const vector<string>& tokens, void * ref)
@@ -341,6 +345,7 @@ bool	ReadNewTerrainInfo(const vector<string>& tokens, void * ref)
 			rule.landuse = *lu;
 			gNaturalTerrainRules.push_back(rule);
 		}
+		NaturalTerrainRulesChanged();
 		return true;
 	}
 	else if(tokens[0] == "CLIFF_INFO")
@@ -910,6 +915,7 @@ void	LoadDEMTables(void)
 	gColorBands.clear();
 	gEnumDEMs.clear();
 	gNaturalTerrainRules.clear();
+	NaturalTerrainRulesChanged();
 	gNaturalTerrainInfo.clear();
 	gRegionalizations.clear();
 	gBeachInfoTable.clear();
@@ -967,6 +973,8 @@ void	LoadDEMTables(void)
 		sAirports[gNaturalTerrainRules[n].name] = line_type;
 	}
 
+	CompileNaturalTerrainRules();
+
 	/*
 	printf("---forests---\n");
 	for (set<int>::iterator f = sForests.begin(); f != sForests.end(); ++f)
@@ -977,6 +985,260 @@ void	LoadDEMTables(void)
 
 #pragma mark -
 
+/************************************************************************
+ * NATURAL TERRAIN RULE INDEX
+ ************************************************************************
+
+	FindNaturalTerrain used to test every rule in order until one matched.  Instead we compile the rule vector into
+	buckets keyed by terrain and landuse - the two enums that split the table best - each holding only the rules that
+	can match that combination, in rule order.  Within a bucket we further partition on one float input, picking the one
+	that leaves the fewest candidates per slot: the rule endpoints on that axis cut the line into slots (below the first
+	endpoint, exactly on an endpoint, between two endpoints, above the last) and each slot lists the rules whose range
+	covers it.  A lookup then runs the full rule test on that short list only.  Since every list is a superset of the
+	matching rules, kept in the original order, the first match is always the same as with the linear scan.
+
+	The index remembers the rule generation it was built from.  Anything that loads or edits gNaturalTerrainRules bumps
+	the generation with NaturalTerrainRulesChanged; until CompileNaturalTerrainRules catches up, FindNaturalTerrain falls
+	back to the linear scan.  Compiling when the index is already current does nothing, so callers about to do a lot of
+	lookups can simply call it.
+*/
+
+struct	terrain_query_t {
+	int		terrain, zoning, landuse, soil_style, agri_style, clim_style;
+	float	slope, slope_tri, temp, temp_rng, rain;
+	int		water;
+	float	slopeheading, relelevation, elevrange, urban_density, urban_radial, urban_trans;
+	int		urban_square;
+	float	lat;
+};
+
+static inline bool	rule_matches(const NaturalTerrainRule_t& rec, const terrain_query_t& q)
+{
+//	float slope_to_use = rec.proj_angle == proj_Down ? q.slope : q.slope_tri;
+	float slope_to_use = q.slope_tri;
+
+	#define MATCH_RANGE(x,vmin,vmax)	if(!(rec.vmin == rec.vmax || (rec.vmin <= x && x <= rec.vmax))) return false;
+	#define MATCH_ENUM(x,field)			if(!(rec.field == NO_VALUE || x == rec.field)) return false;
+
+	MATCH_RANGE(q.temp,temp_min,temp_max)
+	MATCH_RANGE(slope_to_use,slope_min,slope_max)
+	MATCH_RANGE(q.rain,rain_min,rain_max)
+	MATCH_RANGE(q.temp_rng,temp_rng_min,temp_rng_max)
+	MATCH_RANGE(q.slopeheading,slope_heading_min,slope_heading_max)
+//	if (rec.variant == 0 || rec.variant == variant_blob || rec.variant == variant_head)
+	MATCH_ENUM(q.landuse,landuse)
+	MATCH_ENUM(q.soil_style,soil_style)
+	MATCH_ENUM(q.agri_style,agri_style)
+	MATCH_ENUM(q.clim_style,clim_style)
+	MATCH_ENUM(q.terrain,terrain)
+	MATCH_ENUM(q.zoning,zoning)
+	MATCH_RANGE(q.relelevation,rel_elev_min,rel_elev_max)
+	MATCH_RANGE(q.elevrange,elev_range_min,elev_range_max)
+	MATCH_RANGE(q.urban_density,urban_density_min,urban_density_max)
+	MATCH_RANGE(q.urban_trans,urban_trans_min,urban_trans_max)
+	if (!(rec.urban_square == 0 || q.urban_square == DEM_NO_DATA || rec.urban_square == q.urban_square)) return false;
+	MATCH_RANGE(q.lat,lat_min,lat_max)
+	if (!(!rec.near_water || q.water)) return false;
+	MATCH_RANGE(q.urban_radial,urban_radial_min,urban_radial_max)
+
+	#undef MATCH_RANGE
+	#undef MATCH_ENUM
+	return true;
+}
+
+struct	rule_axis_t {
+	float NaturalTerrainRule_t::*	vmin;
+	float NaturalTerrainRule_t::*	vmax;
+	float terrain_query_t::*		value;
+};
+
+static const rule_axis_t	kRuleAxes[] = {
+	{ &NaturalTerrainRule_t::temp_min,			&NaturalTerrainRule_t::temp_max,			&terrain_query_t::temp			},
+	{ &NaturalTerrainRule_t::slope_min,			&NaturalTerrainRule_t::slope_max,			&terrain_query_t::slope_tri		},
+	{ &NaturalTerrainRule_t::rain_min,			&NaturalTerrainRule_t::rain_max,			&terrain_query_t::rain			},
+	{ &NaturalTerrainRule_t::temp_rng_min,		&NaturalTerrainRule_t::temp_rng_max,		&terrain_query_t::temp_rng		},
+	{ &NaturalTerrainRule_t::slope_heading_min,	&NaturalTerrainRule_t::slope_heading_max,	&terrain_query_t::slopeheading	},
+	{ &NaturalTerrainRule_t::rel_elev_min,		&NaturalTerrainRule_t::rel_elev_max,		&terrain_query_t::relelevation	},
+	{ &NaturalTerrainRule_t::elev_range_min,	&NaturalTerrainRule_t::elev_range_max,		&terrain_query_t::elevrange		},
+	{ &NaturalTerrainRule_t::urban_density_min,	&NaturalTerrainRule_t::urban_density_max,	&terrain_query_t::urban_density	},
+	{ &NaturalTerrainRule_t::urban_radial_min,	&NaturalTerrainRule_t::urban_radial_max,	&terrain_query_t::urban_radial	},
+	{ &NaturalTerrainRule_t::urban_trans_min,	&NaturalTerrainRule_t::urban_trans_max,		&terrain_query_t::urban_trans	},
+	{ &NaturalTerrainRule_t::lat_min,			&NaturalTerrainRule_t::lat_max,				&terrain_query_t::lat			}
+};
+#define NUM_RULE_AXES	(sizeof(kRuleAxes) / sizeof(kRuleAxes[0]))
+
+// A partition may hold at most this many times the entries of the unpartitioned bucket.
+#define MAX_SLOT_BLOWUP	32
+
+struct	rule_bucket_t {
+	int					axis;		// into kRuleAxes, -1 = not partitioned
+	vector<float>		breaks;		// sorted rule endpoints on that axis
+	vector<vector<int> >slots;		// 2 * breaks + 1 candidate lists
+	vector<int>			rules;		// all candidates
+};
+
+struct	rule_index_t {
+	int								built_generation;	// -1 = never built
+	hash_map<int, int>				terrain_key;	// enum -> key, everything else is key n_terrain
+	hash_map<int, int>				landuse_key;
+	int								n_terrain;
+	int								n_landuse;
+	vector<rule_bucket_t>			buckets;		// n_terrain+1 x n_landuse+1
+};
+
+static rule_index_t	sRuleIndex = { -1 };
+static int			sRulesGeneration = 0;
+
+void	NaturalTerrainRulesChanged(void)
+{
+	++sRulesGeneration;
+}
+
+// Slot of x among the breaks: 0 = below the first, 2i+1 = on break i, 2i+2 = between break i and i+1 or above the last.
+static inline int	rule_slot(const vector<float>& breaks, float x)
+{
+	vector<float>::const_iterator i = lower_bound(breaks.begin(), breaks.end(), x);
+	int n = i - breaks.begin();
+	return (i != breaks.end() && *i == x) ? 2 * n + 1 : 2 * n;
+}
+
+static void	partition_bucket(rule_bucket_t& b)
+{
+	b.axis = -1;
+	size_t best_entries = b.rules.size() * MAX_SLOT_BLOWUP;
+	double best_avg = b.rules.size();
+	if (b.rules.size() < 8) return;
+
+	for (int a = 0; a < NUM_RULE_AXES; ++a)
+	{
+		const rule_axis_t& ax(kRuleAxes[a]);
+		vector<float> breaks;
+		for (vector<int>::iterator r = b.rules.begin(); r != b.rules.end(); ++r)
+		{
+			const NaturalTerrainRule_t& rec(gNaturalTerrainRules[*r]);
+			if (rec.*ax.vmin != rec.*ax.vmax)
+			{
+				breaks.push_back(rec.*ax.vmin);
+				breaks.push_back(rec.*ax.vmax);
+			}
+		}
+		if (breaks.empty()) continue;
+		sort(breaks.begin(), breaks.end());
+		breaks.erase(unique(breaks.begin(), breaks.end()), breaks.end());
+
+		// Every rule lands in the slots from its min endpoint to its max endpoint, wildcards in all of them.
+		int num_slots = 2 * breaks.size() + 1;
+		size_t entries = 0;
+		for (vector<int>::iterator r = b.rules.begin(); r != b.rules.end(); ++r)
+		{
+			const NaturalTerrainRule_t& rec(gNaturalTerrainRules[*r]);
+			if (rec.*ax.vmin == rec.*ax.vmax)
+				entries += num_slots;
+			else if (rec.*ax.vmin <= rec.*ax.vmax)
+				entries += rule_slot(breaks, rec.*ax.vmax) - rule_slot(breaks, rec.*ax.vmin) + 1;
+		}
+		double avg = (double) entries / num_slots;
+		if (avg < best_avg && entries <= best_entries)
+		{
+			best_avg = avg;
+			b.axis = a;
+			b.breaks.swap(breaks);
+		}
+	}
+	if (b.axis < 0 || best_avg > 0.75 * b.rules.size())		// not worth it
+	{
+		b.axis = -1;
+		b.breaks.clear();
+		return;
+	}
+
+	const rule_axis_t& ax(kRuleAxes[b.axis]);
+	b.slots.resize(2 * b.breaks.size() + 1);
+	for (vector<int>::iterator r = b.rules.begin(); r != b.rules.end(); ++r)
+	{
+		const NaturalTerrainRule_t& rec(gNaturalTerrainRules[*r]);
+		int s1 = 0, s2 = b.slots.size() - 1;
+		if (rec.*ax.vmin != rec.*ax.vmax)
+		{
+			if (rec.*ax.vmin > rec.*ax.vmax) continue;			// can never match
+			s1 = rule_slot(b.breaks, rec.*ax.vmin);
+			s2 = rule_slot(b.breaks, rec.*ax.vmax);
+		}
+		for (int s = s1; s <= s2; ++s)
+			b.slots[s].push_back(*r);
+	}
+}
+
+void	CompileNaturalTerrainRules(void)
+{
+	if (sRuleIndex.built_generation == sRulesGeneration)
+		return;
+
+	rule_index_t idx;
+	idx.n_terrain = idx.n_landuse = 0;
+	for (NaturalTerrainRuleVector::iterator r = gNaturalTerrainRules.begin(); r != gNaturalTerrainRules.end(); ++r)
+	{
+		if (r->terrain != NO_VALUE && idx.terrain_key.count(r->terrain) == 0)
+			idx.terrain_key[r->terrain] = idx.n_terrain++;
+		if (r->landuse != NO_VALUE && idx.landuse_key.count(r->landuse) == 0)
+			idx.landuse_key[r->landuse] = idx.n_landuse++;
+	}
+
+	// Key n_terrain/n_landuse stands for any value no rule names, NO_VALUE included - only wildcard rules match those.
+	vector<int>	terrain_of_key(idx.n_terrain + 1, NO_VALUE), landuse_of_key(idx.n_landuse + 1, NO_VALUE);
+	for (hash_map<int,int>::iterator k = idx.terrain_key.begin(); k != idx.terrain_key.end(); ++k)
+		terrain_of_key[k->second] = k->first;
+	for (hash_map<int,int>::iterator k = idx.landuse_key.begin(); k != idx.landuse_key.end(); ++k)
+		landuse_of_key[k->second] = k->first;
+
+	idx.buckets.resize((idx.n_terrain + 1) * (idx.n_landuse + 1));
+	for (int t = 0; t <= idx.n_terrain; ++t)
+	for (int l = 0; l <= idx.n_landuse; ++l)
+	{
+		rule_bucket_t& b(idx.buckets[t * (idx.n_landuse + 1) + l]);
+		for (int n = 0; n < gNaturalTerrainRules.size(); ++n)
+		{
+			const NaturalTerrainRule_t& rec(gNaturalTerrainRules[n]);
+			if ((rec.terrain == NO_VALUE || rec.terrain == terrain_of_key[t]) &&
+				(rec.landuse == NO_VALUE || rec.landuse == landuse_of_key[l]))
+				b.rules.push_back(n);
+		}
+		partition_bucket(b);
+	}
+
+	idx.built_generation = sRulesGeneration;
+	swap(sRuleIndex, idx);
+}
+
+static int	find_rule_linear(const terrain_query_t& q)
+{
+	for (int rec_num = 0; rec_num < gNaturalTerrainRules.size(); ++rec_num)
+		if (rule_matches(gNaturalTerrainRules[rec_num], q))
+			return rec_num;
+	return -1;
+}
+
+static int	find_rule_indexed(const terrain_query_t& q)
+{
+	hash_map<int,int>::const_iterator t = sRuleIndex.terrain_key.find(q.terrain);
+	hash_map<int,int>::const_iterator l = sRuleIndex.landuse_key.find(q.landuse);
+	int tk = t == sRuleIndex.terrain_key.end() ? sRuleIndex.n_terrain : t->second;
+	int lk = l == sRuleIndex.landuse_key.end() ? sRuleIndex.n_landuse : l->second;
+	const rule_bucket_t& b(sRuleIndex.buckets[tk * (sRuleIndex.n_landuse + 1) + lk]);
+
+	const vector<int> * cand = &b.rules;
+	if (b.axis >= 0)
+	{
+		float x = q.*kRuleAxes[b.axis].value;
+		if (x == x)													// NaN has no slot - check everything
+			cand = &b.slots[rule_slot(b.breaks, x)];
+	}
+	for (vector<int>::const_iterator r = cand->begin(); r != cand->end(); ++r)
+		if (rule_matches(gNaturalTerrainRules[*r], q))
+			return *r;
+	return -1;
+}
+
 int	FindNaturalTerrain(
 				int		terrain,
 				int		zoning,
@@ -1018,44 +1280,84 @@ int	FindNaturalTerrain(
 	DebugAssert(DEM_NO_DATA != 	urban_trans);
 	DebugAssert(DEM_NO_DATA != 	lat);
 
-	// OPTIMIZE - figure out what the major keys should be.
+	terrain_query_t q = { terrain, zoning, landuse, soil_style, agri_style, clim_style, slope, slope_tri, temp, temp_rng, rain,
+						  water, slopeheading, relelevation, elevrange, urban_density, urban_radial, urban_trans, urban_square, lat };
 
-	for (int rec_num = 0; rec_num < gNaturalTerrainRules.size(); ++rec_num)
+	int rec_num;
+	if (sRuleIndex.built_generation == sRulesGeneration)
+		rec_num = find_rule_indexed(q);
+	else
+		rec_num = find_rule_linear(q);
+	return rec_num < 0 ? -1 : gNaturalTerrainRules[rec_num].name;
+}
+
+// Probes the index with queries built around every rule: each float input at and just beyond the rule's endpoints and
+// at its midpoint, with the enums set to the rule's values and to values no rule names.  These hit every slot boundary
+// the index can have.  Returns the number of queries where the index and the linear scan disagree.
+int	CheckNaturalTerrainRules(void)
+{
+	CompileNaturalTerrainRules();
+
+	vector<terrain_query_t>	probes;
+	for (NaturalTerrainRuleVector::iterator r = gNaturalTerrainRules.begin(); r != gNaturalTerrainRules.end(); ++r)
 	{
-		NaturalTerrainRule_t& rec = gNaturalTerrainRules[rec_num];
+		terrain_query_t base = { r->terrain, r->zoning, r->landuse, r->soil_style, r->agri_style, r->clim_style, 0, 0, 0, 0, 0,
+								 r->near_water, 0, 0, 0, 0, 0, 0, r->urban_square, 0 };
+		for (int a = 0; a < NUM_RULE_AXES; ++a)
+			if ((*r).*kRuleAxes[a].vmin != (*r).*kRuleAxes[a].vmax)
+				base.*kRuleAxes[a].value = ((*r).*kRuleAxes[a].vmin + (*r).*kRuleAxes[a].vmax) * 0.5f;
+		base.slope = base.slope_tri;
+
+		for (int e = 0; e < 4; ++e)
+		{
+			terrain_query_t q(base);
+			if (e & 1) q.terrain = NO_VALUE;
+			if (e & 2) q.landuse = NO_VALUE;
+			probes.push_back(q);
+			for (int a = 0; a < NUM_RULE_AXES; ++a)
+			{
+				float vals[5] = { (*r).*kRuleAxes[a].vmin, (*r).*kRuleAxes[a].vmax,
+								  nextafterf((*r).*kRuleAxes[a].vmin, -FLT_MAX), nextafterf((*r).*kRuleAxes[a].vmax, FLT_MAX), 0.0f };
+				for (int v = 0; v < 5; ++v)
+				{
+					terrain_query_t p(q);
+					p.*kRuleAxes[a].value = vals[v];
+					probes.push_back(p);
+				}
+			}
+		}
+	}
 
-//		float slope_to_use = rec.proj_angle == proj_Down ? slope : slope_tri;
-		float slope_to_use = slope_tri;
-		
-		#define MATCH_RANGE(x,vmin,vmax)	if(rec.vmin == rec.vmax || (rec.vmin <= x && x <= rec.vmax))
-		#define MATCH_ENUM(x,field) if(rec.field == NO_VALUE || x == rec.field)
-		
-		MATCH_RANGE(temp,temp_min,temp_max)
-		MATCH_RANGE(slope_to_use,slope_min,slope_max)
-		MATCH_RANGE(rain,rain_min,rain_max)
-		MATCH_RANGE(temp_rng,temp_rng_min,temp_rng_max)
-		MATCH_RANGE(slopeheading,slope_heading_min,slope_heading_max)
-//		if (rec.variant == 0 || rec.variant == variant_blob || rec.variant == variant_head)
-		MATCH_ENUM(landuse,landuse)
-		MATCH_ENUM(soil_style,soil_style)
-		MATCH_ENUM(agri_style,agri_style)
-		MATCH_ENUM(clim_style,clim_style)
-		MATCH_ENUM(terrain,terrain)
-		MATCH_ENUM(zoning,zoning)
-		MATCH_RANGE(relelevation,rel_elev_min,rel_elev_max)
-		MATCH_RANGE(elevrange,elev_range_min,elev_range_max)
-		MATCH_RANGE(urban_density,urban_density_min,urban_density_max)
-		MATCH_RANGE(urban_trans,urban_trans_min,urban_trans_max)
-		if (rec.urban_square == 0 || urban_square == DEM_NO_DATA || rec.urban_square == urban_square)
-		MATCH_RANGE(lat,lat_min,lat_max)
-		if (!rec.near_water || water)
-		MATCH_RANGE(urban_radial,urban_radial_min,urban_radial_max)		
+	int bad = 0;
+	for (vector<terrain_query_t>::iterator p = probes.begin(); p != probes.end(); ++p)
+	{
+		int lin = find_rule_linear(*p);
+		int idx = find_rule_indexed(*p);
+		if (lin != idx)
 		{
-			return rec.name;
+			if (bad < 20)
+				printf("Rule index mismatch: linear found rule %d, index found rule %d (ter=%s lu=%s)\n", lin, idx,
+					FetchTokenString(p->terrain), FetchTokenString(p->landuse));
+			++bad;
 		}
 	}
 
-	return -1;
+	// Throughput, both ways, over the same probes
+	int sink = 0;
+	unsigned long long t0 = query_hpc();
+	for (vector<terrain_query_t>::iterator p = probes.begin(); p != probes.end(); ++p)
+		sink += find_rule_linear(*p);
+	unsigned long long t1 = query_hpc();
+	for (vector<terrain_query_t>::iterator p = probes.begin(); p != probes.end(); ++p)
+		sink -= find_rule_indexed(*p);
+	unsigned long long t2 = query_hpc();
+	double lin_us = hpc_to_microseconds(t1 - t0), idx_us = hpc_to_microseconds(t2 - t1);
+
+	printf("Checked %llu probes against %llu rules: %d mismatches.\n", (unsigned long long) probes.size(),
+		(unsigned long long) gNaturalTerrainRules.size(), bad);
+	printf("Linear scan: %.0lf lookups/sec.  Index: %.0lf lookups/sec.  (%d)\n",
+		probes.size() / max(lin_us, 1.0) * 1e6, probes.size() / max(idx_us, 1.0) * 1e6, sink == 0 ? 0 : 1);
+	return bad;
 }
 
 #pragma mark -
@@ -1383,5 +1685,163 @@ void MakeDirectRules(void)
 		rule.name = all_names->first;
 		gNaturalTerrainRules.insert(gNaturalTerrainRules.begin(), rule);
 	}	
+	NaturalTerrainRulesChanged();
+	CompileNaturalTerrainRules();
 }
 
+
+#if UNIT_TEST
+// Checks the rule index against the linear scan over every slot it can have: made-up rules whose ranges all start and end
+// on a small grid, queried at, between and beyond every grid value (and NaN) on every axis they use, for every terrain and
+// landuse they name plus one they don't.  Then checks that compiling a current index is free and that an edit is seen,
+// and times a tile's worth of lookups both ways.
+//	usage: <rules> <tile size>
+
+#include "PerfUtils.h"
+
+ZoningInfoTable	gZoningInfo;
+
+static const float	kTestGrid[] = { -10.0f, 0.0f, 5.0f, 10.0f, 20.0f, 25.0f, 30.0f, 45.0f };
+#define TEST_GRID	(sizeof(kTestGrid) / sizeof(kTestGrid[0]))
+#define TEST_ENUMS	4
+
+// Mostly short ranges, like the real tables, so that buckets get partitioned; some wildcards and a few backwards ones.
+static void	test_range(float& vmin, float& vmax)
+{
+	int a = rand() % TEST_GRID, b = min<int>(a + rand() % 3, TEST_GRID - 1);
+	switch (rand() % 16) {
+	case 0:	case 1: case 2: case 3:
+			vmin = vmax = 0.0f;						break;	// wildcard
+	case 4:	vmin = kTestGrid[b]; vmax = kTestGrid[a];	break;	// backwards (or a single value)
+	default:vmin = kTestGrid[a]; vmax = kTestGrid[b];	break;
+	}
+}
+
+static void	test_rules(int count)
+{
+	gNaturalTerrainRules.clear();
+	for (int n = 0; n < count; ++n)
+	{
+		NaturalTerrainRule_t r;
+		memset(&r, 0, sizeof(r));
+		r.terrain = r.zoning = r.landuse = r.soil_style = r.agri_style = r.clim_style = NO_VALUE;
+		if (rand() % 4)	r.terrain = 100000 + rand() % TEST_ENUMS;
+		if (rand() % 3)	r.landuse = 200000 + rand() % TEST_ENUMS;
+		r.near_water = rand() % 8 == 0;
+		test_range(r.temp_min, r.temp_max);
+		test_range(r.slope_min, r.slope_max);
+		test_range(r.rain_min, r.rain_max);
+		test_range(r.lat_min, r.lat_max);
+		r.name = n;
+		gNaturalTerrainRules.push_back(r);
+	}
+	NaturalTerrainRulesChanged();
+}
+
+static int	test_all_slots(void)
+{
+	vector<float>	vals;
+	vals.push_back(kTestGrid[0] - 10.0f);
+	for (int g = 0; g < TEST_GRID; ++g)
+	{
+		vals.push_back(kTestGrid[g]);
+		vals.push_back(g + 1 < TEST_GRID ? (kTestGrid[g] + kTestGrid[g + 1]) * 0.5f : kTestGrid[g] + 10.0f);
+	}
+	vals.push_back(nanf(""));
+
+	int bad = 0, n = 0;
+	terrain_query_t q;
+	memset(&q, 0, sizeof(q));
+	q.zoning = q.soil_style = q.agri_style = q.clim_style = NO_VALUE;
+	for (int t = 0; t <= TEST_ENUMS; ++t)
+	for (int l = 0; l <= TEST_ENUMS; ++l)
+	for (q.water = 0; q.water < 2; ++q.water)
+	for (vector<float>::iterator temp = vals.begin(); temp != vals.end(); ++temp)
+	for (vector<float>::iterator slope = vals.begin(); slope != vals.end(); ++slope)
+	for (vector<float>::iterator rain = vals.begin(); rain != vals.end(); ++rain)
+	for (vector<float>::iterator lat = vals.begin(); lat != vals.end(); ++lat)
+	{
+		q.terrain = 100000 + t;				// t == TEST_ENUMS is one no rule names
+		q.landuse = 200000 + l;
+		q.temp = *temp;
+		q.slope = q.slope_tri = *slope;
+		q.rain = *rain;
+		q.lat = *lat;
+		int lin = find_rule_linear(q), idx = find_rule_indexed(q);
+		if (lin != idx)
+		{
+			if (bad < 10)
+				printf("  rule %d vs %d for ter=%d lu=%d water=%d temp=%f slope=%f rain=%f lat=%f\n", lin, idx,
+					q.terrain, q.landuse, q.water, q.temp, q.slope_tri, q.rain, q.lat);
+			++bad;
+		}
+		++n;
+	}
+	int partitioned = 0;
+	for (vector<rule_bucket_t>::iterator b = sRuleIndex.buckets.begin(); b != sRuleIndex.buckets.end(); ++b)
+		if (b->axis >= 0) ++partitioned;
+	printf("Checked %d queries against %llu rules in %d of %llu buckets partitioned: %d mismatches.\n", n,
+		(unsigned long long) gNaturalTerrainRules.size(), partitioned, (unsigned long long) sRuleIndex.buckets.size(), bad);
+	if (partitioned == 0)
+		++bad;
+	return bad;
+}
+
+int main(int argc, const char * argv[])
+{
+	int count = argc > 1 ? atoi(argv[1]) : 1000;
+	int tile = argc > 2 ? atoi(argv[2]) : 1201;
+	int bad = 0;
+	srand(1);
+
+	test_rules(count);
+	if (sRuleIndex.built_generation == sRulesGeneration) { printf("Loading the rules didn't invalidate the index.\n"); ++bad; }
+	CompileNaturalTerrainRules();
+	if (sRuleIndex.built_generation != sRulesGeneration) { printf("Compiling didn't bring the index up to date.\n"); ++bad; }
+	bad += test_all_slots();
+
+	const rule_bucket_t * built = sRuleIndex.buckets.data();
+	CompileNaturalTerrainRules();
+	if (sRuleIndex.buckets.data() != built) { printf("Compiling a current index rebuilt it.\n"); ++bad; }
+
+	// Edit in place - same vector, same size - and make sure the index notices.
+	for (NaturalTerrainRuleVector::iterator r = gNaturalTerrainRules.begin(); r != gNaturalTerrainRules.end(); ++r)
+		swap(r->temp_min, r->temp_max);
+	NaturalTerrainRulesChanged();
+	if (sRuleIndex.built_generation == sRulesGeneration) { printf("Editing the rules didn't invalidate the index.\n"); ++bad; }
+	CompileNaturalTerrainRules();
+	if (sRuleIndex.buckets.data() == built) { printf("Editing the rules didn't rebuild the index.\n"); ++bad; }
+	bad += test_all_slots();
+
+	// One tile of lookups, with inputs spread over the whole grid the way a real tile's DEMs would be.
+	test_rules(count);
+	CompileNaturalTerrainRules();
+	vector<terrain_query_t>	cells(tile * tile);
+	for (vector<terrain_query_t>::iterator c = cells.begin(); c != cells.end(); ++c)
+	{
+		memset(&*c, 0, sizeof(*c));
+		c->zoning = c->soil_style = c->agri_style = c->clim_style = NO_VALUE;
+		c->terrain = 100000 + rand() % TEST_ENUMS;
+		c->landuse = 200000 + rand() % (TEST_ENUMS + 1);
+		c->water = rand() % 8 == 0;
+		c->temp = -20.0f + 75.0f * rand() / RAND_MAX;
+		c->slope = c->slope_tri = -20.0f + 75.0f * rand() / RAND_MAX;
+		c->rain = -20.0f + 75.0f * rand() / RAND_MAX;
+		c->lat = -20.0f + 75.0f * rand() / RAND_MAX;
+	}
+	int sink = 0;
+	unsigned long long t0 = query_hpc();
+	for (vector<terrain_query_t>::iterator c = cells.begin(); c != cells.end(); ++c)
+		sink += find_rule_linear(*c);
+	unsigned long long t1 = query_hpc();
+	for (vector<terrain_query_t>::iterator c = cells.begin(); c != cells.end(); ++c)
+		sink -= find_rule_indexed(*c);
+	unsigned long long t2 = query_hpc();
+	if (sink != 0) { printf("Index and linear scan disagree on the tile.\n"); ++bad; }
+
+	printf("%dx%d tile, %d rules: linear scan %.0lf ms, index %.0lf ms.\n", tile, tile, count,
+		hpc_to_microseconds(t1 - t0) / 1000.0, hpc_to_microseconds(t2 - t1) / 1000.0);
+	printf(bad ? "FAILED\n" : "OK\n");
+	return bad ? 1 : 0;
+}
+#endif
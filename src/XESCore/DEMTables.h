@@ -212,6 +212,17 @@ int		FindNaturalTerrain(
 //				int		variant_blob,
 //				int		variant_head);	// use 0
 
+// Call after adding, removing or editing any of gNaturalTerrainRules.  FindNaturalTerrain uses the (correct but slow)
+// linear scan of all rules until the lookup index is compiled again.
+void	NaturalTerrainRulesChanged(void);
+
+// Builds the lookup index FindNaturalTerrain uses, unless it is already current.  LoadDEMTables and MakeDirectRules call
+// this; so does AssignLandusesToMesh, in case the rules were edited since.
+void	CompileNaturalTerrainRules(void);
+
+// Cross-checks the index against a linear scan and prints lookup throughput for both.  Returns the number of mismatches.
+int		CheckNaturalTerrainRules(void);
+
 // This routine creates a rule whereby if the "terrain" input type matches a real .ter file, we simply use it, period.
 // This allows MeshTool to allow authors to direct-select final x-plane terrain types.  This is an optional init so we 
 // don't have 500 extra rules in the table when making global scenery.
@@ -26,6 +26,9 @@
 #include "MapTopology.h"
 #include "MapHelpers.h"
 #include "GISTool_Globals.h"
+#include "MathUtils.h"
+#include <atomic>
+#include <thread>
 /******************************************************************************************************************************************************
  * OVERLAY HELPERS
  ******************************************************************************************************************************************************/
@@ -306,6 +309,453 @@ void	MapOverlay(Pmwx& bottom, Pmwx& top, Pmwx& result)
 	}
 }
 
+/******************************************************************************************************************************************************
+ * TILED OVERLAY
+ ******************************************************************************************************************************************************/
+
+/*
+	Tiled overlay: we cut both maps into vertical strips, overlay each strip on its own, then stitch the strips back into one
+	arrangement.  The strips are independent so they can run on worker threads; the cut and stitch are serial.
+
+	- Cuts are placed at x positions where NO vertex of either map sits, so every piece of an edge we make runs from a real vertex or
+	  a cut to a real vertex or a cut, and a strip never contains a vertical edge on its boundary.
+	- Each strip arrangement is the pieces of the map inside it plus a rectangular "frame" (curve key -1) that closes it off.  The frame
+	  is split where the pieces touch it.  Every piece keeps its index in a side table so we can get back to the source halfedge for
+	  the meta data; strip faces map to the original face they sit in, and the overlay traits use the ORIGINAL faces, so the strip
+	  overlay applies exactly the same rules as the big sweep.
+	- Frame edges are thrown out when we stitch; the clip vertices left on the cut lines are merged away at the end.
+
+	Lazy NT shares its representation between copies by ref count, which is not thread safe, so every coordinate that goes into a
+	strip is rebuilt from its exact value first.  Worker threads are only used when CGAL is built with thread support.
+*/
+
+#define STRIP_FRAME_KEY		-1
+#define STRIP_MIN_EDGES		5000		// Don't bother cutting maps into strips smaller than this.
+
+struct strip_piece_t {
+	Halfedge_const_handle	src;				// Source halfedge, directed left to right.
+	bool					left_vertex;		// Left end is src's source, not a cut.
+	bool					right_vertex;		// Right end is src's target, not a cut.
+};
+
+struct strip_input_t {
+	vector<X_monotone_curve_2>							curves;
+	vector<pair<Point_2, Vertex_const_handle> >			isolated;
+	Face_const_handle									only_face;		// If the strip has no pieces, the face it sits in.
+};
+
+typedef hash_map<const void *, Face_const_handle>	strip_face_map;
+
+template <class Base>
+class Arr_strip_overlay_traits : public Base {
+public:
+
+	typedef typename Base::Face_handle_A	Face_handle_A;
+	typedef typename Base::Face_handle_B	Face_handle_B;
+	typedef typename Base::Face_handle_R	Face_handle_R;
+
+	const strip_face_map *		faces_a;
+	const strip_face_map *		faces_b;
+
+	void create_face (Face_handle_A f1, Face_handle_B f2, Face_handle_R f) const override
+	{
+		typename strip_face_map::const_iterator o1 = faces_a->find(&*f1);
+		typename strip_face_map::const_iterator o2 = faces_b->find(&*f2);
+		if(o1 == faces_a->end() || o2 == faces_b->end())
+			f->set_contained(false);			// Outside the frame - never used when we stitch.
+		else
+			Base::create_face(o1->second, o2->second, f);
+	}
+};
+
+inline Point_2 strip_fresh(const Point_2& p)
+{
+	return Point_2(NT(CGAL::exact(p.x())), NT(CGAL::exact(p.y())));
+}
+
+// Which strip is x in?  x must not be ON a cut.
+static int strip_for_x(const NT& x, const vector<double>& cuts)
+{
+	int lo = 0, hi = cuts.size();
+	while(lo < hi)
+	{
+		int m = (lo + hi) / 2;
+		if(x > NT(cuts[m]))	lo = m + 1;
+		else				hi = m;
+	}
+	return lo;
+}
+
+static bool strip_on_cut(const NT& x, const vector<double>& cuts)
+{
+	double xd = CGAL::to_double(x);
+	vector<double>::const_iterator i = lower_bound(cuts.begin(), cuts.end(), xd);
+	if(i != cuts.end() && x == NT(*i)) return true;
+	if(i != cuts.begin() && x == NT(*(i-1))) return true;
+	return false;
+}
+
+// Pick up to strips-1 cut lines at vertex quantiles.  Any cut that lands exactly on a vertex is dropped.
+static void strip_pick_cuts(Pmwx& a, Pmwx& b, int strips, vector<double>& cuts, Bbox_2& bounds)
+{
+	vector<double>	xs;
+	xs.reserve(a.number_of_vertices() + b.number_of_vertices());
+	Pmwx * maps[2] = { &a, &b };
+	for(int m = 0; m < 2; ++m)
+	for(Pmwx::Vertex_iterator v = maps[m]->vertices_begin(); v != maps[m]->vertices_end(); ++v)
+	{
+		Bbox_2 vb = v->point().bbox();
+		bounds = (xs.empty() ? vb : bounds + vb);
+		xs.push_back(CGAL::to_double(v->point().x()));
+	}
+	cuts.clear();
+	if(xs.empty())
+		return;
+	sort(xs.begin(), xs.end());
+
+	for(int s = 1; s < strips; ++s)
+	{
+		int n = (int) ((long long) xs.size() * s / strips);
+		if(n < 1 || n >= xs.size() || xs[n-1] == xs[n])
+			continue;
+		double c = (xs[n-1] + xs[n]) * 0.5;
+		if(c <= xs[n-1] || c >= xs[n] || (!cuts.empty() && c <= cuts.back()))
+			continue;
+		cuts.push_back(c);
+	}
+
+	// The doubles are only approximations of the vertices - check against the real thing.
+	vector<char>	bad(cuts.size(), 0);
+	for(int m = 0; m < 2; ++m)
+	for(Pmwx::Vertex_iterator v = maps[m]->vertices_begin(); v != maps[m]->vertices_end(); ++v)
+	{
+		double xd = CGAL::to_double(v->point().x());
+		vector<double>::iterator i = lower_bound(cuts.begin(), cuts.end(), xd);
+		if(i != cuts.end() && v->point().x() == NT(*i))					bad[i - cuts.begin()] = 1;
+		if(i != cuts.begin() && v->point().x() == NT(*(i-1)))			bad[i - cuts.begin() - 1] = 1;
+	}
+	int k = 0;
+	for(int n = 0; n < cuts.size(); ++n)
+	if(!bad[n])
+		cuts[k++] = cuts[n];
+	cuts.resize(k);
+}
+
+// Cut one map into pieces by strip.  Piece indices continue from whatever is already in the piece table so that both maps can share it.
+static void strip_cut_map(Pmwx& m, const vector<double>& cuts, vector<strip_piece_t>& pieces, vector<strip_input_t>& inputs, vector<vector<NT> >& clips)
+{
+	int strips = cuts.size() + 1;
+	clips.assign(cuts.size(), vector<NT>());
+	vector<char>	has_pieces(strips, 0);
+
+	for(Pmwx::Edge_iterator e = m.edges_begin(); e != m.edges_end(); ++e)
+	{
+		Halfedge_const_handle h = Halfedge_handle(e);
+		if(h->direction() != CGAL::ARR_LEFT_TO_RIGHT)
+			h = h->twin();
+		const Point_2& p(h->source()->point());
+		const Point_2& q(h->target()->point());
+
+		int sl = strip_for_x(p.x(), cuts);
+		int sr = strip_for_x(q.x(), cuts);
+		NT	y_prev;
+		for(int s = sl; s <= sr; ++s)
+		{
+			Point_2 l = (s == sl) ? strip_fresh(p) : Point_2(NT(cuts[s-1]), NT(CGAL::exact(y_prev)));
+			Point_2 r;
+			if(s == sr)
+				r = strip_fresh(q);
+			else
+			{
+				NT x(cuts[s]);
+				y_prev = p.y() + (q.y() - p.y()) * (x - p.x()) / (q.x() - p.x());
+				r = Point_2(x, NT(CGAL::exact(y_prev)));
+				clips[s].push_back(y_prev);
+			}
+			strip_piece_t piece = { h, s == sl, s == sr };
+			inputs[s].curves.push_back(X_monotone_curve_2(Segment_2(l, r), (int) pieces.size()));
+			pieces.push_back(piece);
+			has_pieces[s] = 1;
+		}
+	}
+
+	for(Pmwx::Vertex_iterator v = m.vertices_begin(); v != m.vertices_end(); ++v)
+	if(v->is_isolated())
+		inputs[strip_for_x(v->point().x(), cuts)].isolated.push_back(pair<Point_2, Vertex_const_handle>(strip_fresh(v->point()), v));
+
+	// If no edge reaches into a strip, a vertical line through it crosses no edges at all, so the strip is in the unbounded face.
+	for(int s = 0; s < strips; ++s)
+	if(!has_pieces[s])
+		inputs[s].only_face = m.unbounded_face();
+
+	for(vector<vector<NT> >::iterator c = clips.begin(); c != clips.end(); ++c)
+	{
+		sort(c->begin(), c->end());
+		c->erase(unique(c->begin(), c->end()), c->end());
+	}
+}
+
+// Close off each strip with a rectangle, split where this map's pieces hit the cut lines.
+static void strip_add_frames(const vector<double>& cuts, const Bbox_2& frame, const vector<vector<NT> >& clips, vector<strip_input_t>& inputs)
+{
+	int strips = cuts.size() + 1;
+	for(int s = 0; s < strips; ++s)
+	{
+		double x1 = (s == 0) ? frame.xmin() : cuts[s-1];
+		double x2 = (s == strips-1) ? frame.xmax() : cuts[s];
+		vector<X_monotone_curve_2>& c(inputs[s].curves);
+
+		c.push_back(X_monotone_curve_2(Segment_2(Point_2(x1, frame.ymin()), Point_2(x2, frame.ymin())), STRIP_FRAME_KEY));
+		c.push_back(X_monotone_curve_2(Segment_2(Point_2(x1, frame.ymax()), Point_2(x2, frame.ymax())), STRIP_FRAME_KEY));
+		for(int side = 0; side < 2; ++side)
+		{
+			double x = side ? x2 : x1;
+			Point_2	last(x, frame.ymin());
+			int line = side ? s : s - 1;
+			if(line >= 0 && line < clips.size())
+			for(vector<NT>::const_iterator y = clips[line].begin(); y != clips[line].end(); ++y)
+			{
+				Point_2 next(NT(x), NT(CGAL::exact(*y)));
+				c.push_back(X_monotone_curve_2(Segment_2(last, next), STRIP_FRAME_KEY));
+				last = next;
+			}
+			c.push_back(X_monotone_curve_2(Segment_2(last, Point_2(x, frame.ymax())), STRIP_FRAME_KEY));
+		}
+	}
+}
+
+// Build one strip's arrangement and copy the meta data over from the source map.
+static void strip_build(Pmwx& out, const strip_input_t& in, const vector<strip_piece_t>& pieces, strip_face_map& faces)
+{
+	CGAL::insert_non_intersecting_curves(out, in.curves.begin(), in.curves.end());
+	for(vector<pair<Point_2, Vertex_const_handle> >::const_iterator i = in.isolated.begin(); i != in.isolated.end(); ++i)
+		CGAL::insert_point(out, i->first)->set_data(i->second->data());
+
+	for(Pmwx::Halfedge_iterator h = out.halfedges_begin(); h != out.halfedges_end(); ++h)
+	{
+		int k = *h->curve().data().begin();
+		if(k == STRIP_FRAME_KEY)
+			continue;
+		const strip_piece_t& p(pieces[k]);
+		bool fwd = h->direction() == CGAL::ARR_LEFT_TO_RIGHT;
+		Halfedge_const_handle src = fwd ? p.src : p.src->twin();
+		h->set_data(src->data());
+		faces[&*h->face()] = src->face();
+		if(fwd ? p.left_vertex : p.right_vertex)	h->source()->set_data(src->source()->data());
+		if(fwd ? p.right_vertex : p.left_vertex)	h->target()->set_data(src->target()->data());
+	}
+
+	for(Pmwx::Face_iterator f = out.faces_begin(); f != out.faces_end(); ++f)
+	if(!f->is_unbounded())
+	{
+		strip_face_map::iterator i = faces.find(&*f);
+		if(i == faces.end())
+		{
+			// Only the frame bounds this face - that means there are no pieces at all.
+			DebugAssert(in.only_face != Face_const_handle());
+			if(in.only_face == Face_const_handle())
+				continue;
+			i = faces.insert(strip_face_map::value_type(&*f, in.only_face)).first;
+		}
+		f->set_data(i->second->data());
+		f->set_contained(i->second->contained());
+	}
+}
+
+// Only the replace traits collect dead edges.
+template <class Traits>
+inline void strip_set_dead(Traits& t, vector<Halfedge_handle> * dead) { }
+inline void strip_set_dead(Arr_strip_overlay_traits<Arr_replace_overlay_traits<Pmwx, Pmwx, Pmwx> >& t, vector<Halfedge_handle> * dead) { t.dead = dead; }
+
+template <class Traits>
+static void strip_overlay(const strip_input_t& in_a, const strip_input_t& in_b, const vector<strip_piece_t>& pieces, Pmwx& out)
+{
+	Pmwx			a, b;
+	strip_face_map	faces_a, faces_b;
+	strip_build(a, in_a, pieces, faces_a);
+	strip_build(b, in_b, pieces, faces_b);
+
+	vector<Halfedge_handle>				dead;
+	Arr_strip_overlay_traits<Traits>	t;
+	t.faces_a = &faces_a;
+	t.faces_b = &faces_b;
+	strip_set_dead(t, &dead);
+	CGAL::overlay(a, b, out, t);
+	for(vector<Halfedge_handle>::iterator k = dead.begin(); k != dead.end(); ++k)
+		out.remove_edge(*k);
+}
+
+// Glue the strips back together.  Every real edge of a strip becomes a curve keyed by its slot in "from" so we can copy the data back.
+// The edge loop replaces those keys with the original EdgeKeys, so which strip halfedge each result halfedge came from is kept in
+// "src_of" for the face loop.
+template <class Traits>
+static void strip_stitch(Pmwx& src_a, Pmwx& src_b, vector<Pmwx>& strips, const vector<strip_piece_t>& pieces, const vector<double>& cuts, Pmwx& result)
+{
+	vector<X_monotone_curve_2>		curves;
+	vector<Halfedge_handle>			from;
+	vector<Vertex_handle>			isolated;
+
+	for(vector<Pmwx>::iterator s = strips.begin(); s != strips.end(); ++s)
+	{
+		for(Pmwx::Edge_iterator e = s->edges_begin(); e != s->edges_end(); ++e)
+		if(e->curve().data().find(STRIP_FRAME_KEY) == e->curve().data().end())
+		{
+			curves.push_back(X_monotone_curve_2(Segment_2(e->source()->point(), e->target()->point()), (int) from.size()));
+			from.push_back(Halfedge_handle(e));
+		}
+		for(Pmwx::Vertex_iterator v = s->vertices_begin(); v != s->vertices_end(); ++v)
+		if(v->is_isolated())
+			isolated.push_back(v);
+	}
+
+	result.clear();
+	CGAL::insert_non_intersecting_curves(result, curves.begin(), curves.end());
+
+	hash_map<const void *, Halfedge_handle>	src_of;
+	for(Pmwx::Edge_iterator e = result.edges_begin(); e != result.edges_end(); ++e)
+	{
+		Halfedge_handle h = he_get_same_direction(Halfedge_handle(e));
+		DebugAssert(h->curve().data().size() == 1);
+		Halfedge_handle src = from[*h->curve().data().begin()];
+		src_of[&*h] = src;
+		src_of[&*h->twin()] = src->twin();
+		h->set_data(src->data());
+		h->twin()->set_data(src->twin()->data());
+		h->source()->set_data(src->source()->data());
+		h->target()->set_data(src->target()->data());
+
+		EdgeKey_container	keys;
+		for(EdgeKey_container::const_iterator k = src->curve().data().begin(); k != src->curve().data().end(); ++k)
+		{
+			const EdgeKey_container& orig(pieces[*k].src->curve().data());
+			for(EdgeKey_container::const_iterator o = orig.begin(); o != orig.end(); ++o)
+				keys.insert(*o);
+		}
+		h->curve().set_data(keys);
+	}
+
+	for(vector<Vertex_handle>::iterator v = isolated.begin(); v != isolated.end(); ++v)
+		CGAL::insert_point(result, (*v)->point())->set_data((*v)->data());
+
+	for(Pmwx::Face_iterator f = result.faces_begin(); f != result.faces_end(); ++f)
+	if(!f->is_unbounded())
+	{
+		Halfedge_handle h(f->outer_ccb());
+		hash_map<const void *, Halfedge_handle>::iterator src = src_of.find(&*h);
+		DebugAssert(src != src_of.end());
+		if(src == src_of.end())
+			continue;
+		Face_handle sf = src->second->face();
+		f->set_data(sf->data());
+		f->set_contained(sf->contained());
+	}
+	Traits t;
+	t.create_face(src_a.unbounded_face(), src_b.unbounded_face(), result.unbounded_face());
+
+	// Edges were cut where they crossed a strip boundary; put them back together.
+	for(Pmwx::Vertex_iterator v = result.vertices_begin(); v != result.vertices_end(); )
+	{
+		Vertex_handle vv(v);
+		++v;
+		if(vv->degree() != 2 || !strip_on_cut(vv->point().x(), cuts))
+			continue;
+		Halfedge_handle h1(vv->incident_halfedges());
+		Halfedge_handle next = h1->next();
+		if(next == h1->twin() || !CGAL::collinear(h1->source()->point(), vv->point(), next->target()->point()))
+			continue;
+		EdgeKey_container keys(h1->curve().data());
+		for(EdgeKey_container::const_iterator k = next->curve().data().begin(); k != next->curve().data().end(); ++k)
+			keys.insert(*k);
+
+		X_monotone_curve_2 nc(Segment_2(h1->source()->point(), next->target()->point()), keys);
+		if(nc.is_directed_right() == (h1->direction() == CGAL::ARR_LEFT_TO_RIGHT))
+			result.merge_edge(h1, next, nc);
+		else
+		{
+			X_monotone_curve_2 nco(Segment_2(next->target()->point(), h1->source()->point()), keys);
+			result.merge_edge(next->twin(), h1->twin(), nco);
+		}
+	}
+}
+
+template <class Traits>
+static void	MapOverlayStrips(Pmwx& src_a, Pmwx& src_b, Pmwx& result, int strips, bool replace)
+{
+	if(strips <= 0)
+		strips = intlim(thread::hardware_concurrency(), 1, 16);
+	strips = min(strips, (int) ((src_a.number_of_edges() + src_b.number_of_edges()) / STRIP_MIN_EDGES));
+
+	vector<double>	cuts;
+	Bbox_2			bounds;
+	if(strips > 1)
+		strip_pick_cuts(src_a, src_b, strips, cuts, bounds);
+	if(cuts.empty())
+	{
+		if(replace)	MapOverlay(src_a, src_b, result);
+		else		MapMerge(src_a, src_b, result);
+		return;
+	}
+	strips = cuts.size() + 1;
+
+	double margin = 1.0 + max(bounds.xmax() - bounds.xmin(), bounds.ymax() - bounds.ymin());
+	Bbox_2 frame(bounds.xmin() - margin, bounds.ymin() - margin, bounds.xmax() + margin, bounds.ymax() + margin);
+
+	vector<strip_piece_t>	pieces;
+	vector<strip_input_t>	in_a(strips), in_b(strips);
+	vector<vector<NT> >		clips;
+	strip_cut_map(src_a, cuts, pieces, in_a, clips);
+	strip_add_frames(cuts, frame, clips, in_a);
+	strip_cut_map(src_b, cuts, pieces, in_b, clips);
+	strip_add_frames(cuts, frame, clips, in_b);
+	clips.clear();
+
+	vector<Pmwx>	out(strips);
+	atomic<int>		next_strip(0);
+	atomic<bool>	failed(false);
+	auto worker = [&]() {
+		int s;
+		while((s = next_strip++) < strips)
+		try {
+			strip_overlay<Traits>(in_a[s], in_b[s], pieces, out[s]);
+		} catch(...) {
+			failed = true;
+		}
+	};
+
+#if CGAL_HAS_THREADS
+	int num_threads = min(strips, intlim(thread::hardware_concurrency(), 1, 16));
+#else
+	int num_threads = 1;
+#endif
+	vector<thread>	threads;
+	for(int i = 1; i < num_threads; ++i)
+		threads.push_back(thread(worker));
+	worker();
+	for(vector<thread>::iterator t = threads.begin(); t != threads.end(); ++t)
+		t->join();
+
+	if(failed)
+	{
+		fprintf(stderr, "Tiled overlay failed - falling back to a single sweep.\n");
+		result.clear();
+		if(replace)	MapOverlay(src_a, src_b, result);
+		else		MapMerge(src_a, src_b, result);
+		return;
+	}
+
+	strip_stitch<Traits>(src_a, src_b, out, pieces, cuts, result);
+}
+
+void	MapMergeTiled(Pmwx& src_a, Pmwx& src_b, Pmwx& result, int strips)
+{
+	MapOverlayStrips<Arr_full_overlay_traits<Pmwx, Pmwx, Pmwx, Overlay_vertex, Overlay_network, Overlay_terrain> >(src_a, src_b, result, strips, false);
+}
+
+void	MapOverlayTiled(Pmwx& bottom, Pmwx& top, Pmwx& result, int strips)
+{
+	MapOverlayStrips<Arr_replace_overlay_traits<Pmwx, Pmwx, Pmwx> >(bottom, top, result, strips, true);
+}
+
 /************************************************************************************************************************************************
  *
  ************************************************************************************************************************************************/
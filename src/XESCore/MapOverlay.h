@@ -43,6 +43,12 @@ void	MapMerge(Pmwx& src_a, Pmwx& src_b, Pmwx& result);
 // Faces that were bounded in top ("in") top are set as contained, A is not.
 void	MapOverlay(Pmwx& bottom, Pmwx& top, Pmwx& result);
 
+// Same as above, but both maps are cut into vertical strips that are overlaid separately (on worker threads if CGAL has thread
+// support) and stitched back together.  Pass 0 strips to use one per core; maps that are too small to be worth cutting just
+// get the single sweep.  Nothing in the pipeline calls these yet - GISTool -check_overlay compares them to the single sweep.
+void	MapMergeTiled(Pmwx& src_a, Pmwx& src_b, Pmwx& result, int strips);
+void	MapOverlayTiled(Pmwx& bottom, Pmwx& top, Pmwx& result, int strips);
+
 
 
 /******************************************************************************************************************************
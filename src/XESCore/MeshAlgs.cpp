@@ -33,6 +33,7 @@
 #include "AssertUtils.h"
 #include "PlatformUtils.h"
 #include "PerfUtils.h"
+#include "MathUtils.h"
 #include "MapAlgs.h"
 #include "DEMAlgs.h"
 #include "DEMGrid.h"
@@ -43,6 +44,8 @@
 #include "MeshSimplify.h"
 #include "NetHelpers.h"
 #include "Zoning.h"	// for urban cheat table.
+#include <atomic>
+#include <thread>
 #if OPENGL_MAP
 #include "GISTool_Globals.h"
 #endif
@@ -174,6 +177,8 @@
 	};
 #endif
 
+bool	gCheckLanduse = false;
+
 Pmwx::Halfedge_handle	mesh_to_pmwx_he(CDT& io_mesh, CDT::Edge& e);
 
 inline bool IsCustom(int n)
@@ -2207,6 +2212,8 @@ void	AssignLandusesToMesh(	DEMGeoMap& inDEMs,
 
 	if (inProg) inProg(0, 1, "Assigning Landuses", 0.0);
 
+	CompileNaturalTerrainRules();		// in case someone edited the rules since they were loaded
+
 //	DEMGeo&	inClimate(inDEMs[dem_Clima0te]);
 	DEMGeo&	inClimStyle(inDEMs[dem_ClimStyle]);
 	DEMGeo&	inAgriStyle(inDEMs[dem_AgriStyle]);
@@ -2247,20 +2254,54 @@ void	AssignLandusesToMesh(	DEMGeoMap& inDEMs,
 	 ***********************************************************************************************/
 
 	if (inProg) inProg(0, 1, "Assigning Landuses", 0.1);
-	for (tri = ioMesh.finite_faces_begin(); tri != ioMesh.finite_faces_end(); ++tri)
-	{
-		// First assign a basic land use type.
-		{
-			tri->info().flag = 0;
-			// Hires - take from DEM if we don't have one.
-			if (tri->info().terrain != terrain_Water)
-			{
-				double x0 = CGAL::to_double(tri->vertex(0)->point().x());
-				double y0 = CGAL::to_double(tri->vertex(0)->point().y());
-				double x1 = CGAL::to_double(tri->vertex(1)->point().x());
-				double y1 = CGAL::to_double(tri->vertex(1)->point().y());
-				double x2 = CGAL::to_double(tri->vertex(2)->point().x());
-				double y2 = CGAL::to_double(tri->vertex(2)->point().y());
+
+	// Each land triangle's terrain depends only on the DEMs, its own shape and whether a neighbor is water, so we
+	// evaluate them on worker threads into a side table and write the results back in face order afterward.  Water
+	// triangles are never assigned, so the neighbor test sees the same thing the old single pass did - unless a rule
+	// can itself produce terrain_Water, in which case we stay serial and write back as we go.
+	// The workers never touch the mesh: the coordinates (Lazy_exact_nt refines and caches itself on access, so it
+	// can't be shared between threads), the face data and the water neighbors are read into tri_input_t up front.
+
+	struct tri_input_t {
+		double	x0, y0, x1, y1, x2, y2;
+		float	normal[3];
+		int		feature;
+		int		zoning;
+		int		near_water;
+	};
+
+	struct tri_landuse_t {
+		int		terrain;
+		float	lu, sl, sl_tri, tm, tmr, rn, sh_tri, re, er;
+		int		near_water;
+		double	center_y;
+	};
+
+	auto load_tri = [&](CDT::Face_handle tri, tri_input_t& in) {
+				in.x0 = CGAL::to_double(tri->vertex(0)->point().x());
+				in.y0 = CGAL::to_double(tri->vertex(0)->point().y());
+				in.x1 = CGAL::to_double(tri->vertex(1)->point().x());
+				in.y1 = CGAL::to_double(tri->vertex(1)->point().y());
+				in.x2 = CGAL::to_double(tri->vertex(2)->point().x());
+				in.y2 = CGAL::to_double(tri->vertex(2)->point().y());
+				for (int i = 0; i < 3; ++i)
+					in.normal[i] = tri->info().normal[i];
+				in.feature = tri->info().feature;
+
+				int zoning = NO_VALUE;//(tri->info().orig_face == Pmwx::Face_handle()) ? NO_VALUE : tri->info().orig_face->data().GetZoning();
+				if(zoning == NO_VALUE && tri->info().orig_face != Pmwx::Face_handle())
+					zoning = tri->info().orig_face->data().GetParam(af_Variant,-1.0) + 1.0;
+				in.zoning = zoning;
+
+				in.near_water =	(tri->neighbor(0)->info().terrain == terrain_Water && !ioMesh.is_infinite(tri->neighbor(0))) ||
+								(tri->neighbor(1)->info().terrain == terrain_Water && !ioMesh.is_infinite(tri->neighbor(1))) ||
+								(tri->neighbor(2)->info().terrain == terrain_Water && !ioMesh.is_infinite(tri->neighbor(2)));
+	};
+
+	auto eval_tri = [&](const tri_input_t& in, tri_landuse_t& r) {
+				double x0 = in.x0, y0 = in.y0;
+				double x1 = in.x1, y1 = in.y1;
+				double x2 = in.x2, y2 = in.y2;
 				double	center_x = (x0 + x1 + x2) / 3.0;
 				double	center_y = (y0 + y1 + y2) / 3.0;
 
@@ -2336,9 +2377,7 @@ void	AssignLandusesToMesh(	DEMGeoMap& inDEMs,
 				float	er3 = inRelElevRange.value_linear(x2,y2);
 				float	er = SAFE_AVERAGE(er1, er2, er3);	// Could be safe max.
 
-				int		near_water =(tri->neighbor(0)->info().terrain == terrain_Water && !ioMesh.is_infinite(tri->neighbor(0))) ||
-									(tri->neighbor(1)->info().terrain == terrain_Water && !ioMesh.is_infinite(tri->neighbor(1))) ||
-									(tri->neighbor(2)->info().terrain == terrain_Water && !ioMesh.is_infinite(tri->neighbor(2)));
+				int		near_water = in.near_water;
 
 				float	uden1 = inUrbanDensity.value_linear(x0,y0);
 				float	uden2 = inUrbanDensity.value_linear(x1,y1);
@@ -2366,9 +2405,9 @@ void	AssignLandusesToMesh(	DEMGeoMap& inDEMs,
 //				float	el3 = tri->vertex(2)->info().height;
 //				float	el_tri = (el1 + el2 + el3) / 3.0;
 
-				float	sl_tri = 1.0 - tri->info().normal[2];
-				float	flat_len = sqrt(tri->info().normal[1] * tri->info().normal[1] + tri->info().normal[0] * tri->info().normal[0]);
-				float	sh_tri = tri->info().normal[1];
+				float	sl_tri = 1.0 - in.normal[2];
+				float	flat_len = sqrt(in.normal[1] * in.normal[1] + in.normal[0] * in.normal[0]);
+				float	sh_tri = in.normal[1];
 				if (flat_len != 0.0)
 				{
 					sh_tri /= flat_len;
@@ -2385,42 +2424,131 @@ void	AssignLandusesToMesh(	DEMGeoMap& inDEMs,
 //				if (sh_tri >  0.7)	variant_head = 5;
 
 				//fprintf(stderr, " %d", tri->info().feature);
-				int zoning = NO_VALUE;//(tri->info().orig_face == Pmwx::Face_handle()) ? NO_VALUE : tri->info().orig_face->data().GetZoning();
-				if(zoning == NO_VALUE && tri->info().orig_face != Pmwx::Face_handle())
-					zoning = tri->info().orig_face->data().GetParam(af_Variant,-1.0) + 1.0;
-				int terrain = FindNaturalTerrain(tri->info().feature, zoning, lu, ss, as,cs, sl, sl_tri, tm, tmr, rn, near_water, sh_tri, re, er, uden, urad, utrn, usq, fabs((float) center_y)/*, variant_blob, variant_head*/);
+				int terrain = FindNaturalTerrain(in.feature, in.zoning, lu, ss, as,cs, sl, sl_tri, tm, tmr, rn, near_water, sh_tri, re, er, uden, urad, utrn, usq, fabs((float) center_y)/*, variant_blob, variant_head*/);
+
+				r.terrain = terrain;
+				r.lu = lu;				r.sl = sl;				r.sl_tri = sl_tri;
+				r.tm = tm;				r.tmr = tmr;			r.rn = rn;
+				r.sh_tri = sh_tri;		r.re = re;				r.er = er;
+				r.near_water = near_water;
+				r.center_y = center_y;
+	};
+
+	auto store_tri = [&](CDT::Face_handle tri, const tri_landuse_t& r) {
+				int terrain = r.terrain;
 				if (terrain == -1)
-					AssertPrintf("Cannot find terrain for: %s, %f\n", FetchTokenString(lu), /*FetchTokenString(cl), el, */ sl);
+					AssertPrintf("Cannot find terrain for: %s, %f\n", FetchTokenString(r.lu), /*FetchTokenString(cl), el, */ r.sl);
 
-				tri->info().mesh_temp = tm;
-				tri->info().mesh_rain = rn;
+				tri->info().mesh_temp = r.tm;
+				tri->info().mesh_rain = r.rn;
 			#if OPENGL_MAP
 				tri->info().debug_terrain_orig = terrain;
-				tri->info().debug_slope_dem = sl;
-				tri->info().debug_slope_tri = sl_tri;
-				tri->info().debug_temp_range = tmr;
-				tri->info().debug_heading = sh_tri;
-				tri->info().debug_re = re;
-				tri->info().debug_er = er;				
-				tri->info().debug_lu[0] = lu;
-				tri->info().debug_lu[1] = lu;
-				tri->info().debug_lu[2] = lu;
-				tri->info().debug_lu[3] = lu;
-				tri->info().debug_lu[4] = lu ;
+				tri->info().debug_slope_dem = r.sl;
+				tri->info().debug_slope_tri = r.sl_tri;
+				tri->info().debug_temp_range = r.tmr;
+				tri->info().debug_heading = r.sh_tri;
+				tri->info().debug_re = r.re;
+				tri->info().debug_er = r.er;
+				tri->info().debug_lu[0] = r.lu;
+				tri->info().debug_lu[1] = r.lu;
+				tri->info().debug_lu[2] = r.lu;
+				tri->info().debug_lu[3] = r.lu;
+				tri->info().debug_lu[4] = r.lu;
 			#endif
 				if (terrain == -1)
 				{
 					AssertPrintf("No rule. lu=%s, slope=%f, trislope=%f, temp=%f, temprange=%f, rain=%f, water=%d, heading=%f, lat=%f\n",
-						FetchTokenString(lu), /*el,*/ acos(1-sl)*RAD_TO_DEG, acos(1-sl_tri)*RAD_TO_DEG, tm, tmr, rn, near_water, sh_tri, center_y);
+						FetchTokenString(r.lu), /*el,*/ acos(1-r.sl)*RAD_TO_DEG, acos(1-r.sl_tri)*RAD_TO_DEG, r.tm, r.tmr, r.rn, r.near_water, r.sh_tri, r.center_y);
 				}
 				//fprintf(stderr, "->%d", terrain);
 
 				tri->info().terrain = terrain;
+	};
 
-			}
+	unsigned long long	assign_start = query_hpc();
+	vector<CDT::Face_handle>	land_tris;
+	for (tri = ioMesh.finite_faces_begin(); tri != ioMesh.finite_faces_end(); ++tri)
+	{
+		// First assign a basic land use type.
+		tri->info().flag = 0;
+		// Hires - take from DEM if we don't have one.
+		if (tri->info().terrain != terrain_Water)
+			land_tris.push_back(tri);
+	}
+
+	bool rules_make_water = false;
+	for (NaturalTerrainRuleVector::iterator r = gNaturalTerrainRules.begin(); r != gNaturalTerrainRules.end(); ++r)
+		if (r->name == terrain_Water)
+			rules_make_water = true;
+
+	#define LANDUSE_CHUNK 1024
+	int num_threads = rules_make_water ? 1 : intlim(thread::hardware_concurrency(), 1, 16);
+	num_threads = min(num_threads, (int) (land_tris.size() + LANDUSE_CHUNK - 1) / LANDUSE_CHUNK);
 
+	if (num_threads <= 1)
+	{
+		tri_input_t in;
+		tri_landuse_t r;
+		for (vector<CDT::Face_handle>::iterator t = land_tris.begin(); t != land_tris.end(); ++t)
+		{
+			load_tri(*t, in);
+			eval_tri(in, r);
+			store_tri(*t, r);
+		}
+	}
+	else
+	{
+		vector<tri_input_t>		inputs(land_tris.size());
+		for (int n = 0; n < land_tris.size(); ++n)
+			load_tri(land_tris[n], inputs[n]);
+
+		// Threads pull fixed chunks off a shared counter; each result lands in its own slot, so the order the chunks
+		// finish in doesn't matter.
+		vector<tri_landuse_t>	results(land_tris.size());
+		atomic<int>				next_chunk(0);
+		auto worker = [&]() {
+			int b;
+			while ((b = next_chunk++ * LANDUSE_CHUNK) < inputs.size())
+			{
+				int e = min(b + LANDUSE_CHUNK, (int) inputs.size());
+				for (int n = b; n < e; ++n)
+					eval_tri(inputs[n], results[n]);
+			}
+		};
+		vector<thread>	threads;
+		for (int i = 1; i < num_threads; ++i)
+			threads.push_back(thread(worker));
+		worker();
+		for (vector<thread>::iterator t = threads.begin(); t != threads.end(); ++t)
+			t->join();
+
+		if (gCheckLanduse)
+		{
+			// Run the plain single pass again and compare every triangle - any difference means the threads interfered.
+			int mismatches = 0;
+			tri_landuse_t r;
+			for (int n = 0; n < inputs.size(); ++n)
+			{
+				eval_tri(inputs[n], r);
+				const tri_landuse_t& p(results[n]);
+				if (r.terrain != p.terrain || r.lu != p.lu || r.sl != p.sl || r.sl_tri != p.sl_tri || r.tm != p.tm || r.tmr != p.tmr ||
+					r.rn != p.rn || r.sh_tri != p.sh_tri || r.re != p.re || r.er != p.er || r.near_water != p.near_water)
+				{
+					if (mismatches++ < 10)
+						printf("Triangle %d near %lf,%lf: serial terrain %s, parallel %s.\n", n, inputs[n].x0, inputs[n].y0,
+							r.terrain == -1 ? "none" : FetchTokenString(r.terrain), p.terrain == -1 ? "none" : FetchTokenString(p.terrain));
+				}
+			}
+			printf("Checked %llu parallel terrain assignments against a serial pass: %d mismatches.\n", (unsigned long long) inputs.size(), mismatches);
+			if (mismatches)
+				AssertPrintf("Parallel terrain assignment differs from the serial pass in %d triangles.\n", mismatches);
 		}
+
+		for (int n = 0; n < land_tris.size(); ++n)
+			store_tri(land_tris[n], results[n]);
 	}
+	printf("Assigned terrain to %llu triangles on %d thread%s in %.3lf seconds.\n", (unsigned long long) land_tris.size(),
+		max(num_threads, 1), num_threads > 1 ? "s" : "", hpc_to_microseconds(query_hpc() - assign_start) / 1000000.0);
 	
 	/***********************************************************************************************
 	 * ASSIGN BASIC LAND USES TO MESH
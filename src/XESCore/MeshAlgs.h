@@ -51,6 +51,7 @@ struct	MeshPrefs_t {
 	float	rep_switch_m;
 };
 extern MeshPrefs_t	gMeshPrefs;
+extern bool			gCheckLanduse;		// Re-run parallel terrain assignment serially and compare - see AssignLandusesToMesh.
 
 void	TriangulateMesh(Pmwx& inMap, CDT& outMesh, DEMGeoMap& inDEMs, const char * mesh_folder, ProgressFunc inFunc);
 void	AssignLandusesToMesh(	DEMGeoMap& inDems,
@@ -369,6 +369,90 @@ static int DoMerge(const vector<const char *>& args)
 	return 0;
 }
 
+// Total face area by terrain, area feature and containment - the strips cut nothing that survives, but this way the check
+// doesn't care how the faces are numbered.
+typedef map<pair<pair<int, int>, bool>, double>		face_area_table;
+
+static void tally_face_areas(Pmwx& m, face_area_table& out)
+{
+	out.clear();
+	for(Pmwx::Face_iterator f = m.faces_begin(); f != m.faces_end(); ++f)
+	if(!f->is_unbounded())
+		out[make_pair(make_pair(f->data().mTerrainType, f->data().mAreaFeature.mFeatType), f->contained())] += GetMapFaceAreaDegrees(f);
+}
+
+static bool compare_overlays(const char * what, Pmwx& single, Pmwx& tiled, double single_secs, double tiled_secs)
+{
+	bool ok = true;
+	printf("%s: single sweep %.3lf sec, tiled %.3lf sec.\n", what, single_secs, tiled_secs);
+	if(single.number_of_vertices() != tiled.number_of_vertices() ||
+	   single.number_of_edges() != tiled.number_of_edges() ||
+	   single.number_of_faces() != tiled.number_of_faces())
+	{
+		printf("  Size mismatch: %llu/%llu/%llu vertices/edges/faces vs %llu/%llu/%llu.\n",
+			(unsigned long long) single.number_of_vertices(), (unsigned long long) single.number_of_edges(), (unsigned long long) single.number_of_faces(),
+			(unsigned long long) tiled.number_of_vertices(), (unsigned long long) tiled.number_of_edges(), (unsigned long long) tiled.number_of_faces());
+		ok = false;
+	}
+
+	face_area_table	a1, a2;
+	tally_face_areas(single, a1);
+	tally_face_areas(tiled, a2);
+	for(face_area_table::iterator i = a1.begin(); i != a1.end(); ++i)
+	{
+		double other = a2.count(i->first) ? a2[i->first] : 0.0;
+		if(fabs(i->second - other) > 1.0e-9 * max(1.0, fabs(i->second)))
+		{
+			printf("  Area mismatch for %s/%s (%s): %lf vs %lf.\n", FetchTokenString(i->first.first.first), FetchTokenString(i->first.first.second),
+				i->first.second ? "contained" : "not contained", i->second, other);
+			ok = false;
+		}
+	}
+	for(face_area_table::iterator i = a2.begin(); i != a2.end(); ++i)
+	if(a1.count(i->first) == 0)
+	{
+		printf("  Tiled overlay has extra faces of %s/%s (%s).\n", FetchTokenString(i->first.first.first), FetchTokenString(i->first.first.second),
+				i->first.second ? "contained" : "not contained");
+		ok = false;
+	}
+	printf("  %s\n", ok ? "Results match." : "RESULTS DIFFER.");
+	return ok;
+}
+
+// Overlay and merge a second map onto the current one both ways and compare.  The current map is not changed.
+static int DoCheckOverlay(const vector<const char *>& args)
+{
+	MFMemFile * load = MemFile_Open(args[0]);
+	Pmwx		top;
+	if (load)
+	{
+		ReadXESFile(load, &top, NULL, NULL, NULL, gProgress);
+		MemFile_Close(load);
+	} else {
+		fprintf(stderr,"Could not load file %s.\n", args[0]);
+		return 1;
+	}
+	int strips = args.size() > 1 ? atoi(args[1]) : 0;
+
+	bool ok = true;
+	for(int replace = 0; replace < 2; ++replace)
+	{
+		Pmwx	single, tiled;
+		unsigned long long t0 = query_hpc();
+		if(replace)	MapOverlay(gMap, top, single);
+		else		MapMerge(gMap, top, single);
+		unsigned long long t1 = query_hpc();
+		if(replace)	MapOverlayTiled(gMap, top, tiled, strips);
+		else		MapMergeTiled(gMap, top, tiled, strips);
+		unsigned long long t2 = query_hpc();
+
+		if(!compare_overlays(replace ? "Overlay" : "Merge", single, tiled,
+				hpc_to_microseconds(t1 - t0) / 1000000.0, hpc_to_microseconds(t2 - t1) / 1000000.0))
+			ok = false;
+	}
+	return ok ? 0 : 1;
+}
+
 
 
 static int DoSave(const vector<const char *>& args)
@@ -3061,6 +3145,7 @@ static	GISTool_RegCmd_t		sCoreCmds[] = {
 { "-cropsave", 		1, 1, DoCropSave, 		"Save only extent as an XES file.", "" },
 { "-overlay", 		1, 1, DoOverlay, 		"Superimpose/replace a second vector map.", "" },
 { "-merge", 		1, 1, DoMerge,			"Superimpose/merge a second vector map.", "" },
+{ "-check_overlay",	1, 2, DoCheckOverlay,	"<file> [strips] Check tiled overlay against a single sweep.", "Overlays and merges a second vector map onto the current one with a single sweep and with strips, and compares the sizes of the results and the total face area for each terrain/area feature.  Prints timings for both.  Fails if they differ.  The current map is not changed.\n" },
 { "-simplify",		0, 0, DoSimplify,		"Remove unneeded vectors.", "" },
 { "-tag_origin",	1, 1, DoTagOrigin,		"Apply origin code X to this map.", "" },
 { "-clear_debug",	0, 0, DoClearDebug,		"Clear all debug marks.", "" },
@@ -621,6 +621,11 @@ static int DoMeshErrStats(const vector<const char *>& s)
 	return 0;
 }
 
+static int DoCheckTerrainRules(const vector<const char *>& s)
+{
+	return CheckNaturalTerrainRules() ? 1 : 0;
+}
+
 static	GISTool_RegCmd_t		sMiscCmds[] = {
 { "-kill_bad_dsf", 1, 1, KillBadDSF,				"Delete a DSF file if its checksum fails.", "" },
 { "-showcoverage", 1, 2, DoShowCoverage,			"Show coverage of a file as text", "Given a raw 360x180 file, this prints the lat-lon of every none-black point.\n" },
@@ -638,6 +643,7 @@ static	GISTool_RegCmd_t		sMiscCmds[] = {
 { "-make_terrain_package", 1, 1, DoMakeTerrainPackage, "Create or update a terrain package based on the spreadsheets.", make_terrain_package_HELP },
 { "-test_terrain_package", 1, 1, DoTestTerrainPackage, "Check a terrain package based on the spreadsheets.", test_terrain_package_HELP },
 { "-mesh_err_stats", 0, 0, DoMeshErrStats,			"Print statistics about mesh error.", "" },
+{ "-check_terrain_rules", 0, 0, DoCheckTerrainRules,	"Check the terrain rule index against a linear scan.", "Probes the compiled terrain rule index at every rule's range endpoints and compares each result against a plain scan of the rules, then prints lookups/sec for both.  Fails if any lookup differs.\n" },
 #if OPENGL_MAP
 { "-clear_block",		   0, 0, DoClear, "", "" },
 #endif
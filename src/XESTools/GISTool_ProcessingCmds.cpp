@@ -529,6 +529,12 @@ static int DoBuildRoads(const vector<const char *>& args)
 	return 0;
 }
 
+static int DoCheckLandUse(const vector<const char *>& args)
+{
+	gCheckLanduse = true;
+	return 0;
+}
+
 static int DoAssignLandUse(const vector<const char *>& args)
 {
 	if (gVerbose) printf("Assigning land use...\n");
@@ -612,6 +618,7 @@ static	GISTool_RegCmd_t		sProcessCmds[] = {
 { "-instobjs", 		0, 0, DoInstantiateObjs, "Instantiate Objects.", 			  "" },
 { "-buildroads", 	0, 0, DoBuildRoads, 	"Pick Road Types.", 	  			"" },
 { "-assignterrain", 1, 1, DoAssignLandUse, 	"Assign Terrain to Mesh.", 	 		 "" },
+{ "-check_terrain_assign", 0, 0, DoCheckLandUse, "Check parallel terrain assignment against a serial pass.", "Makes every following -assignterrain evaluate the triangles a second time in a single thread and compare each result with the parallel one.  Fails if any triangle differs.\n" },
 { "-exportdsf", 	2, 2, DoBuildDSF, 		"Build DSF file.", 					  "" },
 { "-mapstats", 	0, 0, DoMapStats, 	"Dump Map statistics.", 				  "" },
 
@@ -28,11 +28,13 @@
 #include "MapOverlay.h"
 #include "AssertUtils.h"
 #include "ShapeIO.h"
+#include <shapefil.h>
 #include "MapAlgs.h"
 //#include "SDTSReadTVP.h"
 #include "GISUtils.h"
 #include "ParamDefs.h"
 #include "MemFileUtils.h"
+#include "FileUtils.h"
 #include "Hydro.h"
 //#include "TIGERRead.h"
 #include "gshhs.h"
@@ -568,6 +570,7 @@ static int DoTigerBounds(const vector<const char *>& args)
 "o - overlay on existing map.  This can be slower than cleaning the vector space first.\n" \
 "e - check for overlapping polygon errors.  Abort the import silently if we hit this case.\n" \
 "a - Import vertex altitude from shapefile Z coordinate, if present.\n" \
+"i - with c: keep an index of record boxes next to the shape file (<name>.xgrid), so later crops only read what they need.\n" \
 "<err> is the max error in meters to be allowed when simplifying imported roads.  Pass zero to\n"\
 "import the data with no change.\n"
 static int DoShapeImport(const vector<const char *>& args)
@@ -583,6 +586,7 @@ static int DoShapeImport(const vector<const char *>& args)
 	if(strstr(args[0], "m"))	flags |= shp_Mode_Map;
 	if(strstr(args[0], "e"))	flags |= shp_ErrCheck;
 	if(strstr(args[0], "a"))	flags |= shp_Altitude;
+	if(strstr(args[0], "i"))	flags |= shp_Index;
 
 	double err_margin = atof(args[2]);
 	int grid_steps = atoi(args[3]);
@@ -616,6 +620,104 @@ static int DoShapeImport(const vector<const char *>& args)
 	return 0;
 }
 
+#define HELP_SHAPE_BENCH \
+"-shapefile_bench <filename> <tiles> [<count>]\n" \
+"Times finding the records of each of tiles x tiles crop boxes over the shape file: by decoding every\n" \
+"shape, by reading just the record boxes and through the .xgrid index, and checks all three agree.\n" \
+"With a count, first writes a synthetic shape file of that many small random polygons (1 in 1000 big) -\n" \
+"to a new file only, an existing <filename> is never overwritten.\n"
+static int DoShapeBench(const vector<const char *>& args)
+{
+	const char * shp_file = args[0];
+	int tiles = max(1, atoi(args[1]));
+	if(args.size() > 2)
+	{
+		int count = atoi(args[2]);
+		string shp_path(shp_file);
+		if(shp_path.size() < 4 || strcasecmp(shp_path.c_str() + shp_path.size() - 4, ".shp") != 0)
+			shp_path += ".shp";
+		if(FILE_exists(shp_path.c_str()))
+		{
+			fprintf(stderr,"%s already exists - not overwriting it with synthetic data\n", shp_path.c_str());
+			return 1;
+		}
+		SHPHandle out = SHPCreate(shp_file, SHPT_POLYGON);
+		if(!out)
+		{
+			fprintf(stderr,"Could not create %s\n", shp_file);
+			return 1;
+		}
+		srand(1);
+		for(int n = 0; n < count; ++n)
+		{
+			double x = -10.0 + 20.0 * rand() / RAND_MAX;
+			double y =  40.0 + 10.0 * rand() / RAND_MAX;
+			double w = (n % 1000 == 0) ? 5.0 : 0.01 * rand() / RAND_MAX;
+			double xs[5] = { x, x + w, x + w, x, x };
+			double ys[5] = { y, y, y + w, y + w, y };
+			SHPObject * obj = SHPCreateSimpleObject(SHPT_POLYGON, 5, xs, ys, NULL);
+			SHPWriteObject(out, -1, obj);
+			SHPDestroyObject(obj);
+		}
+		SHPClose(out);
+	}
+
+	SHPHandle file = SHPOpen(shp_file, "rb");
+	if(!file)
+	{
+		fprintf(stderr,"Could not open %s\n", shp_file);
+		return 1;
+	}
+	int		entity_count, shape_type;
+	double	lo[4], hi[4];
+	SHPGetInfo(file, &entity_count, &shape_type, lo, hi);
+
+	double	t[3] = { 0.0, 0.0, 0.0 };
+	long	found = 0;
+	int		mismatch = 0;
+	for(int ty = 0; ty < tiles; ++ty)
+	for(int tx = 0; tx < tiles; ++tx)
+	{
+		double b[4] = { lo[0] + (hi[0] - lo[0]) * tx / tiles,       lo[1] + (hi[1] - lo[1]) * ty / tiles,
+						lo[0] + (hi[0] - lo[0]) * (tx + 1) / tiles, lo[1] + (hi[1] - lo[1]) * (ty + 1) / tiles };
+		vector<int> ids[3];
+
+		unsigned long long t0 = query_hpc();
+		for(int n = 0; n < entity_count; ++n)
+		{
+			SHPObject * obj = SHPReadObject(file, n);
+			if(obj->nSHPType != SHPT_NULL &&
+			   obj->dfXMax >= b[0] && obj->dfXMin <= b[2] && obj->dfYMax >= b[1] && obj->dfYMin <= b[3])
+				ids[0].push_back(n);
+			SHPDestroyObject(obj);
+		}
+		t[0] += hpc_to_microseconds(query_hpc() - t0) / 1000000.0;
+
+		for(int k = 1; k < 3; ++k)
+		{
+			t0 = query_hpc();
+			if(!ShapeFileRecordsInBounds(shp_file, b, k == 2, ids[k]))
+			{
+				fprintf(stderr,"Could not read record boxes of %s\n", shp_file);
+				SHPClose(file);
+				return 1;
+			}
+			t[k] += hpc_to_microseconds(query_hpc() - t0) / 1000000.0;
+		}
+		if(ids[1] != ids[0] || ids[2] != ids[0])
+			++mismatch;
+		found += ids[0].size();
+	}
+	SHPClose(file);
+
+	int n_tiles = tiles * tiles;
+	printf("%d records, %.1lf per tile.  Per tile: decode all %.4lf s, record boxes %.4lf s, grid index %.4lf s (first one builds it).\n",
+		entity_count, (double) found / n_tiles, t[0] / n_tiles, t[1] / n_tiles, t[2] / n_tiles);
+	if(mismatch)
+		printf("%d tiles found different records!\n", mismatch);
+	return mismatch ? 1 : 0;
+}
+
 #define HELP_SHAPE_AG \
 "-shape_ag <filename> [...<filename>]\n" \
 "Imports AG directly into a map from a shapefile."
@@ -998,6 +1100,7 @@ static	GISTool_RegCmd_t		sVectorCmds[] = {
 { "-shapefile", 	5, -1, 	DoShapeImport, 			"Import ESRI Shape File.", HELP_SHAPE_IMPORT },
 { "-shapefile_write", 2, 3, 	DoShapeExport, 		"Export ESRI Shape File.", HELP_SHAPE_EXPORT },
 { "-shape_ag", 1, -1, 			DoShapeAG,			"Import ESRI Shape Fil as AG", HELP_SHAPE_AG },
+{ "-shapefile_bench", 2, 3, DoShapeBench,		"Time cropped shape file reading.", HELP_SHAPE_BENCH },
 { "-shapefile_raster", 4, 4, DoShapeRaster,			"Raster shapefile.", "" },
 { "-reduce_vectors", 1, 1,	DoReduceVectors,		"Simplify vector map by a certain error distance.", HELP_REDUCE_VECTORS },
 { "-remove_outsets", 2, 2, DoRemoveOutsets,			"Remove square outset piers from water areas.", HELP_REMOVE_OUTSETS },
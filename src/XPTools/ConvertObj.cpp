@@ -27,6 +27,7 @@
 #include "ObjUtils.h"
 #include "XObjWriteEmbedded.h"
 #include "ObjConvert.h"
+#include "PerfUtils.h"
 //#include "XUtils.h"
 
 #include "ConvertObjDXF.h"
@@ -63,6 +64,7 @@ static	int	gAxis = axis_Z;
 static	int	gSave = save_OBJ8;
 
 static int	gOptimize = 0;
+static int	gTiming = 0;
 
 void	PostProcessVertex(float v[3], bool inReverse)
 {
@@ -283,8 +285,17 @@ int main(int argc, char * argv[])
 		else if (!strcmp(argv[a],"--obj7"))			gSave = save_OBJ7;
 		else if (!strcmp(argv[a],"--obj8"))			gSave = save_OBJ8;
 
+		else if (!strcmp(argv[a],"--timing"))		gTiming = 1;
+
 		else { printf("Unknown option %s\n",argv[a]); exit(1); }
 	}
-	XGrindFile(argv[argc-3],argv[argc-2],argv[argc-1]);
+	if (gTiming)
+	{
+		// For benchmarking big conversions - all of the read, vertex pooling and write time.
+		StElapsedTime	timer(argv[argc-3]);
+		XGrindFile(argv[argc-3],argv[argc-2],argv[argc-1]);
+	}
+	else
+		XGrindFile(argv[argc-3],argv[argc-2],argv[argc-1]);
 }
 
@@ -26,6 +26,7 @@
 #include "QuiltUtils.h"
 #include "FileUtils.h"
 #include "MathUtils.h"
+#include "PerfUtils.h"
 
 #if PHONE
 	#define WANT_PVR 1
@@ -360,6 +361,11 @@ unsigned char fade_2_black_filter(unsigned char src[], int count, int channel, i
 }
 
 
+// Wrappers around the stock box filters - BitmapUtils only knows them by address, so going through these forces the
+// generic per-sample mipmap path.  Used as the reference in --bench_mips.
+static unsigned char per_sample_box(unsigned char src[], int count, int chan, int level)            { return mip_filter_box(src, count, chan, level); }
+static unsigned char per_sample_box_with_gamma(unsigned char src[], int count, int chan, int level) { return mip_filter_box_with_gamma(src, count, chan, level); }
+
 int main(int argc, char * argv[])
 {
 	char	my_dir[2048];
@@ -427,6 +433,110 @@ int main(int argc, char * argv[])
 		return 0;
 	}
 
+	// Compression benchmark: time DXT1 and DXT5 output, with box-filtered mipmaps, for one PNG - with each encoder,
+	// and check the quality of the full size level against the original.
+	if (argc >= 3 && strcmp(argv[1], "--bench_dxt") == 0)
+	{
+		int runs = argc > 3 ? max(1, atoi(argv[3])) : 3;
+		string outf = string(argv[2]) + ".bench.dds";
+		for (int encoder = dds_encode_best; encoder <= dds_encode_fast; ++encoder)
+		for (int bc_type = 1; bc_type <= 3; bc_type += 2)
+		{
+			double best = 1e9;
+			long pixels = 0;
+			for (int r = 0; r < runs; ++r)
+			{
+				ImageInfo	info;
+				if (CreateBitmapFromPNG(argv[2], &info, false, GAMMA_SRGB))
+				{
+					printf("Unable to open png file %s\n", argv[2]);
+					return 1;
+				}
+				ConvertBitmapToAlpha(&info, false);
+				pixels = info.width * info.height;
+				unsigned long long t0 = query_hpc();
+				int err = WriteBitmapToDDS_MT(info, bc_type, outf.c_str(), mip_filter_box_with_gamma, encoder);
+				best = min(best, hpc_to_microseconds(query_hpc() - t0) / 1000000.0);
+				DestroyBitmap(&info);
+				if (err)
+				{
+					printf("Unable to write DDS file %s\n", outf.c_str());
+					return 1;
+				}
+			}
+
+			// PSNR over RGB, skipping pixels DXT1 makes transparent
+			ImageInfo orig, dds;
+			double err2 = 0.0;
+			long samples = 0;
+			if (CreateBitmapFromPNG(argv[2], &orig, false, GAMMA_SRGB) == 0)
+			{
+				ConvertBitmapToAlpha(&orig, false);
+				if (CreateBitmapFromDDS(outf.c_str(), &dds) == 0)
+				{
+					for (long i = 0; i < pixels; ++i)
+					if (bc_type != 1 || orig.data[4*i+3] >= 128)
+					for (int c = 0; c < 3; ++c)
+					{
+						double d = (double) orig.data[4*i+c] - (double) dds.data[4*i+c];
+						err2 += d * d;
+						++samples;
+					}
+					DestroyBitmap(&dds);
+				}
+				DestroyBitmap(&orig);
+			}
+			double psnr = err2 > 0.0 ? 10.0 * log10(255.0 * 255.0 * samples / err2) : 99.0;
+
+			printf("%s DXT%d: %.3lf seconds, %.1lf Mpixels/sec (best of %d), PSNR %.2lf dB\n", encoder == dds_encode_fast ? "fast" : "best",
+				bc_type == 1 ? 1 : 5, best, pixels / best / 1e6, runs, psnr);
+		}
+		FILE_delete_file(outf.c_str(), false);
+		return 0;
+	}
+
+	// Mipmap benchmark: build the mip stack with both box filters, once through the per-sample filter call and once
+	// through the row kernels BitmapUtils uses for them, and check the two give the very same bytes.
+	if (argc >= 3 && strcmp(argv[1], "--bench_mips") == 0)
+	{
+		int runs = argc > 3 ? max(1, atoi(argv[3])) : 3;
+		int bad = 0;
+		for (int gamma = 0; gamma < 2; ++gamma)
+		{
+			mip_func_t fast = gamma ? mip_filter_box_with_gamma : mip_filter_box;
+			mip_func_t slow = gamma ? per_sample_box_with_gamma : per_sample_box;
+			double best[2] = { 1e9, 1e9 };
+			for (int r = 0; r < runs; ++r)
+			{
+				ImageInfo	info[2];
+				for (int k = 0; k < 2; ++k)
+				{
+					if (CreateBitmapFromPNG(argv[2], &info[k], false, GAMMA_SRGB))
+					{
+						printf("Unable to open png file %s\n", argv[2]);
+						return 1;
+					}
+					unsigned long long t0 = query_hpc();
+					MakeMipmapStackWithFilter(&info[k], k ? fast : slow);
+					best[k] = min(best[k], hpc_to_microseconds(query_hpc() - t0) / 1000000.0);
+				}
+				long bytes = 0;
+				for (long x = info[0].width, y = info[0].height; ; x = max(1L, x / 2), y = max(1L, y / 2))
+				{
+					bytes += x * y * info[0].channels;
+					if (x == 1 && y == 1) break;
+				}
+				if (memcmp(info[0].data, info[1].data, bytes) != 0)
+					++bad;
+				DestroyBitmap(&info[0]);
+				DestroyBitmap(&info[1]);
+			}
+			printf("%s: per sample %.3lf seconds, row kernel %.3lf seconds (best of %d), %s\n", gamma ? "box with gamma" : "box",
+				best[0], best[1], runs, bad ? "OUTPUT DIFFERS" : "identical output");
+		}
+		return bad ? 1 : 0;
+	}
+
 	if (argc < 4) {
 		printf("Usage: %s <method> [options] <input_file> <output_file>|-\n",argv[0]);
 		printf("          compression method being one of\n");
@@ -436,6 +546,7 @@ int main(int argc, char * argv[])
 		printf("          --png2dxt    Auto select BC1/dxt1 or BC3/dxt5 compression\n");
 		printf("          --png2rgb    Uncompressed 8b/pixel\n");
 		printf("          recognized options are\n");
+		printf("          --fast       Quick, lower quality DXT1/DXT5 compression for previews\n");
 		printf("          --pre_mips   Source image includes Mip-Map Tree\n");
 		printf("          --night_mips Generate nXP10 Night-style mimaps that get brighter\n");
 		printf("          --fade_mips  Generate Mimaps fading to transparent\n");
@@ -448,6 +559,8 @@ int main(int argc, char * argv[])
 		printf("          --gamma_22   This version of DDSTool always uses sRGB/gamma=2.2\n");
 		printf("\n");
 		printf("Usage: %s --quilt <input_file> <width> <height> <patch size> <overlap> <trials> <output_files>\n",argv[0]);
+		printf("       %s --bench_dxt <input_file> [runs]\n",argv[0]);
+		printf("       %s --bench_mips <input_file> [runs]\n",argv[0]);
 		printf("       %s --version\n",argv[0]);
 #if WANT_ATI
 		printf("       Compiled with WANT_ATI, supports --png2atc4, --png2atc_raw16, --png2atc_raw24\n");
@@ -645,6 +758,7 @@ int main(int argc, char * argv[])
 	{
 		int arg_base = 2;
 		mip_func_t  mip_filter  = mip_filter_box_with_gamma;
+		int         encoder     = dds_encode_best;
 
 		if(strcmp(argv[arg_base], "--std_mips") == 0)   ++arg_base;
 		if(strcmp(argv[arg_base], "--pre_mips") == 0) { ++arg_base; mip_filter = nullptr;	}
@@ -652,6 +766,7 @@ int main(int argc, char * argv[])
 		if (strcmp(argv[2], "--fade_mips") == 0)      { ++arg_base; mip_filter = fade_filter;	}
 		if (strcmp(argv[2], "--ctl_mips") == 0)       { ++arg_base; mip_filter = fade_2_black_filter; }
 
+		if(strcmp(argv[arg_base], "--fast") == 0)     { ++arg_base; encoder = dds_encode_fast; }
 		if (strcmp(argv[arg_base], "--gamma_22") == 0)  ++arg_base;
 
 		if (strcmp(argv[arg_base], "--scale_none") == 0) ++arg_base;
@@ -745,7 +860,7 @@ int main(int argc, char * argv[])
 
 		ConvertBitmapToAlpha(&info,false);
 
-		if (WriteBitmapToDDS_MT(info, bc_type, outf.c_str(), mip_filter ? (bc_type > 3  ? mip_filter_box : mip_filter) : nullptr))
+		if (WriteBitmapToDDS_MT(info, bc_type, outf.c_str(), mip_filter ? (bc_type > 3  ? mip_filter_box : mip_filter) : nullptr, encoder))
 		{
 			printf("Unable to write DDS file %s\n", argv[arg_base+1]);
 			return 1;